@@ -0,0 +1,145 @@
+// BenchClient.h
+// Blocking loopback RTMP client pieces shared by the benchmarks (POSIX sockets).
+#ifndef BENCHCLIENT_H
+#define BENCHCLIENT_H
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static inline bool read_exact(int fd, char* buffer, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+        ssize_t n = recv(fd, buffer + received, length - received, 0);
+        if (n <= 0) return false;
+        received += n;
+    }
+    return true;
+}
+
+static inline bool write_all(int fd, const char* data, size_t length) {
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t n = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Connects to the loopback port; returns -1 on failure.
+// With reset_on_close the socket skips TIME_WAIT, so churn tests do not run out of ports.
+static inline int connect_loopback(int port, bool reset_on_close) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    if (reset_on_close) {
+        linger no_linger = { 1, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &no_linger, sizeof(no_linger));
+    }
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Connects and completes the C0/C1 -> S0/S1/S2 -> C2 exchange; returns -1 on failure
+static inline int connect_and_handshake(int port, bool reset_on_close) {
+    int fd = connect_loopback(port, reset_on_close);
+    if (fd < 0) return -1;
+
+    char c0c1[1537];
+    std::memset(c0c1, 0, sizeof(c0c1));
+    c0c1[0] = 0x03;
+    char s0s1s2[3073];
+    if (!write_all(fd, c0c1, sizeof(c0c1)) ||
+        !read_exact(fd, s0s1s2, sizeof(s0s1s2)) ||
+        !write_all(fd, s0s1s2 + 1, 1536)) {  // C2 echoes S1
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Appends one message as a single fmt 0 chunk; the payload must fit the announced chunk size
+static inline void append_message(std::vector<char>& out, unsigned int csid, unsigned int timestamp,
+                                  unsigned char type, unsigned int stream_id, const char* payload, size_t length) {
+    const char header[12] = {
+        static_cast<char>(csid & 0x3F),
+        static_cast<char>(timestamp >> 16), static_cast<char>(timestamp >> 8), static_cast<char>(timestamp),
+        static_cast<char>(length >> 16), static_cast<char>(length >> 8), static_cast<char>(length),
+        static_cast<char>(type),
+        static_cast<char>(stream_id), static_cast<char>(stream_id >> 8),
+        static_cast<char>(stream_id >> 16), static_cast<char>(stream_id >> 24)
+    };
+    out.insert(out.end(), header, header + sizeof(header));
+    out.insert(out.end(), payload, payload + length);
+}
+
+static inline void amf_string(std::vector<char>& out, const std::string& value) {
+    out.push_back(0x02);
+    out.push_back(static_cast<char>(value.size() >> 8));
+    out.push_back(static_cast<char>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+static inline void amf_number(std::vector<char>& out, double value) {
+    unsigned long long bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    out.push_back(0x00);
+    for (int shift = 56; shift >= 0; shift -= 8) out.push_back(static_cast<char>(bits >> shift));
+}
+
+// connect("app") then createStream, in one buffer
+static inline std::vector<char> build_connect_commands(const std::string& app) {
+    std::vector<char> out;
+    std::vector<char> body;
+
+    amf_string(body, "connect");
+    amf_number(body, 1);
+    body.push_back(0x03);
+    body.push_back(0x00); body.push_back(0x03);
+    body.insert(body.end(), "app", "app" + 3);
+    amf_string(body, app);
+    body.push_back(0x00); body.push_back(0x00); body.push_back(0x09);
+    append_message(out, 3, 0, 0x14, 0, body.data(), body.size());
+
+    body.clear();
+    amf_string(body, "createStream");
+    amf_number(body, 2);
+    body.push_back(0x05);
+    append_message(out, 3, 0, 0x14, 0, body.data(), body.size());
+    return out;
+}
+
+// connect("app"), createStream, then publish or play "name" on stream 1, all in one write
+static inline std::vector<char> build_session_commands(const std::string& app, const std::string& name, bool publish) {
+    std::vector<char> out = build_connect_commands(app);
+    std::vector<char> body;
+    amf_string(body, publish ? "publish" : "play");
+    amf_number(body, 3);
+    body.push_back(0x05);
+    amf_string(body, name);
+    append_message(out, 8, 0, 0x14, 1, body.data(), body.size());
+    return out;
+}
+
+#endif // BENCHCLIENT_H
@@ -0,0 +1,452 @@
+// Corpus.h
+// Fixed synthetic inputs for rtmp_bench, checked in under Bench/corpus so that runs on
+// different commits and machines parse byte-identical data. `rtmp_bench --write-corpus <dir>`
+// regenerates them; generation is deterministic, so change it only together with the files.
+//
+//   publish_chunk4096.bin  client side of a publish session after the handshake: set chunk
+//                          size 4096, connect, releaseStream, FCPublish, createStream, publish,
+//                          @setDataFrame, AVC and AAC sequence headers, then 2 s of 30 fps
+//                          video (keyframe every second) and AAC audio with acknowledgements,
+//                          headers compressed to fmt 1/2/3 the way encoders send them
+//   publish_chunk128.bin   the same session at chunk size 128
+//   commands_amf0.bin      AMF0 command and data bodies as records: 4-byte big-endian
+//                          length, then the body
+//   commands_amf3.bin      AMF3 command (0x11) bodies after the format byte, same records
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef std::vector<char> Bytes;
+
+// Same sequence on every platform, unlike rand()
+class CorpusRandom {
+public:
+    explicit CorpusRandom(unsigned int seed) : state_(seed) {}
+    unsigned int next() {
+        state_ = state_ * 1664525u + 1013904223u;
+        return state_ >> 8;
+    }
+    unsigned int between(unsigned int low, unsigned int high) { return low + next() % (high - low + 1); }
+
+private:
+    unsigned int state_;
+};
+
+static inline void corpus_u16(Bytes& out, unsigned int value) {
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+static inline void corpus_u32(Bytes& out, unsigned int value) {
+    corpus_u16(out, value >> 16);
+    corpus_u16(out, value & 0xFFFF);
+}
+
+// AMF0 writers
+static inline void amf0_string(Bytes& out, const std::string& value) {
+    out.push_back(0x02);
+    corpus_u16(out, static_cast<unsigned int>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+static inline void amf0_number(Bytes& out, double value) {
+    unsigned long long bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    out.push_back(0x00);
+    for (int shift = 56; shift >= 0; shift -= 8) out.push_back(static_cast<char>(bits >> shift));
+}
+
+static inline void amf0_boolean(Bytes& out, bool value) {
+    out.push_back(0x01);
+    out.push_back(value ? 1 : 0);
+}
+
+static inline void amf0_key(Bytes& out, const std::string& key) {
+    corpus_u16(out, static_cast<unsigned int>(key.size()));
+    out.insert(out.end(), key.begin(), key.end());
+}
+
+static inline void amf0_object_end(Bytes& out) {
+    corpus_u16(out, 0);
+    out.push_back(0x09);
+}
+
+// AMF3 writers, inline strings only unless a reference is asked for
+static inline void amf3_u29(Bytes& out, unsigned int value) {
+    if (value < 0x80) {
+        out.push_back(static_cast<char>(value));
+    } else if (value < 0x4000) {
+        out.push_back(static_cast<char>(0x80 | (value >> 7)));
+        out.push_back(static_cast<char>(value & 0x7F));
+    } else {
+        out.push_back(static_cast<char>(0x80 | (value >> 14)));
+        out.push_back(static_cast<char>(0x80 | ((value >> 7) & 0x7F)));
+        out.push_back(static_cast<char>(value & 0x7F));
+    }
+}
+
+static inline void amf3_text(Bytes& out, const std::string& value) {
+    amf3_u29(out, static_cast<unsigned int>(value.size() << 1) | 1);
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+static inline void amf3_string(Bytes& out, const std::string& value) {
+    out.push_back(0x06);
+    amf3_text(out, value);
+}
+
+// Splits messages into chunks with the header compression encoders use: fmt 0 for the first
+// message on a chunk stream, fmt 1 when length or type change, fmt 2 when only the
+// timestamp moves, and fmt 3 for continuations
+class ChunkWriter {
+public:
+    explicit ChunkWriter(std::size_t chunk_size) : chunk_size_(chunk_size) {}
+
+    void set_chunk_size(std::size_t chunk_size) {
+        Bytes payload;
+        corpus_u32(payload, static_cast<unsigned int>(chunk_size));
+        message(2, 0, 0x01, 0, payload);
+        chunk_size_ = chunk_size;
+    }
+
+    void message(unsigned int csid, unsigned int timestamp, unsigned char type, unsigned int stream_id,
+                 const Bytes& payload) {
+        Last& last = last_[csid];
+        unsigned int fmt = 0;
+        if (last.used && last.stream_id == stream_id && timestamp >= last.timestamp) {
+            fmt = (last.length == payload.size() && last.type == type) ? 2 : 1;
+        }
+
+        out.push_back(static_cast<char>((fmt << 6) | csid));
+        unsigned int stamp = fmt == 0 ? timestamp : timestamp - last.timestamp;
+        out.push_back(static_cast<char>(stamp >> 16));
+        corpus_u16(out, stamp & 0xFFFF);
+        if (fmt <= 1) {
+            out.push_back(static_cast<char>(payload.size() >> 16));
+            corpus_u16(out, static_cast<unsigned int>(payload.size() & 0xFFFF));
+            out.push_back(static_cast<char>(type));
+        }
+        if (fmt == 0) {
+            for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>(stream_id >> (8 * i)));
+        }
+        for (std::size_t offset = 0; offset < payload.size() || offset == 0; offset += chunk_size_) {
+            if (offset > 0) out.push_back(static_cast<char>(0xC0 | csid));
+            std::size_t piece = payload.size() - offset < chunk_size_ ? payload.size() - offset : chunk_size_;
+            out.insert(out.end(), payload.begin() + offset, payload.begin() + offset + piece);
+            if (payload.empty()) break;
+        }
+
+        last.used = true;
+        last.timestamp = timestamp;
+        last.length = payload.size();
+        last.type = type;
+        last.stream_id = stream_id;
+    }
+
+    Bytes out;
+
+private:
+    struct Last {
+        Last() : used(false), timestamp(0), length(0), type(0), stream_id(0) {}
+        bool used;
+        unsigned int timestamp;
+        std::size_t length;
+        unsigned char type;
+        unsigned int stream_id;
+    };
+
+    std::size_t chunk_size_;
+    Last last_[64];
+};
+
+static inline Bytes corpus_connect_command() {
+    Bytes body;
+    amf0_string(body, "connect");
+    amf0_number(body, 1);
+    body.push_back(0x03);
+    amf0_key(body, "app");            amf0_string(body, "live");
+    amf0_key(body, "type");           amf0_string(body, "nonprivate");
+    amf0_key(body, "flashVer");       amf0_string(body, "FMLE/3.0 (compatible; FMSc/1.0)");
+    amf0_key(body, "swfUrl");         amf0_string(body, "rtmp://127.0.0.1:1935/live");
+    amf0_key(body, "tcUrl");          amf0_string(body, "rtmp://127.0.0.1:1935/live");
+    amf0_key(body, "fpad");           amf0_boolean(body, false);
+    amf0_key(body, "capabilities");   amf0_number(body, 239);
+    amf0_key(body, "audioCodecs");    amf0_number(body, 3575);
+    amf0_key(body, "videoCodecs");    amf0_number(body, 252);
+    amf0_key(body, "videoFunction");  amf0_number(body, 1);
+    amf0_object_end(body);
+    return body;
+}
+
+static inline Bytes corpus_stream_command(const std::string& name, double transaction_id, const std::string& stream) {
+    Bytes body;
+    amf0_string(body, name);
+    amf0_number(body, transaction_id);
+    body.push_back(0x05);
+    if (!stream.empty()) amf0_string(body, stream);
+    return body;
+}
+
+static inline Bytes corpus_metadata() {
+    Bytes body;
+    amf0_string(body, "@setDataFrame");
+    amf0_string(body, "onMetaData");
+    body.push_back(0x08);
+    corpus_u32(body, 13);
+    amf0_key(body, "duration");        amf0_number(body, 0);
+    amf0_key(body, "width");           amf0_number(body, 1280);
+    amf0_key(body, "height");          amf0_number(body, 720);
+    amf0_key(body, "videodatarate");   amf0_number(body, 2500);
+    amf0_key(body, "framerate");       amf0_number(body, 30);
+    amf0_key(body, "videocodecid");    amf0_number(body, 7);
+    amf0_key(body, "audiodatarate");   amf0_number(body, 128);
+    amf0_key(body, "audiosamplerate"); amf0_number(body, 44100);
+    amf0_key(body, "audiosamplesize"); amf0_number(body, 16);
+    amf0_key(body, "stereo");          amf0_boolean(body, true);
+    amf0_key(body, "audiocodecid");    amf0_number(body, 10);
+    amf0_key(body, "encoder");         amf0_string(body, "Lavf60.16.100");
+    amf0_key(body, "filesize");        amf0_number(body, 0);
+    amf0_object_end(body);
+    return body;
+}
+
+// FLV video tag body: frame type and codec, AVC packet type, composition time, then NAL
+// units with 4-byte length prefixes
+static inline Bytes corpus_video_frame(CorpusRandom& random, bool keyframe, std::size_t size) {
+    Bytes body;
+    body.push_back(keyframe ? 0x17 : 0x27);
+    body.push_back(0x01);
+    body.push_back(0);
+    body.push_back(0);
+    body.push_back(0);
+    std::size_t nal = size - body.size() - 4;
+    corpus_u32(body, static_cast<unsigned int>(nal));
+    body.push_back(keyframe ? 0x65 : 0x41);
+    while (body.size() < size) body.push_back(static_cast<char>(random.next()));
+    return body;
+}
+
+static inline Bytes corpus_publish_session(std::size_t chunk_size) {
+    CorpusRandom random(1935);
+    ChunkWriter writer(128);
+    // Announced even at the default, so the session does not depend on what came before it
+    writer.set_chunk_size(chunk_size);
+
+    writer.message(3, 0, 0x14, 0, corpus_connect_command());
+    writer.message(3, 0, 0x14, 0, corpus_stream_command("releaseStream", 2, "bench"));
+    writer.message(3, 0, 0x14, 0, corpus_stream_command("FCPublish", 3, "bench"));
+    writer.message(3, 0, 0x14, 0, corpus_stream_command("createStream", 4, ""));
+    Bytes publish = corpus_stream_command("publish", 5, "bench");
+    amf0_string(publish, "live");
+    writer.message(8, 0, 0x14, 1, publish);
+    writer.message(4, 0, 0x12, 1, corpus_metadata());
+
+    static const char avc_config[] = {
+        0x17, 0x00, 0x00, 0x00, 0x00, 0x01, 0x64, 0x00, 0x1F, -1, -31, 0x00, 0x19, 0x67, 0x64, 0x00,
+        0x1F, -84, -39, 0x40, 0x50, 0x05, -69, 0x01, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00,
+        0x03, 0x03, -64, -15, -125, 0x19, 0x60, 0x01, 0x00, 0x06, 0x68, -21, -29, -53, 0x22, -64
+    };
+    writer.message(6, 0, 0x09, 1, Bytes(avc_config, avc_config + sizeof(avc_config)));
+    static const char aac_config[] = { -81, 0x00, 0x12, 0x10 };
+    writer.message(4, 0, 0x08, 1, Bytes(aac_config, aac_config + sizeof(aac_config)));
+
+    // 30 fps video and 1024-sample AAC frames at 44.1 kHz, interleaved by timestamp
+    const unsigned int duration_ms = 2000;
+    unsigned int video_index = 0;
+    unsigned int audio_index = 0;
+    unsigned int next_ack = 1000;
+    while (true) {
+        unsigned int video_time = video_index * 1000 / 30;
+        unsigned int audio_time = audio_index * 1024 * 1000 / 44100;
+        if (video_time >= duration_ms && audio_time >= duration_ms) {
+            break;
+        }
+        if (video_time <= audio_time) {
+            bool keyframe = video_index % 30 == 0;
+            std::size_t size = keyframe ? random.between(40000, 50000) : random.between(3000, 9000);
+            writer.message(6, video_time, 0x09, 1, corpus_video_frame(random, keyframe, size));
+            ++video_index;
+        } else {
+            Bytes frame;
+            frame.push_back(static_cast<char>(0xAF));
+            frame.push_back(0x01);
+            std::size_t size = random.between(330, 390);
+            while (frame.size() < size) frame.push_back(static_cast<char>(random.next()));
+            writer.message(4, audio_time, 0x08, 1, frame);
+            ++audio_index;
+        }
+        if (video_time >= next_ack) {
+            Bytes ack;
+            corpus_u32(ack, static_cast<unsigned int>(writer.out.size()));
+            writer.message(2, 0, 0x03, 0, ack);
+            next_ack += 1000;
+        }
+    }
+    return writer.out;
+}
+
+static inline void corpus_record(Bytes& out, const Bytes& body) {
+    corpus_u32(out, static_cast<unsigned int>(body.size()));
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+static inline Bytes corpus_amf0_commands() {
+    Bytes out;
+    corpus_record(out, corpus_connect_command());
+    corpus_record(out, corpus_stream_command("releaseStream", 2, "bench"));
+    corpus_record(out, corpus_stream_command("FCPublish", 3, "bench"));
+    corpus_record(out, corpus_stream_command("createStream", 4, ""));
+    Bytes publish = corpus_stream_command("publish", 5, "bench?token=0123456789abcdef");
+    amf0_string(publish, "live");
+    corpus_record(out, publish);
+
+    Bytes play = corpus_stream_command("play", 6, "bench");
+    amf0_number(play, -2);
+    amf0_number(play, -1);
+    amf0_boolean(play, true);
+    corpus_record(out, play);
+    corpus_record(out, corpus_metadata());
+
+    // onStatus with a nested info object and a strict array, as some servers relay them
+    Bytes status;
+    amf0_string(status, "onStatus");
+    amf0_number(status, 0);
+    status.push_back(0x05);
+    status.push_back(0x03);
+    amf0_key(status, "level");       amf0_string(status, "status");
+    amf0_key(status, "code");        amf0_string(status, "NetStream.Play.Start");
+    amf0_key(status, "description"); amf0_string(status, "Started playing bench.");
+    amf0_key(status, "details");     amf0_string(status, "bench");
+    amf0_key(status, "clientid");    amf0_string(status, "ASAICiss");
+    amf0_key(status, "tracks");
+    status.push_back(0x0A);
+    corpus_u32(status, 2);
+    status.push_back(0x03);
+    amf0_key(status, "type"); amf0_string(status, "video");
+    amf0_key(status, "id");   amf0_number(status, 1);
+    amf0_object_end(status);
+    status.push_back(0x03);
+    amf0_key(status, "type"); amf0_string(status, "audio");
+    amf0_key(status, "id");   amf0_number(status, 2);
+    amf0_object_end(status);
+    amf0_object_end(status);
+    corpus_record(out, status);
+    return out;
+}
+
+static inline Bytes corpus_amf3_commands() {
+    Bytes out;
+
+    // connect with its command object in AMF3
+    Bytes connect;
+    amf0_string(connect, "connect");
+    amf0_number(connect, 1);
+    connect.push_back(0x11);
+    connect.push_back(0x0A);
+    connect.push_back(0x0B);  // Inline dynamic traits, no sealed members
+    amf3_text(connect, "");
+    amf3_text(connect, "app");            amf3_string(connect, "live");
+    amf3_text(connect, "flashVer");       amf3_string(connect, "WIN 32,0,0,465");
+    amf3_text(connect, "tcUrl");          amf3_string(connect, "rtmp://127.0.0.1:1935/live");
+    amf3_text(connect, "fpad");           connect.push_back(0x02);
+    amf3_text(connect, "capabilities");   connect.push_back(0x04); amf3_u29(connect, 239);
+    amf3_text(connect, "audioCodecs");    connect.push_back(0x04); amf3_u29(connect, 3575);
+    amf3_text(connect, "videoCodecs");    connect.push_back(0x04); amf3_u29(connect, 252);
+    amf3_text(connect, "objectEncoding"); connect.push_back(0x04); amf3_u29(connect, 3);
+    amf3_text(connect, "");
+    corpus_record(out, connect);
+
+    Bytes create_stream;
+    amf0_string(create_stream, "createStream");
+    amf0_number(create_stream, 2);
+    create_stream.push_back(0x05);
+    corpus_record(out, create_stream);
+
+    Bytes play;
+    amf0_string(play, "play");
+    amf0_number(play, 3);
+    play.push_back(0x05);
+    play.push_back(0x11);
+    amf3_string(play, "bench");
+    corpus_record(out, play);
+
+    // Two objects of one sealed class in an array: the second reuses traits and strings
+    Bytes tracks;
+    amf0_string(tracks, "setTracks");
+    amf0_number(tracks, 4);
+    tracks.push_back(0x05);
+    tracks.push_back(0x11);
+    tracks.push_back(0x09);
+    amf3_u29(tracks, (2 << 1) | 1);
+    amf3_text(tracks, "");
+    tracks.push_back(0x0A);
+    amf3_u29(tracks, (2 << 4) | 0x03);  // Inline traits, two sealed members
+    amf3_text(tracks, "Track");
+    amf3_text(tracks, "type");
+    amf3_text(tracks, "id");
+    amf3_string(tracks, "video");
+    tracks.push_back(0x04); amf3_u29(tracks, 1);
+    tracks.push_back(0x0A);
+    amf3_u29(tracks, (0 << 2) | 0x01);  // Traits reference 0
+    tracks.push_back(0x06); amf3_u29(tracks, 3 << 1);  // String reference: "video"
+    tracks.push_back(0x04); amf3_u29(tracks, 2);
+    corpus_record(out, tracks);
+    return out;
+}
+
+struct CorpusFile {
+    const char* name;
+    Bytes (*build)();
+};
+
+static inline Bytes corpus_publish_4096() { return corpus_publish_session(4096); }
+static inline Bytes corpus_publish_128() { return corpus_publish_session(128); }
+
+static const CorpusFile CORPUS_FILES[] = {
+    { "publish_chunk4096.bin", corpus_publish_4096 },
+    { "publish_chunk128.bin", corpus_publish_128 },
+    { "commands_amf0.bin", corpus_amf0_commands },
+    { "commands_amf3.bin", corpus_amf3_commands },
+};
+
+static inline bool read_corpus(const std::string& path, Bytes& out) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    out.clear();
+    char buffer[64 * 1024];
+    std::size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), file)) > 0) out.insert(out.end(), buffer, buffer + n);
+    std::fclose(file);
+    return true;
+}
+
+static inline bool write_corpus(const std::string& path, const Bytes& data) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+// Splits a commands file into its records; false if it is malformed
+static inline bool split_records(const Bytes& data, std::vector<Bytes>& records) {
+    records.clear();
+    std::size_t offset = 0;
+    while (offset < data.size()) {
+        if (data.size() - offset < 4) return false;
+        std::size_t length = (static_cast<std::size_t>(static_cast<unsigned char>(data[offset])) << 24) |
+                             (static_cast<unsigned char>(data[offset + 1]) << 16) |
+                             (static_cast<unsigned char>(data[offset + 2]) << 8) |
+                             static_cast<unsigned char>(data[offset + 3]);
+        offset += 4;
+        if (data.size() - offset < length) return false;
+        records.push_back(Bytes(data.begin() + offset, data.begin() + offset + length));
+        offset += length;
+    }
+    return true;
+}
+
+#endif // CORPUS_H
@@ -0,0 +1,248 @@
+// FanoutBench.cpp
+// Loopback benchmark for publish -> play fan-out: one publisher sends paced video at a
+// fixed bitrate to an in-process server, N players receive it, and we report whether
+// every player kept up plus the aggregate egress rate. With --unpaced the publisher
+// sends as fast as the server drains, which shows the fan-out ceiling instead.
+// With --http-flv the players fetch the stream as HTTP-FLV from the server's HTTP port
+// instead of playing it over RTMP. The server's CPU time (the process's, less what the
+// players and the publisher used) gives the viewers one core serves at that bitrate, so
+// running both ways compares the two protocols.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+
+#include "BenchClient.h"
+#include "Client.h"
+#include "Log.h"
+#include "Metrics.h"
+
+struct FanoutOptions {
+    unsigned int players;
+    unsigned int workers;
+    unsigned int bitrate_kbps;
+    unsigned int fps;
+    double seconds;
+    bool unpaced;
+    bool http_flv;
+    int port;
+
+    FanoutOptions()
+        : players(1000),
+          workers(1),
+          bitrate_kbps(6000),
+          fps(30),
+          seconds(5.0),
+          unpaced(false),
+          http_flv(false),
+          port(19450) {}
+};
+
+static bool parse_options(int argc, char* argv[], FanoutOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--players") == 0 && has_value) {
+            options.players = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--workers") == 0 && has_value) {
+            options.workers = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--bitrate") == 0 && has_value) {
+            options.bitrate_kbps = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--fps") == 0 && has_value) {
+            options.fps = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--unpaced") == 0) {
+            options.unpaced = true;
+        } else if (std::strcmp(argv[i], "--http-flv") == 0) {
+            options.http_flv = true;
+        } else if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+            options.port = std::atoi(argv[++i]);
+        } else {
+            std::printf("Usage: %s [--players n] [--workers n] [--bitrate kbps] [--fps n] [--seconds s] [--unpaced] [--http-flv] [--port p]\n", argv[0]);
+            return false;
+        }
+    }
+    if (options.fps == 0) options.fps = 30;
+    if (options.workers == 0) options.workers = 1;
+    return true;
+}
+
+// CPU time of the whole process, all threads
+static unsigned long long process_cpu_ns() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ull +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ull;
+}
+
+// Sends video frames (keyframe every two seconds) and returns the payload bytes sent
+static unsigned long long run_publisher(int fd, const FanoutOptions& options, std::atomic<bool>& stop_flag) {
+    size_t frame_size = static_cast<size_t>(options.bitrate_kbps) * 1000 / 8 / options.fps;
+    if (frame_size < 16) frame_size = 16;
+    std::vector<char> frame(frame_size, 0);
+    std::vector<char> out;
+
+    // AVC sequence header first, so players that join late still get one
+    const char sequence_header[] = { 0x17, 0x00, 0x00, 0x00, 0x00, 0x01, 0x64, 0x00, 0x1F };
+    append_message(out, 6, 0, 0x09, 1, sequence_header, sizeof(sequence_header));
+    write_all(fd, out.data(), out.size());
+
+    unsigned long long sent = 0;
+    bench_clock::time_point started = bench_clock::now();
+    for (unsigned int index = 0; !stop_flag; ++index) {
+        double due = static_cast<double>(index) / options.fps;
+        if (due >= options.seconds) break;
+        if (!options.unpaced) {
+            std::this_thread::sleep_until(started + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(due)));
+        } else if (std::chrono::duration<double>(bench_clock::now() - started).count() >= options.seconds) {
+            break;
+        }
+
+        frame[0] = (index % (options.fps * 2) == 0) ? 0x17 : 0x27;
+        frame[1] = 0x01;
+        out.clear();
+        append_message(out, 6, static_cast<unsigned int>(due * 1000), 0x09, 1, frame.data(), frame.size());
+        if (!write_all(fd, out.data(), out.size())) break;
+        sent += frame.size();
+    }
+    return sent;
+}
+
+int main(int argc, char* argv[]) {
+    FanoutOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+
+    // Keep the report readable
+    Log::set_level(Log::LEVEL_OFF);
+
+    ServerConfig config;
+    config.port = options.port;
+    config.workers = options.workers;
+    if (options.http_flv) {
+        config.http_port = options.port + 1;
+    }
+    std::unique_ptr<RTMPServer> server(new RTMPServer());
+    if (!server->start(config)) {
+        std::fprintf(stderr, "Failed to start server on port %d\n", config.port);
+        return 1;
+    }
+    std::thread server_thread([&server]() { server->run(); });
+
+    // Publisher first, since HTTP-FLV only serves streams that are live. Its frames start
+    // once every player is in, so each of them sees the stream from its first keyframe.
+    int publisher = connect_and_handshake(options.port, false);
+    std::vector<char> publish;
+    const char chunk_size[] = { 0x00, 0x01, 0x00, 0x00 };  // 65536, larger than any frame we send
+    append_message(publish, 2, 0, 0x01, 0, chunk_size, sizeof(chunk_size));
+    std::vector<char> commands = build_session_commands("live", "bench", true);
+    publish.insert(publish.end(), commands.begin(), commands.end());
+    if (publisher < 0 || !write_all(publisher, publish.data(), publish.size())) {
+        std::fprintf(stderr, "Publisher failed to connect\n");
+        return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    static const char http_request[] = "GET /live/bench.flv HTTP/1.1\r\nHost: bench\r\n\r\n";
+    std::vector<char> play = options.http_flv ? std::vector<char>(http_request, http_request + sizeof(http_request) - 1)
+                                              : build_session_commands("live", "bench", false);
+    std::vector<pollfd> players;
+    for (unsigned int i = 0; i < options.players; ++i) {
+        int fd = options.http_flv ? connect_loopback(config.http_port, false) : connect_and_handshake(options.port, false);
+        if (fd < 0 || !write_all(fd, play.data(), play.size())) {
+            std::fprintf(stderr, "Player %u failed to connect\n", i);
+            break;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        pollfd entry;
+        entry.fd = fd;
+        entry.events = POLLIN;
+        entry.revents = 0;
+        players.push_back(entry);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::atomic<bool> stop_flag(false);
+    std::atomic<bool> publisher_done(false);
+    unsigned long long payload_sent = 0;
+    unsigned long long publisher_cpu_ns = 0;
+    unsigned long long process_cpu_start = process_cpu_ns();
+    unsigned long long drain_cpu_start = Metrics::thread_cpu_ns();
+    bench_clock::time_point started = bench_clock::now();
+    std::thread publisher_thread([&]() {
+        payload_sent = run_publisher(publisher, options, stop_flag);
+        publisher_cpu_ns = Metrics::thread_cpu_ns();
+        publisher_done = true;
+    });
+
+    // Drain every player until the publisher is done and the pipes have gone quiet
+    std::vector<unsigned long long> received(players.size(), 0);
+    std::vector<char> scratch(256 * 1024);
+    bench_clock::time_point last_data = bench_clock::now();
+    while (true) {
+        int ready = poll(players.data(), players.size(), 50);
+        for (size_t i = 0; i < players.size() && ready > 0; ++i) {
+            if (players[i].revents == 0) continue;
+            --ready;
+            ssize_t n;
+            while ((n = recv(players[i].fd, scratch.data(), scratch.size(), 0)) > 0) {
+                received[i] += n;
+                last_data = bench_clock::now();
+            }
+        }
+        double quiet = std::chrono::duration<double>(bench_clock::now() - last_data).count();
+        if (publisher_done && quiet > 0.5) break;
+    }
+    double elapsed = std::chrono::duration<double>(last_data - started).count();
+    publisher_thread.join();
+    unsigned long long client_cpu_ns = Metrics::thread_cpu_ns() - drain_cpu_start + publisher_cpu_ns;
+    unsigned long long process_cpu = process_cpu_ns() - process_cpu_start;
+    double server_cpu = process_cpu > client_cpu_ns ? (process_cpu - client_cpu_ns) / 1e9 : 0.0;
+
+    ServerStats server_stats = server->stats();  // Before the publisher leaves and its GOP cache goes with it
+    close(publisher);
+    for (size_t i = 0; i < players.size(); ++i) close(players[i].fd);
+    server->stop();
+    server_thread.join();
+    server.reset();
+
+    unsigned long long total = 0;
+    unsigned long long slowest = players.empty() ? 0 : received[0];
+    for (size_t i = 0; i < received.size(); ++i) {
+        total += received[i];
+        slowest = std::min(slowest, received[i]);
+    }
+    double sent_mbps = payload_sent * 8 / elapsed / 1e6;
+    double slowest_mbps = slowest * 8 / elapsed / 1e6;
+
+    std::printf("players:              %zu %s on %u worker(s)%s\n", players.size(),
+                options.http_flv ? "HTTP-FLV" : "RTMP", options.workers, options.unpaced ? ", unpaced" : "");
+    std::printf("publisher:            %.2f Mbps over %.2f s\n", sent_mbps, elapsed);
+    std::printf("slowest player:       %.2f Mbps (%.1f%% of published payload)\n",
+                slowest_mbps, payload_sent ? 100.0 * slowest / payload_sent : 0.0);
+    std::printf("aggregate egress:     %.1f MB/s\n", total / elapsed / 1e6);
+    std::printf("server CPU:           %.2f s (%.0f%% of one core)", server_cpu, 100.0 * server_cpu / elapsed);
+    if (server_cpu > 0) {
+        std::printf(", about %.0f viewers per core at this bitrate", players.size() / (server_cpu / elapsed));
+    }
+    std::printf("\n");
+    std::printf("chunk cache:          %llu hits, %llu misses\n",
+                server_stats.chunk_cache_hits, server_stats.chunk_cache_misses);
+    std::printf("gop cache:            %.1f KB\n", server_stats.gop_cache_bytes / 1024.0);
+    std::printf("backpressure:         %llu packets dropped, %llu players disconnected\n",
+                server_stats.media_dropped, server_stats.slow_disconnects);
+    std::printf("slab pool:            %llu hits, %llu misses, %.1f KB in use, %.1f KB cached at most\n",
+                server_stats.pool_hits, server_stats.pool_misses,
+                server_stats.pool_in_use_bytes / 1024.0, server_stats.pool_cached_high_water_bytes / 1024.0);
+    return 0;
+}
@@ -0,0 +1,158 @@
+// HlsBench.cpp
+// Cost of HLS packaging. N streams of H.264 video and AAC audio at a set bitrate are fed
+// to an HlsPackager through the SinkBench harness, and we report the CPU the packager spent
+// per second of media per stream, so how many streams one core packages in real time.
+// With --realtime the frames are fed at their media rate instead, and the segment-ready
+// latency (closing keyframe handed over to segment in the store) is what players would see.
+// Halfway through every GOP each stream also sends an onCuePoint data message, which the
+// packager does not queue, so a dropped packet count above zero means lost video.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "HlsPackager.h"
+#include "HlsStore.h"
+#include "Log.h"
+#include "SinkBench.h"
+
+struct HlsOptions : SinkOptions {
+    double gop_seconds;
+    double segment_seconds;
+
+    HlsOptions()
+        : SinkOptions(3000),
+          gop_seconds(2.0),
+          segment_seconds(2.0) {}
+};
+
+static bool parse_options(int argc, char* argv[], HlsOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (parse_sink_option(argc, argv, i, options)) {
+            continue;
+        } else if (std::strcmp(argv[i], "--gop-seconds") == 0 && has_value) {
+            options.gop_seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--segment-seconds") == 0 && has_value) {
+            options.segment_seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--realtime") == 0) {
+            options.realtime = true;
+        } else {
+            std::printf("Usage: %s %s [--gop-seconds s] [--segment-seconds s] [--realtime]\n",
+                        argv[0], SINK_OPTIONS_USAGE);
+            return false;
+        }
+    }
+    return true;
+}
+
+// An AVC video tag holding one NAL unit of the given type and size
+static std::vector<char> make_frame(bool keyframe, std::size_t nal_size) {
+    std::vector<char> body(9 + nal_size, 0x5A);
+    body[0] = keyframe ? 0x17 : 0x27;
+    body[1] = 0x01;
+    body[2] = body[3] = body[4] = 0;  // Composition offset
+    body[5] = static_cast<char>(nal_size >> 24);
+    body[6] = static_cast<char>(nal_size >> 16);
+    body[7] = static_cast<char>(nal_size >> 8);
+    body[8] = static_cast<char>(nal_size);
+    body[9] = keyframe ? 0x65 : 0x41;
+    return body;
+}
+
+// Smallest bucket limit below which at least fraction of the samples fall
+static double percentile_ms(const HistogramSnapshot& histogram, double fraction) {
+    unsigned long long wanted = static_cast<unsigned long long>(histogram.count * fraction + 0.5);
+    unsigned long long seen = 0;
+    for (std::size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        seen += histogram.counts[i];
+        if (seen >= wanted && seen > 0) {
+            return LatencyHistogram::bucket_limit(i) / 1000.0;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    HlsOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+    Log::set_level(Log::LEVEL_OFF);
+
+    unsigned int segment_ms = static_cast<unsigned int>(options.segment_seconds * 1000);
+    HlsStore store(6, segment_ms);
+    HlsPackager packager(store, segment_ms);
+    packager.start();
+
+    SinkFeeder feeder(packager, packager.stats(), options, "hls");
+
+    // 128 kbps of AAC-LC at 44.1 kHz besides the video
+    const unsigned int audio_kbps = 128;
+    const double audio_frame_ms = 1024 * 1000.0 / 44100;
+    std::size_t audio_size = static_cast<std::size_t>(audio_kbps * 1000 / 8 * audio_frame_ms / 1000);
+    std::size_t frame_size = static_cast<std::size_t>(options.kbps) * 1000 / 8 / options.fps;
+    if (frame_size < 16) frame_size = 16;
+    std::vector<char> keyframe = make_frame(true, frame_size);
+    std::vector<char> inter_frame = make_frame(false, frame_size);
+    std::vector<char> audio_frame(2 + audio_size, 0x21);
+    audio_frame[0] = static_cast<char>(0xAF);
+    audio_frame[1] = 0x01;
+
+    const char avc_config[] = { 0x17, 0x00, 0x00, 0x00, 0x00, 0x01, 0x64, 0x00, 0x1F, static_cast<char>(0xFF),
+                                static_cast<char>(0xE1), 0x00, 0x04, 0x67, 0x64, 0x00, 0x1F, 0x01, 0x00, 0x02,
+                                0x68, static_cast<char>(0xEE) };
+    const char aac_config[] = { static_cast<char>(0xAF), 0x00, 0x12, 0x10 };
+    std::vector<char> video_header(avc_config, avc_config + sizeof(avc_config));
+    std::vector<char> audio_header(aac_config, aac_config + sizeof(aac_config));
+    const char cue_point[] = { 0x02, 0x00, 0x0A, 'o', 'n', 'C', 'u', 'e', 'P', 'o', 'i', 'n', 't',
+                               0x03, 0x00, 0x00, 0x09 };  // "onCuePoint" and an empty object
+    std::vector<char> data_message(cue_point, cue_point + sizeof(cue_point));
+    feeder.send_all(0, 0x09, video_header);
+    feeder.send_all(0, 0x08, audio_header);
+
+    // Each stream's frame comes with the audio frames that fall before it
+    const HlsStats& stats = packager.stats();
+    unsigned int gop_frames = static_cast<unsigned int>(options.gop_seconds * options.fps);
+    if (gop_frames == 0) gop_frames = 1;
+    auto audio_due = [&](unsigned int timestamp) { return static_cast<unsigned int>(timestamp / audio_frame_ms) + 1; };
+    bench_clock::time_point started = bench_clock::now();
+    unsigned int frames = feeder.feed(started, [&](unsigned int frame, unsigned int stream) {
+        unsigned int timestamp = frame * 1000 / options.fps;
+        unsigned int audio_from = frame == 0 ? 0 : audio_due((frame - 1) * 1000 / options.fps);
+        for (unsigned int a = audio_from; a < audio_due(timestamp); ++a) {
+            feeder.send(stream, static_cast<unsigned int>(a * audio_frame_ms), 0x08, audio_frame);
+        }
+        feeder.send(stream, timestamp, 0x09, frame % gop_frames == 0 ? keyframe : inter_frame);
+        if (frame % gop_frames == gop_frames / 2) {
+            feeder.send(stream, timestamp, 0x12, data_message);
+        }
+    });
+    feeder.unpublish_all();
+    packager.stop();
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - started).count();
+
+    double cpu_seconds = stats.cpu_ns.load() / 1e9;
+    double media_seconds = static_cast<double>(frames) / options.fps;
+    HistogramSnapshot ready;
+    ready.add(stats.segment_ready);
+
+    std::printf("streams:              %u at %u+%u kbps, %u fps, keyframe every %.1f s (%.1f s of media)%s\n",
+                options.streams, options.kbps, audio_kbps, options.fps, options.gop_seconds, media_seconds,
+                options.realtime ? ", real time" : "");
+    std::printf("segments:             %llu, %.1f MB of MPEG-TS, %llu packet(s) dropped, %.1f MB still in the store\n",
+                stats.segments.load(), stats.segment_bytes.load() / 1e6, stats.packets_dropped.load(),
+                store.bytes() / 1e6);
+    std::printf("packager CPU:         %.2f s over %.2f s (%.0f%% of one core)\n",
+                cpu_seconds, elapsed, 100.0 * cpu_seconds / elapsed);
+    if (cpu_seconds > 0 && media_seconds > 0) {
+        double per_stream = cpu_seconds / (media_seconds * options.streams);
+        std::printf("per stream:           %.3f%% of a core, about %.0f real-time streams per core\n",
+                    100.0 * per_stream, 1.0 / per_stream);
+    }
+    if (ready.count > 0) {
+        std::printf("segment ready:        p50 < %.3f ms, p99 < %.3f ms over %llu keyframe cut(s)\n",
+                    percentile_ms(ready, 0.5), percentile_ms(ready, 0.99), ready.count);
+    }
+    return 0;
+}
@@ -0,0 +1,872 @@
+// LoadGen.cpp
+// Synthetic RTMP clients for sizing hardware. Publishers send FLV-shaped H.264 and AAC at a
+// set bitrate and chunk size, and players pull those streams. A few epoll threads carry all
+// the connections, so one process can drive thousands of them. Each client does the same
+// C0/C1 -> S0/S1/S2 -> C2 handshake a real encoder does. It then pipelines connect,
+// createStream and publish or play, and reads the server's replies through its own chunk
+// parser.
+//
+// Reported:
+//   - connect latency: connect() to the handshake reply, and to NetStream.*.Start
+//   - throughput both ways, during the ramp and afterwards
+//   - delivery latency: each video frame carries its send time, and a player measures from
+//     there to the frame's last chunk arriving
+//   - with --handshake-only, handshakes per second: every player sends C2 and reconnects
+//     as soon as S0/S1/S2 are in, and no publishers run
+//
+// Runs against any server on --host/--port, or starts one in this process with --in-process.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Client.h"
+#include "Corpus.h"
+#include "Log.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct LoadOptions {
+    std::string host;
+    int port;
+    unsigned int publishers;
+    unsigned int players;
+    std::string app;
+    std::string stream_prefix;   // Publisher N publishes <prefix>N; player M plays <prefix>(M % publishers)
+    unsigned int video_kbps;
+    unsigned int audio_kbps;     // 0 sends video only
+    unsigned int fps;
+    unsigned int keyframe_seconds;
+    unsigned int chunk_size;     // Publishers announce it before connect; players keep 128
+    double seconds;              // After the last client has been started
+    double connect_rate;         // New connections per second; 0 starts them all at once
+    unsigned int threads;
+    double interval;             // Seconds between progress lines
+    bool in_process;
+    unsigned int workers;        // For --in-process
+    bool handshake_only;         // Players reconnect right after S0+S1+S2; measures handshakes/s
+
+    LoadOptions()
+        : host("127.0.0.1"),
+          port(1935),
+          publishers(1),
+          players(100),
+          app("live"),
+          stream_prefix("load"),
+          video_kbps(2500),
+          audio_kbps(128),
+          fps(30),
+          keyframe_seconds(2),
+          chunk_size(4096),
+          seconds(10.0),
+          connect_rate(0),
+          threads(1),
+          interval(1.0),
+          in_process(false),
+          workers(0),
+          handshake_only(false) {}
+};
+
+static bool parse_options(int argc, char* argv[], LoadOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--host") == 0 && has_value) {
+            options.host = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+            options.port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--publishers") == 0 && has_value) {
+            options.publishers = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--players") == 0 && has_value) {
+            options.players = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--app") == 0 && has_value) {
+            options.app = argv[++i];
+        } else if (std::strcmp(argv[i], "--stream") == 0 && has_value) {
+            options.stream_prefix = argv[++i];
+        } else if (std::strcmp(argv[i], "--video-kbps") == 0 && has_value) {
+            options.video_kbps = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--audio-kbps") == 0 && has_value) {
+            options.audio_kbps = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--fps") == 0 && has_value) {
+            options.fps = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--keyframe-interval") == 0 && has_value) {
+            options.keyframe_seconds = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--chunk-size") == 0 && has_value) {
+            options.chunk_size = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--connect-rate") == 0 && has_value) {
+            options.connect_rate = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--interval") == 0 && has_value) {
+            options.interval = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--in-process") == 0) {
+            options.in_process = true;
+        } else if (std::strcmp(argv[i], "--workers") == 0 && has_value) {
+            options.workers = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--handshake-only") == 0) {
+            options.handshake_only = true;
+        } else {
+            std::printf("Usage: %s [--host ipv4] [--port p] [--publishers n] [--players n] [--app name] [--stream prefix]\n"
+                        "          [--video-kbps n] [--audio-kbps n] [--fps n] [--keyframe-interval s] [--chunk-size n]\n"
+                        "          [--seconds s] [--connect-rate n/s] [--threads n] [--interval s]\n"
+                        "          [--in-process [--workers n]] [--handshake-only]\n", argv[0]);
+            return false;
+        }
+    }
+    if (options.fps == 0) options.fps = 30;
+    if (options.keyframe_seconds == 0) options.keyframe_seconds = 2;
+    if (options.chunk_size < 128) options.chunk_size = 128;
+    if (options.threads == 0) options.threads = 1;
+    if (options.interval <= 0) options.interval = 1.0;
+    if (options.handshake_only) options.publishers = 0;
+    return options.publishers + options.players > 0;
+}
+
+static inline unsigned long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count();
+}
+
+static inline unsigned int read_u24(const unsigned char* p) {
+    return (p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+static inline unsigned int read_u32(const unsigned char* p) {
+    return (static_cast<unsigned int>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline bool contains(const char* data, std::size_t length, const char* text) {
+    std::size_t text_length = std::strlen(text);
+    return std::search(data, data + length, text, text + text_length) != data + length;
+}
+
+// Client side of the chunk stream. Reassembles the server's messages but keeps only the
+// first KEEP_BYTES of each, which covers every command reply and the stamp in a video frame.
+// Only whole chunks are consumed; the caller keeps the rest for the next read.
+class ChunkReader {
+public:
+    static const std::size_t KEEP_BYTES = 1024;
+    static const std::size_t MALFORMED = static_cast<std::size_t>(-1);
+
+    ChunkReader() : chunk_size_(128) {}
+
+    // Calls handler(type, kept, kept_length) for each complete message; returns the bytes
+    // consumed, or MALFORMED
+    template <typename Handler>
+    std::size_t read(const char* data, std::size_t length, Handler handler) {
+        static const std::size_t HEADER_SIZES[4] = { 11, 7, 3, 0 };
+        std::size_t position = 0;
+        while (position < length) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(data) + position;
+            std::size_t available = length - position;
+            unsigned int fmt = p[0] >> 6;
+            unsigned int csid = p[0] & 0x3F;
+            std::size_t basic = 1;
+            if (csid == 0) {
+                if (available < 2) break;
+                csid = 64 + p[1];
+                basic = 2;
+            } else if (csid == 1) {
+                if (available < 3) break;
+                csid = 64 + p[1] + (p[2] << 8);
+                basic = 3;
+            }
+            std::size_t needed = basic + HEADER_SIZES[fmt];
+            if (available < needed) break;
+            if (csid >= streams_.size()) streams_.resize(csid + 1);
+            Stream& stream = streams_[csid];
+
+            const unsigned char* header = p + basic;
+            bool extended = fmt < 3 ? read_u24(header) == 0xFFFFFF : stream.extended;
+            if (extended) needed += 4;
+            if (fmt < 3 && stream.received > 0) return MALFORMED;  // New header inside a message
+            std::size_t message_length = fmt <= 1 ? read_u24(header + 3) : stream.length;
+            std::size_t piece = std::min(chunk_size_, message_length - stream.received);
+            if (available < needed + piece) break;
+
+            if (fmt <= 1) {
+                stream.length = message_length;
+                stream.type = header[6];
+            }
+            stream.extended = extended;
+            const char* payload = data + position + needed;
+            std::size_t keep = stream.kept.size() < KEEP_BYTES ? std::min(piece, KEEP_BYTES - stream.kept.size()) : 0;
+            stream.kept.insert(stream.kept.end(), payload, payload + keep);
+            stream.received += piece;
+            position += needed + piece;
+
+            if (stream.received == stream.length) {
+                if (stream.type == 0x01 && stream.kept.size() >= 4) {
+                    std::size_t size = read_u32(reinterpret_cast<const unsigned char*>(stream.kept.data())) & 0x7FFFFFFF;
+                    if (size > 0) chunk_size_ = size;
+                }
+                handler(stream.type, stream.kept.data(), stream.kept.size());
+                stream.received = 0;
+                stream.kept.clear();
+            }
+        }
+        return position;
+    }
+
+private:
+    struct Stream {
+        Stream() : length(0), type(0), extended(false), received(0) {}
+        std::size_t length;
+        unsigned char type;
+        bool extended;
+        std::size_t received;
+        Bytes kept;
+    };
+
+    std::size_t chunk_size_;
+    std::vector<Stream> streams_;
+};
+
+struct LoadClient {
+    enum State {
+        PENDING,      // Waiting for its start time
+        CONNECTING,
+        HANDSHAKE,    // C0+C1 sent, waiting for S0+S1+S2
+        COMMANDS,     // C2 and commands sent, waiting for NetStream.*.Start
+        STREAMING,
+        CLOSED
+    };
+
+    LoadClient(bool is_publisher, const std::string& stream_name, bench_clock::time_point start)
+        : publisher(is_publisher),
+          stream(stream_name),
+          state(PENDING),
+          fd(-1),
+          start_at(start),
+          writer(128),
+          sent(0),
+          writable_wait(false),
+          received_total(0),
+          last_ack(0),
+          ack_window(0),
+          video_index(0),
+          audio_index(0),
+          ready_ns(0) {}
+
+    bool publisher;
+    std::string stream;
+    State state;
+    int fd;
+    bench_clock::time_point start_at;
+    bench_clock::time_point connect_started;
+    bench_clock::time_point streaming_since;
+
+    ChunkWriter writer;  // writer.out is the unsent output from `sent` on
+    std::size_t sent;
+    bool writable_wait;  // Registered for EPOLLOUT
+
+    Bytes in;            // Received and not yet parsed
+    ChunkReader reader;
+    unsigned long long received_total;
+    unsigned long long last_ack;
+    unsigned int ack_window;
+
+    unsigned int video_index;
+    unsigned int audio_index;
+    unsigned long long ready_ns;  // Players ignore frames sent before they were playing
+};
+
+// Updated by the client threads, read by the progress line
+struct LoadCounters {
+    std::atomic<unsigned long long> bytes_sent;
+    std::atomic<unsigned long long> bytes_received;
+    std::atomic<unsigned long long> frames_sent;
+    std::atomic<unsigned long long> frames_received;
+    std::atomic<unsigned long long> frames_skipped;  // Publisher's socket too far behind
+    std::atomic<unsigned long long> handshakes;      // Completed by --handshake-only clients
+    std::atomic<unsigned int> publishers_ready;
+    std::atomic<unsigned int> players_ready;
+    std::atomic<unsigned int> failed;
+    std::atomic<unsigned int> disconnected;
+
+    LoadCounters()
+        : bytes_sent(0),
+          bytes_received(0),
+          frames_sent(0),
+          frames_received(0),
+          frames_skipped(0),
+          handshakes(0),
+          publishers_ready(0),
+          players_ready(0),
+          failed(0),
+          disconnected(0) {}
+};
+
+// Latencies in microseconds, owned by one thread until it is joined
+struct LoadSamples {
+    std::vector<unsigned int> handshake;
+    std::vector<unsigned int> publish_ready;
+    std::vector<unsigned int> play_ready;
+    std::vector<unsigned int> delivery;
+
+    void merge(const LoadSamples& other) {
+        handshake.insert(handshake.end(), other.handshake.begin(), other.handshake.end());
+        publish_ready.insert(publish_ready.end(), other.publish_ready.begin(), other.publish_ready.end());
+        play_ready.insert(play_ready.end(), other.play_ready.begin(), other.play_ready.end());
+        delivery.insert(delivery.end(), other.delivery.begin(), other.delivery.end());
+    }
+};
+
+static inline unsigned int micros_since(bench_clock::time_point start, bench_clock::time_point now) {
+    return static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(now - start).count());
+}
+
+// One epoll loop and the clients it carries
+class LoadThread {
+public:
+    static const std::size_t HANDSHAKE_SIZE = 1 + 1536;
+    static const std::size_t MAX_BACKLOG = 4 * 1024 * 1024;  // Unsent bytes before a publisher skips frames
+    static const std::size_t READ_SIZE = 64 * 1024;
+    static const unsigned int KEYFRAME_SCALE = 4;            // Keyframe size over inter-frame size
+    static const std::size_t VIDEO_STAMP_OFFSET = 10;        // After tag header, NAL length and NAL header
+    static const std::size_t MIN_VIDEO_FRAME = VIDEO_STAMP_OFFSET + 12;
+
+    LoadThread(const LoadOptions& options, LoadCounters& counters)
+        : options_(options), counters_(counters), epoll_fd_(-1), next_start_(0) {
+        // Frame sizes that keep the GOP at the requested bitrate with larger keyframes
+        std::size_t gop_frames = options.fps * options.keyframe_seconds;
+        std::size_t gop_bytes = static_cast<std::size_t>(options.video_kbps) * 1000 / 8 * options.keyframe_seconds;
+        std::size_t minimum = MIN_VIDEO_FRAME;
+        inter_frame_size_ = std::max(minimum, gop_bytes / (gop_frames + KEYFRAME_SCALE - 1));
+        keyframe_size_ = inter_frame_size_ * KEYFRAME_SCALE;
+        gop_frames_ = static_cast<unsigned int>(gop_frames);
+        // AAC: 1024 samples per frame at 44.1 kHz
+        audio_frame_size_ = 2 + static_cast<std::size_t>(options.audio_kbps) * 1000 / 8 * 1024 / 44100;
+    }
+
+    ~LoadThread() {
+        for (std::size_t i = 0; i < clients_.size(); ++i) {
+            close_client(*clients_[i]);
+        }
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+    }
+
+    // Clients are started in the order they are added
+    void add_client(bool publisher, const std::string& stream, bench_clock::time_point start) {
+        clients_.push_back(std::unique_ptr<LoadClient>(new LoadClient(publisher, stream, start)));
+    }
+
+    void run(bench_clock::time_point end) {
+        epoll_fd_ = epoll_create1(0);
+        if (epoll_fd_ < 0) {
+            std::perror("epoll_create1");
+            return;
+        }
+        std::vector<epoll_event> events(256);
+        while (true) {
+            bench_clock::time_point now = bench_clock::now();
+            if (now >= end) break;
+            while (next_start_ < clients_.size() && clients_[next_start_]->start_at <= now) {
+                start_client(*clients_[next_start_++]);
+            }
+            pump_publishers(now);
+
+            int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), 1);
+            for (int i = 0; i < ready; ++i) {
+                handle_event(*static_cast<LoadClient*>(events[i].data.ptr), events[i].events);
+            }
+        }
+    }
+
+    LoadSamples samples;
+
+private:
+    void start_client(LoadClient& client) {
+        client.connect_started = bench_clock::now();
+        client.fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (client.fd < 0) {
+            fail(client);
+            return;
+        }
+        fcntl(client.fd, F_SETFL, fcntl(client.fd, F_GETFL) | O_NONBLOCK);
+        int enable = 1;
+        setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        linger no_linger = { 1, 0 };  // Repeated runs should not leave thousands of ports in TIME_WAIT
+        setsockopt(client.fd, SOL_SOCKET, SO_LINGER, &no_linger, sizeof(no_linger));
+
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(options_.port);
+        inet_pton(AF_INET, options_.host.c_str(), &address.sin_addr);
+        if (connect(client.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 && errno != EINPROGRESS) {
+            fail(client);
+            return;
+        }
+
+        client.state = LoadClient::CONNECTING;
+        client.writable_wait = true;
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT;
+        event.data.ptr = &client;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client.fd, &event);
+    }
+
+    void handle_event(LoadClient& client, unsigned int events) {
+        if (client.state == LoadClient::CONNECTING) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+                fail(client);
+                return;
+            }
+            // C0 (version 3) and C1 (time, zero, then filler the server does not check)
+            client.state = LoadClient::HANDSHAKE;
+            client.writer.out.assign(HANDSHAKE_SIZE, 0);
+            client.writer.out[0] = 0x03;
+        }
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            if (!receive(client)) {
+                if (client.state == LoadClient::CLOSED) return;  // A reply already failed it
+                if (client.state == LoadClient::STREAMING) {
+                    ++counters_.disconnected;
+                    close_client(client);
+                } else {
+                    fail(client);
+                }
+                return;
+            }
+        }
+        flush(client);
+    }
+
+    bool receive(LoadClient& client) {
+        while (true) {
+            std::size_t old_size = client.in.size();
+            client.in.resize(old_size + READ_SIZE);
+            ssize_t n = recv(client.fd, client.in.data() + old_size, READ_SIZE, 0);
+            client.in.resize(old_size + (n > 0 ? n : 0));
+            if (n == 0) return false;
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return false;
+            }
+            client.received_total += n;
+            counters_.bytes_received += n;
+        }
+
+        std::size_t consumed = 0;
+        if (client.state == LoadClient::HANDSHAKE) {
+            if (client.in.size() < 2 * HANDSHAKE_SIZE - 1) return true;
+            if (client.in[0] != 0x03) return false;
+            samples.handshake.push_back(micros_since(client.connect_started, bench_clock::now()));
+            if (options_.handshake_only) {
+                reconnect(client);
+                return true;
+            }
+            // C2 echoes S1, then everything up to publish or play goes out in the same write
+            client.writer.out.insert(client.writer.out.end(), client.in.begin() + 1, client.in.begin() + HANDSHAKE_SIZE);
+            queue_commands(client);
+            client.state = LoadClient::COMMANDS;
+            consumed = 2 * HANDSHAKE_SIZE - 1;
+        }
+
+        std::size_t parsed = client.reader.read(client.in.data() + consumed, client.in.size() - consumed,
+            [this, &client](unsigned char type, const char* data, std::size_t length) {
+                on_message(client, type, data, length);
+            });
+        if (parsed == ChunkReader::MALFORMED || client.state == LoadClient::CLOSED) return false;
+        client.in.erase(client.in.begin(), client.in.begin() + consumed + parsed);
+
+        if (client.ack_window > 0 && client.received_total - client.last_ack >= client.ack_window) {
+            Bytes ack;
+            corpus_u32(ack, static_cast<unsigned int>(client.received_total));
+            client.writer.message(2, 0, 0x03, 0, ack);
+            client.last_ack = client.received_total;
+        }
+        return true;
+    }
+
+    void queue_commands(LoadClient& client) {
+        if (client.publisher) {
+            client.writer.set_chunk_size(options_.chunk_size);
+        }
+        std::string tc_url = "rtmp://" + options_.host + ":" + std::to_string(options_.port) + "/" + options_.app;
+        Bytes body;
+        amf0_string(body, "connect");
+        amf0_number(body, 1);
+        body.push_back(0x03);
+        amf0_key(body, "app");          amf0_string(body, options_.app);
+        amf0_key(body, "type");         amf0_string(body, "nonprivate");
+        amf0_key(body, "flashVer");     amf0_string(body, client.publisher ? "FMLE/3.0 (compatible; rtmp_loadgen)" : "LNX 9,0,124,2");
+        amf0_key(body, "tcUrl");        amf0_string(body, tc_url);
+        amf0_key(body, "fpad");         amf0_boolean(body, false);
+        amf0_key(body, "capabilities"); amf0_number(body, 15);
+        amf0_key(body, "audioCodecs");  amf0_number(body, 3575);
+        amf0_key(body, "videoCodecs");  amf0_number(body, 252);
+        amf0_object_end(body);
+        client.writer.message(3, 0, 0x14, 0, body);
+        client.writer.message(3, 0, 0x14, 0, corpus_stream_command("createStream", 2, ""));
+
+        // createStream is answered with stream 1 on a fresh connection
+        if (client.publisher) {
+            Bytes publish = corpus_stream_command("publish", 3, client.stream);
+            amf0_string(publish, "live");
+            client.writer.message(8, 0, 0x14, 1, publish);
+        } else {
+            Bytes play = corpus_stream_command("play", 3, client.stream);
+            amf0_number(play, -2);
+            client.writer.message(8, 0, 0x14, 1, play);
+        }
+    }
+
+    void on_message(LoadClient& client, unsigned char type, const char* data, std::size_t length) {
+        if (type == 0x05 && length >= 4) {
+            client.ack_window = read_u32(reinterpret_cast<const unsigned char*>(data));
+        } else if (type == 0x14 || type == 0x11) {
+            on_command(client, data, length);
+        } else if (type == 0x09 && client.state == LoadClient::STREAMING && !client.publisher) {
+            ++counters_.frames_received;
+            if (length >= MIN_VIDEO_FRAME && std::memcmp(data + VIDEO_STAMP_OFFSET, "LGEN", 4) == 0) {
+                const unsigned char* stamp = reinterpret_cast<const unsigned char*>(data + VIDEO_STAMP_OFFSET + 4);
+                unsigned long long sent_ns = (static_cast<unsigned long long>(read_u32(stamp)) << 32) | read_u32(stamp + 4);
+                // Frames from the GOP cache were sent before this player joined
+                if (sent_ns >= client.ready_ns) {
+                    samples.delivery.push_back(static_cast<unsigned int>((now_ns() - sent_ns) / 1000));
+                }
+            }
+        }
+    }
+
+    void on_command(LoadClient& client, const char* data, std::size_t length) {
+        if (client.state != LoadClient::COMMANDS) return;
+        if (contains(data, length, "_error") || contains(data, length, "BadName") || contains(data, length, "Play.Failed")) {
+            fail(client);
+            return;
+        }
+        bench_clock::time_point now = bench_clock::now();
+        if (client.publisher && contains(data, length, "NetStream.Publish.Start")) {
+            samples.publish_ready.push_back(micros_since(client.connect_started, now));
+            ++counters_.publishers_ready;
+            start_stream(client, now);
+        } else if (!client.publisher && contains(data, length, "NetStream.Play.Start")) {
+            samples.play_ready.push_back(micros_since(client.connect_started, now));
+            ++counters_.players_ready;
+            client.state = LoadClient::STREAMING;
+            client.ready_ns = now_ns();
+        }
+    }
+
+    // Metadata and decoder configuration, as an encoder sends them right after publish
+    void start_stream(LoadClient& client, bench_clock::time_point now) {
+        client.writer.message(4, 0, 0x12, 1, corpus_metadata());
+        static const char avc_config[] = {
+            0x17, 0x00, 0x00, 0x00, 0x00, 0x01, 0x64, 0x00, 0x1F, -1, -31, 0x00, 0x04, 0x67, 0x64, 0x00,
+            0x1F, 0x01, 0x00, 0x04, 0x68, -21, -29, -53
+        };
+        client.writer.message(6, 0, 0x09, 1, Bytes(avc_config, avc_config + sizeof(avc_config)));
+        if (options_.audio_kbps > 0) {
+            static const char aac_config[] = { -81, 0x00, 0x12, 0x10 };
+            client.writer.message(4, 0, 0x08, 1, Bytes(aac_config, aac_config + sizeof(aac_config)));
+        }
+        client.state = LoadClient::STREAMING;
+        client.streaming_since = now;
+    }
+
+    // Queues every frame that is due on every streaming publisher
+    void pump_publishers(bench_clock::time_point now) {
+        for (std::size_t i = 0; i < next_start_; ++i) {
+            LoadClient& client = *clients_[i];
+            if (!client.publisher || client.state != LoadClient::STREAMING) continue;
+            double elapsed = std::chrono::duration<double>(now - client.streaming_since).count();
+            bool queued = false;
+
+            while (client.video_index <= elapsed * options_.fps) {
+                unsigned int timestamp = static_cast<unsigned int>(static_cast<unsigned long long>(client.video_index) * 1000 / options_.fps);
+                bool keyframe = client.video_index % gop_frames_ == 0;
+                ++client.video_index;
+                if (backlog(client) > MAX_BACKLOG) {
+                    ++counters_.frames_skipped;
+                    continue;
+                }
+                fill_video_frame(keyframe ? keyframe_size_ : inter_frame_size_, keyframe);
+                client.writer.message(6, timestamp, 0x09, 1, frame_);
+                ++counters_.frames_sent;
+                queued = true;
+            }
+            while (options_.audio_kbps > 0 && client.audio_index * 1024.0 / 44100 <= elapsed) {
+                unsigned int timestamp = static_cast<unsigned int>(static_cast<unsigned long long>(client.audio_index) * 1024 * 1000 / 44100);
+                ++client.audio_index;
+                if (backlog(client) > MAX_BACKLOG) continue;
+                frame_.resize(audio_frame_size_);
+                frame_[0] = static_cast<char>(0xAF);
+                frame_[1] = 0x01;
+                client.writer.message(4, timestamp, 0x08, 1, frame_);
+                queued = true;
+            }
+            if (queued) flush(client);
+        }
+    }
+
+    // FLV video tag body: frame type and codec, AVC packet type, composition time, one NAL unit
+    // with a 4-byte length; its payload starts with "LGEN" and the send time
+    void fill_video_frame(std::size_t size, bool keyframe) {
+        frame_.resize(size);
+        char* p = frame_.data();
+        p[0] = keyframe ? 0x17 : 0x27;
+        p[1] = 0x01;
+        p[2] = p[3] = p[4] = 0;
+        std::size_t nal = size - 9;
+        p[5] = static_cast<char>(nal >> 24);
+        p[6] = static_cast<char>(nal >> 16);
+        p[7] = static_cast<char>(nal >> 8);
+        p[8] = static_cast<char>(nal);
+        p[9] = keyframe ? 0x65 : 0x41;
+        std::memcpy(p + VIDEO_STAMP_OFFSET, "LGEN", 4);
+        unsigned long long sent_ns = now_ns();
+        for (int i = 0; i < 8; ++i) {
+            p[VIDEO_STAMP_OFFSET + 4 + i] = static_cast<char>(sent_ns >> (56 - 8 * i));
+        }
+    }
+
+    static std::size_t backlog(const LoadClient& client) {
+        return client.writer.out.size() - client.sent;
+    }
+
+    void flush(LoadClient& client) {
+        if (client.fd < 0 || client.state == LoadClient::CONNECTING) return;
+        Bytes& out = client.writer.out;
+        while (client.sent < out.size()) {
+            ssize_t n = send(client.fd, out.data() + client.sent, out.size() - client.sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (client.state == LoadClient::STREAMING) {
+                    ++counters_.disconnected;
+                    close_client(client);
+                } else {
+                    fail(client);
+                }
+                return;
+            }
+            client.sent += n;
+            counters_.bytes_sent += n;
+        }
+        if (client.sent == out.size()) {
+            out.clear();
+            client.sent = 0;
+        } else if (client.sent >= READ_SIZE) {
+            out.erase(out.begin(), out.begin() + client.sent);
+            client.sent = 0;
+        }
+
+        bool want_write = client.sent < out.size();
+        if (want_write != client.writable_wait) {
+            client.writable_wait = want_write;
+            epoll_event event;
+            event.events = EPOLLIN | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+            event.data.ptr = &client;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, client.fd, &event);
+        }
+    }
+
+    // Sends C2 and starts over on a new socket
+    void reconnect(LoadClient& client) {
+        const char* c2 = reinterpret_cast<const char*>(client.in.data()) + 1;
+        send(client.fd, c2, HANDSHAKE_SIZE - 1, MSG_NOSIGNAL);
+        ++counters_.handshakes;
+        close_client(client);
+        client.in.clear();
+        client.writer.out.clear();
+        client.sent = 0;
+        start_client(client);
+    }
+
+    void fail(LoadClient& client) {
+        ++counters_.failed;
+        close_client(client);
+    }
+
+    void close_client(LoadClient& client) {
+        if (client.fd >= 0) {
+            close(client.fd);  // Also leaves the epoll set
+            client.fd = -1;
+        }
+        client.state = LoadClient::CLOSED;
+    }
+
+    const LoadOptions& options_;
+    LoadCounters& counters_;
+    int epoll_fd_;
+    std::vector<std::unique_ptr<LoadClient>> clients_;
+    std::size_t next_start_;
+
+    std::size_t inter_frame_size_;
+    std::size_t keyframe_size_;
+    unsigned int gop_frames_;
+    std::size_t audio_frame_size_;
+    Bytes frame_;
+};
+
+static void print_latency(const char* name, std::vector<unsigned int>& samples) {
+    if (samples.empty()) {
+        std::printf("%-22s no samples\n", name);
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    std::size_t n = samples.size();
+    const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    std::printf("%-22s n=%-9zu", name, n);
+    static const char* labels[] = { "p50", "p90", "p99", "p99.9" };
+    for (int i = 0; i < 4; ++i) {
+        std::size_t index = std::min(n - 1, static_cast<std::size_t>(quantiles[i] * n));
+        std::printf(" %s %8.2f ms", labels[i], samples[index] / 1000.0);
+    }
+    std::printf("  max %8.2f ms\n", samples.back() / 1000.0);
+}
+
+// Raise the descriptor limit as far as allowed; a few thousand clients need more than 1024
+static void raise_file_limit(std::size_t needed) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= needed) return;
+    limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, needed);
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < needed) {
+        std::fprintf(stderr, "Warning: only %llu file descriptors available for %zu sockets\n",
+                     static_cast<unsigned long long>(limit.rlim_cur), needed);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+    in_addr probe;
+    if (inet_pton(AF_INET, options.host.c_str(), &probe) != 1) {
+        std::fprintf(stderr, "--host must be an IPv4 address: %s\n", options.host.c_str());
+        return 1;
+    }
+    std::size_t clients = options.publishers + options.players;
+    raise_file_limit((options.in_process ? 2 : 1) * clients + 64);
+
+    std::unique_ptr<RTMPServer> server;
+    std::thread server_thread;
+    if (options.in_process) {
+        Log::set_level(Log::LEVEL_OFF);
+        ServerConfig config;
+        config.port = options.port;
+        config.workers = options.workers;
+        server.reset(new RTMPServer());
+        if (!server->start(config)) {
+            std::fprintf(stderr, "Failed to start server on port %d\n", config.port);
+            return 1;
+        }
+        server_thread = std::thread([&server]() { server->run(); });
+    }
+
+    // Publishers start first so players find their streams; clients go round-robin to threads
+    LoadCounters counters;
+    std::vector<std::unique_ptr<LoadThread>> threads;
+    for (unsigned int t = 0; t < options.threads; ++t) {
+        threads.push_back(std::unique_ptr<LoadThread>(new LoadThread(options, counters)));
+    }
+    bench_clock::time_point start = bench_clock::now() + std::chrono::milliseconds(50);
+    double ramp_seconds = options.connect_rate > 0 ? clients / options.connect_rate : 0;
+    unsigned int streams = std::max(options.publishers, 1u);
+    for (std::size_t i = 0; i < clients; ++i) {
+        bool publisher = i < options.publishers;
+        std::size_t stream = publisher ? i : (i - options.publishers) % streams;
+        bench_clock::duration offset = std::chrono::duration_cast<bench_clock::duration>(
+            std::chrono::duration<double>(options.connect_rate > 0 ? i / options.connect_rate : 0));
+        threads[i % threads.size()]->add_client(publisher, options.stream_prefix + std::to_string(stream), start + offset);
+    }
+    bench_clock::time_point ramp_end = start + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(ramp_seconds));
+    bench_clock::time_point end = ramp_end + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(options.seconds));
+
+    std::printf("%u publisher(s) at %u+%u kbps, %u player(s), chunk size %u, %u thread(s)%s\n",
+                options.publishers, options.video_kbps, options.audio_kbps, options.players, options.chunk_size,
+                options.threads, options.in_process ? ", in-process server" : "");
+    std::vector<std::thread> runners;
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+        LoadThread* thread = threads[t].get();
+        runners.push_back(std::thread([thread, end]() { thread->run(end); }));
+    }
+
+    // Progress once per interval; the totals after the ramp give the steady-state rates
+    unsigned long long last_sent = 0;
+    unsigned long long last_received = 0;
+    unsigned long long steady_sent = 0;
+    unsigned long long steady_received = 0;
+    bool ramp_done = false;
+    bench_clock::time_point last = start;
+    bench_clock::time_point steady_start = ramp_end;
+    while (bench_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(options.interval));
+        bench_clock::time_point now = bench_clock::now();
+        unsigned long long sent = counters.bytes_sent;
+        unsigned long long received = counters.bytes_received;
+        if (!ramp_done && now >= ramp_end) {
+            ramp_done = true;
+            steady_start = now;
+            steady_sent = sent;
+            steady_received = received;
+        }
+        double seconds = std::chrono::duration<double>(now - last).count();
+        std::printf("t=%7.1fs  publishers %u/%u  players %u/%u  failed %u  dropped %u  up %9.1f Mbps  down %9.1f Mbps\n",
+                    std::chrono::duration<double>(now - start).count(),
+                    counters.publishers_ready.load(), options.publishers, counters.players_ready.load(), options.players,
+                    counters.failed.load(), counters.disconnected.load(),
+                    (sent - last_sent) * 8 / seconds / 1e6, (received - last_received) * 8 / seconds / 1e6);
+        std::fflush(stdout);
+        last = now;
+        last_sent = sent;
+        last_received = received;
+    }
+    for (std::size_t t = 0; t < runners.size(); ++t) {
+        runners[t].join();
+    }
+    double steady_seconds = std::chrono::duration<double>(bench_clock::now() - steady_start).count();
+
+    LoadSamples samples;
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+        samples.merge(threads[t]->samples);
+    }
+    threads.clear();  // Closes every client
+
+    std::printf("\nclients:               %u/%u publishers and %u/%u players ready, %u failed, %u dropped while streaming\n",
+                counters.publishers_ready.load(), options.publishers, counters.players_ready.load(), options.players,
+                counters.failed.load(), counters.disconnected.load());
+    std::printf("steady state:          up %.1f Mbps, down %.1f Mbps over %.1f s\n",
+                (counters.bytes_sent - steady_sent) * 8 / steady_seconds / 1e6,
+                (counters.bytes_received - steady_received) * 8 / steady_seconds / 1e6, steady_seconds);
+    std::printf("video frames:          %llu sent, %llu received by players, %llu skipped on publisher backlog\n",
+                counters.frames_sent.load(), counters.frames_received.load(), counters.frames_skipped.load());
+    if (options.handshake_only) {
+        std::printf("handshakes:            %llu, %.0f/s\n", counters.handshakes.load(),
+                    counters.handshakes / steady_seconds);
+    }
+    print_latency("handshake:", samples.handshake);
+    print_latency("connect to publish:", samples.publish_ready);
+    print_latency("connect to play:", samples.play_ready);
+    print_latency("delivery:", samples.delivery);
+
+    if (server) {
+        server->stop();
+        server_thread.join();
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+// NalBench.cpp
+// Throughput of the NAL unit kernels on multi-megabyte keyframes: start code scanning,
+// emulation prevention detection and removal, and AVCC <-> Annex-B conversion, once per
+// scanning kernel this build and CPU support. Every kernel's results are checked against
+// the scalar one first, on small buffers dense with zeros, ones and threes where the
+// edge cases are.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Nal.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct NalOptions {
+    std::size_t megabytes;
+    unsigned int slices;
+    unsigned int iterations;
+
+    NalOptions() : megabytes(4), slices(8), iterations(50) {}
+};
+
+static bool parse_options(int argc, char* argv[], NalOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--megabytes") == 0 && has_value) {
+            options.megabytes = static_cast<std::size_t>(std::atol(argv[++i]));
+        } else if (std::strcmp(argv[i], "--slices") == 0 && has_value) {
+            options.slices = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--iterations") == 0 && has_value) {
+            options.iterations = std::atoi(argv[++i]);
+        } else {
+            std::printf("Usage: %s [--megabytes n] [--slices n] [--iterations n]\n", argv[0]);
+            return false;
+        }
+    }
+    if (options.megabytes == 0) options.megabytes = 1;
+    if (options.slices == 0) options.slices = 1;
+    if (options.iterations == 0) options.iterations = 1;
+    return true;
+}
+
+static unsigned int next_random(unsigned int& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Escapes an RBSP the way an encoder does: 03 after two zeros when the next byte is 0-3
+static std::string escape(const std::string& rbsp) {
+    std::string out;
+    out.reserve(rbsp.size() + rbsp.size() / 256);
+    unsigned int zeros = 0;
+    for (std::size_t i = 0; i < rbsp.size(); ++i) {
+        unsigned char byte = static_cast<unsigned char>(rbsp[i]);
+        if (zeros >= 2 && byte <= 3) {
+            out.push_back(3);
+            zeros = 0;
+        }
+        out.push_back(static_cast<char>(byte));
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+    return out;
+}
+
+// Every match from begin to end, as offsets
+static std::vector<std::size_t> all_matches(const std::string& data, bool start_codes) {
+    std::vector<std::size_t> found;
+    const char* end = data.data() + data.size();
+    const char* p = data.data();
+    while (true) {
+        p = start_codes ? Nal::find_start_code(p, end) : Nal::find_emulation_prevention(p, end);
+        if (p == end) break;
+        found.push_back(p - data.data());
+        ++p;
+    }
+    return found;
+}
+
+static bool check_against_scalar(Nal::Kernel kernel) {
+    unsigned int state = 2463534242u;
+    static const unsigned char alphabet[] = { 0, 0, 0, 0, 1, 3, 0x65, 0xFF };
+    for (int round = 0; round < 20000; ++round) {
+        std::string data(next_random(state) % 200, '\0');
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(alphabet[next_random(state) % sizeof(alphabet)]);
+        }
+        for (int start_codes = 0; start_codes < 2; ++start_codes) {
+            Nal::set_kernel(Nal::KERNEL_SCALAR);
+            std::vector<std::size_t> expected = all_matches(data, start_codes != 0);
+            Nal::set_kernel(kernel);
+            if (all_matches(data, start_codes != 0) != expected) {
+                std::fprintf(stderr, "%s disagrees with scalar on a %zu-byte buffer\n",
+                             Nal::kernel_name(kernel), data.size());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Runs body iterations times over bytes of input and prints MB/s
+template <typename Body>
+static void measure(const char* name, std::size_t bytes, unsigned int iterations, Body body) {
+    bench_clock::time_point start = bench_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i) {
+        body();
+    }
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    std::printf("  %-30s %10.0f MB/s\n", name, bytes * static_cast<double>(iterations) / seconds / 1e6);
+}
+
+int main(int argc, char* argv[]) {
+    NalOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+
+    // One IDR picture split into slices of random (incompressible, like CABAC output) data
+    unsigned int state = 88172645u;
+    std::size_t slice_size = options.megabytes * 1024 * 1024 / options.slices;
+    std::string rbsp;
+    std::string annexb;
+    std::string avcc;
+    std::size_t escapes = 0;
+    for (unsigned int slice = 0; slice < options.slices; ++slice) {
+        std::string payload(slice_size, '\0');
+        for (std::size_t i = 0; i < payload.size(); ++i) {
+            payload[i] = static_cast<char>(next_random(state) >> 24);
+        }
+        payload[0] = static_cast<char>(0x65);  // IDR slice header
+        payload[payload.size() - 1] = static_cast<char>(0x80);  // rbsp_stop_one_bit
+        std::string unit = escape(payload);
+        escapes += unit.size() - payload.size();
+        rbsp += payload;
+
+        annexb.append(Nal::START_CODE, sizeof(Nal::START_CODE));
+        annexb += unit;
+        char length[4] = { static_cast<char>(unit.size() >> 24), static_cast<char>(unit.size() >> 16),
+                           static_cast<char>(unit.size() >> 8), static_cast<char>(unit.size()) };
+        avcc.append(length, sizeof(length));
+        avcc += unit;
+    }
+    std::printf("keyframe: %.1f MB in %u slice(s), %zu emulation prevention byte(s); best kernel %s\n",
+                annexb.size() / 1e6, options.slices, escapes, Nal::kernel_name(Nal::kernel()));
+
+    static const Nal::Kernel kernels[] = { Nal::KERNEL_SCALAR, Nal::KERNEL_SSE2, Nal::KERNEL_AVX2 };
+    for (std::size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (!Nal::set_kernel(kernels[k])) {
+            std::printf("%s: not available\n", Nal::kernel_name(kernels[k]));
+            continue;
+        }
+        if (!check_against_scalar(kernels[k])) {
+            return 1;
+        }
+
+        // Every result checked once before it is timed
+        std::string out;
+        std::size_t found = 0;
+        const char* end = annexb.data() + annexb.size();
+        for (const char* p = Nal::find_start_code(annexb.data(), end); p != end; p = Nal::find_start_code(p + 3, end)) {
+            ++found;
+        }
+        std::size_t escapes_found = 0;
+        for (const char* p = Nal::find_emulation_prevention(annexb.data(), end); p != end;
+             p = Nal::find_emulation_prevention(p + 3, end)) {
+            ++escapes_found;
+        }
+        std::string unescaped;
+        for (const char* p = avcc.data(); p < avcc.data() + avcc.size(); ) {
+            const unsigned char* length = reinterpret_cast<const unsigned char*>(p);
+            std::size_t size = (static_cast<std::size_t>(length[0]) << 24) | (length[1] << 16) | (length[2] << 8) | length[3];
+            Nal::remove_emulation_prevention(p + 4, size, unescaped);
+            p += 4 + size;
+        }
+        bool converted = Nal::annexb_to_avcc(annexb.data(), annexb.size(), 4, out) && out == avcc;
+        out.clear();
+        converted = converted && Nal::avcc_to_annexb(avcc.data(), avcc.size(), 4, out) && out == annexb;
+        if (found != options.slices || escapes_found != escapes || unescaped != rbsp || !converted) {
+            std::fprintf(stderr, "%s: wrong results (%zu start codes, %zu escapes)\n",
+                         Nal::kernel_name(kernels[k]), found, escapes_found);
+            return 1;
+        }
+
+        std::printf("%s:\n", Nal::kernel_name(kernels[k]));
+        measure("start code scan", annexb.size(), options.iterations, [&]() {
+            for (const char* p = Nal::find_start_code(annexb.data(), end); p != end; p = Nal::find_start_code(p + 3, end)) {
+            }
+        });
+        measure("emulation prevention scan", annexb.size(), options.iterations, [&]() {
+            for (const char* p = Nal::find_emulation_prevention(annexb.data(), end); p != end;
+                 p = Nal::find_emulation_prevention(p + 3, end)) {
+            }
+        });
+        measure("emulation prevention removal", avcc.size(), options.iterations, [&]() {
+            unescaped.clear();
+            Nal::remove_emulation_prevention(avcc.data() + 4, avcc.size() - 4, unescaped);
+        });
+        measure("annex-b -> avcc", annexb.size(), options.iterations, [&]() {
+            out.clear();
+            Nal::annexb_to_avcc(annexb.data(), annexb.size(), 4, out);
+        });
+        measure("avcc -> annex-b (no scan)", avcc.size(), options.iterations, [&]() {
+            out.clear();
+            Nal::avcc_to_annexb(avcc.data(), avcc.size(), 4, out);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,29 @@
+// NullBackend.h
+// Backend for benchmarks that drive a Connection directly instead of through sockets.
+#ifndef NULLBACKEND_H
+#define NULLBACKEND_H
+
+#include "Connection.h"
+#include "IOBackend.h"
+
+// Accepts flush requests and never writes; the benchmark throws output away itself
+class NullBackend : public IOBackend {
+public:
+    bool init(socket_t, Worker*) override { return true; }
+    void run(const std::atomic<bool>&) override {}
+    void request_flush(Connection*) override {}
+    const char* name() const override { return "null"; }
+};
+
+// Marks everything the connection queued as sent
+static inline void discard_output(Connection& conn) {
+    ChunkSegment segments[64];
+    while (conn.has_pending_output()) {
+        size_t count = conn.pin_output(segments, 64);
+        size_t bytes = 0;
+        for (size_t i = 0; i < count; ++i) bytes += segments[i].length;
+        conn.complete_output(bytes);
+    }
+}
+
+#endif // NULLBACKEND_H
@@ -0,0 +1,190 @@
+// ParseBench.cpp
+// Parse throughput with the logger at different levels. Each session is a fresh Connection
+// fed a recorded client byte stream (handshake, connect, createStream, then audio, video and
+// acknowledgements) straight through on_data(), so only parsing, dispatch and logging run;
+// output is discarded. Rows:
+//   - off:          logging disabled at run time
+//   - info:         info level through the per-thread rings and the writer thread
+//   - info (sync):  info level written on the calling thread, as before the writer existed
+//   - debug rows only when built with -DRTMP_DEBUG_LOG=ON, where every packet logs
+// Log output goes to /dev/null while sessions run.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "BenchClient.h"
+#include "Connection.h"
+#include "Log.h"
+#include "NullBackend.h"
+#include "Worker.h"
+
+struct ParseOptions {
+    unsigned int sessions;
+    unsigned int messages;   // Media messages per session
+};
+
+static bool parse_options(int argc, char* argv[], ParseOptions& options) {
+    options.sessions = 2000;
+    options.messages = 300;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--sessions") == 0 && has_value) {
+            options.sessions = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--messages") == 0 && has_value) {
+            options.messages = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "Usage: %s [--sessions <n>] [--messages <n per session>]\n", argv[0]);
+            return false;
+        }
+    }
+    return options.sessions > 0;
+}
+
+// Appends one message as a fmt 0 chunk followed by fmt 3 continuations
+static void append_chunked(std::vector<char>& out, unsigned int csid, unsigned int timestamp, unsigned char type,
+                           unsigned int stream_id, const char* payload, size_t length, size_t chunk_size) {
+    size_t first = length < chunk_size ? length : chunk_size;
+    std::vector<char> message;
+    append_message(message, csid, timestamp, type, stream_id, payload, first);
+    message[4] = static_cast<char>(length >> 16);  // The header announces the whole message
+    message[5] = static_cast<char>(length >> 8);
+    message[6] = static_cast<char>(length);
+    out.insert(out.end(), message.begin(), message.end());
+    for (size_t offset = first; offset < length; offset += chunk_size) {
+        out.push_back(static_cast<char>(0xC0 | (csid & 0x3F)));
+        size_t piece = length - offset < chunk_size ? length - offset : chunk_size;
+        out.insert(out.end(), payload + offset, payload + offset + piece);
+    }
+}
+
+// What one client sends over its whole session
+static std::vector<char> build_session(unsigned int messages) {
+    const size_t chunk_size = 4096;
+    std::vector<char> out(1537 + 1536, 0);  // C0 + C1, then C2
+    out[0] = 0x03;
+
+    const char set_chunk_size[] = { 0x00, 0x00, 0x10, 0x00 };
+    append_message(out, 2, 0, 0x01, 0, set_chunk_size, sizeof(set_chunk_size));
+
+    // connect and createStream; publishing needs a running hub, so media stays unclaimed
+    std::vector<char> commands = build_connect_commands("live");
+    out.insert(out.end(), commands.begin(), commands.end());
+
+    std::vector<char> video(6000, 0x17);
+    std::vector<char> audio(300, static_cast<char>(0xAF));
+    for (unsigned int i = 0; i < messages; ++i) {
+        unsigned int timestamp = i * 20;
+        if (i % 2 == 0) {
+            append_chunked(out, 6, timestamp, 0x09, 1, video.data(), video.size(), chunk_size);
+        } else {
+            append_chunked(out, 4, timestamp, 0x08, 1, audio.data(), audio.size(), chunk_size);
+        }
+        if (i % 16 == 15) {
+            const char ack[] = { 0x00, 0x00, 0x10, 0x00 };
+            append_message(out, 2, 0, 0x03, 0, ack, sizeof(ack));
+        }
+    }
+    return out;
+}
+
+struct Result {
+    double seconds;
+    unsigned long long messages;
+};
+
+static Result run_sessions(const ParseOptions& options, const std::vector<char>& session) {
+    NullBackend backend;
+    Worker worker(0);
+    const size_t read_size = 64 * 1024;  // Roughly what one recv hands the parser
+
+    bench_clock::time_point start = bench_clock::now();
+    for (unsigned int s = 0; s < options.sessions; ++s) {
+        Connection conn(RTMP_INVALID_SOCKET, "127.0.0.1", &backend, &worker);
+        for (size_t offset = 0; offset < session.size(); offset += read_size) {
+            size_t length = session.size() - offset < read_size ? session.size() - offset : read_size;
+            if (!conn.on_data(session.data() + offset, length)) {
+                break;
+            }
+            discard_output(conn);
+        }
+    }
+    Result result;
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    result.messages = worker.stats().messages_received.load();
+    return result;
+}
+
+struct Row {
+    const char* name;
+    Result result;
+};
+
+int main(int argc, char* argv[]) {
+    ParseOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+    std::vector<char> session = build_session(options.messages);
+
+    // Send everything the server logs to /dev/null; the report goes to the saved stdout
+    std::fflush(stdout);
+    std::fflush(stderr);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    close(null_fd);
+
+    std::vector<Row> rows;
+    Log::set_level(Log::LEVEL_OFF);
+    run_sessions(options, session);  // Warm up allocators and caches
+    Row off = { "off", run_sessions(options, session) };
+    rows.push_back(off);
+
+    Log::set_level(Log::LEVEL_INFO);
+    Row info_sync = { "info (sync)", run_sessions(options, session) };
+    Log::start();
+    Row info = { "info", run_sessions(options, session) };
+    rows.push_back(info);
+    rows.push_back(info_sync);
+    Log::stop();
+
+#if RTMP_LOG_MIN_LEVEL <= 0
+    Log::set_level(Log::LEVEL_DEBUG);
+    Row debug_sync = { "debug (sync)", run_sessions(options, session) };
+    Log::start();
+    Row debug = { "debug", run_sessions(options, session) };
+    rows.push_back(debug);
+    rows.push_back(debug_sync);
+    Log::stop();
+#endif
+    unsigned long long dropped = Log::dropped();
+
+    std::fflush(stdout);
+    std::fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    std::printf("%u sessions x %zu bytes (%u media messages each)\n", options.sessions, session.size(), options.messages);
+    std::printf("%-14s %12s %14s %10s\n", "logging", "MB/s", "messages/sec", "vs off");
+    double baseline = rows[0].result.messages / rows[0].result.seconds;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Result& r = rows[i].result;
+        double bytes = static_cast<double>(session.size()) * options.sessions;
+        double rate = r.messages / r.seconds;
+        std::printf("%-14s %12.1f %14.0f %9.1f%%\n", rows[i].name, bytes / r.seconds / 1e6, rate, 100.0 * rate / baseline);
+    }
+    if (dropped > 0) {
+        std::printf("log lines dropped on full rings: %llu\n", dropped);
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+// ReactorBench.cpp
+// Loopback benchmark for the multi-worker server: for 1, 2, 4 ... N workers it measures
+//   - accepted connections/sec (connect + full handshake + close, client resets the socket)
+//   - messages/sec (persistent connections streaming small control messages)
+// The server runs in-process with its logging turned off.
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "BenchClient.h"
+#include "Client.h"
+#include "Log.h"
+
+struct BenchOptions {
+    unsigned int max_workers;
+    unsigned int client_threads;
+    unsigned int connections_per_thread;
+    double seconds;
+    int base_port;
+
+    BenchOptions()
+        : max_workers(std::thread::hardware_concurrency()),
+          client_threads(4),
+          connections_per_thread(8),
+          seconds(3.0),
+          base_port(19350) {
+        if (max_workers == 0) max_workers = 1;
+    }
+};
+
+// A batch of Acknowledgement messages (fmt 0, csid 2, type 3, 4-byte body)
+static std::vector<char> build_message_batch(size_t count) {
+    std::vector<char> batch;
+    for (size_t i = 0; i < count; ++i) {
+        const char message[16] = {
+            0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x03,
+            0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x10, 0x00
+        };
+        batch.insert(batch.end(), message, message + sizeof(message));
+    }
+    return batch;
+}
+
+static double elapsed_seconds(bench_clock::time_point since) {
+    return std::chrono::duration<double>(bench_clock::now() - since).count();
+}
+
+static double measure_accept_rate(const BenchOptions& options, int port, RTMPServer& server) {
+    std::atomic<bool> stop_flag(false);
+    std::vector<std::thread> clients;
+
+    unsigned long long accepted_before = server.stats().connections_accepted;
+    bench_clock::time_point started = bench_clock::now();
+    for (unsigned int t = 0; t < options.client_threads; ++t) {
+        clients.emplace_back([&]() {
+            while (!stop_flag) {
+                int fd = connect_and_handshake(port, true);
+                if (fd >= 0) close(fd);
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+    stop_flag = true;
+    for (size_t i = 0; i < clients.size(); ++i) clients[i].join();
+
+    double elapsed = elapsed_seconds(started);
+    return (server.stats().connections_accepted - accepted_before) / elapsed;
+}
+
+static double measure_message_rate(const BenchOptions& options, int port, RTMPServer& server) {
+    std::atomic<bool> stop_flag(false);
+    std::vector<std::thread> clients;
+    std::vector<char> batch = build_message_batch(256);
+
+    // Open every connection before the clock starts
+    std::vector<std::vector<int> > sockets(options.client_threads);
+    for (unsigned int t = 0; t < options.client_threads; ++t) {
+        for (unsigned int c = 0; c < options.connections_per_thread; ++c) {
+            int fd = connect_and_handshake(port, true);
+            if (fd >= 0) sockets[t].push_back(fd);
+        }
+    }
+
+    unsigned long long messages_before = server.stats().messages_received;
+    bench_clock::time_point started = bench_clock::now();
+    for (unsigned int t = 0; t < options.client_threads; ++t) {
+        clients.emplace_back([&, t]() {
+            while (!stop_flag) {
+                for (size_t c = 0; c < sockets[t].size() && !stop_flag; ++c) {
+                    write_all(sockets[t][c], batch.data(), batch.size());
+                }
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+    double elapsed = elapsed_seconds(started);
+    unsigned long long messages = server.stats().messages_received - messages_before;
+
+    stop_flag = true;
+    for (size_t i = 0; i < clients.size(); ++i) clients[i].join();
+    for (size_t t = 0; t < sockets.size(); ++t) {
+        for (size_t c = 0; c < sockets[t].size(); ++c) close(sockets[t][c]);
+    }
+    return messages / elapsed;
+}
+
+static bool parse_options(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--max-workers") == 0 && has_value) {
+            options.max_workers = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--clients") == 0 && has_value) {
+            options.client_threads = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--connections") == 0 && has_value) {
+            options.connections_per_thread = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+            options.base_port = std::atoi(argv[++i]);
+        } else {
+            std::printf("Usage: %s [--max-workers n] [--clients n] [--connections n] [--seconds s] [--port p]\n", argv[0]);
+            return false;
+        }
+    }
+    if (options.max_workers == 0) options.max_workers = 1;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+
+    std::vector<unsigned int> worker_counts;
+    for (unsigned int n = 1; n < options.max_workers; n *= 2) worker_counts.push_back(n);
+    worker_counts.push_back(options.max_workers);
+
+    // Keep the benchmark output readable
+    Log::set_level(Log::LEVEL_OFF);
+
+    std::printf("%-8s %16s %16s %18s\n", "workers", "accepts/sec", "messages/sec", "messages/sec/core");
+    for (size_t i = 0; i < worker_counts.size(); ++i) {
+        ServerConfig config;
+        config.port = options.base_port + static_cast<int>(i);
+        config.workers = worker_counts[i];
+
+        RTMPServer server;
+        if (!server.start(config)) {
+            std::fprintf(stderr, "Failed to start server with %u workers on port %d\n", config.workers, config.port);
+            return 1;
+        }
+        std::thread server_thread([&server]() { server.run(); });
+
+        double accepts = measure_accept_rate(options, config.port, server);
+        double messages = measure_message_rate(options, config.port, server);
+
+        server.stop();
+        server_thread.join();
+
+        std::printf("%-8u %16.0f %16.0f %18.0f\n", config.workers, accepts, messages, messages / config.workers);
+        std::fflush(stdout);
+    }
+
+    return 0;
+}
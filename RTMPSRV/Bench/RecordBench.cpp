@@ -0,0 +1,128 @@
+// RecordBench.cpp
+// Disk throughput of the FLV recorder. N streams of video at a set bitrate are fed to a
+// Recorder through the SinkBench harness, and we report the MB/s that reached the disk,
+// the CPU the I/O thread spent on it, and so how many recordings of that bitrate one core
+// can keep up with. The clock stops after every file is closed and sync() has returned, so
+// the figure is what the disk sustains rather than what the page cache absorbs.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "Log.h"
+#include "Recorder.h"
+#include "SinkBench.h"
+
+struct RecordOptions : SinkOptions {
+    std::string directory;
+    unsigned int max_file_mb;  // Rotation size; 0 keeps one file per stream
+    bool keep;                 // Leave the files behind for inspection
+
+    RecordOptions()
+        : SinkOptions(4000),
+          directory("/tmp/rtmp_record_bench"),
+          max_file_mb(0),
+          keep(false) {}
+};
+
+static bool parse_options(int argc, char* argv[], RecordOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (parse_sink_option(argc, argv, i, options)) {
+            continue;
+        } else if (std::strcmp(argv[i], "--dir") == 0 && has_value) {
+            options.directory = argv[++i];
+        } else if (std::strcmp(argv[i], "--max-file-mb") == 0 && has_value) {
+            options.max_file_mb = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--keep") == 0) {
+            options.keep = true;
+        } else {
+            std::printf("Usage: %s [--dir path] %s [--max-file-mb n] [--keep]\n", argv[0], SINK_OPTIONS_USAGE);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Removes the .flv files a run left in the directory
+static void remove_recordings(const std::string& directory) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".flv") == 0) {
+            unlink((directory + "/" + name).c_str());
+        }
+    }
+    closedir(dir);
+}
+
+int main(int argc, char* argv[]) {
+    RecordOptions options;
+    if (!parse_options(argc, argv, options)) {
+        return 1;
+    }
+    Log::set_level(Log::LEVEL_OFF);
+
+    Recorder recorder(options.directory, static_cast<unsigned long long>(options.max_file_mb) * 1024 * 1024, 0);
+    if (!recorder.start()) {
+        std::fprintf(stderr, "Cannot record into %s\n", options.directory.c_str());
+        return 1;
+    }
+
+    SinkFeeder feeder(recorder, recorder.stats(), options, "record");
+
+    std::size_t frame_size = static_cast<std::size_t>(options.kbps) * 1000 / 8 / options.fps;
+    if (frame_size < 16) frame_size = 16;
+    std::vector<char> keyframe(frame_size, 0x5A);
+    std::vector<char> inter_frame(frame_size, 0x5A);
+    keyframe[0] = 0x17;
+    keyframe[1] = 0x01;
+    inter_frame[0] = 0x27;
+    inter_frame[1] = 0x01;
+    const char avc_config[] = { 0x17, 0x00, 0x00, 0x00, 0x00, 0x01, 0x64, 0x00, 0x1F };
+    std::vector<char> sequence_header(avc_config, avc_config + sizeof(avc_config));
+
+    feeder.send_all(0, 0x09, sequence_header);
+
+    const RecorderStats& stats = recorder.stats();
+    unsigned long long produced = 0;
+    bench_clock::time_point started = bench_clock::now();
+    unsigned int frames = feeder.feed(started, [&](unsigned int frame, unsigned int stream) {
+        const std::vector<char>& body = frame % (options.fps * 2) == 0 ? keyframe : inter_frame;
+        feeder.send(stream, frame * 1000 / options.fps, 0x09, body);
+        produced += body.size();
+    });
+    feeder.unpublish_all();
+    recorder.stop();
+    sync();
+    double elapsed = std::chrono::duration<double>(bench_clock::now() - started).count();
+
+    unsigned long long written = stats.bytes_written.load();
+    double io_seconds = stats.cpu_ns.load() / 1e9;
+    double stream_bytes_per_second = options.kbps * 1000.0 / 8;
+    double recorded_seconds = static_cast<double>(frames) / options.fps;
+
+    std::printf("streams:              %u at %u kbps, %u fps, %u frame(s) each (%.1f s of media)\n",
+                options.streams, options.kbps, options.fps, frames, recorded_seconds);
+    std::printf("files:                %llu in %s\n", stats.files_opened.load(), options.directory.c_str());
+    std::printf("written:              %.1f MB (%.1f MB payload), %llu packet(s) dropped, %llu error(s)\n",
+                written / 1e6, produced / 1e6, stats.packets_dropped.load(), stats.write_errors.load());
+    std::printf("disk throughput:      %.1f MB/s over %.2f s, sync included\n", written / elapsed / 1e6, elapsed);
+    std::printf("I/O thread CPU:       %.2f s (%.0f%% of one core)\n", io_seconds, 100.0 * io_seconds / elapsed);
+    if (io_seconds > 0) {
+        std::printf("per I/O core:         %.1f MB/s, about %.0f recordings at %u kbps\n",
+                    written / io_seconds / 1e6, written / io_seconds / stream_bytes_per_second, options.kbps);
+    }
+    std::printf("disk-bound capacity:  about %.0f recordings at %u kbps\n",
+                written / elapsed / stream_bytes_per_second, options.kbps);
+
+    if (!options.keep) {
+        remove_recordings(options.directory);
+    }
+    return stats.write_errors.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+// RecvBufferBench.cpp
+// Microbenchmark for the connection receive path: bytes/sec of feeding a byte stream through
+//   - the previous approach: recv() into a stack buffer, std::vector insert, erase of the consumed prefix
+//   - RecvBuffer: reads land in the buffer's free space and the parser consumes in place
+// The "parser" consumes whole fixed-size units (think chunks) and touches one byte per unit,
+// so both sides do identical parsing work and only buffer management differs.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "RecvBuffer.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct Scenario {
+    const char* name;
+    std::size_t read_size;   // Bytes delivered per simulated recv()
+    std::size_t unit_size;   // Bytes the parser needs before it can consume anything
+};
+
+// Consumes as many whole units as are available; returns bytes consumed
+static std::size_t parse_units(const char* data, std::size_t length, std::size_t unit_size, unsigned long& checksum) {
+    std::size_t consumed = 0;
+    while (length - consumed >= unit_size) {
+        checksum += static_cast<unsigned char>(data[consumed]);
+        consumed += unit_size;
+    }
+    return consumed;
+}
+
+static double run_vector(const Scenario& scenario, const std::vector<char>& source, std::size_t total, unsigned long& checksum) {
+    std::vector<char> buffer;
+    char stack_buffer[64 * 1024];
+    std::size_t fed = 0;
+    bench_clock::time_point start = bench_clock::now();
+    while (fed < total) {
+        std::size_t offset = fed % source.size();
+        std::size_t length = scenario.read_size;
+        if (offset + length > source.size()) length = source.size() - offset;
+
+        // Stands in for recv() into the stack buffer, then the append
+        std::memcpy(stack_buffer, source.data() + offset, length);
+        buffer.insert(buffer.end(), stack_buffer, stack_buffer + length);
+        fed += length;
+
+        std::size_t consumed = parse_units(buffer.data(), buffer.size(), scenario.unit_size, checksum);
+        if (consumed > 0) {
+            buffer.erase(buffer.begin(), buffer.begin() + consumed);
+        }
+    }
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static double run_ring(const Scenario& scenario, const std::vector<char>& source, std::size_t total, unsigned long& checksum) {
+    RecvBuffer buffer;
+    std::size_t fed = 0;
+    bench_clock::time_point start = bench_clock::now();
+    while (fed < total) {
+        std::size_t offset = fed % source.size();
+        std::size_t length = scenario.read_size;
+        if (offset + length > source.size()) length = source.size() - offset;
+
+        // Stands in for recv() writing into the free space
+        if (!buffer.reserve(length)) {
+            std::fprintf(stderr, "RecvBuffer refused to grow\n");
+            std::exit(1);
+        }
+        std::memcpy(buffer.write_ptr(), source.data() + offset, length);
+        buffer.commit(length);
+        fed += length;
+
+        std::size_t consumed = parse_units(buffer.read_ptr(), buffer.readable(), scenario.unit_size, checksum);
+        buffer.consume(consumed);
+    }
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t megabytes = 512;
+    if (argc > 2 && std::strcmp(argv[1], "--megabytes") == 0) {
+        megabytes = static_cast<std::size_t>(std::atol(argv[2]));
+    } else if (argc > 1) {
+        std::printf("Usage: %s [--megabytes n]\n", argv[0]);
+        return 1;
+    }
+    std::size_t total = megabytes * 1024 * 1024;
+
+    static const Scenario scenarios[] = {
+        { "128B chunks, 1460B reads",    1460,   128 + 1 },
+        { "4KB chunks, 16KB reads",      16384,  4096 + 1 },
+        { "60KB chunks, 64KB reads",     65536,  60 * 1024 },
+        { "256KB keyframe, 4KB reads",   4096,   256 * 1024 },
+        { "1MB keyframe, 64KB reads",    65536,  1024 * 1024 },
+    };
+
+    std::vector<char> source(8 * 1024 * 1024);
+    for (std::size_t i = 0; i < source.size(); ++i) source[i] = static_cast<char>(i * 131);
+
+    RecvBuffer probe;
+    probe.reserve(RecvBuffer::INITIAL_CAPACITY + 1);
+    std::printf("RecvBuffer storage: linear up to %zu KB, then %s\n", RecvBuffer::INITIAL_CAPACITY / 1024,
+                probe.mirrored() ? "a mirrored memfd ring" : "linear");
+    std::printf("%-30s %14s %14s %9s\n", "scenario", "vector MB/s", "ring MB/s", "speedup");
+
+    for (std::size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+        const Scenario& scenario = scenarios[i];
+        unsigned long vector_sum = 0;
+        unsigned long ring_sum = 0;
+        double vector_seconds = run_vector(scenario, source, total, vector_sum);
+        double ring_seconds = run_ring(scenario, source, total, ring_sum);
+        if (vector_sum != ring_sum) {
+            std::fprintf(stderr, "Checksum mismatch in '%s'\n", scenario.name);
+            return 1;
+        }
+
+        double vector_rate = megabytes / vector_seconds;
+        double ring_rate = megabytes / ring_seconds;
+        std::printf("%-30s %14.0f %14.0f %8.2fx\n", scenario.name, vector_rate, ring_rate, ring_rate / vector_rate);
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+// ResponseBench.cpp
+// Command replies per second, queued on a Connection whose output is thrown away. For each
+// reply two rows:
+//   - rebuilt:   the AMF body written field by field, then split into chunks, on every call
+//                (how every reply was sent before templates)
+//   - template:  the prebuilt wire form copied and the IDs patched in place
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "BenchClient.h"
+#include "Connection.h"
+#include "Log.h"
+#include "NullBackend.h"
+#include "ParseAMF.h"
+#include "Worker.h"
+
+static const unsigned int DRAIN_EVERY = 64;  // Replies queued between discards
+
+enum Reply {
+    REPLY_CONNECT,
+    REPLY_CREATE_STREAM,
+    REPLY_ON_STATUS
+};
+
+static void send_rebuilt(Connection& conn, Reply reply, double transaction_id) {
+    PooledBytes body;
+    if (reply == REPLY_CONNECT) {
+        ParseAMF::build_connect_body(body, false, transaction_id);
+        conn.send_message(3, 0, 0x14, 0, body.data(), body.size());
+    } else if (reply == REPLY_CREATE_STREAM) {
+        ParseAMF::build_create_stream_body(body, false, transaction_id);
+        conn.send_message(3, 0, 0x14, 0, body.data(), body.size());
+    } else {
+        ParseAMF::build_on_status_body(body, false, "status", "NetStream.Play.Start", "Playback started.");
+        conn.send_message(5, 0, 0x14, 1, body.data(), body.size());
+    }
+}
+
+static void send_template(Connection& conn, Reply reply, double transaction_id) {
+    if (reply == REPLY_CONNECT) {
+        ParseAMF::send_connect_response(conn, transaction_id);
+    } else if (reply == REPLY_CREATE_STREAM) {
+        ParseAMF::send_create_stream_response(conn, transaction_id);
+    } else {
+        ParseAMF::send_on_status_play(conn, 1);
+    }
+}
+
+static double replies_per_second(Reply reply, bool use_template, unsigned int count) {
+    NullBackend backend;
+    Worker worker(0);
+    Connection conn(RTMP_INVALID_SOCKET, "127.0.0.1", &backend, &worker);
+
+    bench_clock::time_point start = bench_clock::now();
+    for (unsigned int i = 0; i < count; ++i) {
+        double transaction_id = static_cast<double>(i % 1000 + 1);
+        if (use_template) {
+            send_template(conn, reply, transaction_id);
+        } else {
+            send_rebuilt(conn, reply, transaction_id);
+        }
+        if (i % DRAIN_EVERY == DRAIN_EVERY - 1) {
+            discard_output(conn);
+        }
+    }
+    discard_output(conn);
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+    return count / seconds;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int count = 1000000;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--replies") == 0 && i + 1 < argc) {
+            count = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "Usage: %s [--replies <n per row>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (count == 0) {
+        return 1;
+    }
+    Log::set_level(Log::LEVEL_OFF);
+
+    static const char* names[] = { "connect", "createStream", "onStatus" };
+    std::printf("%-14s %16s %16s %9s\n", "reply", "rebuilt/sec", "template/sec", "speedup");
+    for (int reply = REPLY_CONNECT; reply <= REPLY_ON_STATUS; ++reply) {
+        replies_per_second(static_cast<Reply>(reply), false, count / 10);  // Warm up
+        double rebuilt = replies_per_second(static_cast<Reply>(reply), false, count);
+        double templated = replies_per_second(static_cast<Reply>(reply), true, count);
+        std::printf("%-14s %16.0f %16.0f %8.1fx\n", names[reply], rebuilt, templated, templated / rebuilt);
+    }
+    return 0;
+}
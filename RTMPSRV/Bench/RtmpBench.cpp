@@ -0,0 +1,294 @@
+// RtmpBench.cpp
+// Microbenchmarks for the parsing and encoding hot paths, over the fixed corpora in
+// Bench/corpus (see Corpus.h). Every case runs a calibrated number of operations per
+// repetition and reports the median, so numbers from different commits on one machine can
+// be compared directly; --csv prints them in a form that diffs cleanly.
+//
+//   parse/*      whole publish sessions through Connection::on_data in 64 KB reads: chunk
+//                demultiplexing, reassembly, command handling, media packets for the hub
+//   amf0/*, amf3/*  decoding the command corpora, and encoding replies with the AMF writers
+//   header/*     one chunk header; chunk/* one message split into chunks
+//   handshake/*  C0+C1 in, S0+S1+S2 queued
+//   recv/*       RecvBuffer fed 4 KB reads and consumed like the parser does
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "AMF0.h"
+#include "ChunkCache.h"
+#include "Connection.h"
+#include "Corpus.h"
+#include "Log.h"
+#include "NullBackend.h"
+#include "ParseAMF.h"
+#include "ParseUtils.h"
+#include "RecvBuffer.h"
+#include "ServerConfig.h"
+#include "StreamHub.h"
+#include "Worker.h"
+
+#ifndef RTMP_BENCH_CORPUS_DIR
+#define RTMP_BENCH_CORPUS_DIR "Bench/corpus"
+#endif
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct BenchOptions {
+    std::string corpus_dir;
+    std::string filter;
+    double min_time;          // Seconds per repetition
+    unsigned int repetitions;
+    bool csv;
+    bool list;
+};
+
+// One operation; returns the bytes it processed, or 0 where throughput means nothing
+typedef std::function<std::size_t()> BenchOperation;
+
+struct BenchCase {
+    std::string name;
+    BenchOperation operation;
+};
+
+struct BenchResult {
+    unsigned long long iterations;
+    double ns_per_op;      // Median over repetitions
+    double spread;         // (slowest - fastest) / median
+    double bytes_per_op;
+};
+
+static double run_for(const BenchOperation& operation, unsigned long long iterations, std::size_t& bytes) {
+    bytes = 0;
+    bench_clock::time_point start = bench_clock::now();
+    for (unsigned long long i = 0; i < iterations; ++i) {
+        bytes += operation();
+    }
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static BenchResult measure(const BenchOperation& operation, const BenchOptions& options) {
+    // Grow the iteration count until one batch takes a tenth of the target, then scale
+    std::size_t bytes;
+    unsigned long long iterations = 1;
+    double seconds = run_for(operation, iterations, bytes);
+    while (seconds < options.min_time / 10) {
+        iterations *= seconds < options.min_time / 1000 ? 10 : 2;
+        seconds = run_for(operation, iterations, bytes);
+    }
+    iterations = static_cast<unsigned long long>(iterations * options.min_time / seconds) + 1;
+
+    std::vector<double> samples;
+    for (unsigned int r = 0; r < options.repetitions; ++r) {
+        samples.push_back(run_for(operation, iterations, bytes) * 1e9 / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.iterations = iterations;
+    result.ns_per_op = samples[samples.size() / 2];
+    result.spread = (samples.back() - samples.front()) / result.ns_per_op;
+    result.bytes_per_op = static_cast<double>(bytes) / iterations;
+    return result;
+}
+
+static bool parse_options(int argc, char* argv[], BenchOptions& options, std::string& write_dir) {
+    options.corpus_dir = RTMP_BENCH_CORPUS_DIR;
+    options.min_time = 0.5;
+    options.repetitions = 5;
+    options.csv = false;
+    options.list = false;
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--corpus") == 0 && has_value) {
+            options.corpus_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--filter") == 0 && has_value) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && has_value) {
+            options.min_time = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && has_value) {
+            options.repetitions = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--write-corpus") == 0 && has_value) {
+            write_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--csv") == 0) {
+            options.csv = true;
+        } else if (std::strcmp(argv[i], "--list") == 0) {
+            options.list = true;
+        } else {
+            std::fprintf(stderr,
+                         "Usage: %s [--filter <substring>] [--min-time <seconds>] [--repetitions <n>] [--csv]\n"
+                         "          [--list] [--corpus <dir>] [--write-corpus <dir>]\n", argv[0]);
+            return false;
+        }
+    }
+    return options.min_time > 0 && options.repetitions > 0;
+}
+
+// C0+C1 and C2 a client sends before its first chunk
+static Bytes client_handshake() {
+    Bytes bytes(1 + 1536 + 1536, 0);
+    bytes[0] = 0x03;
+    return bytes;
+}
+
+// A fresh connection per session, fed in reads of roughly what one recv returns
+static std::size_t run_session(Worker& worker, NullBackend& backend, const Bytes& handshake, const Bytes& session) {
+    const std::size_t read_size = 64 * 1024;
+    Connection conn(RTMP_INVALID_SOCKET, "127.0.0.1", &backend, &worker);
+    conn.on_data(handshake.data(), handshake.size());
+    discard_output(conn);
+    for (std::size_t offset = 0; offset < session.size(); offset += read_size) {
+        std::size_t length = std::min(read_size, session.size() - offset);
+        if (!conn.on_data(session.data() + offset, length)) {
+            break;
+        }
+        discard_output(conn);
+    }
+    return session.size();
+}
+
+static std::size_t decode_all(const std::vector<Bytes>& records, AMFDocument& document) {
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        AMF0::decode(records[i].data(), records[i].size(), document);
+        bytes += records[i].size();
+    }
+    return bytes;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    std::string write_dir;
+    if (!parse_options(argc, argv, options, write_dir)) {
+        return 1;
+    }
+
+    if (!write_dir.empty()) {
+        for (std::size_t i = 0; i < sizeof(CORPUS_FILES) / sizeof(CORPUS_FILES[0]); ++i) {
+            std::string path = write_dir + "/" + CORPUS_FILES[i].name;
+            Bytes data = CORPUS_FILES[i].build();
+            if (!write_corpus(path, data)) {
+                std::fprintf(stderr, "Cannot write %s\n", path.c_str());
+                return 1;
+            }
+            std::printf("%s: %zu bytes\n", path.c_str(), data.size());
+        }
+        return 0;
+    }
+
+    Bytes publish_4096, publish_128, amf0_data, amf3_data;
+    std::vector<Bytes> amf0_records, amf3_records;
+    if (!read_corpus(options.corpus_dir + "/publish_chunk4096.bin", publish_4096) ||
+        !read_corpus(options.corpus_dir + "/publish_chunk128.bin", publish_128) ||
+        !read_corpus(options.corpus_dir + "/commands_amf0.bin", amf0_data) ||
+        !read_corpus(options.corpus_dir + "/commands_amf3.bin", amf3_data) ||
+        !split_records(amf0_data, amf0_records) || !split_records(amf3_data, amf3_records)) {
+        std::fprintf(stderr, "Missing or malformed corpus in %s (see --corpus, --write-corpus)\n", options.corpus_dir.c_str());
+        return 1;
+    }
+
+    Log::set_level(Log::LEVEL_OFF);
+    // Publishing sessions need a hub; with no players, media stops after the GOP cache
+    ServerConfig config;
+    StreamHub hub(1, config.gop_cache_bytes);
+    NullBackend backend;
+    Worker worker(0);
+    if (!worker.attach(config, &hub)) {
+        return 1;
+    }
+    Bytes handshake = client_handshake();
+    AMFDocument document;
+    Bytes payload(6000);
+    for (std::size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<char>(i * 31);
+    Bytes c0c1(handshake.begin(), handshake.begin() + 1537);
+    Bytes reads(publish_4096.begin(), publish_4096.begin() + std::min<std::size_t>(publish_4096.size(), 256 * 1024));
+    std::size_t read_offset = 0;
+    RecvBuffer recv_buffer;
+
+    std::vector<BenchCase> cases;
+    cases.push_back(BenchCase{ "parse/publish_chunk4096", [&]() {
+        return run_session(worker, backend, handshake, publish_4096);
+    } });
+    cases.push_back(BenchCase{ "parse/publish_chunk128", [&]() {
+        return run_session(worker, backend, handshake, publish_128);
+    } });
+    cases.push_back(BenchCase{ "amf0/decode_commands", [&]() {
+        return decode_all(amf0_records, document);
+    } });
+    cases.push_back(BenchCase{ "amf3/decode_commands", [&]() {
+        return decode_all(amf3_records, document);
+    } });
+    cases.push_back(BenchCase{ "amf0/encode_connect_result", [&]() {
+        PooledBytes body;
+        ParseAMF::build_connect_body(body, false, 1.0);
+        return body.size();
+    } });
+    cases.push_back(BenchCase{ "amf0/encode_on_status", [&]() {
+        PooledBytes body;
+        ParseAMF::build_on_status_body(body, false, "status", "NetStream.Play.Start", "Playback started.");
+        return body.size();
+    } });
+    cases.push_back(BenchCase{ "amf3/encode_connect_result", [&]() {
+        PooledBytes body;
+        ParseAMF::build_connect_body(body, true, 1.0);
+        return body.size();
+    } });
+    cases.push_back(BenchCase{ "header/build_rtmp_header", [&]() {
+        char header[16];
+        return Parses::build_rtmp_header(0, 6, 40, 6000, 0x09, 1, header);
+    } });
+    cases.push_back(BenchCase{ "chunk/split_6000_at_128", [&]() {
+        ChunkedMessage message(payload.data(), payload.size(), 40, 0x09, 128, 6, 1);
+        return message.total_length();
+    } });
+    cases.push_back(BenchCase{ "chunk/split_6000_at_4096", [&]() {
+        ChunkedMessage message(payload.data(), payload.size(), 40, 0x09, 4096, 6, 1);
+        return message.total_length();
+    } });
+    cases.push_back(BenchCase{ "handshake/c0c1_to_s0s1s2", [&]() {
+        Connection conn(RTMP_INVALID_SOCKET, "127.0.0.1", &backend, &worker);
+        conn.on_data(c0c1.data(), c0c1.size());
+        discard_output(conn);
+        return c0c1.size();
+    } });
+    cases.push_back(BenchCase{ "recv/4k_reads", [&]() {
+        // Whole chunks of the 4096 session leave a partial one behind, as the parser does
+        const std::size_t read_size = 4096;
+        const std::size_t unit_size = 4096 + 12;
+        if (read_offset + read_size > reads.size()) read_offset = 0;
+        recv_buffer.append(reads.data() + read_offset, read_size);
+        read_offset += read_size;
+        std::size_t whole = recv_buffer.readable() - recv_buffer.readable() % unit_size;
+        if (whole > 0) recv_buffer.consume(whole);
+        return read_size;
+    } });
+
+    if (!options.csv && !options.list) {
+        std::printf("%-28s %12s %14s %10s %8s\n", "benchmark", "iterations", "ns/op", "MB/s", "spread");
+    } else if (options.csv) {
+        std::printf("benchmark,iterations,ns_per_op,mb_per_s\n");
+    }
+    for (std::size_t i = 0; i < cases.size(); ++i) {
+        if (!options.filter.empty() && cases[i].name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        if (options.list) {
+            std::printf("%s\n", cases[i].name.c_str());
+            continue;
+        }
+        BenchResult result = measure(cases[i].operation, options);
+        double mb_per_s = result.bytes_per_op > 0 ? result.bytes_per_op / result.ns_per_op * 1e3 : 0.0;
+        if (options.csv) {
+            std::printf("%s,%llu,%.1f,%.1f\n", cases[i].name.c_str(), result.iterations, result.ns_per_op, mb_per_s);
+        } else {
+            std::printf("%-28s %12llu %14.1f %10.1f %7.1f%%\n", cases[i].name.c_str(), result.iterations,
+                        result.ns_per_op, mb_per_s, result.spread * 100);
+        }
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+// SinkBench.h
+// Feeding harness shared by the benchmarks of QueuedSink subclasses. N streams are published
+// to the sink and fed one frame per stream in turn, as interleaved publishers would deliver
+// them, by default as fast as the sink's thread takes them: the producer only backs off to
+// keep the queue below its drop limit.
+#ifndef SINKBENCH_H
+#define SINKBENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Metrics.h"
+#include "QueuedSink.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Options every sink benchmark takes
+struct SinkOptions {
+    unsigned int streams;
+    unsigned int kbps;
+    unsigned int fps;
+    double seconds;
+    bool realtime;  // Feed frames at their media rate instead
+
+    explicit SinkOptions(unsigned int default_kbps)
+        : streams(100),
+          kbps(default_kbps),
+          fps(30),
+          seconds(5.0),
+          realtime(false) {}
+};
+
+static const char SINK_OPTIONS_USAGE[] = "[--streams n] [--kbps n] [--fps n] [--seconds s]";
+
+// Takes argv[i], and its value, when it is one of the common options
+static inline bool parse_sink_option(int argc, char* argv[], int& i, SinkOptions& options) {
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--streams") == 0 && has_value) {
+        options.streams = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--kbps") == 0 && has_value) {
+        options.kbps = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--fps") == 0 && has_value) {
+        options.fps = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {
+        options.seconds = std::atof(argv[++i]);
+    } else {
+        return false;
+    }
+    if (options.streams == 0) options.streams = 1;
+    if (options.fps == 0) options.fps = 30;
+    if (options.kbps == 0) options.kbps = 1;
+    return true;
+}
+
+static inline MediaPacketPtr make_packet(unsigned long long sequence, unsigned int timestamp, unsigned char type,
+                                         const std::vector<char>& body) {
+    std::shared_ptr<MediaPacket> packet = std::make_shared<MediaPacket>();
+    packet->sequence = sequence;
+    packet->timestamp = timestamp;
+    packet->message_type_id = type;
+    packet->ingest_ns = Metrics::now_ns();
+    packet->payload.resize(body.size());
+    std::memcpy(packet->payload.data(), body.data(), body.size());
+    return packet;
+}
+
+// The published streams, numbered like a hub would number their packets
+class SinkFeeder {
+public:
+    SinkFeeder(QueuedSink& sink, const QueuedSinkStats& stats, const SinkOptions& options, const char* key_prefix)
+        : sink_(sink), stats_(stats), options_(options), sequences_(options.streams, 0) {
+        for (unsigned int i = 0; i < options.streams; ++i) {
+            char key[32];
+            std::snprintf(key, sizeof(key), "live/%s%u", key_prefix, i);
+            streams_.push_back(std::unique_ptr<Stream>(new Stream(key, 1, 0)));
+            sink_.on_publish(*streams_.back());
+        }
+    }
+
+    // Queues one packet of every stream
+    void send_all(unsigned int timestamp, unsigned char type, const std::vector<char>& body) {
+        for (unsigned int i = 0; i < options_.streams; ++i) {
+            send(i, timestamp, type, body);
+        }
+    }
+
+    void send(unsigned int stream, unsigned int timestamp, unsigned char type, const std::vector<char>& body) {
+        sink_.on_media(*streams_[stream], make_packet(sequences_[stream]++, timestamp, type, body));
+    }
+
+    // Calls produce(frame, stream) for one frame of every stream in turn until the run is
+    // over, and returns how many frames that was
+    template <typename Produce>
+    unsigned int feed(bench_clock::time_point started, Produce produce) {
+        unsigned int frame = 0;
+        while (std::chrono::duration<double>(bench_clock::now() - started).count() < options_.seconds) {
+            if (options_.realtime) {
+                std::this_thread::sleep_until(started + std::chrono::milliseconds(frame * 1000ull / options_.fps));
+            }
+            for (unsigned int i = 0; i < options_.streams; ++i) {
+                while (stats_.queued_bytes.load(std::memory_order_relaxed) > QueuedSink::MAX_QUEUE_BYTES / 2) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+                produce(frame, i);
+            }
+            ++frame;
+        }
+        return frame;
+    }
+
+    void unpublish_all() {
+        for (unsigned int i = 0; i < options_.streams; ++i) {
+            sink_.on_unpublish(*streams_[i]);
+        }
+    }
+
+private:
+    QueuedSink& sink_;
+    const QueuedSinkStats& stats_;
+    const SinkOptions& options_;
+    std::vector<std::unique_ptr<Stream> > streams_;
+    std::vector<unsigned long long> sequences_;
+};
+
+#endif // SINKBENCH_H
@@ -1,40 +1,174 @@
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <thread>
 #include "Client.h"        // RTMP server
+#include "Log.h"
+#include "ParseControl.h"  // For MAX_OUT_CHUNK_SIZE
 
 // Global instance of the RTMP server
 RTMPServer server;
 
+// Set by the signal handler, which must not log; main() reports it once run() returns
+volatile std::sig_atomic_t sigint_received = 0;
+
 // Signal handler for graceful shutdown
 void signal_handler(int signal) {
     if (signal == SIGINT) {
-        std::cout << "SIGINT received. Stopping server..." << std::endl;
+        sigint_received = 1;
         server.stop();  // Gracefully stop the server
     }
 }
 
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --port <n>       TCP port to listen on (default 1935)\n"
+              << "  --workers <n>    Event loop threads, 0 = one per core (default 0)\n"
+              << "  --pin            Pin each worker thread to its own CPU (Linux)\n"
+              << "  --io-backend <b> epoll or io_uring (falls back to epoll if unsupported)\n"
+              << "  --log-level <l>  debug, info, warn, error or off (default info; debug needs a\n"
+              << "                   build configured with -DRTMP_DEBUG_LOG=ON)\n"
+              << "  --gop-cache <kb> Per-stream GOP cache for instant play start, 0 = off (default 16384)\n"
+              << "  --max-send-queue <kb>\n"
+              << "                   Unsent output after which a slow player is dropped (default 16384);\n"
+              << "                   video is skipped from a quarter of it and audio from half\n"
+              << "  --chunk-size <n> Outbound chunk size announced to clients, 128-65536 (default 4096)\n"
+              << "  --ack-window <n> Bytes between acknowledgements, both ways (default 5000000); a player\n"
+              << "                   that acknowledges may run at most twice this ahead of its acks\n"
+              << "  --handshake-timeout <ms>\n"
+              << "                   Drop connections that have not completed the handshake by then,\n"
+              << "                   0 = never (default 10000)\n"
+              << "  --metrics-port <n>\n"
+              << "                   Serve Prometheus metrics over HTTP at /metrics (default off)\n"
+              << "  --record-dir <path>\n"
+              << "                   Record every published stream as FLV files in this directory\n"
+              << "  --record-max-mb <n>\n"
+              << "                   Start a new file at the next keyframe past this size, 0 = never (default 0)\n"
+              << "  --record-max-seconds <n>\n"
+              << "                   Or past this duration, 0 = never (default 3600)\n"
+              << "  --vod-dir <path>  Play FLV files from this directory: \"play name\" finds <app>/<name>.flv\n"
+              << "                   or <name>.flv, unless the client asks for live or the stream is live\n"
+              << "  --http-port <n>  Serve HTTP on this port too, from the same workers (default off);\n"
+              << "                   live streams play as HTTP-FLV at /<app>/<name>.flv\n"
+              << "  --hls            Package every published H.264/AAC stream as HLS, served over\n"
+              << "                   --http-port at /<app>/<name>.m3u8\n"
+              << "  --hls-segment-seconds <n>\n"
+              << "                   Cut segments at the first keyframe past this duration (default 2)\n"
+              << "  --hls-window <n> Segments listed in each playlist (default 6)\n";
+}
 
+// Parse command line options into the server configuration
+static bool parse_arguments(int argc, char* argv[], ServerConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+            config.port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--workers") == 0 && has_value) {
+            config.workers = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--gop-cache") == 0 && has_value) {
+            config.gop_cache_bytes = static_cast<std::size_t>(std::atol(argv[++i])) * 1024;
+        } else if (std::strcmp(argv[i], "--max-send-queue") == 0 && has_value) {
+            std::size_t limit = static_cast<std::size_t>(std::atol(argv[++i])) * 1024;
+            config.backpressure.disconnect_bytes = limit;
+            config.backpressure.drop_audio_bytes = limit / 2;
+            config.backpressure.drop_inter_frames_bytes = limit / 4;
+        } else if (std::strcmp(argv[i], "--chunk-size") == 0 && has_value) {
+            long size = std::atol(argv[++i]);
+            if (size < 128 || size > static_cast<long>(ParseControl::MAX_OUT_CHUNK_SIZE)) {
+                print_usage(argv[0]);
+                return false;
+            }
+            config.chunk_size = static_cast<std::size_t>(size);
+        } else if (std::strcmp(argv[i], "--ack-window") == 0 && has_value) {
+            long window = std::atol(argv[++i]);
+            if (window < 4096 || window > 0x7FFFFFFF) {
+                print_usage(argv[0]);
+                return false;
+            }
+            config.ack_window = static_cast<unsigned int>(window);
+        } else if (std::strcmp(argv[i], "--handshake-timeout") == 0 && has_value) {
+            config.handshake_timeout_ms = static_cast<unsigned int>(std::atol(argv[++i]));
+        } else if (std::strcmp(argv[i], "--metrics-port") == 0 && has_value) {
+            config.metrics_port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--record-dir") == 0 && has_value) {
+            config.record_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--record-max-mb") == 0 && has_value) {
+            config.record_max_bytes = static_cast<unsigned long long>(std::atol(argv[++i])) * 1024 * 1024;
+        } else if (std::strcmp(argv[i], "--record-max-seconds") == 0 && has_value) {
+            config.record_max_seconds = static_cast<unsigned int>(std::atol(argv[++i]));
+        } else if (std::strcmp(argv[i], "--vod-dir") == 0 && has_value) {
+            config.vod_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--http-port") == 0 && has_value) {
+            config.http_port = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--hls") == 0) {
+            config.hls = true;
+        } else if (std::strcmp(argv[i], "--hls-segment-seconds") == 0 && has_value) {
+            config.hls_segment_ms = static_cast<unsigned int>(std::atof(argv[++i]) * 1000);
+        } else if (std::strcmp(argv[i], "--hls-window") == 0 && has_value) {
+            config.hls_window = static_cast<unsigned int>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--log-level") == 0 && has_value) {
+            Log::Level level;
+            if (!Log::parse_level(argv[++i], level)) {
+                print_usage(argv[0]);
+                return false;
+            }
+            Log::set_level(level);
+        } else if (std::strcmp(argv[i], "--pin") == 0) {
+            config.pin_workers = true;
+        } else if (std::strcmp(argv[i], "--io-backend") == 0 && has_value) {
+            const char* backend = argv[++i];
+            if (std::strcmp(backend, "io_uring") == 0) {
+                config.backend = ServerConfig::BACKEND_IO_URING;
+            } else if (std::strcmp(backend, "epoll") == 0) {
+                config.backend = ServerConfig::BACKEND_EPOLL;
+            } else {
+                print_usage(argv[0]);
+                return false;
+            }
+        } else {
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+    if (config.hls && config.http_port <= 0) {
+        std::cerr << "--hls needs --http-port to serve the playlists from.\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    ServerConfig config;
+    if (!parse_arguments(argc, argv, config)) {
+        return 1;
+    }
 
-int main() {
     // Register the signal handler for SIGINT (Ctrl+C)
     std::signal(SIGINT, signal_handler);
 
+    // Workers log through per-thread rings from here on
+    Log::start();
 
     // Attempt to start the server
-    std::cout << "Attempting to start RTMP server on port 1935..." << std::endl;
-    if (server.start(1935)) {
-        std::cout << "RTMP server successfully started on port 1935." << std::endl;
+    LOG_INFO("Attempting to start RTMP server on port " << config.port << "...");
+    if (server.start(config)) {
+        LOG_INFO("RTMP server successfully started on port " << config.port << ".");
 
         // Main loop to run the server
-        std::cout << "Running the RTMP server..." << std::endl;
+        LOG_INFO("Running the RTMP server...");
         server.run();  // This will block until the server is stopped
+        if (sigint_received) {
+            LOG_INFO("Stopped by SIGINT.");
+        }
     } else {
-        std::cerr << "Failed to start the RTMP server on port 1935." << std::endl;
+        LOG_ERROR("Failed to start the RTMP server on port " << config.port << ".");
+        Log::stop();
         return 1;  // Exit with error code
     }
 
 
-    std::cout << "RTMP server stopped." << std::endl;
+    LOG_INFO("RTMP server stopped.");
+    Log::stop();
     return 0;  // Exit gracefully
 }
@@ -0,0 +1,51 @@
+#include "AMF.h"
+
+std::size_t AMFDocument::add(AMFType type) {
+    AMFValue value;
+    value.type = type;
+    value.next = 0;
+    value.count = 0;
+    value.key.data = "";
+    value.key.length = 0;
+    value.string = value.key;
+    value.number = 0.0;
+    values_.push_back(value);
+    return values_.size() - 1;
+}
+
+bool AMFDocument::copy(std::size_t first, std::size_t end, std::size_t& slot) {
+    if (values_.size() + (end - first) > MAX_VALUES) {
+        return false;
+    }
+    slot = values_.size();
+    for (std::size_t i = first; i < end; ++i) {
+        AMFValue value = values_[i];
+        // Sibling links inside the subtree move with it; the root's own link does not
+        value.next = i == first || value.next == 0 ? 0 : static_cast<unsigned int>(value.next - first + slot);
+        values_.push_back(value);
+    }
+    return true;
+}
+
+const AMFValue* AMFDocument::property(const AMFValue* object, const char* key) const {
+    if (!object || !object->is_object()) {
+        return nullptr;
+    }
+    for (const AMFValue* child = first_child(*object); child; child = next_sibling(*child)) {
+        if (child->key.equals(key)) {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+const AMFValue* AMFDocument::element(const AMFValue* array, std::size_t index) const {
+    if (!array || array->type != AMF_STRICT_ARRAY || index >= array->count) {
+        return nullptr;
+    }
+    const AMFValue* child = first_child(*array);
+    while (index-- > 0) {
+        child = next_sibling(*child);
+    }
+    return child;
+}
@@ -0,0 +1,148 @@
+#ifndef AMF_H
+#define AMF_H
+
+#include <cstddef> // For std::size_t
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Log.h"
+
+// Bytes inside a decoded message; valid only while that message's payload is
+struct AMFString {
+    const char* data;
+    std::size_t length;
+
+    bool empty() const { return length == 0; }
+    bool equals(const char* text) const {
+        return std::strlen(text) == length && std::memcmp(data, text, length) == 0;
+    }
+    std::string str() const { return std::string(data, length); }
+};
+
+inline LogLine& operator<<(LogLine& line, const AMFString& value) {
+    return line.append(value.data, value.length);
+}
+
+enum AMFType {
+    AMF_NUMBER,
+    AMF_BOOLEAN,
+    AMF_STRING,         // Long strings too
+    AMF_OBJECT,
+    AMF_NULL,
+    AMF_UNDEFINED,
+    AMF_ECMA_ARRAY,
+    AMF_STRICT_ARRAY,
+    AMF_DATE
+};
+
+// One node of a decoded value tree. Nodes are stored depth first, so an object's or
+// array's first child directly follows it and the rest are reached through next.
+struct AMFValue {
+    AMFType type;
+    unsigned int next;   // Index of the next sibling, 0 for the last one
+    unsigned int count;  // Children of objects and arrays
+    AMFString key;       // Property name inside objects and ECMA arrays
+    AMFString string;    // String contents
+    double number;       // Numbers, booleans as 0 or 1, dates as milliseconds since the epoch
+
+    bool is_number() const { return type == AMF_NUMBER; }
+    bool is_string() const { return type == AMF_STRING; }
+    bool is_object() const { return type == AMF_OBJECT || type == AMF_ECMA_ARRAY; }
+};
+
+// AMF3 reference tables for one AMF3 context: values sent in full once and referred to by
+// position afterwards. Plain vectors indexed by that position, reused across messages.
+struct AMF3Tables {
+    // Object traits: class name, sealed member names and whether dynamic members follow
+    struct Traits {
+        AMFString class_name;
+        std::size_t first_member;  // Into member_names
+        std::size_t member_count;
+        bool dynamic;
+    };
+    // Nodes of a complex value already decoded; end stays 0 until it is complete
+    struct Complex {
+        std::size_t first;
+        std::size_t end;
+    };
+
+    std::vector<AMFString> strings;
+    std::vector<Complex> complex;
+    std::vector<Traits> traits;
+    std::vector<AMFString> member_names;
+
+    void clear() {
+        strings.clear();
+        complex.clear();
+        traits.clear();
+        member_names.clear();
+    }
+};
+
+// Flat arena holding the values of one message. Decoders append to it; clearing keeps the
+// storage, so a document reused across messages stops allocating once it has seen the
+// largest command.
+class AMFDocument {
+public:
+    // Caps the nodes one message may expand to, since AMF3 references copy whole subtrees
+    static const std::size_t MAX_VALUES = 1 << 16;
+
+    AMFDocument() {}
+
+    void clear() {
+        values_.clear();
+        roots_.clear();
+        amf3_.clear();
+    }
+
+    // Top-level values in message order: command name, transaction ID, arguments
+    std::size_t root_count() const { return roots_.size(); }
+    const AMFValue* root(std::size_t index) const {
+        return index < roots_.size() ? &values_[roots_[index]] : nullptr;
+    }
+
+    const AMFValue* first_child(const AMFValue& value) const {
+        return value.count > 0 ? &value + 1 : nullptr;
+    }
+    const AMFValue* next_sibling(const AMFValue& value) const {
+        return value.next != 0 ? &values_[value.next] : nullptr;
+    }
+
+    // Property of an object or ECMA array, or null
+    const AMFValue* property(const AMFValue* object, const char* key) const;
+    // Element of a strict array, or null
+    const AMFValue* element(const AMFValue* array, std::size_t index) const;
+
+    // Helpers for arguments that may be missing or of the wrong type
+    static double number_or(const AMFValue* value, double fallback) {
+        return value && value->type == AMF_NUMBER ? value->number : fallback;
+    }
+    static bool boolean_or(const AMFValue* value, bool fallback) {
+        return value && value->type == AMF_BOOLEAN ? value->number != 0.0 : fallback;
+    }
+    static AMFString string_or_empty(const AMFValue* value) {
+        AMFString empty = { "", 0 };
+        return value && value->type == AMF_STRING ? value->string : empty;
+    }
+
+    // Used by decoders while building. Indices stay valid while values are appended;
+    // references do not.
+    std::size_t add(AMFType type);
+    AMFValue& at(std::size_t index) { return values_[index]; }
+    std::size_t size() const { return values_.size(); }
+    void add_root(std::size_t index) { roots_.push_back(static_cast<unsigned int>(index)); }
+    void truncate(std::size_t size) { values_.resize(size); }
+    // Appends a copy of the complete subtree in [first, end); false past MAX_VALUES
+    bool copy(std::size_t first, std::size_t end, std::size_t& slot);
+    AMF3Tables& amf3_tables() { return amf3_; }
+
+private:
+    AMFDocument(const AMFDocument&);
+    AMFDocument& operator=(const AMFDocument&);
+
+    std::vector<AMFValue> values_;
+    std::vector<unsigned int> roots_;
+    AMF3Tables amf3_;
+};
+
+#endif // AMF_H
@@ -0,0 +1,180 @@
+#include "AMF0.h"
+#include "AMF3.h"
+#include <cstdint>
+
+namespace {
+
+enum Marker {
+    MARKER_NUMBER = 0x00,
+    MARKER_BOOLEAN = 0x01,
+    MARKER_STRING = 0x02,
+    MARKER_OBJECT = 0x03,
+    MARKER_NULL = 0x05,
+    MARKER_UNDEFINED = 0x06,
+    MARKER_ECMA_ARRAY = 0x08,
+    MARKER_OBJECT_END = 0x09,
+    MARKER_STRICT_ARRAY = 0x0A,
+    MARKER_DATE = 0x0B,
+    MARKER_LONG_STRING = 0x0C,
+    MARKER_AVMPLUS = 0x11
+};
+
+unsigned int read_u16(const char* data) {
+    return (static_cast<unsigned char>(data[0]) << 8) | static_cast<unsigned char>(data[1]);
+}
+
+unsigned int read_u32(const char* data) {
+    return (static_cast<unsigned int>(static_cast<unsigned char>(data[0])) << 24) |
+           (static_cast<unsigned char>(data[1]) << 16) |
+           (static_cast<unsigned char>(data[2]) << 8) |
+           static_cast<unsigned char>(data[3]);
+}
+
+double read_double(const char* data) {
+    uint64_t bits = (static_cast<uint64_t>(read_u32(data)) << 32) | read_u32(data + 4);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Walks one message; index always points at the next unread byte
+struct Reader {
+    const char* data;
+    std::size_t length;
+    std::size_t index;
+    AMFDocument& document;
+
+    bool has(std::size_t bytes) const { return length - index >= bytes; }
+
+    bool value(std::size_t& slot, unsigned int depth);
+    bool properties(std::size_t parent, unsigned int depth, bool end_optional);
+};
+
+// Decodes the value at index into a new node and stores its position in slot
+bool Reader::value(std::size_t& slot, unsigned int depth) {
+    if (!has(1) || depth > AMF0::MAX_DEPTH) {
+        return false;
+    }
+    unsigned char marker = static_cast<unsigned char>(data[index++]);
+    switch (marker) {
+        case MARKER_NUMBER:
+            if (!has(8)) return false;
+            slot = document.add(AMF_NUMBER);
+            document.at(slot).number = read_double(data + index);
+            index += 8;
+            return true;
+        case MARKER_BOOLEAN:
+            if (!has(1)) return false;
+            slot = document.add(AMF_BOOLEAN);
+            document.at(slot).number = data[index++] != 0 ? 1.0 : 0.0;
+            return true;
+        case MARKER_STRING:
+        case MARKER_LONG_STRING: {
+            std::size_t prefix = marker == MARKER_STRING ? 2 : 4;
+            if (!has(prefix)) return false;
+            std::size_t size = prefix == 2 ? read_u16(data + index) : read_u32(data + index);
+            index += prefix;
+            if (!has(size)) return false;
+            slot = document.add(AMF_STRING);
+            document.at(slot).string.data = data + index;
+            document.at(slot).string.length = size;
+            index += size;
+            return true;
+        }
+        case MARKER_NULL:
+            slot = document.add(AMF_NULL);
+            return true;
+        case MARKER_UNDEFINED:
+            slot = document.add(AMF_UNDEFINED);
+            return true;
+        case MARKER_OBJECT:
+            slot = document.add(AMF_OBJECT);
+            return properties(slot, depth, false);
+        case MARKER_ECMA_ARRAY:
+            // The count is only a hint; properties run to the end marker like an object's.
+            // Some encoders leave the marker off metadata at the end of the message.
+            if (!has(4)) return false;
+            index += 4;
+            slot = document.add(AMF_ECMA_ARRAY);
+            return properties(slot, depth, true);
+        case MARKER_STRICT_ARRAY: {
+            if (!has(4)) return false;
+            std::size_t count = read_u32(data + index);
+            index += 4;
+            if (count > length - index) return false;  // Every element takes at least a byte
+            slot = document.add(AMF_STRICT_ARRAY);
+            std::size_t previous = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                std::size_t child;
+                if (!value(child, depth + 1)) return false;
+                if (i > 0) document.at(previous).next = static_cast<unsigned int>(child);
+                previous = child;
+            }
+            document.at(slot).count = static_cast<unsigned int>(count);
+            return true;
+        }
+        case MARKER_DATE:
+            // Milliseconds since the epoch, then a time zone the format says to ignore
+            if (!has(10)) return false;
+            slot = document.add(AMF_DATE);
+            document.at(slot).number = read_double(data + index);
+            index += 10;
+            return true;
+        case MARKER_AVMPLUS:
+            // One AMF3 value follows, with reference tables of its own
+            document.amf3_tables().clear();
+            return AMF3::decode_value(data, length, index, document, slot, depth);
+        default:
+            return false;  // Object-end outside an object, references
+    }
+}
+
+// Key/value pairs up to the empty key and object-end marker
+bool Reader::properties(std::size_t parent, unsigned int depth, bool end_optional) {
+    std::size_t previous = 0;
+    unsigned int count = 0;
+    while (true) {
+        if (end_optional && index == length) {
+            break;
+        }
+        if (!has(2)) return false;
+        std::size_t key_length = read_u16(data + index);
+        if (key_length == 0 && has(3) && static_cast<unsigned char>(data[index + 2]) == MARKER_OBJECT_END) {
+            index += 3;
+            break;
+        }
+        index += 2;
+        if (!has(key_length)) return false;
+        AMFString key = { data + index, key_length };
+        index += key_length;
+
+        std::size_t child;
+        if (!value(child, depth + 1)) return false;
+        document.at(child).key = key;
+        if (count > 0) document.at(previous).next = static_cast<unsigned int>(child);
+        previous = child;
+        ++count;
+    }
+    document.at(parent).count = count;
+    return true;
+}
+
+} // namespace
+
+bool AMF0::decode(const char* data, std::size_t length, AMFDocument& document) {
+    document.clear();
+    Reader reader = { data, length, 0, document };
+    std::size_t previous = 0;
+    while (reader.index < length) {
+        std::size_t start = document.size();
+        std::size_t slot;
+        if (!reader.value(slot, 0)) {
+            document.truncate(start);  // Drop the half-built value
+            return false;
+        }
+        if (document.root_count() > 0) document.at(previous).next = static_cast<unsigned int>(slot);
+        document.add_root(slot);
+        previous = slot;
+    }
+    return true;
+}
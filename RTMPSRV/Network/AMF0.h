@@ -0,0 +1,20 @@
+#ifndef AMF0_H
+#define AMF0_H
+
+#include <cstddef> // For std::size_t
+#include "AMF.h"
+
+// AMF0 decoder for command and data messages. Strings in the resulting tree point into the
+// message payload instead of being copied, and nodes live in the document's arena.
+// Values behind the avmplus marker are handed to the AMF3 decoder.
+class AMF0 {
+public:
+    // Deeper nesting than any real command or metadata is treated as malformed
+    static const unsigned int MAX_DEPTH = 32;
+
+    // Clears document and decodes every value in data into it. Stops at the first malformed,
+    // truncated or unsupported value and returns false; the values before it stay usable.
+    static bool decode(const char* data, std::size_t length, AMFDocument& document);
+};
+
+#endif // AMF0_H
@@ -0,0 +1,334 @@
+#include "AMF3.h"
+#include "AMF0.h"   // For the depth limit
+#include <cstdint>
+#include <cmath>
+
+namespace {
+
+enum Marker {
+    MARKER_UNDEFINED = 0x00,
+    MARKER_NULL = 0x01,
+    MARKER_FALSE = 0x02,
+    MARKER_TRUE = 0x03,
+    MARKER_INTEGER = 0x04,
+    MARKER_DOUBLE = 0x05,
+    MARKER_STRING = 0x06,
+    MARKER_XML_DOC = 0x07,
+    MARKER_DATE = 0x08,
+    MARKER_ARRAY = 0x09,
+    MARKER_OBJECT = 0x0A,
+    MARKER_XML = 0x0B,
+    MARKER_BYTE_ARRAY = 0x0C
+};
+
+// Integers are 29 bits, signed
+const double INTEGER_MIN = -268435456.0;
+const double INTEGER_MAX = 268435455.0;
+
+// Object header bits after the inline flag
+const unsigned int TRAITS_INLINE = 0x02;
+const unsigned int TRAITS_EXTERNALIZABLE = 0x04;
+const unsigned int TRAITS_DYNAMIC = 0x08;
+
+double read_double(const char* data) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; ++i) {
+        bits = (bits << 8) | static_cast<unsigned char>(data[i]);
+    }
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+struct Reader {
+    const char* data;
+    std::size_t length;
+    std::size_t& index;
+    AMFDocument& document;
+    AMF3Tables& tables;
+
+    bool has(std::size_t bytes) const { return length - index >= bytes; }
+
+    bool u29(unsigned int& value);
+    bool string(AMFString& value);
+    bool reference(unsigned int header, std::size_t& slot);
+    void link(std::size_t parent, std::size_t& previous, std::size_t child);
+    bool value(std::size_t& slot, unsigned int depth);
+};
+
+// Variable-length 29-bit integer: seven bits per byte while the high bit is set, all eight
+// in a fourth byte
+bool Reader::u29(unsigned int& value) {
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (!has(1)) return false;
+        unsigned char byte = static_cast<unsigned char>(data[index++]);
+        if (i == 3) {
+            value = (value << 8) | byte;
+            return true;
+        }
+        value = (value << 7) | (byte & 0x7F);
+        if ((byte & 0x80) == 0) return true;
+    }
+    return true;
+}
+
+// Inline string, added to the string table unless empty, or a reference into it
+bool Reader::string(AMFString& value) {
+    unsigned int header;
+    if (!u29(header)) return false;
+    if ((header & 1) == 0) {
+        if ((header >> 1) >= tables.strings.size()) return false;
+        value = tables.strings[header >> 1];
+        return true;
+    }
+    std::size_t size = header >> 1;
+    if (!has(size)) return false;
+    value.data = data + index;
+    value.length = size;
+    index += size;
+    if (size > 0) {
+        tables.strings.push_back(value);
+    }
+    return true;
+}
+
+// Copies a complex value decoded earlier; one still being decoded would be a cycle
+bool Reader::reference(unsigned int header, std::size_t& slot) {
+    std::size_t position = header >> 1;
+    if (position >= tables.complex.size() || tables.complex[position].end == 0) {
+        return false;
+    }
+    return document.copy(tables.complex[position].first, tables.complex[position].end, slot);
+}
+
+void Reader::link(std::size_t parent, std::size_t& previous, std::size_t child) {
+    AMFValue& container = document.at(parent);
+    if (container.count++ > 0) {
+        document.at(previous).next = static_cast<unsigned int>(child);
+    }
+    previous = child;
+}
+
+bool Reader::value(std::size_t& slot, unsigned int depth) {
+    if (!has(1) || depth > AMF0::MAX_DEPTH) {
+        return false;
+    }
+    unsigned char marker = static_cast<unsigned char>(data[index++]);
+    switch (marker) {
+        case MARKER_UNDEFINED:
+            slot = document.add(AMF_UNDEFINED);
+            return true;
+        case MARKER_NULL:
+            slot = document.add(AMF_NULL);
+            return true;
+        case MARKER_FALSE:
+        case MARKER_TRUE:
+            slot = document.add(AMF_BOOLEAN);
+            document.at(slot).number = marker == MARKER_TRUE ? 1.0 : 0.0;
+            return true;
+        case MARKER_INTEGER: {
+            unsigned int bits;
+            if (!u29(bits)) return false;
+            int value = (bits & 0x10000000) ? static_cast<int>(bits) - 0x20000000 : static_cast<int>(bits);
+            slot = document.add(AMF_NUMBER);
+            document.at(slot).number = value;
+            return true;
+        }
+        case MARKER_DOUBLE:
+            if (!has(8)) return false;
+            slot = document.add(AMF_NUMBER);
+            document.at(slot).number = read_double(data + index);
+            index += 8;
+            return true;
+        case MARKER_STRING: {
+            AMFString value;
+            if (!string(value)) return false;
+            slot = document.add(AMF_STRING);
+            document.at(slot).string = value;
+            return true;
+        }
+        case MARKER_XML_DOC:
+        case MARKER_XML:
+        case MARKER_BYTE_ARRAY: {
+            unsigned int header;
+            if (!u29(header)) return false;
+            if ((header & 1) == 0) return reference(header, slot);
+            std::size_t size = header >> 1;
+            if (!has(size)) return false;
+            slot = document.add(AMF_STRING);
+            document.at(slot).string.data = data + index;
+            document.at(slot).string.length = size;
+            index += size;
+            AMF3Tables::Complex entry = { slot, slot + 1 };
+            tables.complex.push_back(entry);
+            return true;
+        }
+        case MARKER_DATE: {
+            unsigned int header;
+            if (!u29(header)) return false;
+            if ((header & 1) == 0) return reference(header, slot);
+            if (!has(8)) return false;
+            slot = document.add(AMF_DATE);
+            document.at(slot).number = read_double(data + index);
+            index += 8;
+            AMF3Tables::Complex entry = { slot, slot + 1 };
+            tables.complex.push_back(entry);
+            return true;
+        }
+        case MARKER_ARRAY: {
+            unsigned int header;
+            if (!u29(header)) return false;
+            if ((header & 1) == 0) return reference(header, slot);
+            std::size_t dense = header >> 1;
+            slot = document.add(AMF_STRICT_ARRAY);
+            std::size_t entry = tables.complex.size();
+            AMF3Tables::Complex pending = { slot, 0 };
+            tables.complex.push_back(pending);
+
+            std::size_t previous = 0;
+            while (true) {
+                AMFString key;
+                if (!string(key)) return false;
+                if (key.empty()) break;
+                std::size_t child;
+                if (!value(child, depth + 1)) return false;
+                document.at(child).key = key;
+                document.at(slot).type = AMF_ECMA_ARRAY;
+                link(slot, previous, child);
+            }
+            if (dense > length - index) return false;  // Every element takes at least a byte
+            for (std::size_t i = 0; i < dense; ++i) {
+                std::size_t child;
+                if (!value(child, depth + 1)) return false;
+                link(slot, previous, child);
+            }
+            tables.complex[entry].end = document.size();
+            return true;
+        }
+        case MARKER_OBJECT: {
+            unsigned int header;
+            if (!u29(header)) return false;
+            if ((header & 1) == 0) return reference(header, slot);
+
+            std::size_t traits_index;
+            if ((header & TRAITS_INLINE) == 0) {
+                traits_index = header >> 2;
+                if (traits_index >= tables.traits.size()) return false;
+            } else {
+                if (header & TRAITS_EXTERNALIZABLE) return false;  // Needs the class's own reader
+                AMF3Tables::Traits traits;
+                if (!string(traits.class_name)) return false;
+                traits.dynamic = (header & TRAITS_DYNAMIC) != 0;
+                traits.first_member = tables.member_names.size();
+                traits.member_count = header >> 4;
+                if (traits.member_count > length - index) return false;
+                for (std::size_t i = 0; i < traits.member_count; ++i) {
+                    AMFString name;
+                    if (!string(name)) return false;
+                    tables.member_names.push_back(name);
+                }
+                traits_index = tables.traits.size();
+                tables.traits.push_back(traits);
+            }
+
+            slot = document.add(AMF_OBJECT);
+            std::size_t entry = tables.complex.size();
+            AMF3Tables::Complex pending = { slot, 0 };
+            tables.complex.push_back(pending);
+
+            // Tables grow while members decode, so copy what is needed instead of holding references
+            AMF3Tables::Traits traits = tables.traits[traits_index];
+            std::size_t previous = 0;
+            for (std::size_t i = 0; i < traits.member_count; ++i) {
+                AMFString key = tables.member_names[traits.first_member + i];
+                std::size_t child;
+                if (!value(child, depth + 1)) return false;
+                document.at(child).key = key;
+                link(slot, previous, child);
+            }
+            while (traits.dynamic) {
+                AMFString key;
+                if (!string(key)) return false;
+                if (key.empty()) break;
+                std::size_t child;
+                if (!value(child, depth + 1)) return false;
+                document.at(child).key = key;
+                link(slot, previous, child);
+            }
+            tables.complex[entry].end = document.size();
+            return true;
+        }
+        default:
+            return false;  // Vectors, dictionaries
+    }
+}
+
+} // namespace
+
+bool AMF3::decode_value(const char* data, std::size_t length, std::size_t& index,
+                        AMFDocument& document, std::size_t& slot, unsigned int depth) {
+    Reader reader = { data, length, index, document, document.amf3_tables() };
+    return reader.value(slot, depth);
+}
+
+void AMF3::write_u29(unsigned int value, PooledBytes& buffer) {
+    value &= 0x1FFFFFFF;
+    if (value < 0x80) {
+        buffer.push_back(static_cast<char>(value));
+    } else if (value < 0x4000) {
+        buffer.push_back(static_cast<char>(0x80 | (value >> 7)));
+        buffer.push_back(static_cast<char>(value & 0x7F));
+    } else if (value < 0x200000) {
+        buffer.push_back(static_cast<char>(0x80 | (value >> 14)));
+        buffer.push_back(static_cast<char>(0x80 | ((value >> 7) & 0x7F)));
+        buffer.push_back(static_cast<char>(value & 0x7F));
+    } else {
+        buffer.push_back(static_cast<char>(0x80 | (value >> 22)));
+        buffer.push_back(static_cast<char>(0x80 | ((value >> 15) & 0x7F)));
+        buffer.push_back(static_cast<char>(0x80 | ((value >> 8) & 0x7F)));
+        buffer.push_back(static_cast<char>(value & 0xFF));
+    }
+}
+
+void AMF3::write_null(PooledBytes& buffer) {
+    buffer.push_back(MARKER_NULL);
+}
+
+void AMF3::write_boolean(bool value, PooledBytes& buffer) {
+    buffer.push_back(value ? MARKER_TRUE : MARKER_FALSE);
+}
+
+void AMF3::write_number(double value, PooledBytes& buffer) {
+    if (value >= INTEGER_MIN && value <= INTEGER_MAX && std::floor(value) == value) {
+        buffer.push_back(MARKER_INTEGER);
+        write_u29(static_cast<unsigned int>(static_cast<int>(value)), buffer);
+        return;
+    }
+    buffer.push_back(MARKER_DOUBLE);
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 7; i >= 0; --i) {
+        buffer.push_back(static_cast<char>((bits >> (i * 8)) & 0xFF));
+    }
+}
+
+void AMF3::write_string(const char* value, std::size_t length, PooledBytes& buffer) {
+    buffer.push_back(MARKER_STRING);
+    write_key(value, length, buffer);
+}
+
+void AMF3::begin_object(PooledBytes& buffer) {
+    buffer.push_back(MARKER_OBJECT);
+    write_u29(0x01 | TRAITS_INLINE | TRAITS_DYNAMIC, buffer);  // Inline, dynamic, no sealed members
+    write_key("", 0, buffer);                                  // Anonymous class
+}
+
+void AMF3::write_key(const char* key, std::size_t length, PooledBytes& buffer) {
+    write_u29(static_cast<unsigned int>(length << 1) | 1, buffer);
+    buffer.append(key, length);
+}
+
+void AMF3::end_object(PooledBytes& buffer) {
+    write_key("", 0, buffer);  // Empty key ends the dynamic members
+}
@@ -0,0 +1,36 @@
+#ifndef AMF3_H
+#define AMF3_H
+
+#include <cstddef> // For std::size_t
+#include "AMF.h"
+#include "SlabPool.h"
+
+// AMF3 values, as carried by the AMF0 avmplus marker inside AMF3 command (0x11) and data
+// (0x0F) messages. Decoded into the same tree as AMF0, with these mappings:
+//   - integers become numbers, XML and byte arrays become strings
+//   - arrays with only dense elements become strict arrays; mixed ones become ECMA arrays
+//     with the associative members first and the dense elements after them, unkeyed
+//   - references to earlier objects are expanded into a copy of that object's nodes
+// Externalizable objects, vectors and dictionaries are not supported.
+class AMF3 {
+public:
+    // Decodes the value at index (just past the avmplus marker) into a new node stored in
+    // slot, using and extending the document's AMF3 reference tables. Depth counts as in AMF0.
+    static bool decode_value(const char* data, std::size_t length, std::size_t& index,
+                             AMFDocument& document, std::size_t& slot, unsigned int depth);
+
+    // Encoder. Values are always written inline, so no reference tables are needed.
+    static void write_null(PooledBytes& buffer);
+    static void write_boolean(bool value, PooledBytes& buffer);
+    static void write_number(double value, PooledBytes& buffer);  // Integer when it fits
+    static void write_string(const char* value, std::size_t length, PooledBytes& buffer);
+    // Anonymous dynamic object: begin, then key/value pairs, then end
+    static void begin_object(PooledBytes& buffer);
+    static void write_key(const char* key, std::size_t length, PooledBytes& buffer);
+    static void end_object(PooledBytes& buffer);
+
+private:
+    static void write_u29(unsigned int value, PooledBytes& buffer);
+};
+
+#endif // AMF3_H
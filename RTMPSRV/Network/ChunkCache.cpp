@@ -0,0 +1,167 @@
+#include "ChunkCache.h"
+
+ChunkedMessage::ChunkedMessage(const char* payload, std::size_t length, unsigned int timestamp,
+                               unsigned char message_type_id, std::size_t chunk_size,
+                               unsigned int csid, unsigned int message_stream_id)
+    : chunk_size_(chunk_size),
+      csid_(csid),
+      message_stream_id_(message_stream_id),
+      segment_count_(0),
+      total_length_(0),
+      next_(nullptr) {
+    bool extended = timestamp >= 0xFFFFFF;
+    unsigned int timestamp_field = extended ? 0xFFFFFF : timestamp;
+
+    header_[0] = static_cast<char>(csid & 0x3F);  // fmt 0; our chunk stream ids are all below 64
+    header_[1] = (timestamp_field >> 16) & 0xFF;
+    header_[2] = (timestamp_field >> 8) & 0xFF;
+    header_[3] = timestamp_field & 0xFF;
+    header_[4] = (length >> 16) & 0xFF;
+    header_[5] = (length >> 8) & 0xFF;
+    header_[6] = length & 0xFF;
+    header_[7] = message_type_id;
+    header_[8] = message_stream_id & 0xFF;  // Little-endian
+    header_[9] = (message_stream_id >> 8) & 0xFF;
+    header_[10] = (message_stream_id >> 16) & 0xFF;
+    header_[11] = (message_stream_id >> 24) & 0xFF;
+    std::size_t header_size = 12;
+    std::size_t continuation_size = 1;
+    char continuation[5];
+    continuation[0] = static_cast<char>(0xC0 | (csid & 0x3F));  // fmt 3
+    if (extended) {
+        header_[12] = continuation[1] = (timestamp >> 24) & 0xFF;
+        header_[13] = continuation[2] = (timestamp >> 16) & 0xFF;
+        header_[14] = continuation[3] = (timestamp >> 8) & 0xFF;
+        header_[15] = continuation[4] = timestamp & 0xFF;
+        header_size = 16;
+        continuation_size = 5;
+    }
+
+    std::size_t chunks = length == 0 ? 1 : (length + chunk_size - 1) / chunk_size;
+    total_length_ = header_size + (chunks - 1) * continuation_size + length;
+    if (chunks == 1) {
+        ChunkSegment header = { header_, header_size };
+        segments_[segment_count_++] = header;
+        if (length > 0) {
+            ChunkSegment body = { payload, length };
+            segments_[segment_count_++] = body;
+        }
+        return;
+    }
+
+    wire_.reserve(total_length_);
+    wire_.append(header_, header_size);
+    std::size_t offset = 0;
+    while (offset < length) {
+        if (offset > 0) {
+            wire_.append(continuation, continuation_size);
+        }
+        std::size_t piece = length - offset;
+        if (piece > chunk_size) piece = chunk_size;
+        wire_.append(payload + offset, piece);
+        offset += piece;
+    }
+    ChunkSegment whole = { wire_.data(), wire_.size() };
+    segments_[segment_count_++] = whole;
+}
+
+FlvTag::FlvTag(const char* payload, std::size_t length, unsigned int timestamp, unsigned char message_type_id)
+    : segment_count_(0) {
+    static const char HEX[] = "0123456789abcdef";
+    std::size_t tag_length = Flv::TAG_OVERHEAD + length;
+
+    // Chunk size line, written backwards so it ends right where the tag header starts
+    std::size_t line_start = CHUNK_LINE_MAX;
+    head_[--line_start] = '\n';
+    head_[--line_start] = '\r';
+    std::size_t remaining = tag_length;
+    do {
+        head_[--line_start] = HEX[remaining & 0x0F];
+        remaining >>= 4;
+    } while (remaining != 0);
+    Flv::write_tag_header(head_ + CHUNK_LINE_MAX, message_type_id, length, timestamp);
+    Flv::write_tag_trailer(tail_, length);
+    tail_[Flv::TAG_TRAILER_SIZE] = '\r';
+    tail_[Flv::TAG_TRAILER_SIZE + 1] = '\n';
+
+    ChunkSegment plain_head = { head_ + CHUNK_LINE_MAX, Flv::TAG_HEADER_SIZE };
+    ChunkSegment chunked_head = { head_ + line_start, CHUNK_LINE_MAX - line_start + Flv::TAG_HEADER_SIZE };
+    plain_[segment_count_] = plain_head;
+    chunked_[segment_count_++] = chunked_head;
+    if (length > 0) {
+        ChunkSegment body = { payload, length };
+        plain_[segment_count_] = body;
+        chunked_[segment_count_++] = body;
+    }
+    ChunkSegment plain_tail = { tail_, Flv::TAG_TRAILER_SIZE };
+    ChunkSegment chunked_tail = { tail_, Flv::TAG_TRAILER_SIZE + 2 };
+    plain_[segment_count_] = plain_tail;
+    chunked_[segment_count_++] = chunked_tail;
+
+    plain_length_ = tag_length;
+    chunked_length_ = tag_length + (CHUNK_LINE_MAX - line_start) + 2;
+}
+
+ChunkCache::~ChunkCache() {
+    ChunkedMessage* entry = head_.load(std::memory_order_acquire);
+    while (entry) {
+        ChunkedMessage* next = entry->next_;
+        delete entry;
+        entry = next;
+    }
+    delete flv_tag_.load(std::memory_order_acquire);
+}
+
+const ChunkedMessage* ChunkCache::find(const ChunkedMessage* from, const ChunkedMessage* until,
+                                       std::size_t chunk_size, unsigned int csid, unsigned int message_stream_id) {
+    for (const ChunkedMessage* entry = from; entry != until; entry = entry->next_) {
+        if (entry->matches(chunk_size, csid, message_stream_id)) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+const ChunkedMessage& ChunkCache::get(const char* payload, std::size_t length, unsigned int timestamp,
+                                      unsigned char message_type_id, std::size_t chunk_size,
+                                      unsigned int csid, unsigned int message_stream_id, bool& hit) const {
+    ChunkedMessage* head = head_.load(std::memory_order_acquire);
+    const ChunkedMessage* found = find(head, nullptr, chunk_size, csid, message_stream_id);
+    if (found) {
+        hit = true;
+        return *found;
+    }
+
+    hit = false;
+    ChunkedMessage* created = new ChunkedMessage(payload, length, timestamp, message_type_id,
+                                                 chunk_size, csid, message_stream_id);
+    while (true) {
+        created->next_ = head;
+        if (head_.compare_exchange_weak(head, created, std::memory_order_release, std::memory_order_acquire)) {
+            return *created;
+        }
+        // Entries only ever get pushed in front, so just check what arrived since our last look
+        found = find(head, created->next_, chunk_size, csid, message_stream_id);
+        if (found) {
+            delete created;
+            return *found;
+        }
+    }
+}
+
+const FlvTag& ChunkCache::flv_tag(const char* payload, std::size_t length, unsigned int timestamp,
+                                  unsigned char message_type_id, bool& hit) const {
+    FlvTag* existing = flv_tag_.load(std::memory_order_acquire);
+    if (existing) {
+        hit = true;
+        return *existing;
+    }
+
+    hit = false;
+    FlvTag* created = new FlvTag(payload, length, timestamp, message_type_id);
+    if (flv_tag_.compare_exchange_strong(existing, created, std::memory_order_release, std::memory_order_acquire)) {
+        return *created;
+    }
+    delete created;
+    return *existing;
+}
@@ -0,0 +1,121 @@
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include <atomic>
+#include <cstddef> // For std::size_t
+#include "Flv.h"
+#include "SlabPool.h"
+
+// One contiguous piece of serialized output; laid out like struct iovec so a writer can
+// gather a ChunkedMessage without copying, but portable to platforms without writev.
+struct ChunkSegment {
+    const char* data;
+    std::size_t length;
+};
+
+// A message split into chunks for one (chunk size, csid, message stream id):
+// fmt 0 header, payload slice, then a fmt 3 header before every further slice.
+// A single-chunk message is two segments, the header stored here and the caller's payload,
+// which must outlive this object and stay unmodified. Longer messages are serialized once
+// into one contiguous buffer: a gathered send of many small header/slice pairs costs the
+// kernel far more than that one copy. Once built it is never changed, so any number of
+// connections on any worker may read it at the same time.
+class ChunkedMessage {
+public:
+    ChunkedMessage(const char* payload, std::size_t length, unsigned int timestamp,
+                   unsigned char message_type_id, std::size_t chunk_size,
+                   unsigned int csid, unsigned int message_stream_id);
+
+    bool matches(std::size_t chunk_size, unsigned int csid, unsigned int message_stream_id) const {
+        return chunk_size_ == chunk_size && csid_ == csid && message_stream_id_ == message_stream_id;
+    }
+
+    const ChunkSegment* segments() const { return segments_; }
+    std::size_t segment_count() const { return segment_count_; }
+    std::size_t total_length() const { return total_length_; }
+
+    // Cached forms live as long as their packet; take them from the slab pool too
+    static void* operator new(std::size_t size) { return SlabPool::allocate(size); }
+    static void operator delete(void* block, std::size_t size) { SlabPool::release(block, size); }
+
+private:
+    friend class ChunkCache;
+
+    ChunkedMessage(const ChunkedMessage&);
+    ChunkedMessage& operator=(const ChunkedMessage&);
+
+    std::size_t chunk_size_;
+    unsigned int csid_;
+    unsigned int message_stream_id_;
+
+    char header_[16];        // fmt 0 basic + message header, plus the extended timestamp if any
+    PooledBytes wire_;       // Whole serialized message when it spans several chunks
+    ChunkSegment segments_[2];
+    std::size_t segment_count_;
+    std::size_t total_length_;
+
+    ChunkedMessage* next_;   // ChunkCache list link
+};
+
+// A message framed as an FLV tag for HTTP-FLV viewers: tag header, the caller's payload
+// (which, as for ChunkedMessage, must outlive this object) and PreviousTagSize. Both forms a
+// response may use are kept, the plain tag and the tag as one HTTP/1.1 chunk; they differ
+// only in the chunk size line and the CRLF after the tag, so they share one set of buffers.
+class FlvTag {
+public:
+    FlvTag(const char* payload, std::size_t length, unsigned int timestamp, unsigned char message_type_id);
+
+    const ChunkSegment* segments(bool http_chunked) const { return http_chunked ? chunked_ : plain_; }
+    std::size_t segment_count() const { return segment_count_; }
+    std::size_t total_length(bool http_chunked) const { return http_chunked ? chunked_length_ : plain_length_; }
+
+    static void* operator new(std::size_t size) { return SlabPool::allocate(size); }
+    static void operator delete(void* block, std::size_t size) { SlabPool::release(block, size); }
+
+private:
+    FlvTag(const FlvTag&);
+    FlvTag& operator=(const FlvTag&);
+
+    static const std::size_t CHUNK_LINE_MAX = 10;  // Eight hex digits and CRLF
+
+    char head_[CHUNK_LINE_MAX + Flv::TAG_HEADER_SIZE];  // Chunk size line right-aligned before the tag header
+    char tail_[Flv::TAG_TRAILER_SIZE + 2];              // PreviousTagSize, then the CRLF ending the chunk
+    ChunkSegment plain_[3];
+    ChunkSegment chunked_[3];
+    std::size_t segment_count_;
+    std::size_t plain_length_;
+    std::size_t chunked_length_;
+};
+
+// Chunked forms of one immutable message, created on first request and shared afterwards.
+// Players of a stream nearly always agree on chunk size, csid and stream id, so the list
+// rarely holds more than one entry. Lookups are lock-free; two workers racing to build the
+// same entry both serialize it and the loser's copy is discarded. The FLV tag form for
+// HTTP-FLV viewers is kept alongside, built the same way.
+class ChunkCache {
+public:
+    ChunkCache() : head_(nullptr), flv_tag_(nullptr) {}
+    ~ChunkCache();
+
+    // Returns the message chunked for (chunk_size, csid, message_stream_id);
+    // hit is false when this call had to serialize it.
+    const ChunkedMessage& get(const char* payload, std::size_t length, unsigned int timestamp,
+                              unsigned char message_type_id, std::size_t chunk_size,
+                              unsigned int csid, unsigned int message_stream_id, bool& hit) const;
+
+    // Returns the message framed as an FLV tag; hit is false when this call had to build it
+    const FlvTag& flv_tag(const char* payload, std::size_t length, unsigned int timestamp,
+                          unsigned char message_type_id, bool& hit) const;
+
+private:
+    ChunkCache(const ChunkCache&);
+    ChunkCache& operator=(const ChunkCache&);
+
+    static const ChunkedMessage* find(const ChunkedMessage* from, const ChunkedMessage* until,
+                                      std::size_t chunk_size, unsigned int csid, unsigned int message_stream_id);
+
+    mutable std::atomic<ChunkedMessage*> head_;
+    mutable std::atomic<FlvTag*> flv_tag_;
+};
+
+#endif // CHUNKCACHE_H
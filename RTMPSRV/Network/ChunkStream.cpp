@@ -0,0 +1,63 @@
+#include "ChunkStream.h"
+
+ChunkStream::ChunkStream()
+    : has_header(false),
+      extended_timestamp(false),
+      timestamp(0),
+      timestamp_delta(0),
+      message_length(0),
+      message_type_id(0),
+      message_stream_id(0),
+      received(0) {}
+
+ChunkStreamTable::ChunkStreamTable() : partial_messages_(0), partial_bytes_(0) {}
+
+ChunkStream* ChunkStreamTable::get(unsigned int csid) {
+    if (csid < FLAT_CSIDS) {
+        return &flat_[csid];
+    }
+    std::unordered_map<unsigned int, ChunkStream>::iterator it = extended_.find(csid);
+    if (it != extended_.end()) {
+        return &it->second;
+    }
+    if (extended_.size() >= MAX_EXTENDED_CSIDS) {
+        return nullptr;
+    }
+    return &extended_[csid];
+}
+
+void ChunkStreamTable::abort(unsigned int csid) {
+    if (csid < FLAT_CSIDS) {
+        release(flat_[csid]);
+        return;
+    }
+    std::unordered_map<unsigned int, ChunkStream>::iterator it = extended_.find(csid);
+    if (it != extended_.end()) {
+        release(it->second);
+    }
+}
+
+bool ChunkStreamTable::append(ChunkStream& stream, const char* data, std::size_t length) {
+    bool starts = stream.received == 0;
+    if ((starts && partial_messages_ >= MAX_PARTIAL_MESSAGES) || partial_bytes_ + length > MAX_PARTIAL_BYTES) {
+        return false;
+    }
+    if (starts) {
+        // The declared length is only a claim; reserve up to a bound and grow as chunks arrive
+        ++partial_messages_;
+        stream.payload.reserve(stream.message_length < INITIAL_RESERVE ? stream.message_length : INITIAL_RESERVE);
+    }
+    stream.payload.append(data, length);
+    stream.received += length;
+    partial_bytes_ += length;
+    return true;
+}
+
+void ChunkStreamTable::release(ChunkStream& stream) {
+    if (stream.received > 0) {
+        --partial_messages_;
+        partial_bytes_ -= stream.received;
+    }
+    stream.received = 0;
+    PooledBytes().swap(stream.payload);  // Handlers that took the buffer over left it empty
+}
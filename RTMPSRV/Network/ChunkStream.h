@@ -0,0 +1,76 @@
+#ifndef CHUNKSTREAM_H
+#define CHUNKSTREAM_H
+
+#include <unordered_map>
+#include <cstddef> // For std::size_t
+#include "SlabPool.h"
+
+// A complete RTMP message, either reassembled from chunks or pointing straight into
+// the receive buffer when it arrived in a single chunk. data is only valid during dispatch.
+struct RTMPMessage {
+    unsigned int csid;
+    unsigned int timestamp;
+    unsigned char message_type_id;
+    unsigned int message_stream_id;
+    const char* data;
+    std::size_t length;
+    PooledBytes* buffer;        // Reassembly buffer holding data, if any; a handler may take it over
+};
+
+// Header fields a sender may omit (fmt 1/2/3), remembered per chunk stream id,
+// plus the partially received message on that chunk stream.
+struct ChunkStream {
+    ChunkStream();
+
+    bool has_header;                 // A fmt 0 header has been seen, so fmt 1/2/3 can be resolved
+    bool extended_timestamp;         // The last fmt 0/1/2 header carried a 32-bit extended timestamp
+    unsigned int timestamp;          // Absolute timestamp of the current message
+    unsigned int timestamp_delta;    // Reapplied when a fmt 3 chunk starts a new message
+    unsigned int message_length;
+    unsigned char message_type_id;
+    unsigned int message_stream_id;
+
+    PooledBytes payload;             // Reassembly buffer, only held while a message is in flight
+    std::size_t received;            // Payload bytes of the current message seen so far
+
+    bool in_message() const { return received > 0; }
+};
+
+// Per-connection chunk stream demuxer state.
+// csid 2..63 (one-byte basic header, what encoders use in practice) live in a flat array;
+// the extended range 64..65599 goes to a hash map on first use. A peer declares message
+// lengths up to 16 MB and may open a message on every chunk stream, so buffers grow with
+// the bytes that actually arrive, and the number of extended chunk streams, of partial
+// messages and of bytes held for them are capped.
+class ChunkStreamTable {
+public:
+    static const std::size_t MAX_EXTENDED_CSIDS = 256;
+    static const std::size_t MAX_PARTIAL_MESSAGES = 64;
+    static const std::size_t MAX_PARTIAL_BYTES = 32 * 1024 * 1024;
+
+    ChunkStreamTable();
+
+    // nullptr when csid would be one extended chunk stream too many
+    ChunkStream* get(unsigned int csid);
+
+    // Discards a partially received message (Abort Message, type 2)
+    void abort(unsigned int csid);
+
+    // Appends one chunk's payload. Returns false, appending nothing, when it would take the
+    // connection past MAX_PARTIAL_MESSAGES or MAX_PARTIAL_BYTES.
+    bool append(ChunkStream& stream, const char* data, std::size_t length);
+
+    // Returns the stream's reassembly buffer to the slab pool once its message was dispatched
+    void release(ChunkStream& stream);
+
+private:
+    static const unsigned int FLAT_CSIDS = 64;
+    static const std::size_t INITIAL_RESERVE = 64 * 1024;  // Larger messages double from here
+
+    ChunkStream flat_[FLAT_CSIDS];
+    std::unordered_map<unsigned int, ChunkStream> extended_;
+    std::size_t partial_messages_;  // Chunk streams with a message in flight
+    std::size_t partial_bytes_;     // Payload received for those messages
+};
+
+#endif // CHUNKSTREAM_H
@@ -1,186 +1,235 @@
 // Client.cpp
 #include "Client.h"
-#include "Parse.h"      // For RTMP parsing and handshake
-#include "ParseAMF.h"   // For handling AMF commands (connect, createStream, publish)
-#include "Buffer.h"     // For managing the data buffer
-#include <iostream>
+#include "Log.h"
+#include "SlabPool.h"
 #include <thread>
-#include <vector>
-#include <mutex>
-#include <chrono>
-#include <ctime>
-#include <sstream>
-#include <iomanip>
-
-// Utility function to get current timestamp for logging
-std::string current_timestamp() {
-    auto now = std::chrono::system_clock::now();
-    std::time_t now_c = std::chrono::system_clock::to_time_t(now);
-    std::tm local_time;
-    localtime_s(&local_time, &now_c);  // Thread-safe localtime function
-
-    std::ostringstream oss;
-    oss << std::put_time(&local_time, "%Y-%m-%d %H:%M:%S");
-    return oss.str();
-}
 
 bool RTMPServer::is_running() const {
     return running_;
 }
 
 bool RTMPServer::start(int port) {
-    std::cout << "[" << current_timestamp() << "] [start] Attempting to start RTMP server on port " << port << "..." << std::endl;
-
-    // Initialize Winsock
-    WSADATA wsaData;
-    int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (result != 0) {
-        std::cerr << "[" << current_timestamp() << "] [start] WSAStartup failed with error: " << result << std::endl;
-        return false;
-    }
+    ServerConfig config;
+    config.port = port;
+    return start(config);
+}
 
-    // Create socket
-    server_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (server_fd == INVALID_SOCKET) {
-        std::cerr << "[" << current_timestamp() << "] [start] Failed to create socket. Error: " << WSAGetLastError() << std::endl;
-        WSACleanup();
-        return false;
+bool RTMPServer::start(const ServerConfig& config) {
+    config_ = config;
+    int port = config.port;
+    unsigned int worker_count = config.workers;
+    if (worker_count == 0) {
+        worker_count = std::thread::hardware_concurrency();
+        if (worker_count == 0) worker_count = 1;
     }
 
-    // Bind to address
-    sockaddr_in address;
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
+    LOG_INFO("[start] Attempting to start RTMP server on port " << port
+              << " with " << worker_count << " worker(s)...");
 
-    if (bind(server_fd, (sockaddr*)&address, sizeof(address)) == SOCKET_ERROR) {
-        std::cerr << "[" << current_timestamp() << "] [start] Bind failed. Error: " << WSAGetLastError() << std::endl;
-        closesocket(server_fd);
-        WSACleanup();
+    // Initialize the socket layer (Winsock on Windows)
+    if (!Socket::startup()) {
         return false;
     }
 
-    // Start listening
-    if (listen(server_fd, SOMAXCONN) == SOCKET_ERROR) {
-        std::cerr << "[" << current_timestamp() << "] [start] Listen failed. Error: " << WSAGetLastError() << std::endl;
-        closesocket(server_fd);
-        WSACleanup();
-        return false;
+    // Every worker binds its own listener when the kernel can balance between them;
+    // otherwise they all wait on one shared non-blocking listener.
+    bool reuse_port = worker_count > 1 && Socket::supports_reuse_port();
+    socket_t shared_listener = RTMP_INVALID_SOCKET;
+    if (!reuse_port) {
+        shared_listener = Socket::create_listener(port);
+        if (shared_listener == RTMP_INVALID_SOCKET) {
+            LOG_ERROR("[start] Failed to create listening socket on port " << port);
+            Socket::cleanup();
+            return false;
+        }
     }
 
-    std::cout << "[" << current_timestamp() << "] [start] RTMP server started successfully on port " << port << "." << std::endl;
-    return true;
-}
-
-void RTMPServer::run() {
-    std::cout << "[" << current_timestamp() << "] [run] RTMP server is now running..." << std::endl;
-    running_ = true;
-
-    while (running_) {
-        sockaddr_in client_address;
-        int client_len = sizeof(client_address);
-
-        // Accept incoming connections
-        SOCKET client_socket = accept(server_fd, (sockaddr*)&client_address, &client_len);
-        if (client_socket == INVALID_SOCKET) {
-            if (!running_) break;  // Exit if the server has been stopped
-            std::cerr << "[" << current_timestamp() << "] [run] Failed to accept connection. Error: " << WSAGetLastError() << std::endl;
-            continue;
+    socket_t shared_http_listener = RTMP_INVALID_SOCKET;
+    if (config.http_port > 0 && !reuse_port) {
+        shared_http_listener = Socket::create_listener(config.http_port);
+        if (shared_http_listener == RTMP_INVALID_SOCKET) {
+            LOG_ERROR("[start] Failed to create HTTP listening socket on port " << config.http_port);
+            Socket::close(shared_listener);
+            Socket::cleanup();
+            return false;
         }
-
-        std::lock_guard<std::mutex> lock(log_mutex);
-        std::string client_ip = inet_ntoa(client_address.sin_addr);
-        std::cout << "[" << current_timestamp() << "] [run] New client connected from " << client_ip << std::endl;
-
-        // Handle the client in a separate thread
-        client_threads.emplace_back([this, client_socket, client_ip]() {
-            handle_client(client_socket, client_ip);
-        });
     }
 
-    std::cout << "[" << current_timestamp() << "] [run] Shutting down server..." << std::endl;
-
-    // Join all threads when shutting down
-    for (std::thread& t : client_threads) {
-        if (t.joinable()) {
-            t.join();
+    hub_.reset(new StreamHub(worker_count, config.gop_cache_bytes));
+    if (config.hls) {
+        hls_store_.reset(new HlsStore(config.hls_window, config.hls_segment_ms));
+        hls_packager_.reset(new HlsPackager(*hls_store_, config.hls_segment_ms));
+        hls_packager_->start();
+        hub_->add_sink(hls_packager_.get());
+    }
+    if (!config.record_dir.empty()) {
+        recorder_.reset(new Recorder(config.record_dir, config.record_max_bytes, config.record_max_seconds));
+        if (!recorder_->start()) {
+            recorder_.reset();
+            if (!reuse_port) {
+                Socket::close(shared_listener);
+                if (shared_http_listener != RTMP_INVALID_SOCKET) Socket::close(shared_http_listener);
+            }
+            Socket::cleanup();
+            return false;
         }
+        hub_->add_sink(recorder_.get());
     }
-}
 
-void RTMPServer::handle_client(SOCKET client_socket, const std::string& client_ip) {
-    std::cout << "[handle_client] Client connected from IP: " << client_ip << std::endl;
+    for (unsigned int i = 0; i < worker_count; ++i) {
+        socket_t listener = reuse_port ? Socket::create_listener(port, true) : shared_listener;
+        if (listener == RTMP_INVALID_SOCKET) {
+            LOG_ERROR("[start] Failed to create listening socket for worker " << i);
+            workers_.clear();
+            Socket::cleanup();
+            return false;
+        }
 
-    // Perform RTMP handshake
-    if (!Parse::perform_handshake(client_socket)) {
-        std::lock_guard<std::mutex> lock(log_mutex);
-        std::cerr << "[handle_client] RTMP handshake failed for IP: " << client_ip << std::endl;
-        closesocket(client_socket);
-        return;
+        // The first worker owns the shared listener; with SO_REUSEPORT each owns its own
+        std::unique_ptr<Worker> worker(new Worker(i));
+        if (config.http_port > 0) {
+            socket_t http_listener = reuse_port ? Socket::create_listener(config.http_port, true) : shared_http_listener;
+            if (http_listener == RTMP_INVALID_SOCKET) {
+                LOG_ERROR("[start] Failed to create HTTP listening socket for worker " << i);
+                if (reuse_port) Socket::close(listener);
+                workers_.clear();
+                Socket::cleanup();
+                return false;
+            }
+            worker->set_http(http_listener, reuse_port || i == 0, hls_store_.get());
+        }
+        if (!worker->init(listener, reuse_port || i == 0, config, hub_.get())) {
+            worker.reset();  // Closes the listeners it was given to own
+            workers_.clear();
+            Socket::cleanup();
+            return false;
+        }
+        workers_.push_back(std::move(worker));
     }
 
-    std::cout << "[handle_client] RTMP handshake completed successfully for IP: " << client_ip << std::endl;
+    if (config.metrics_port > 0) {
+        metrics_.reset(new MetricsServer());
+        if (!metrics_->init(config.metrics_port, [this]() { return Metrics::prometheus_text(stats()); })) {
+            metrics_.reset();
+            workers_.clear();
+            Socket::cleanup();
+            return false;
+        }
+    }
 
-    char buffer[BUFFER_SIZE];
-    int read_size;
+    if (config.http_port > 0) {
+        LOG_INFO("[start] Serving HTTP on port " << config.http_port << (config.hls ? " with HLS." : "."));
+    }
+    LOG_INFO("[start] RTMP server started successfully on port " << port
+              << " using " << workers_.size() << " " << workers_[0]->backend_name() << " worker(s)"
+              << (reuse_port ? " with SO_REUSEPORT." : "."));
+    return true;
+}
 
-    // Initialize a local buffer to accumulate incoming data
-    std::vector<char> data_buffer;
+void RTMPServer::run() {
+    LOG_INFO("[run] RTMP server is now running...");
+    running_ = true;
 
-    // Process RTMP packets after handshake
-    while ((read_size = recv(client_socket, buffer, BUFFER_SIZE, 0)) > 0) {
-        std::lock_guard<std::mutex> lock(log_mutex);
-        std::cout << "[handle_client] Received " << read_size << " bytes from client IP: " << client_ip << std::endl;
+    // Each worker accepts and serves its own connections until stop() is called
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->spawn(running_, config_.pin_workers);
+    }
+    if (metrics_) {
+        metrics_->spawn(running_);
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->join();
+    }
+    if (metrics_) {
+        metrics_->join();  // Before the workers it reads from go away
+    }
 
-        // Append received data to the local buffer
-        data_buffer.insert(data_buffer.end(), buffer, buffer + read_size);
+    LOG_INFO("[run] Server has stopped accepting new connections; shutting down...");
+    workers_.clear();
+    if (recorder_) {
+        recorder_->stop();  // Writes out what the workers queued before they went away
+    }
+    if (hls_packager_) {
+        hls_packager_->stop();
+    }
+}
 
-        // Process complete RTMP messages from the buffer
-        size_t bytes_processed = 0;
-        while (bytes_processed < data_buffer.size()) {
-            size_t consumed = Parse::parse_rtmp_packet(data_buffer.data() + bytes_processed,
-                                                       data_buffer.size() - bytes_processed,
-                                                       client_socket);
-            if (consumed > 0) {
-                bytes_processed += consumed;
-            } else {
-                // Not enough data to parse a full message, wait for more data
-                break;
-            }
-        }
+// Only clears a lock-free atomic, so a signal handler may call it; run() does the logging
+void RTMPServer::stop() {
+    running_.store(false);  // Each event loop notices within one poll interval and closes its listener
+}
 
-        // Remove processed bytes from the buffer
-        if (bytes_processed > 0) {
-            data_buffer.erase(data_buffer.begin(), data_buffer.begin() + bytes_processed);
+ServerStats RTMPServer::stats() const {
+    ServerStats totals = ServerStats();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        const WorkerStats& stats = workers_[i]->stats();
+        totals.connections_accepted += stats.connections_accepted.load(std::memory_order_relaxed);
+        totals.connections_open += stats.connections_open.load(std::memory_order_relaxed);
+        totals.handshake_failures += stats.handshake_failures.load(std::memory_order_relaxed);
+        totals.messages_received += stats.messages_received.load(std::memory_order_relaxed);
+        for (unsigned int type = 0; type <= MESSAGE_TYPE_SLOTS; ++type) {
+            totals.messages_by_type[type] += stats.messages_by_type[type].load(std::memory_order_relaxed);
         }
+        totals.bytes_received += stats.bytes_received.load(std::memory_order_relaxed);
+        totals.bytes_sent += stats.bytes_sent.load(std::memory_order_relaxed);
+        totals.send_queue_bytes += stats.send_queue_bytes.load(std::memory_order_relaxed);
+        totals.chunk_cache_hits += stats.chunk_cache_hits.load(std::memory_order_relaxed);
+        totals.chunk_cache_misses += stats.chunk_cache_misses.load(std::memory_order_relaxed);
+        totals.chunk_header_bytes_saved += stats.chunk_header_bytes_saved.load(std::memory_order_relaxed);
+        totals.acks_sent += stats.acks_sent.load(std::memory_order_relaxed);
+        totals.handshake_timeouts += stats.handshake_timeouts.load(std::memory_order_relaxed);
+        totals.send_window_stalls += stats.send_window_stalls.load(std::memory_order_relaxed);
+        totals.media_dropped += stats.media_dropped.load(std::memory_order_relaxed);
+        totals.slow_disconnects += stats.slow_disconnects.load(std::memory_order_relaxed);
+        totals.vod_players += stats.vod_players.load(std::memory_order_relaxed);
+        totals.vod_bytes += stats.vod_bytes.load(std::memory_order_relaxed);
+        totals.http_requests += stats.http_requests.load(std::memory_order_relaxed);
+        totals.http_flv_players += stats.http_flv_players.load(std::memory_order_relaxed);
+        totals.handshake_time.add(stats.handshake_time);
+        totals.delivery_latency.add(stats.delivery_latency);
     }
-
-    if (read_size == 0) {
-        std::lock_guard<std::mutex> lock(log_mutex);
-        std::cout << "[handle_client] Client from IP: " << client_ip << " disconnected." << std::endl;
-    } else {
-        std::lock_guard<std::mutex> lock(log_mutex);
-        std::cerr << "[handle_client] Error receiving data from client IP: " << client_ip << ", error: " << WSAGetLastError() << std::endl;
+    if (hub_) {
+        totals.gop_cache_bytes = hub_->gop_cache_bytes();
+    }
+    if (recorder_) {
+        const RecorderStats& recording = recorder_->stats();
+        totals.record_bytes_written = recording.bytes_written.load(std::memory_order_relaxed);
+        totals.record_files_opened = recording.files_opened.load(std::memory_order_relaxed);
+        totals.recordings_active = recording.recordings_active.load(std::memory_order_relaxed);
+        totals.record_packets_dropped = recording.packets_dropped.load(std::memory_order_relaxed);
+        totals.record_write_errors = recording.write_errors.load(std::memory_order_relaxed);
+        totals.record_queue_bytes = recording.queued_bytes.load(std::memory_order_relaxed);
     }
 
-    // Close client socket
-    closesocket(client_socket);
-    std::cout << "[handle_client] Closed client socket for IP: " << client_ip << std::endl;
-}
-
+    if (hls_packager_) {
+        const HlsStats& hls = hls_packager_->stats();
+        totals.hls_streams = hls.streams_active.load(std::memory_order_relaxed);
+        totals.hls_segments = hls.segments.load(std::memory_order_relaxed);
+        totals.hls_segment_bytes = hls.segment_bytes.load(std::memory_order_relaxed);
+        totals.hls_packets_dropped = hls.packets_dropped.load(std::memory_order_relaxed);
+        totals.hls_queue_bytes = hls.queued_bytes.load(std::memory_order_relaxed);
+        totals.hls_cpu_ns = hls.cpu_ns.load(std::memory_order_relaxed);
+        totals.hls_store_bytes = hls_store_->bytes();
+        totals.hls_segment_ready.add(hls.segment_ready);
+    }
 
-void RTMPServer::stop() {
-    std::cout << "[" << current_timestamp() << "] [stop] Stopping RTMP server..." << std::endl;
-    running_ = false;
-    closesocket(server_fd);  // Close server socket to stop accepting new connections
-    std::cout << "[" << current_timestamp() << "] [stop] Server has stopped accepting new connections." << std::endl;
+    // The pool is process-wide; oversized requests count as misses but are never cached
+    std::vector<SlabClassStats> classes;
+    SlabPool::stats(classes);
+    for (size_t i = 0; i < classes.size(); ++i) {
+        totals.pool_hits += classes[i].hits;
+        totals.pool_misses += classes[i].misses;
+        totals.pool_in_use_bytes += classes[i].in_use * classes[i].block_size;
+        totals.pool_cached_high_water_bytes += classes[i].cached_high_water * classes[i].block_size;
+    }
+    return totals;
 }
 
 RTMPServer::~RTMPServer() {
-    if (server_fd != INVALID_SOCKET) {
-        std::cout << "[" << current_timestamp() << "] [~RTMPServer] Closing server socket." << std::endl;
-        closesocket(server_fd);
+    if (!workers_.empty()) {
+        LOG_INFO("[~RTMPServer] Closing server sockets.");
+        workers_.clear();
     }
-    WSACleanup();
-    std::cout << "[" << current_timestamp() << "] [~RTMPServer] Winsock cleanup completed." << std::endl;
+    Socket::cleanup();
+    LOG_INFO("[~RTMPServer] Socket cleanup completed.");
 }
@@ -1,31 +1,44 @@
 // Client.h
 #ifndef CLIENT_H
 #define CLIENT_H
-#define BUFFER_SIZE 4096  // Define a buffer size, e.g., 4096 bytes
 
+#include <atomic>
+#include <memory>
 #include <string>
-#include <thread>
 #include <vector>
-#include <mutex>
-#include <winsock2.h>
+#include "HlsPackager.h"
+#include "HlsStore.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
+#include "Recorder.h"
+#include "Socket.h"
+#include "ServerConfig.h"
+#include "Worker.h"
+#include "StreamHub.h"
 
 class RTMPServer {
 public:
-    RTMPServer() : running_(false), server_fd(INVALID_SOCKET) {}
+    RTMPServer() : running_(false) {}
     ~RTMPServer();
-    
+
     bool start(int port);
+    bool start(const ServerConfig& config);
     void run();
-    void stop();
+    void stop();  // Async-signal-safe
     bool is_running() const;
 
-private:
-    void handle_client(SOCKET client_socket, const std::string& client_ip);
+    std::size_t worker_count() const { return workers_.size(); }
+    ServerStats stats() const;
 
-    SOCKET server_fd;
-    bool running_;
-    std::vector<std::thread> client_threads;
-    std::mutex log_mutex;
+private:
+    ServerConfig config_;
+    std::atomic<bool> running_;  // Lock-free, which stop() relies on
+    std::unique_ptr<HlsStore> hls_store_;           // Only with config.hls; workers serve from it
+    std::unique_ptr<HlsPackager> hls_packager_;     // Fills it; outlives the hub and workers
+    std::unique_ptr<Recorder> recorder_;            // Only with config.record_dir; outlives the hub and workers
+    std::unique_ptr<StreamHub> hub_;                // Declared before workers_ so it outlives them
+    std::vector<std::unique_ptr<Worker>> workers_;  // One event loop per core, each with its own connections
+    std::unique_ptr<MetricsServer> metrics_;        // Only with config.metrics_port
 };
 
 #endif // CLIENT_H
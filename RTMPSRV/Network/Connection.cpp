@@ -0,0 +1,594 @@
+#include "Connection.h"
+#include "IOBackend.h"
+#include "Worker.h"     // For WorkerStats and the stream hub
+#include "Parse.h"      // For RTMP parsing and handshake
+#include "Flv.h"
+#include "Http.h"
+#include "ParseControl.h"  // For Acknowledgement
+#include "StreamHub.h"
+#include "VodSession.h"
+#include "Metrics.h"
+#include "Log.h"
+#include <algorithm>
+
+static const std::size_t DEFAULT_CHUNK_SIZE = 128;
+
+// Chunk streams used for media sent to players
+static const unsigned int CSID_AUDIO = 4;
+static const unsigned int CSID_DATA = 5;
+static const unsigned int CSID_VIDEO = 6;
+
+static unsigned int media_csid(unsigned char message_type_id) {
+    return message_type_id == 0x09 ? CSID_VIDEO : (message_type_id == 0x08 ? CSID_AUDIO : CSID_DATA);
+}
+
+// A message chunked around a payload that owner keeps alive
+struct MappedMessage {
+    MappedMessage(const std::shared_ptr<const void>& owner, const char* payload, std::size_t length,
+                  unsigned int timestamp, unsigned char message_type_id, std::size_t chunk_size,
+                  unsigned int csid, unsigned int message_stream_id)
+        : owner(owner),
+          message(payload, length, timestamp, message_type_id, chunk_size, csid, message_stream_id) {}
+
+    std::shared_ptr<const void> owner;
+    ChunkedMessage message;
+};
+
+Connection::Connection(socket_t fd, const std::string& client_ip, IOBackend* backend, Worker* worker, bool http)
+    : fd_(fd),
+      client_ip_(client_ip),
+      backend_(backend),
+      worker_(worker),
+      stats_(&worker->stats()),
+      state_(http ? HTTP : HANDSHAKE_C0),
+      flush_requested_(false),
+      input_pending_(false),
+      close_after_output_(false),
+      accepted_ns_(Metrics::now_ns()),
+      handshake_done_(false),
+      reported_queue_bytes_(0),
+      in_chunk_size_(DEFAULT_CHUNK_SIZE),
+      out_chunk_size_(DEFAULT_CHUNK_SIZE),
+      bytes_in_(0),
+      acked_in_(0),
+      in_ack_window_(0),
+      announced_ack_window_(0),
+      bytes_out_(0),
+      handshake_out_(0),
+      peer_acked_(0),
+      peer_acks_(false),
+      peer_bandwidth_(0),
+      peer_limit_type_(ParseControl::LIMIT_DYNAMIC),
+      window_stalled_(false),
+      object_encoding_(0),
+      role_(ROLE_NONE),
+      media_stream_id_(0),
+      http_flv_(false),
+      http_chunked_(false),
+      sent_video_(false),
+      waiting_keyframe_(false),
+      replaying_cache_(false),
+      sent_through_(0) {
+    stats_->connections_open.fetch_add(1, std::memory_order_relaxed);
+    out_queue_.set_delivery_histogram(&stats_->delivery_latency);
+}
+
+Connection::~Connection() {
+    stop_media();
+    stats_->connections_open.fetch_sub(1, std::memory_order_relaxed);
+    stats_->send_queue_bytes.fetch_sub(reported_queue_bytes_, std::memory_order_relaxed);
+    if (!handshake_done_) {
+        stats_->handshake_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (fd_ != RTMP_INVALID_SOCKET) {
+        Socket::close(fd_);
+        LOG_DEBUG("[Connection] Closed client socket for IP: " << client_ip_);
+    }
+}
+
+bool Connection::on_readable() {
+    // Edge-triggered backends only report new data once, so drain the socket completely,
+    // or flag that we stopped early and let the backend call again
+    input_pending_ = false;
+    std::size_t received = 0;
+    while (!is_closed()) {
+        if (received >= READ_BUDGET) {
+            input_pending_ = true;
+            break;
+        }
+        // Receive straight into the buffer the parser reads from
+        if (!in_buffer_.reserve(BUFFER_SIZE)) {
+            return false;
+        }
+        long read_size = Socket::recv(fd_, in_buffer_.write_ptr(), in_buffer_.writable());
+        if (read_size > 0) {
+            LOG_DEBUG("[on_readable] Received " << read_size << " bytes from client IP: " << client_ip_);
+
+            in_buffer_.commit(read_size);
+            received += read_size;
+            process_input();
+            count_input(read_size);
+            continue;
+        }
+
+        if (read_size == 0) {
+            LOG_INFO("[on_readable] Client from IP: " << client_ip_ << " disconnected.");
+            return false;
+        }
+
+        int error = Socket::last_error();
+        if (Socket::would_block(error)) {
+            break;
+        }
+        if (Socket::interrupted(error)) {
+            continue;
+        }
+        LOG_WARN("[on_readable] Error receiving data from client IP: " << client_ip_ << ", error: " << error);
+        return false;
+    }
+
+    return !is_closed();
+}
+
+bool Connection::on_data(const char* data, std::size_t length) {
+    // Append received data to the local buffer and parse whatever is complete
+    if (!in_buffer_.append(data, length)) {
+        return false;
+    }
+    process_input();
+    count_input(length);
+    return !is_closed();
+}
+
+bool Connection::on_writable() {
+    flush_requested_ = false;
+
+    // Everything queued goes out in as few sendmsg() calls as the segment limit allows
+    ChunkSegment segments[Socket::MAX_SEND_SEGMENTS];
+    while (has_pending_output() && !output_blocked()) {
+        std::size_t count = out_queue_.gather(segments, Socket::MAX_SEND_SEGMENTS, false);
+        long sent = Socket::send_segments(fd_, segments, count);
+        if (sent > 0) {
+            out_queue_.consume(sent);
+            count_output(sent);
+            continue;
+        }
+
+        int error = Socket::last_error();
+        if (sent < 0 && Socket::would_block(error)) {
+            update_queue_gauge();
+            return true;  // The backend calls us again once the socket drains
+        }
+        if (sent < 0 && Socket::interrupted(error)) {
+            continue;
+        }
+        LOG_WARN("[on_writable] Send failed for client IP: " << client_ip_ << ", error: " << error);
+        return false;
+    }
+
+    update_queue_gauge();
+    return !is_closed() && !(close_after_output_ && !has_pending_output());
+}
+
+bool Connection::send(const char* data, std::size_t length) {
+    if (is_closed()) {
+        return false;
+    }
+
+    out_queue_.append(data, length);
+    schedule_flush();
+    return true;
+}
+
+std::size_t Connection::pin_output(ChunkSegment* segments, std::size_t max) {
+    flush_requested_ = false;
+    if (output_blocked()) {
+        return 0;  // An Acknowledgement schedules the next flush
+    }
+    return out_queue_.gather(segments, max, true);
+}
+
+bool Connection::complete_output(std::size_t sent) {
+    out_queue_.consume(sent);
+    count_output(sent);
+    update_queue_gauge();
+    return !is_closed() && !(close_after_output_ && !has_pending_output());
+}
+
+unsigned int Connection::preferred_ack_window() const {
+    return worker_->ack_window();
+}
+
+void Connection::set_peer_bandwidth(unsigned int size, unsigned char limit_type) {
+    // Dynamic only counts after a hard limit; soft may lower the limit but never raise it
+    if (limit_type == ParseControl::LIMIT_DYNAMIC) {
+        if (peer_limit_type_ != ParseControl::LIMIT_HARD) {
+            return;
+        }
+        limit_type = ParseControl::LIMIT_HARD;
+    }
+    if (limit_type == ParseControl::LIMIT_SOFT && peer_bandwidth_ != 0 && peer_bandwidth_ < size) {
+        return;
+    }
+    peer_bandwidth_ = size;
+    peer_limit_type_ = limit_type;
+    if (has_pending_output()) {
+        schedule_flush();  // The new limit may be the larger one
+    }
+}
+
+void Connection::on_acknowledgement(unsigned int sequence_number) {
+    peer_acked_ = sequence_number;
+    peer_acks_ = true;
+    if (has_pending_output()) {
+        schedule_flush();
+    }
+}
+
+bool Connection::send_window_full() const {
+    // A client that never acknowledges is never held back
+    if (!peer_acks_) {
+        return false;
+    }
+    // Headroom over the window we announced, since clients acknowledge only once they have
+    // received more than it, and we echo their Set Peer Bandwidth as that window
+    unsigned long long limit = 2ull * announced_ack_window_;
+    if (peer_bandwidth_ > limit) {
+        limit = peer_bandwidth_;
+    }
+    if (limit == 0) {
+        return false;
+    }
+    // Sequence numbers wrap at 2^32; a client that counts more than we sent has nothing in flight
+    int unacked = static_cast<int>(static_cast<unsigned int>(bytes_out_ - handshake_out_) - peer_acked_);
+    return unacked > 0 && static_cast<unsigned long long>(unacked) >= limit;
+}
+
+bool Connection::output_blocked() {
+    bool full = send_window_full();
+    if (full && !window_stalled_) {
+        stats_->send_window_stalls.fetch_add(1, std::memory_order_relaxed);
+    }
+    window_stalled_ = full;
+    return full;
+}
+
+void Connection::count_input(std::size_t length) {
+    bytes_in_ += length;
+    stats_->bytes_received.fetch_add(length, std::memory_order_relaxed);
+
+    unsigned int window = in_ack_window_ != 0 ? in_ack_window_ : announced_ack_window_;
+    if (state_ != ESTABLISHED || window == 0 || bytes_in_ - acked_in_ < window) {
+        return;
+    }
+    acked_in_ = bytes_in_;
+    ParseControl::send_acknowledgement(*this, static_cast<unsigned int>(bytes_in_));
+    stats_->acks_sent.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Connection::count_output(std::size_t length) {
+    bytes_out_ += length;
+    stats_->bytes_sent.fetch_add(length, std::memory_order_relaxed);
+}
+
+void Connection::schedule_flush() {
+    update_queue_gauge();
+    if (!flush_requested_) {
+        flush_requested_ = true;
+        backend_->request_flush(this);
+    }
+}
+
+bool Connection::send_message(unsigned int csid, unsigned int timestamp, unsigned char message_type_id,
+                              unsigned int message_stream_id, const char* payload, std::size_t length) {
+    ChunkedMessage message(payload, length, timestamp, message_type_id, out_chunk_size_, csid, message_stream_id);
+    record_chunking(length);
+    return send_chunked(message);
+}
+
+std::size_t Connection::preferred_out_chunk_size() const {
+    return worker_->chunk_size();
+}
+
+void Connection::record_chunking(std::size_t payload_length) {
+    // One-byte fmt 3 basic header per continuation chunk; the csids we send are all below 64
+    if (payload_length > DEFAULT_CHUNK_SIZE && out_chunk_size_ > DEFAULT_CHUNK_SIZE) {
+        std::size_t saved = (payload_length - 1) / DEFAULT_CHUNK_SIZE - (payload_length - 1) / out_chunk_size_;
+        stats_->chunk_header_bytes_saved.fetch_add(saved, std::memory_order_relaxed);
+    }
+}
+
+bool Connection::send_chunked(const ChunkedMessage& message) {
+    if (is_closed()) {
+        return false;
+    }
+
+    const ChunkSegment* segments = message.segments();
+    for (size_t i = 0; i < message.segment_count(); ++i) {
+        out_queue_.append(segments[i].data, segments[i].length);
+    }
+    schedule_flush();
+    return true;
+}
+
+bool Connection::send_shared(const std::shared_ptr<const void>& owner, const char* data, std::size_t length) {
+    if (is_closed()) {
+        return false;
+    }
+
+    out_queue_.append(owner, data, length, SendQueue::PRIORITY_ESSENTIAL);
+    schedule_flush();
+    return true;
+}
+
+bool Connection::start_publishing(const std::string& stream_name) {
+    if (role_ != ROLE_NONE) {
+        LOG_WARN("[start_publishing] Client " << client_ip_ << " already publishes or plays a stream.");
+        return false;
+    }
+
+    stream_ = worker_->hub().publish(app_ + "/" + stream_name, this);
+    if (!stream_) {
+        return false;
+    }
+    role_ = ROLE_PUBLISHER;
+    return true;
+}
+
+void Connection::start_playing(const std::string& stream_name, unsigned int message_stream_id) {
+    media_stream_id_ = message_stream_id;
+    attach_player(app_ + "/" + stream_name);
+}
+
+void Connection::start_http_flv(const std::string& key, bool http_chunked) {
+    http_flv_ = true;
+    http_chunked_ = http_chunked;
+
+    // Whether the stream has audio or video is only known once its packets arrive; players
+    // go by the tags, so announce both
+    char header[Flv::FILE_HEADER_SIZE];
+    Flv::write_file_header(header, true, true);
+    if (http_chunked_) {
+        send("d\r\n", 3);
+        send(header, sizeof(header));
+        send("\r\n", 2);
+    } else {
+        send(header, sizeof(header));
+    }
+    stats_->http_flv_players.fetch_add(1, std::memory_order_relaxed);
+    attach_player(key);
+}
+
+void Connection::attach_player(const std::string& key) {
+    stream_ = worker_->hub().play(key, worker_->id(), this);
+    role_ = ROLE_PLAYER;
+    waiting_keyframe_ = true;
+
+    // Start from metadata, decoder configuration and the current GOP instead of waiting for
+    // the next keyframe. A packet cached here may also be in flight to us from another
+    // worker, so remember how far the cache went.
+    std::vector<MediaPacketPtr> initial;
+    unsigned long long last_sequence = stream_->initial_packets(initial);
+    sent_through_ = 0;
+    replaying_cache_ = true;
+    for (size_t i = 0; i < initial.size(); ++i) {
+        send_media(initial[i]);
+    }
+    replaying_cache_ = false;
+    sent_through_ = last_sequence;
+}
+
+bool Connection::start_vod(const std::string& stream_name, double start, double duration,
+                           unsigned int message_stream_id) {
+    // -2000 (-2 from older clients) prefers a live stream of that name when there is one;
+    // every other negative start is live only
+    bool prefer_live = start == -2000.0 || start == -2.0;
+    if (role_ != ROLE_NONE || worker_->vod_dir().empty() || (start < 0 && !prefer_live) ||
+        (prefer_live && worker_->hub().is_live(app_ + "/" + stream_name))) {
+        return false;
+    }
+    std::string path;
+    if (!VodFile::resolve(worker_->vod_dir(), app_, stream_name, path)) {
+        return false;
+    }
+    std::shared_ptr<const VodFile> file = VodFile::open(path);
+    if (!file) {
+        return false;
+    }
+
+    // Start and duration are in milliseconds; the session sends its first tags before this loop iteration ends
+    unsigned int start_ms = start > 0 && start < 4294967295.0 ? static_cast<unsigned int>(start) : 0;
+    long long duration_ms = duration >= 0 && duration < 9e18 ? static_cast<long long>(duration) : -1;
+    role_ = ROLE_VOD_PLAYER;
+    media_stream_id_ = message_stream_id;
+    vod_.reset(new VodSession(*this, worker_->vod(), file, start_ms, duration_ms));
+    stats_->vod_players.fetch_add(1, std::memory_order_relaxed);
+    LOG_INFO("[start_vod] Client " << client_ip_ << " plays " << path << " from " << start_ms << " ms.");
+    return true;
+}
+
+void Connection::pause_media(bool paused) {
+    if (vod_) {
+        vod_->pause(paused);
+    }
+}
+
+void Connection::stop_media() {
+    if (role_ == ROLE_PUBLISHER) {
+        worker_->hub().unpublish(stream_, this);
+    } else if (role_ == ROLE_PLAYER) {
+        worker_->hub().stop_playing(stream_, worker_->id(), this);
+        if (http_flv_) {
+            stats_->http_flv_players.fetch_sub(1, std::memory_order_relaxed);
+            http_flv_ = false;
+        }
+    } else if (role_ == ROLE_VOD_PLAYER) {
+        vod_.reset();
+        stats_->vod_players.fetch_sub(1, std::memory_order_relaxed);
+    }
+    role_ = ROLE_NONE;
+    stream_.reset();
+}
+
+void Connection::publish_media(unsigned int timestamp, unsigned char message_type_id,
+                               const char* data, std::size_t length, PooledBytes* buffer) {
+    if (role_ != ROLE_PUBLISHER) {
+        return;  // Media from a client that never issued publish
+    }
+
+    std::shared_ptr<MediaPacket> packet = std::allocate_shared<MediaPacket>(PoolAllocator<MediaPacket>());
+    packet->sequence = stream_->next_sequence();
+    packet->timestamp = timestamp;
+    packet->message_type_id = message_type_id;
+    packet->ingest_ns = Metrics::now_ns();
+    if (buffer) {
+        packet->payload.swap(*buffer);
+    } else {
+        packet->payload.assign(data, length);
+    }
+
+    // Encoders wrap metadata as @setDataFrame("onMetaData", ...); players expect plain onMetaData
+    static const char set_data_frame[] = "\x02\x00\x0D@setDataFrame";
+    const std::size_t prefix_length = sizeof(set_data_frame) - 1;
+    if (message_type_id == 0x12 && packet->payload.size() > prefix_length &&
+        std::equal(set_data_frame, set_data_frame + prefix_length, packet->payload.begin())) {
+        packet->payload.erase_front(prefix_length);
+    }
+
+    worker_->hub().broadcast(stream_, worker_->id(), packet);
+}
+
+void Connection::send_media(const MediaPacketPtr& packet) {
+    if (is_closed()) {
+        return;
+    }
+    if (packet->sequence <= sent_through_) {
+        return;  // Already sent from the GOP cache
+    }
+
+    SendQueue::Priority priority = SendQueue::PRIORITY_ESSENTIAL;
+    if (packet->is_audio() && !packet->is_sequence_header()) {
+        priority = SendQueue::PRIORITY_AUDIO;
+    } else if (packet->is_video() && !packet->is_sequence_header() && !packet->is_keyframe()) {
+        priority = SendQueue::PRIORITY_INTER_FRAME;
+    }
+
+    // Shed load for a player that is not keeping up, so it neither holds on to every
+    // packet since it stalled nor ever makes the publisher wait
+    const BackpressurePolicy& policy = worker_->backpressure();
+    std::size_t queued = out_queue_.queued_bytes();
+    if (queued >= policy.drop_inter_frames_bytes) {
+        if (queued >= policy.disconnect_bytes) {
+            LOG_WARN("[send_media] Player " << client_ip_ << " is " << queued << " bytes behind, disconnecting.");
+            stats_->slow_disconnects.fetch_add(1, std::memory_order_relaxed);
+            close();
+            // Ask even if a flush is already pending: a completion-based backend with a
+            // send in flight to this stalled peer would not look at us again otherwise
+            backend_->request_flush(this);
+            return;
+        }
+
+        SendQueue::Priority shed = queued >= policy.drop_audio_bytes || http_flv_ ? SendQueue::PRIORITY_AUDIO
+                                                                                  : SendQueue::PRIORITY_INTER_FRAME;
+        std::size_t dropped = out_queue_.drop(shed);
+        waiting_keyframe_ = true;  // Frames after the gap reference ones the player never got
+        if (priority >= shed) {
+            ++dropped;
+        }
+        stats_->media_dropped.fetch_add(dropped, std::memory_order_relaxed);
+        if (priority >= shed) {
+            update_queue_gauge();
+            return;
+        }
+    }
+
+    if (packet->is_video() && waiting_keyframe_ && !packet->is_sequence_header()) {
+        if (!packet->is_keyframe()) {
+            return;  // Undecodable without the preceding keyframe
+        }
+        waiting_keyframe_ = false;
+    }
+    if (http_flv_) {
+        // Audio of a stream with video resumes along with it, so the two stay in step
+        if (waiting_keyframe_ && sent_video_ && priority == SendQueue::PRIORITY_AUDIO) {
+            return;
+        }
+        sent_video_ = sent_video_ || packet->is_video();
+        bool hit;
+        const FlvTag& tag = packet->flv_tag(hit);
+        (hit ? stats_->chunk_cache_hits : stats_->chunk_cache_misses).fetch_add(1, std::memory_order_relaxed);
+        out_queue_.append(packet, tag.segments(http_chunked_), tag.segment_count(), tag.total_length(http_chunked_),
+                          priority, replaying_cache_ ? 0 : packet->ingest_ns);
+        schedule_flush();
+        return;
+    }
+
+    // Players sharing a chunk size and stream id reuse the first one's serialization,
+    // and the queue only references it
+    unsigned int csid = media_csid(packet->message_type_id);
+    bool hit;
+    const ChunkedMessage& chunked = packet->chunked(out_chunk_size_, csid, media_stream_id_, hit);
+    (hit ? stats_->chunk_cache_hits : stats_->chunk_cache_misses).fetch_add(1, std::memory_order_relaxed);
+    record_chunking(packet->payload.size());
+    out_queue_.append(packet, chunked, priority, replaying_cache_ ? 0 : packet->ingest_ns);
+    schedule_flush();
+}
+
+bool Connection::send_mapped_media(const std::shared_ptr<const void>& owner, unsigned int timestamp,
+                                   unsigned char message_type_id, const char* payload, std::size_t length) {
+    if (is_closed()) {
+        return false;
+    }
+    std::shared_ptr<MappedMessage> mapped = std::allocate_shared<MappedMessage>(
+        PoolAllocator<MappedMessage>(), owner, payload, length, timestamp, message_type_id, out_chunk_size_,
+        media_csid(message_type_id), media_stream_id_);
+    record_chunking(length);
+    stats_->vod_bytes.fetch_add(length, std::memory_order_relaxed);
+    out_queue_.append(mapped, mapped->message, SendQueue::PRIORITY_ESSENTIAL);
+    schedule_flush();
+    return true;
+}
+
+void Connection::record_message(unsigned char message_type_id) {
+    stats_->messages_received.fetch_add(1, std::memory_order_relaxed);
+    stats_->messages_by_type[Metrics::message_type_slot(message_type_id)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Connection::update_queue_gauge() {
+    unsigned long long queued = out_queue_.queued_bytes();
+    if (queued != reported_queue_bytes_) {
+        // Unsigned wrap-around makes a shrinking queue subtract
+        stats_->send_queue_bytes.fetch_add(queued - reported_queue_bytes_, std::memory_order_relaxed);
+        reported_queue_bytes_ = queued;
+    }
+}
+
+void Connection::process_input() {
+    // Process complete handshake segments and RTMP messages in place
+    while (in_buffer_.readable() > 0 && !is_closed()) {
+        const char* data = in_buffer_.read_ptr();
+        size_t length = in_buffer_.readable();
+
+        size_t consumed;
+        if (state_ == ESTABLISHED) {
+            consumed = Parse::parse_rtmp_packet(data, length, *this);
+        } else if (state_ == HTTP) {
+            // A complete request counts as the handshake; the deadline drops clients that never send one
+            consumed = Http::handle_request(*this, *worker_, data, length);
+            handshake_done_ = handshake_done_ || consumed > 0;
+        } else {
+            consumed = Parse::perform_handshake(*this, data, length);
+            if (state_ == ESTABLISHED) {
+                handshake_done_ = true;
+                handshake_out_ = bytes_out_ + out_queue_.queued_bytes();  // All of it S0, S1 and S2
+                stats_->handshake_time.record((Metrics::now_ns() - accepted_ns_) / 1000);
+            }
+        }
+
+        if (consumed == 0) {
+            // Not enough data to parse a full message, wait for more data
+            break;
+        }
+        in_buffer_.consume(consumed);
+    }
+}
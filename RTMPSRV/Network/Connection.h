@@ -0,0 +1,227 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+#define BUFFER_SIZE 4096  // Minimum free space offered to each recv() call
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef> // For std::size_t
+#include "Socket.h"
+#include "ChunkStream.h"
+#include "ChunkCache.h"
+#include "RecvBuffer.h"
+#include "SendQueue.h"
+#include "StreamHub.h"
+
+class IOBackend;
+class VodSession;
+class Worker;
+struct WorkerStats;
+
+// Per-client state owned by an IOBackend: where the client is in the handshake,
+// bytes received but not yet parsed, bytes queued but not yet written, and the
+// stream it publishes or plays, if any.
+class Connection {
+public:
+    enum State {
+        HANDSHAKE_C0,    // Waiting for C0
+        HANDSHAKE_C1,    // S0/S1 queued, waiting for C1
+        HANDSHAKE_C2,    // S2 queued, waiting for C2
+        ESTABLISHED,     // Exchanging RTMP chunks
+        HTTP,            // Accepted on the HTTP listener; requests go to Http
+        CLOSED
+    };
+
+    // Bytes one readiness event may consume before the loop moves on to flushing and
+    // other connections, so a fast publisher cannot starve its own players
+    static const std::size_t READ_BUDGET = 64 * 1024;
+
+    enum Role {
+        ROLE_NONE,
+        ROLE_PUBLISHER,
+        ROLE_PLAYER,
+        ROLE_VOD_PLAYER
+    };
+
+    Connection(socket_t fd, const std::string& client_ip, IOBackend* backend, Worker* worker, bool http = false);
+    ~Connection();
+
+    socket_t fd() const { return fd_; }
+    const std::string& client_ip() const { return client_ip_; }
+    State state() const { return state_; }
+    void set_state(State state) { state_ = state; }
+    bool is_closed() const { return state_ == CLOSED; }
+    void close() { state_ = CLOSED; }
+
+    // Whether the handshake is still unfinished timeout_ns after accept
+    bool handshake_expired(unsigned long long now_ns, unsigned long long timeout_ns) const {
+        return !handshake_done_ && now_ns - accepted_ns_ >= timeout_ns;
+    }
+    unsigned long long accepted_ns() const { return accepted_ns_; }
+
+    // Reads until the socket would block or READ_BUDGET bytes were taken in, parsing as data
+    // arrives; input_pending() then tells whether the socket may still hold more.
+    // Returns false once the connection should be torn down.
+    bool on_readable();
+    bool input_pending() const { return input_pending_; }
+
+    // Parses bytes a completion-based backend already received on our behalf.
+    // Returns false once the connection should be torn down.
+    bool on_data(const char* data, std::size_t length);
+
+    // Writes as much queued output as the socket accepts.
+    // Returns false once the connection should be torn down.
+    bool on_writable();
+
+    // Queues bytes for the client; the owning backend flushes them after the current batch.
+    bool send(const char* data, std::size_t length);
+    // Tears the connection down once everything queued so far has been written, for HTTP
+    // responses that announce Connection: close. Further input is ignored meanwhile.
+    void close_after_output() { close_after_output_ = true; }
+    bool closing_after_output() const { return close_after_output_; }
+    bool has_pending_output() const { return !out_queue_.empty(); }
+    std::size_t queued_bytes() const { return out_queue_.queued_bytes(); }
+
+    // For backends that write asynchronously: fills segments from the front of the output
+    // queue and returns how many. They stay valid until complete_output() reports how
+    // much of them was written, which returns false once the connection should be torn down.
+    std::size_t pin_output(ChunkSegment* segments, std::size_t max);
+    bool complete_output(std::size_t sent);
+
+    // Queues a whole RTMP message split into chunks of the outbound chunk size
+    bool send_message(unsigned int csid, unsigned int timestamp, unsigned char message_type_id,
+                      unsigned int message_stream_id, const char* payload, std::size_t length);
+
+    // Queues a copy of a message that is already split into chunks
+    bool send_chunked(const ChunkedMessage& message);
+
+    // Queues bytes that owner keeps alive by reference, such as an HTTP response body
+    bool send_shared(const std::shared_ptr<const void>& owner, const char* data, std::size_t length);
+
+    // Chunk sizes per direction: what the client announced for its chunks, and what we
+    // announced for ours. Both start at the protocol default of 128.
+    std::size_t in_chunk_size() const { return in_chunk_size_; }
+    void set_in_chunk_size(std::size_t size) { in_chunk_size_ = size; }
+    std::size_t out_chunk_size() const { return out_chunk_size_; }
+    void set_out_chunk_size(std::size_t size) { out_chunk_size_ = size; }
+    // What the server announces after connect (ServerConfig::chunk_size)
+    std::size_t preferred_out_chunk_size() const;
+
+    // Acknowledgement windows. We acknowledge the client's input every set_ack_window()
+    // bytes since accept (our own announced window until it picks one). Once it acknowledges
+    // ours, which it counts from the end of the handshake, output stops while more than its
+    // Set Peer Bandwidth or twice our window, whichever is larger, is unacknowledged; what
+    // piles up meanwhile is subject to the BackpressurePolicy like any other backlog.
+    unsigned int preferred_ack_window() const;  // ServerConfig::ack_window
+    unsigned int announced_ack_window() const { return announced_ack_window_; }
+    void set_announced_ack_window(unsigned int size) { announced_ack_window_ = size; }
+    void set_ack_window(unsigned int size) { in_ack_window_ = size; }
+    void set_peer_bandwidth(unsigned int size, unsigned char limit_type);
+    void on_acknowledgement(unsigned int sequence_number);
+    bool send_window_full() const;
+
+    // Counts the chunk headers a message of this length saved by going out at
+    // out_chunk_size() instead of 128
+    void record_chunking(std::size_t payload_length);
+
+    // Called by the parser for every complete message it dispatches
+    void record_message(unsigned char message_type_id);
+
+    // Application name from the connect command; stream keys are "app/name"
+    const std::string& app() const { return app_; }
+    void set_app(const std::string& app) { app_ = app; }
+
+    // objectEncoding from connect: 3 means the client wants replies in AMF3, 0 plain AMF0
+    unsigned int object_encoding() const { return object_encoding_; }
+    void set_object_encoding(unsigned int encoding) { object_encoding_ = encoding; }
+
+    Role role() const { return role_; }
+    bool start_publishing(const std::string& stream_name);
+    // Callers check role() first, so the status can go out before the cached packets do
+    void start_playing(const std::string& stream_name, unsigned int message_stream_id);
+    // Plays the live stream key ("app/name") as the body of an HTTP-FLV response whose
+    // header is already queued: the FLV header, then every packet as a tag, each one an
+    // HTTP/1.1 chunk when http_chunked is set
+    void start_http_flv(const std::string& key, bool http_chunked);
+    // Plays the FLV file the name maps to under ServerConfig::vod_dir instead, unless start
+    // (play's start argument) asks for live only, or for live first and the stream is live.
+    // Returns false when there is no such file, so the caller falls back to live.
+    bool start_vod(const std::string& stream_name, double start, double duration, unsigned int message_stream_id);
+    void pause_media(bool paused);  // VOD only; live players keep receiving
+    void stop_media();
+    unsigned int media_stream_id() const { return media_stream_id_; }
+
+    // Publisher: hands an audio/video/data message to the hub. If the parser reassembled it,
+    // buffer holds the payload and is taken over instead of copied.
+    void publish_media(unsigned int timestamp, unsigned char message_type_id,
+                       const char* data, std::size_t length, PooledBytes* buffer);
+
+    // Player: queues a packet from the stream it plays, by reference. A player that falls
+    // behind sheds inter frames, then audio, then gets disconnected (see BackpressurePolicy).
+    // An HTTP-FLV viewer sheds both at once and skips everything up to the next keyframe:
+    // its players buffer rather than drop, and only catch up by skipping ahead.
+    void send_media(const MediaPacketPtr& packet);
+
+    // VOD player: queues a message whose payload lives in memory owner keeps alive, such as
+    // a mapped file, chunked around the payload rather than copying it where it fits one chunk
+    bool send_mapped_media(const std::shared_ptr<const void>& owner, unsigned int timestamp,
+                           unsigned char message_type_id, const char* payload, std::size_t length);
+
+    ChunkStreamTable& chunk_streams() { return chunk_streams_; }
+
+private:
+    void process_input();
+    void attach_player(const std::string& key);  // Joins the hub and queues the GOP cache
+    void schedule_flush();
+    void update_queue_gauge();  // Brings the worker's send_queue_bytes up to date with ours
+    void count_input(std::size_t length);   // Acknowledges the client's input once a window is full
+    void count_output(std::size_t length);
+    bool output_blocked();      // send_window_full(), counting the stall
+
+    socket_t fd_;
+    std::string client_ip_;
+    IOBackend* backend_;
+    Worker* worker_;
+    WorkerStats* stats_;
+    State state_;
+    bool flush_requested_;
+    bool input_pending_;
+    bool close_after_output_;
+    unsigned long long accepted_ns_;           // For the handshake time
+    bool handshake_done_;
+    unsigned long long reported_queue_bytes_;  // Our share of the worker's send_queue_bytes
+
+    RecvBuffer in_buffer_;          // Received bytes not yet consumed by the parser
+    SendQueue out_queue_;           // Output not yet accepted by the socket
+
+    ChunkStreamTable chunk_streams_;  // Inbound chunk stream headers and partial messages
+    std::size_t in_chunk_size_;       // Chunk size the client sends with
+    std::size_t out_chunk_size_;      // Chunk size we send with (the RTMP default until announced)
+
+    unsigned long long bytes_in_;          // Received since accept, handshake included
+    unsigned long long acked_in_;          // bytes_in_ when we last acknowledged
+    unsigned int in_ack_window_;           // Client's Window Acknowledgement Size; 0 = use ours
+    unsigned int announced_ack_window_;    // Last Window Acknowledgement Size we sent; 0 = none yet
+    unsigned long long bytes_out_;         // Taken by the socket since accept
+    unsigned long long handshake_out_;     // Of those, the handshake's; acknowledgements count the rest
+    unsigned int peer_acked_;              // Sequence number of the client's last Acknowledgement
+    bool peer_acks_;                       // Whether it has acknowledged at all
+    unsigned int peer_bandwidth_;          // From its Set Peer Bandwidth; 0 = none
+    unsigned char peer_limit_type_;
+    bool window_stalled_;                  // Output is waiting for an Acknowledgement
+
+    std::string app_;
+    unsigned int object_encoding_;
+    Role role_;
+    std::shared_ptr<Stream> stream_;
+    unsigned int media_stream_id_;    // Message stream the player receives media on
+    bool http_flv_;                   // Player receives FLV tags in an HTTP response, not RTMP chunks
+    bool http_chunked_;               // With chunked transfer coding
+    bool sent_video_;                 // Player has been sent video; HTTP-FLV resyncs audio on keyframes then
+    bool waiting_keyframe_;           // Player skips inter frames until the first keyframe
+    bool replaying_cache_;            // Sending the GOP cache, whose delivery latency means nothing
+    unsigned long long sent_through_; // Live packets up to this sequence already came from the GOP cache
+    std::unique_ptr<VodSession> vod_; // With ROLE_VOD_PLAYER
+};
+
+#endif // CONNECTION_H
@@ -0,0 +1,56 @@
+#include "FastRandom.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <thread>
+
+namespace {
+
+uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+struct Xorshift128Plus {
+    uint64_t s0;
+    uint64_t s1;
+
+    Xorshift128Plus() {
+        // random_device alone may be deterministic on some toolchains, so mix in more
+        std::random_device device;
+        uint64_t seed = (static_cast<uint64_t>(device()) << 32) ^ device();
+        seed ^= static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        seed ^= static_cast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) << 1;
+        s0 = splitmix64(seed);
+        s1 = splitmix64(seed);
+    }
+
+    uint64_t next() {
+        uint64_t x = s0;
+        uint64_t y = s1;
+        s0 = y;
+        x ^= x << 23;
+        s1 = x ^ y ^ (x >> 17) ^ (y >> 26);
+        return s1 + y;
+    }
+};
+
+} // namespace
+
+void FastRandom::fill(char* out, std::size_t length) {
+    static thread_local Xorshift128Plus generator;
+    while (length >= 8) {
+        uint64_t value = generator.next();
+        std::memcpy(out, &value, 8);
+        out += 8;
+        length -= 8;
+    }
+    if (length > 0) {
+        uint64_t value = generator.next();
+        std::memcpy(out, &value, length);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef FASTRANDOM_H
+#define FASTRANDOM_H
+
+#include <cstddef> // For std::size_t
+
+// Non-cryptographic random bytes from a xorshift128+ generator per thread, seeded once
+// from std::random_device, the clock and the thread. Handshake filler only has to differ
+// between connections; it never needs to be unpredictable.
+class FastRandom {
+public:
+    static void fill(char* out, std::size_t length);
+};
+
+#endif // FASTRANDOM_H
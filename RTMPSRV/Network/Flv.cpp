@@ -0,0 +1,45 @@
+#include "Flv.h"
+
+static void write_u24(char* out, unsigned int value) {
+    out[0] = static_cast<char>((value >> 16) & 0xFF);
+    out[1] = static_cast<char>((value >> 8) & 0xFF);
+    out[2] = static_cast<char>(value & 0xFF);
+}
+
+static unsigned int read_u24(const char* in) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(in);
+    return (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+}
+
+void Flv::write_file_header(char* out, bool audio, bool video) {
+    out[0] = 'F';
+    out[1] = 'L';
+    out[2] = 'V';
+    out[3] = 0x01;  // Version
+    out[4] = static_cast<char>((audio ? 0x04 : 0) | (video ? 0x01 : 0));
+    out[5] = 0x00;  // Header size, 9 (big-endian)
+    out[6] = 0x00;
+    out[7] = 0x00;
+    out[8] = 0x09;
+    out[9] = out[10] = out[11] = out[12] = 0x00;  // PreviousTagSize0
+}
+
+void Flv::write_tag_header(char* out, unsigned char type, std::size_t body_size, unsigned int timestamp) {
+    out[0] = static_cast<char>(type);
+    write_u24(out + 1, static_cast<unsigned int>(body_size));
+    write_u24(out + 4, timestamp & 0xFFFFFF);
+    out[7] = static_cast<char>((timestamp >> 24) & 0xFF);
+    write_u24(out + 8, 0);  // Stream ID, always 0
+}
+
+void Flv::write_tag_trailer(char* out, std::size_t body_size) {
+    unsigned int tag_size = static_cast<unsigned int>(TAG_HEADER_SIZE + body_size);
+    out[0] = static_cast<char>((tag_size >> 24) & 0xFF);
+    write_u24(out + 1, tag_size & 0xFFFFFF);
+}
+
+void Flv::read_tag_header(const char* in, unsigned char& type, std::size_t& body_size, unsigned int& timestamp) {
+    type = static_cast<unsigned char>(in[0]) & 0x1F;  // The upper bits flag filtered (encrypted) tags
+    body_size = read_u24(in + 1);
+    timestamp = read_u24(in + 4) | (static_cast<unsigned int>(static_cast<unsigned char>(in[7])) << 24);
+}
@@ -0,0 +1,37 @@
+#ifndef FLV_H
+#define FLV_H
+
+#include <cstddef> // For std::size_t
+
+// FLV container framing around RTMP media messages. An audio (8), video (9) or script
+// data (18) message body is an FLV tag body as it is, so a file or HTTP stream is just
+// the header, then per message an 11-byte tag header, the body and the tag's total size.
+class Flv {
+public:
+    static const std::size_t FILE_HEADER_SIZE = 13;  // Signature, version, flags, header size, PreviousTagSize0
+    static const std::size_t TAG_HEADER_SIZE = 11;
+    static const std::size_t TAG_TRAILER_SIZE = 4;   // PreviousTagSize
+    static const std::size_t TAG_OVERHEAD = TAG_HEADER_SIZE + TAG_TRAILER_SIZE;
+
+    static const unsigned char TAG_AUDIO = 8;
+    static const unsigned char TAG_VIDEO = 9;
+    static const unsigned char TAG_SCRIPT = 18;
+
+    static bool is_tag_type(unsigned char message_type_id) {
+        return message_type_id == TAG_AUDIO || message_type_id == TAG_VIDEO || message_type_id == TAG_SCRIPT;
+    }
+
+    // Writes FILE_HEADER_SIZE bytes announcing audio and/or video
+    static void write_file_header(char* out, bool audio, bool video);
+
+    // Writes TAG_HEADER_SIZE bytes; timestamps past 24 bits go into the extension byte
+    static void write_tag_header(char* out, unsigned char type, std::size_t body_size, unsigned int timestamp);
+
+    // Writes TAG_TRAILER_SIZE bytes closing a tag with this body size
+    static void write_tag_trailer(char* out, std::size_t body_size);
+
+    // Reads the TAG_HEADER_SIZE bytes at in
+    static void read_tag_header(const char* in, unsigned char& type, std::size_t& body_size, unsigned int& timestamp);
+};
+
+#endif // FLV_H
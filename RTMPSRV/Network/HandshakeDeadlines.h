@@ -0,0 +1,47 @@
+#ifndef HANDSHAKEDEADLINES_H
+#define HANDSHAKEDEADLINES_H
+
+#include <deque>
+#include "Socket.h"
+
+// Sockets still handshaking, in accept order and therefore in deadline order. A backend
+// adds every socket it accepts and, once per loop iteration, closes those popped here
+// whose connection has not finished its handshake, so clients that connect and then send
+// nothing, or trickle C1 a byte at a time, cannot hold on to a connection.
+class HandshakeDeadlines {
+public:
+    HandshakeDeadlines() : timeout_ns_(0) {}
+
+    void set_timeout_ms(unsigned int timeout_ms) { timeout_ns_ = timeout_ms * 1000000ull; }
+    unsigned long long timeout_ns() const { return timeout_ns_; }
+    bool empty() const { return entries_.empty(); }
+
+    void add(socket_t fd, unsigned long long accepted_ns) {
+        if (timeout_ns_ != 0) {
+            Entry entry = { accepted_ns + timeout_ns_, fd };
+            entries_.push_back(entry);
+        }
+    }
+
+    // Next socket whose deadline has passed. The socket may since have been closed or
+    // reused, so the caller checks the connection it belongs to now.
+    bool pop_expired(unsigned long long now_ns, socket_t& fd) {
+        if (entries_.empty() || entries_.front().deadline_ns > now_ns) {
+            return false;
+        }
+        fd = entries_.front().fd;
+        entries_.pop_front();
+        return true;
+    }
+
+private:
+    struct Entry {
+        unsigned long long deadline_ns;
+        socket_t fd;
+    };
+
+    std::deque<Entry> entries_;
+    unsigned long long timeout_ns_;  // 0 disables the deadline
+};
+
+#endif // HANDSHAKEDEADLINES_H
@@ -0,0 +1,249 @@
+#include "HlsPackager.h"
+#include "Log.h"
+#include "Nal.h"
+#include "TsMuxer.h"
+
+namespace {
+
+const unsigned char CODEC_AVC = 7;
+const unsigned char CODEC_AAC = 10;
+const unsigned char AVC_NALU = 1;   // AVCPacketType of coded frames
+const unsigned char AAC_RAW = 1;    // AACPacketType of coded frames
+const char ACCESS_UNIT_DELIMITER[] = { 0, 0, 0, 1, 0x09, static_cast<char>(0xF0) };  // Any slice type
+
+// Signed 24-bit composition time offset of an AVC video tag
+int composition_offset(const PooledBytes& payload) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(payload.data());
+    int value = (p[2] << 16) | (p[3] << 8) | p[4];
+    return value & 0x800000 ? value - 0x1000000 : value;
+}
+
+// Past the access unit delimiter the encoder put in front of the frame, if any, which
+// would otherwise end up behind the parameter sets
+const char* skip_delimiter(const char* units, const char* end, bool annexb, unsigned int length_size) {
+    if (annexb) {
+        const char* first = Nal::find_start_code(units, end) + 3;
+        if (first >= end || Nal::type(*first) != Nal::TYPE_AUD) {
+            return units;
+        }
+        const char* next = Nal::find_start_code(first, end);
+        return next > first && next[-1] == 0 ? next - 1 : next;  // Keeping a 4-byte start code whole
+    }
+    if (static_cast<std::size_t>(end - units) <= length_size || Nal::type(units[length_size]) != Nal::TYPE_AUD) {
+        return units;
+    }
+    std::size_t size = 0;
+    for (unsigned int i = 0; i < length_size; ++i) {
+        size = (size << 8) | static_cast<unsigned char>(units[i]);
+    }
+    return units + length_size + size;  // is_avcc() checked it fits
+}
+
+} // namespace
+
+// One stream's segments
+class HlsPackager::Packaging : public QueuedSink::Session {
+public:
+    Packaging(HlsPackager& owner, const std::string& key)
+        : owner_(owner),
+          key_(key),
+          has_avc_(false),
+          has_aac_(false),
+          start_timestamp_(0),
+          last_timestamp_(0),
+          audio_timestamp_(0),
+          last_segment_bytes_(0) {
+        owner_.stats_.streams_active.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Packaging() {
+        if (segment_) {
+            cut(last_timestamp_, 0);
+        }
+        owner_.store_.end(key_, Metrics::now_ns());
+        owner_.stats_.streams_active.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+protected:
+    void write(const MediaPacketPtr& packet) override {
+        const PooledBytes& payload = packet->payload;
+        if (packet->is_sequence_header()) {
+            if (packet->is_video() && ((unsigned char)payload[0] & 0x0F) == CODEC_AVC && payload.size() > 5) {
+                has_avc_ = Nal::parse_avc_config(payload.data() + 5, payload.size() - 5, avc_);
+            } else if (packet->is_audio() && payload.size() > 2) {
+                has_aac_ = TsMuxer::parse_aac_config(payload.data() + 2, payload.size() - 2, aac_);
+            }
+            return;
+        }
+        if (packet->is_video()) {
+            write_video(*packet);
+        } else if (packet->is_audio()) {
+            write_audio(*packet);
+        }
+    }
+
+private:
+    void write_video(const MediaPacket& packet) {
+        const PooledBytes& payload = packet.payload;
+        if (!has_avc_ || payload.size() < 5 || ((unsigned char)payload[0] & 0x0F) != CODEC_AVC || payload[1] != AVC_NALU) {
+            return;  // Only H.264 goes into these segments
+        }
+        bool keyframe = packet.is_keyframe();
+        if (waiting_keyframe_ && !keyframe) {
+            owner_.stats_.packets_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        waiting_keyframe_ = false;
+        if (keyframe) {
+            boundary(packet);
+        }
+        if (!segment_) {
+            return;
+        }
+
+        // Some encoders send Annex-B inside FLV; what does not parse as AVCC goes out as it is
+        const char* units = payload.data() + 5;
+        const char* end = payload.data() + payload.size();
+        bool annexb = !Nal::is_avcc(units, end - units, avc_.length_size);
+        if (annexb && !Nal::is_annexb(units, end - units)) {
+            LOG_WARN("[HlsPackager] Malformed video frame in '" << key_ << "'; waiting for the next keyframe.");
+            waiting_keyframe_ = true;
+            return;
+        }
+        units = skip_delimiter(units, end, annexb, avc_.length_size);
+
+        // Our delimiter first, then the parameter sets in front of every IDR
+        scratch_.clear();
+        scratch_.append(ACCESS_UNIT_DELIMITER, sizeof(ACCESS_UNIT_DELIMITER));
+        if (keyframe) {
+            scratch_ += avc_.parameter_sets;
+        }
+        if (annexb) {
+            scratch_.append(units, end - units);
+        } else {
+            Nal::avcc_to_annexb(units, end - units, avc_.length_size, scratch_);
+        }
+        muxer_.write_video(segment_->data, packet.timestamp, composition_offset(payload), keyframe,
+                           scratch_.data(), scratch_.size());
+        last_timestamp_ = packet.timestamp;
+    }
+
+    void write_audio(const MediaPacket& packet) {
+        const PooledBytes& payload = packet.payload;
+        if (!has_aac_ || payload.size() < 3 || ((unsigned char)payload[0] >> 4) != CODEC_AAC || payload[1] != AAC_RAW) {
+            return;
+        }
+        if (!has_avc_) {
+            boundary(packet);  // Audio-only streams may be cut anywhere
+        }
+        if (!segment_) {
+            return;
+        }
+
+        if (audio_.empty()) {
+            audio_timestamp_ = packet.timestamp;
+        }
+        char header[TsMuxer::ADTS_HEADER_SIZE];
+        TsMuxer::write_adts_header(header, aac_, payload.size() - 2);
+        audio_.append(header, sizeof(header));
+        audio_.append(payload.data() + 2, payload.size() - 2);
+        if (packet.timestamp - audio_timestamp_ >= AUDIO_BATCH_MS) {
+            flush_audio();
+        }
+        if (!has_avc_) {
+            last_timestamp_ = packet.timestamp;
+        }
+    }
+
+    void flush_audio() {
+        if (!audio_.empty()) {
+            muxer_.write_audio(segment_->data, audio_timestamp_, audio_.data(), audio_.size());
+            audio_.clear();
+        }
+    }
+
+    // Cuts the open segment if it is long enough, and opens one if none is
+    void boundary(const MediaPacket& packet) {
+        unsigned int elapsed = packet.timestamp >= start_timestamp_ ? packet.timestamp - start_timestamp_ : 0;
+        if (segment_ && elapsed >= owner_.segment_ms_) {
+            cut(packet.timestamp, packet.ingest_ns);
+        }
+        if (!segment_) {
+            segment_ = std::make_shared<HlsSegment>();
+            segment_->data.reserve(last_segment_bytes_ + last_segment_bytes_ / 8);  // Rarely grows after that
+            muxer_.set_tracks(has_avc_, has_aac_);
+            muxer_.write_tables(segment_->data);
+            start_timestamp_ = packet.timestamp;
+        }
+    }
+
+    // Hands the open segment to the store; ingest_ns is when the packet that ended it came in
+    void cut(unsigned int timestamp, unsigned long long ingest_ns) {
+        flush_audio();
+        segment_->duration_ms = timestamp >= start_timestamp_ ? timestamp - start_timestamp_ : 0;
+        last_segment_bytes_ = segment_->data.size();
+        owner_.store_.add(key_, segment_);
+        segment_.reset();
+
+        owner_.stats_.segments.fetch_add(1, std::memory_order_relaxed);
+        owner_.stats_.segment_bytes.fetch_add(last_segment_bytes_, std::memory_order_relaxed);
+        if (ingest_ns != 0) {
+            unsigned long long now = Metrics::now_ns();
+            owner_.stats_.segment_ready.record(now > ingest_ns ? (now - ingest_ns) / 1000 : 0);
+        }
+    }
+
+    HlsPackager& owner_;
+    std::string key_;
+    TsMuxer muxer_;
+    Nal::AvcConfig avc_;
+    TsMuxer::AacConfig aac_;
+    bool has_avc_;
+    bool has_aac_;
+
+    std::shared_ptr<HlsSegment> segment_;  // Being filled; null until the first keyframe
+    unsigned int start_timestamp_;         // Of the open segment
+    unsigned int last_timestamp_;
+    std::string scratch_;                  // Annex-B form of the current frame
+    std::string audio_;                    // ADTS frames waiting for one PES
+    unsigned int audio_timestamp_;         // Of the first of them
+    std::size_t last_segment_bytes_;
+};
+
+HlsPackager::HlsPackager(HlsStore& store, unsigned int segment_ms)
+    : QueuedSink(stats_),
+      store_(store),
+      segment_ms_(segment_ms),
+      last_expiry_ns_(Metrics::now_ns()) {}
+
+HlsPackager::~HlsPackager() {
+    stop();
+}
+
+void HlsPackager::start() {
+    start_thread();
+}
+
+void HlsPackager::stop() {
+    stop_thread();
+}
+
+bool HlsPackager::accepts(const MediaPacket& packet) const {
+    return packet.is_video() || packet.is_audio();
+}
+
+bool HlsPackager::wakes(const MediaPacket& packet, unsigned long long queued) const {
+    (void)queued;
+    return packet.is_keyframe();  // A keyframe may end a segment, which players are waiting for
+}
+
+QueuedSink::Session* HlsPackager::open_session(const std::string& key) {
+    return new Packaging(*this, key);
+}
+
+void HlsPackager::tick(unsigned long long now_ns) {
+    if (now_ns - last_expiry_ns_ >= 1000000000ull) {
+        store_.expire(now_ns);
+        last_expiry_ns_ = now_ns;
+    }
+}
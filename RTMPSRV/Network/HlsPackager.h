@@ -0,0 +1,57 @@
+#ifndef HLSPACKAGER_H
+#define HLSPACKAGER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include "HlsStore.h"
+#include "Metrics.h"
+#include "QueuedSink.h"
+
+struct HlsStats : QueuedSinkStats {
+    std::atomic<unsigned long long> streams_active;
+    std::atomic<unsigned long long> segments;
+    std::atomic<unsigned long long> segment_bytes;    // MPEG-TS produced
+    LatencyHistogram segment_ready;                   // Closing keyframe parsed to its segment in the store
+
+    HlsStats()
+        : streams_active(0),
+          segments(0),
+          segment_bytes(0) {}
+};
+
+// Packages every published H.264/AAC stream as HLS: AVCC video becomes Annex-B with an
+// access unit delimiter and, on keyframes, the parameter sets; raw AAC gets ADTS headers;
+// both are muxed into MPEG-TS. A segment is cut at the first keyframe at least
+// segment_ms after the previous cut (audio-only streams at any frame) and goes to the
+// HlsStore at once. Like the Recorder, this is a QueuedSink: one thread does the work,
+// woken by every keyframe so a segment is ready as soon as it can be.
+class HlsPackager : public QueuedSink {
+public:
+    static const unsigned int AUDIO_BATCH_MS = 100;  // AAC frames per PES, to spare TS overhead
+
+    HlsPackager(HlsStore& store, unsigned int segment_ms);
+    ~HlsPackager();
+
+    void start();
+    void stop();  // Packages everything queued so far and ends every stream
+
+    const HlsStats& stats() const { return stats_; }
+
+protected:
+    bool accepts(const MediaPacket& packet) const override;
+    bool wakes(const MediaPacket& packet, unsigned long long queued) const override;
+    Session* open_session(const std::string& key) override;
+    void tick(unsigned long long now_ns) override;  // Expires ended streams from the store
+
+private:
+    class Packaging;
+
+    HlsStore& store_;
+    unsigned int segment_ms_;
+    unsigned long long last_expiry_ns_;  // Packager thread only
+
+    HlsStats stats_;
+};
+
+#endif // HLSPACKAGER_H
@@ -0,0 +1,137 @@
+#include "HlsStore.h"
+#include <cstdio>
+
+HlsStore::HlsStore(unsigned int window, unsigned int segment_ms)
+    : window_(window > 0 ? window : 1),
+      target_duration_(segment_ms > 1000 ? (segment_ms + 999) / 1000 : 1),
+      bytes_(0) {}
+
+void HlsStore::add(const std::string& key, const std::shared_ptr<HlsSegment>& segment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = entries_.find(key);
+    if (found == entries_.end()) {
+        Entry entry;
+        // Playlist "/app/name.m3u8", segments "/app/name/<sequence>.ts"
+        std::size_t slash = key.rfind('/');
+        entry.segment_prefix = (slash == std::string::npos ? key : key.substr(slash + 1)) + "/";
+        entry.next_sequence = 0;
+        entry.target_duration = target_duration_;
+        entry.discontinuities_dropped = 0;
+        entry.ended = false;
+        entry.ended_ns = 0;
+        found = entries_.insert(std::make_pair(key, entry)).first;
+    }
+    Entry& entry = found->second;
+
+    // Every EXTINF, rounded, must fit the target duration
+    unsigned int seconds = (segment->duration_ms + 500) / 1000;
+    if (seconds > entry.target_duration) {
+        entry.target_duration = seconds;
+    }
+    segment->sequence = entry.next_sequence++;
+    segment->discontinuity = entry.ended;
+    entry.ended = false;
+    entry.segments.push_back(segment);
+    bytes_ += segment->data.size();
+
+    while (entry.segments.size() > window_ + RETAINED_EXTRA) {
+        const HlsSegment& oldest = *entry.segments.front();
+        bytes_ -= oldest.data.size();
+        if (oldest.discontinuity) {
+            ++entry.discontinuities_dropped;
+        }
+        entry.segments.pop_front();  // Responses still sending it keep their reference
+    }
+    build_playlist(entry);
+}
+
+void HlsStore::end(const std::string& key, unsigned long long now_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = entries_.find(key);
+    if (found != entries_.end()) {
+        found->second.ended = true;
+        found->second.ended_ns = now_ns;
+        build_playlist(found->second);
+    }
+}
+
+void HlsStore::expire(unsigned long long now_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.ended && now_ns - it->second.ended_ns >= ENDED_RETENTION_MS * 1000000ull) {
+            for (std::size_t i = 0; i < it->second.segments.size(); ++i) {
+                bytes_ -= it->second.segments[i]->data.size();
+            }
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::shared_ptr<const std::string> HlsStore::playlist(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = entries_.find(key);
+    return found != entries_.end() ? found->second.playlist : std::shared_ptr<const std::string>();
+}
+
+HlsSegmentPtr HlsStore::segment(const std::string& key, unsigned long long sequence) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = entries_.find(key);
+    if (found == entries_.end() || found->second.segments.empty()) {
+        return HlsSegmentPtr();
+    }
+    // Sequence numbers are consecutive, so the segment's position follows from the first one
+    const std::deque<HlsSegmentPtr>& segments = found->second.segments;
+    unsigned long long first = segments.front()->sequence;
+    if (sequence < first || sequence - first >= segments.size()) {
+        return HlsSegmentPtr();
+    }
+    return segments[static_cast<std::size_t>(sequence - first)];
+}
+
+std::size_t HlsStore::stream_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+unsigned long long HlsStore::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+void HlsStore::build_playlist(Entry& entry) const {
+    std::size_t first = entry.segments.size() > window_ ? entry.segments.size() - window_ : 0;
+
+    unsigned long long discontinuities = entry.discontinuities_dropped;
+    for (std::size_t i = 0; i < first; ++i) {
+        if (entry.segments[i]->discontinuity) ++discontinuities;
+    }
+
+    std::shared_ptr<std::string> text = std::make_shared<std::string>();
+    text->reserve(128 + (entry.segments.size() - first) * (48 + entry.segment_prefix.size()));
+    char line[96];
+    std::snprintf(line, sizeof(line),
+                  "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:%u\n#EXT-X-MEDIA-SEQUENCE:%llu\n",
+                  entry.target_duration, first < entry.segments.size() ? entry.segments[first]->sequence : entry.next_sequence);
+    *text += line;
+    if (discontinuities > 0) {
+        std::snprintf(line, sizeof(line), "#EXT-X-DISCONTINUITY-SEQUENCE:%llu\n", discontinuities);
+        *text += line;
+    }
+    for (std::size_t i = first; i < entry.segments.size(); ++i) {
+        const HlsSegment& segment = *entry.segments[i];
+        if (segment.discontinuity) {
+            *text += "#EXT-X-DISCONTINUITY\n";
+        }
+        std::snprintf(line, sizeof(line), "#EXTINF:%u.%03u,\n", segment.duration_ms / 1000, segment.duration_ms % 1000);
+        *text += line;
+        *text += entry.segment_prefix;
+        std::snprintf(line, sizeof(line), "%llu.ts\n", segment.sequence);
+        *text += line;
+    }
+    if (entry.ended) {
+        *text += "#EXT-X-ENDLIST\n";
+    }
+    entry.playlist = text;
+}
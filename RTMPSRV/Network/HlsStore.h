@@ -0,0 +1,74 @@
+#ifndef HLSSTORE_H
+#define HLSSTORE_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <cstddef> // For std::size_t
+
+// One finished MPEG-TS segment. Never changed once stored, so any number of HTTP
+// responses on any worker send it straight from data while the store lets it go.
+struct HlsSegment {
+    unsigned long long sequence;  // Media sequence number, assigned by the store
+    unsigned int duration_ms;
+    bool discontinuity;           // First segment after the stream was published again
+    std::string data;
+};
+
+typedef std::shared_ptr<const HlsSegment> HlsSegmentPtr;
+
+// The most recent segments of every packaged stream, in memory, and the live playlist
+// that lists them. The packager adds segments; workers answering HTTP requests take
+// references to a playlist or a segment under a short lock and send them from there.
+// A stream keeps window segments in its playlist and RETAINED_EXTRA more in the store,
+// for players that fetched the playlist just before it moved on. Its target duration
+// starts from the configured segment duration and only ever rises, to fit a longer
+// segment, since players may not see it change between reloads (RFC 8216 4.3.3.1).
+class HlsStore {
+public:
+    static const unsigned int RETAINED_EXTRA = 2;
+    static const unsigned int ENDED_RETENTION_MS = 60000;  // How long a stopped stream stays
+
+    HlsStore(unsigned int window, unsigned int segment_ms);
+
+    // Numbers the segment and makes it the newest one of key
+    void add(const std::string& key, const std::shared_ptr<HlsSegment>& segment);
+    // The stream stopped: its playlist gets EXT-X-ENDLIST until it is published again,
+    // or until expire() drops it ENDED_RETENTION_MS later
+    void end(const std::string& key, unsigned long long now_ns);
+    void expire(unsigned long long now_ns);
+
+    // Null when there is no such stream, or no such segment any more
+    std::shared_ptr<const std::string> playlist(const std::string& key) const;
+    HlsSegmentPtr segment(const std::string& key, unsigned long long sequence) const;
+
+    std::size_t stream_count() const;
+    unsigned long long bytes() const;   // Segment data held right now
+
+private:
+    HlsStore(const HlsStore&);
+    HlsStore& operator=(const HlsStore&);
+
+    struct Entry {
+        std::deque<HlsSegmentPtr> segments;
+        std::shared_ptr<const std::string> playlist;
+        std::string segment_prefix;             // Segment URIs relative to the playlist
+        unsigned long long next_sequence;
+        unsigned int target_duration;           // EXT-X-TARGETDURATION, in seconds
+        unsigned long long discontinuities_dropped;  // Discontinuities no longer in the store
+        bool ended;
+        unsigned long long ended_ns;
+    };
+
+    void build_playlist(Entry& entry) const;
+
+    unsigned int window_;
+    unsigned int target_duration_;  // What every stream starts with
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;  // Guarded by mutex_
+    unsigned long long bytes_;                        // Guarded by mutex_
+};
+
+#endif // HLSSTORE_H
@@ -0,0 +1,188 @@
+#include "Http.h"
+#include "Connection.h"
+#include "HlsStore.h"
+#include "Worker.h"
+#include "Log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char HEADER_END[] = "\r\n\r\n";
+
+const char* reason_phrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        default: return "Error";
+    }
+}
+
+bool equals_ignore_case(const char* a, std::size_t length, const char* b) {
+    if (std::strlen(b) != length) {
+        return false;
+    }
+    for (std::size_t i = 0; i < length; ++i) {
+        char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] - 'A' + 'a' : a[i];
+        if (x != b[i]) return false;
+    }
+    return true;
+}
+
+bool contains_ignore_case(const char* text, std::size_t length, const char* word) {
+    std::size_t word_length = std::strlen(word);
+    for (std::size_t i = 0; i + word_length <= length; ++i) {
+        if (equals_ignore_case(text + i, word_length, word)) return true;
+    }
+    return false;
+}
+
+// "/app/name/123.ts" -> "app/name", 123
+bool parse_segment_path(const std::string& path, std::string& key, unsigned long long& sequence) {
+    std::size_t slash = path.rfind('/');
+    std::size_t digits_end = path.size() - 3;
+    if (slash == std::string::npos || slash < 2 || slash + 1 >= digits_end || digits_end - slash - 1 > 19) {
+        return false;
+    }
+    sequence = 0;
+    for (std::size_t i = slash + 1; i < digits_end; ++i) {
+        if (path[i] < '0' || path[i] > '9') return false;
+        sequence = sequence * 10 + static_cast<unsigned long long>(path[i] - '0');
+    }
+    key = path.substr(1, slash - 1);
+    return true;
+}
+
+bool ends_with(const std::string& text, const char* suffix) {
+    std::size_t length = std::strlen(suffix);
+    return text.size() > length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+// Header of a live FLV response, which has no length: chunked for HTTP/1.1; for HTTP/1.0
+// the body runs until the client disconnects, and the connection is never reused
+void send_flv_header(Connection& conn, bool chunked) {
+    char header[256];
+    int header_length = std::snprintf(header, sizeof(header),
+                                      "HTTP/1.1 200 OK\r\n"
+                                      "Content-Type: video/x-flv\r\n"
+                                      "%s"
+                                      "Cache-Control: no-cache\r\n"
+                                      "Access-Control-Allow-Origin: *\r\n"
+                                      "Connection: %s\r\n"
+                                      "\r\n",
+                                      chunked ? "Transfer-Encoding: chunked\r\n" : "",
+                                      chunked ? "keep-alive" : "close");
+    conn.send(header, static_cast<std::size_t>(header_length));
+}
+
+} // namespace
+
+std::size_t Http::handle_request(Connection& conn, Worker& worker, const char* data, std::size_t length) {
+    if (conn.role() == Connection::ROLE_PLAYER || conn.closing_after_output()) {
+        return length;  // The last response is endless or ends the connection; nothing after it gets an answer
+    }
+    const char* end = std::search(data, data + length, HEADER_END, HEADER_END + 4);
+    if (end == data + length) {
+        if (length >= MAX_REQUEST_BYTES) {
+            LOG_WARN("[Http] Request from " << conn.client_ip() << " exceeds " << MAX_REQUEST_BYTES << " bytes.");
+            conn.close();
+        }
+        return 0;
+    }
+    std::size_t consumed = end - data + 4;
+    worker.stats().http_requests.fetch_add(1, std::memory_order_relaxed);
+
+    // Request line: method, target, version
+    const char* line_end = std::search(data, end + 2, HEADER_END, HEADER_END + 2);
+    const char* method_end = std::find(data, line_end, ' ');
+    const char* target_end = method_end == line_end ? line_end : std::find(method_end + 1, line_end, ' ');
+    if (target_end == line_end || method_end + 1 >= target_end || method_end[1] != '/') {
+        LOG_WARN("[Http] Malformed request from " << conn.client_ip() << "; closing.");
+        conn.close();
+        return 0;
+    }
+    std::string method(data, method_end);
+    std::string path(method_end + 1, std::find(method_end + 1, target_end, '?'));
+    std::string version(target_end + 1, line_end);
+
+    // HTTP/1.1 stays open unless told otherwise, HTTP/1.0 only when asked to
+    bool keep_alive = version == "HTTP/1.1";
+    if (!keep_alive && version != "HTTP/1.0") {
+        conn.close();
+        return 0;
+    }
+    for (const char* line = line_end + 2; line < end; ) {
+        const char* next = std::search(line, end + 2, HEADER_END, HEADER_END + 2);
+        const char* colon = std::find(line, next, ':');
+        if (colon != next && equals_ignore_case(line, colon - line, "connection")) {
+            if (contains_ignore_case(colon + 1, next - colon - 1, "close")) keep_alive = false;
+            if (contains_ignore_case(colon + 1, next - colon - 1, "keep-alive")) keep_alive = true;
+        }
+        line = next + 2;
+    }
+
+    bool head = method == "HEAD";
+    if (!head && method != "GET") {
+        send_response(conn, 405, "text/plain", "no-cache", std::shared_ptr<const void>(), nullptr, 0, false, keep_alive);
+        return consumed;
+    }
+
+    const HlsStore* hls = worker.hls();
+    std::string key;
+    unsigned long long sequence = 0;
+    if (ends_with(path, ".flv")) {
+        key = path.substr(1, path.size() - 5);
+        if (worker.hub().is_live(key)) {
+            send_flv_header(conn, version == "HTTP/1.1");
+            if (!head) {
+                conn.start_http_flv(key, version == "HTTP/1.1");
+            } else if (version != "HTTP/1.1") {
+                conn.close_after_output();
+            }
+            return consumed;
+        }
+    } else if (hls && ends_with(path, ".m3u8")) {
+        std::shared_ptr<const std::string> playlist = hls->playlist(path.substr(1, path.size() - 6));
+        if (playlist) {
+            send_response(conn, 200, "application/vnd.apple.mpegurl", "no-cache", playlist,
+                          playlist->data(), playlist->size(), head, keep_alive);
+            return consumed;
+        }
+    } else if (hls && ends_with(path, ".ts") && parse_segment_path(path, key, sequence)) {
+        HlsSegmentPtr segment = hls->segment(key, sequence);
+        if (segment) {
+            // Never changes once written, but a republished stream reuses the numbers eventually
+            send_response(conn, 200, "video/mp2t", "max-age=60", segment, segment->data.data(), segment->data.size(),
+                          head, keep_alive);
+            return consumed;
+        }
+    }
+    send_response(conn, 404, "text/plain", "no-cache", std::shared_ptr<const void>(), nullptr, 0, head, keep_alive);
+    return consumed;
+}
+
+void Http::send_response(Connection& conn, int status, const char* content_type, const char* cache_control,
+                         const std::shared_ptr<const void>& owner, const char* body, std::size_t length,
+                         bool head, bool keep_alive) {
+    char header[384];
+    int header_length = std::snprintf(header, sizeof(header),
+                                      "HTTP/1.1 %d %s\r\n"
+                                      "Content-Type: %s\r\n"
+                                      "Content-Length: %lu\r\n"
+                                      "Cache-Control: %s\r\n"
+                                      "Access-Control-Allow-Origin: *\r\n"
+                                      "Connection: %s\r\n"
+                                      "\r\n",
+                                      status, reason_phrase(status), content_type, static_cast<unsigned long>(length),
+                                      cache_control, keep_alive ? "keep-alive" : "close");
+    conn.send(header, static_cast<std::size_t>(header_length));
+    if (!head && length > 0) {
+        conn.send_shared(owner, body, length);
+    }
+    if (!keep_alive) {
+        conn.close_after_output();
+    }
+}
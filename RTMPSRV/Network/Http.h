@@ -0,0 +1,32 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <memory>
+#include <string>
+#include <cstddef> // For std::size_t
+
+class Connection;
+class Worker;
+
+// HTTP/1.1 on connections accepted from the worker's HTTP listener, served by the same
+// event loop as RTMP. GET and HEAD only, keep-alive and pipelining included:
+//   /<app>/<name>.flv              live stream as HTTP-FLV, for as long as the client stays
+//   /<app>/<name>.m3u8             live HLS playlist (with --hls)
+//   /<app>/<name>/<sequence>.ts    one of its segments
+// Bodies go out by reference to what the HlsStore or the published packets hold; nothing
+// is copied per request or per viewer.
+class Http {
+public:
+    static const std::size_t MAX_REQUEST_BYTES = 8 * 1024;  // Request line and headers
+
+    // Answers the request at the front of data and returns its length, or 0 while it is
+    // incomplete. A request that is malformed or too large closes the connection.
+    static std::size_t handle_request(Connection& conn, Worker& worker, const char* data, std::size_t length);
+
+    // Queues a response; the body stays owned by owner. HEAD responses leave it out.
+    static void send_response(Connection& conn, int status, const char* content_type, const char* cache_control,
+                              const std::shared_ptr<const void>& owner, const char* body, std::size_t length,
+                              bool head, bool keep_alive);
+};
+
+#endif // HTTP_H
@@ -0,0 +1,25 @@
+#ifndef IOBACKEND_H
+#define IOBACKEND_H
+
+#include <atomic>
+#include "Socket.h"
+
+class Connection;
+class Worker;
+struct WorkerStats;
+
+// Drives the listening socket and every accepted connection on one thread.
+// Connections queue their output and ask the backend to flush it once the
+// current batch of events has been processed. Backends also watch the worker's
+// fan-out wakeup and drain its inbox every iteration, before flushing.
+class IOBackend {
+public:
+    virtual ~IOBackend() {}
+
+    virtual bool init(socket_t listener, Worker* worker) = 0;
+    virtual void run(const std::atomic<bool>& running) = 0;
+    virtual void request_flush(Connection* conn) = 0;
+    virtual const char* name() const = 0;
+};
+
+#endif // IOBACKEND_H
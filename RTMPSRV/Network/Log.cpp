@@ -0,0 +1,380 @@
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+std::atomic<int> Log::level_(Log::LEVEL_INFO);
+
+namespace {
+
+const char* const LEVEL_NAMES[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+// How long the writer sleeps once the rings are empty
+const std::chrono::milliseconds WRITER_INTERVAL(10);
+
+struct Record {
+    unsigned long long time_us;  // Microseconds since the epoch
+    unsigned short length;
+    unsigned char level;
+    char text[Log::MAX_LINE_LENGTH];
+};
+
+// Records of one thread. The owning thread is the only producer and the writer thread the
+// only consumer, so head and tail are plain release/acquire counters. When a thread exits
+// its ring is released and the next new thread adopts it, leftover records and all.
+struct Ring {
+    static const std::size_t CAPACITY = 2048;  // Power of two; 512 KB of records
+
+    Ring() : head(0), tail(0), dropped(0), in_use(true), next(nullptr) {}
+
+    // The owner writes head and the writer tail, so each gets a cache line of its own; by
+    // padding rather than alignas, which new ignores before C++17
+    Record records[CAPACITY];
+    std::atomic<unsigned long long> head;     // Next record the owner fills
+    char head_padding[64];
+    std::atomic<unsigned long long> tail;     // Next record the writer takes
+    char tail_padding[64];
+    std::atomic<unsigned long long> dropped;  // Lines refused since the writer last looked
+    std::atomic<bool> in_use;
+    Ring* next;                               // Never changes once published
+};
+
+struct RingOwner {
+    RingOwner() : ring(nullptr) {}
+    ~RingOwner() {
+        if (ring) {
+            ring->in_use.store(false, std::memory_order_release);
+        }
+    }
+    Ring* ring;
+};
+
+std::atomic<Ring*> rings(nullptr);       // Every ring ever created; rings are reused, never freed
+std::atomic<bool> asynchronous(false);   // Writer thread is running
+std::atomic<unsigned long long> dropped_total(0);
+thread_local RingOwner local_ring;
+
+std::mutex writer_mutex;                 // Guards the writer thread's lifetime and stopping
+std::condition_variable writer_wake;
+std::thread writer;
+bool stopping = false;
+
+unsigned long long now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Formats "[YYYY-MM-DD HH:MM:SS.mmm] [LEVEL] ", reusing the calendar part within a second
+class Stamp {
+public:
+    Stamp() : second_(-1) {}
+
+    std::size_t format(unsigned long long time_us, int level, char* out, std::size_t size) {
+        long long second = static_cast<long long>(time_us / 1000000);
+        if (second != second_) {
+            std::time_t seconds = static_cast<std::time_t>(second);
+            std::tm calendar;
+#ifdef _WIN32
+            localtime_s(&calendar, &seconds);
+#else
+            localtime_r(&seconds, &calendar);
+#endif
+            std::strftime(date_, sizeof(date_), "%Y-%m-%d %H:%M:%S", &calendar);
+            second_ = second;
+        }
+        int length = std::snprintf(out, size, "[%s.%03u] [%s] ", date_,
+                                   static_cast<unsigned int>(time_us / 1000 % 1000), LEVEL_NAMES[level]);
+        return length > 0 ? static_cast<std::size_t>(length) : 0;
+    }
+
+private:
+    long long second_;
+    char date_[24];
+};
+
+const std::size_t PREFIX_MAX = 48;
+const std::size_t FORMATTED_MAX = PREFIX_MAX + Log::MAX_LINE_LENGTH + 1;
+
+// Writes the finished line, newline included, to out[FORMATTED_MAX]; returns its length
+std::size_t format_line(Stamp& stamp, unsigned long long time_us, int level,
+                        const char* text, std::size_t length, char* out) {
+    std::size_t prefix_length = stamp.format(time_us, level, out, PREFIX_MAX);
+    if (prefix_length >= PREFIX_MAX) {
+        prefix_length = PREFIX_MAX - 1;
+    }
+    std::memcpy(out + prefix_length, text, length);
+    out[prefix_length + length] = '\n';
+    return prefix_length + length + 1;
+}
+
+void append_line(std::string& out, Stamp& stamp, unsigned long long time_us, int level,
+                 const char* text, std::size_t length) {
+    char line[FORMATTED_MAX];
+    out.append(line, format_line(stamp, time_us, level, text, length, line));
+}
+
+void write_out(std::FILE* stream, const char* text, std::size_t length) {
+    if (length > 0) {
+        std::fwrite(text, 1, length, stream);
+        std::fflush(stream);
+    }
+}
+
+Ring* acquire_ring() {
+    for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+        bool free = false;
+        if (!ring->in_use.load(std::memory_order_relaxed) &&
+            ring->in_use.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+            return ring;
+        }
+    }
+
+    Ring* ring = new (std::nothrow) Ring();
+    if (!ring) {
+        return nullptr;
+    }
+    Ring* head = rings.load(std::memory_order_relaxed);
+    do {
+        ring->next = head;
+    } while (!rings.compare_exchange_weak(head, ring, std::memory_order_release, std::memory_order_relaxed));
+    return ring;
+}
+
+struct Pending {
+    unsigned long long time_us;
+    const Record* record;
+};
+
+bool pending_before(const Pending& a, const Pending& b) {
+    return a.time_us < b.time_us;
+}
+
+// Moves everything the rings hold to stdout (debug, info) and stderr (warnings, errors).
+// Returns whether there was anything to write.
+bool drain(Stamp& stamp, std::vector<Pending>& batch, std::vector<std::pair<Ring*, unsigned long long> >& taken,
+           std::string& out, std::string& err) {
+    batch.clear();
+    taken.clear();
+    out.clear();
+    err.clear();
+
+    unsigned long long dropped = 0;
+    for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+        unsigned long long tail = ring->tail.load(std::memory_order_relaxed);
+        unsigned long long head = ring->head.load(std::memory_order_acquire);
+        for (unsigned long long i = tail; i != head; ++i) {
+            const Record& record = ring->records[i & (Ring::CAPACITY - 1)];
+            Pending pending = { record.time_us, &record };
+            batch.push_back(pending);
+        }
+        if (head != tail) {
+            taken.push_back(std::make_pair(ring, head));
+        }
+        if (ring->dropped.load(std::memory_order_relaxed) != 0) {  // Rarely; leave the line clean
+            dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+        }
+    }
+    if (batch.empty() && dropped == 0) {
+        return false;
+    }
+
+    // Each ring is already in order; merge them so interleaved threads read chronologically
+    std::stable_sort(batch.begin(), batch.end(), pending_before);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        const Record& record = *batch[i].record;
+        std::string& target = record.level >= Log::LEVEL_WARN ? err : out;
+        append_line(target, stamp, record.time_us, record.level, record.text, record.length);
+    }
+    for (std::size_t i = 0; i < taken.size(); ++i) {
+        taken[i].first->tail.store(taken[i].second, std::memory_order_release);
+    }
+
+    if (dropped > 0) {
+        dropped_total.fetch_add(dropped, std::memory_order_relaxed);
+        char text[96];
+        int length = std::snprintf(text, sizeof(text), "[Log] %llu line(s) dropped, a thread logged faster than they were written",
+                                   dropped);
+        append_line(err, stamp, now_us(), Log::LEVEL_WARN, text, static_cast<std::size_t>(length));
+    }
+
+    write_out(stdout, out.data(), out.size());
+    write_out(stderr, err.data(), err.size());
+    return true;
+}
+
+void writer_loop() {
+    Stamp stamp;
+    std::vector<Pending> batch;
+    std::vector<std::pair<Ring*, unsigned long long> > taken;
+    std::string out;
+    std::string err;
+
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    while (!stopping) {
+        lock.unlock();
+        bool wrote = drain(stamp, batch, taken, out, err);
+        lock.lock();
+        if (!wrote && !stopping) {
+            writer_wake.wait_for(lock, WRITER_INTERVAL);
+        }
+    }
+    lock.unlock();
+    drain(stamp, batch, taken, out, err);
+}
+
+void stop_at_exit() {
+    Log::stop();
+}
+
+} // namespace
+
+void Log::start() {
+    static bool registered = false;
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    if (writer.joinable()) {
+        return;
+    }
+    if (!registered) {
+        std::atexit(stop_at_exit);  // A writer left running at exit would take queued lines with it
+        registered = true;
+    }
+    stopping = false;
+    writer = std::thread(writer_loop);
+    asynchronous.store(true, std::memory_order_release);
+}
+
+void Log::stop() {
+    std::thread finishing;
+    {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        if (!writer.joinable()) {
+            return;
+        }
+        asynchronous.store(false, std::memory_order_release);
+        stopping = true;
+        finishing.swap(writer);
+    }
+    writer_wake.notify_one();
+    finishing.join();
+}
+
+bool Log::parse_level(const char* name, Level& level) {
+    static const char* const names[] = { "debug", "info", "warn", "error", "off" };
+    for (int i = LEVEL_DEBUG; i <= LEVEL_OFF; ++i) {
+        if (std::strcmp(name, names[i]) == 0) {
+            level = static_cast<Level>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned long long Log::dropped() {
+    unsigned long long total = dropped_total.load(std::memory_order_relaxed);
+    for (Ring* ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+        total += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Log::write(const LogLine& line) {
+    unsigned long long time_us = now_us();
+
+    if (!asynchronous.load(std::memory_order_acquire)) {
+        // No writer thread: format and write right here, one fwrite per line
+        Stamp stamp;
+        char text[FORMATTED_MAX];
+        std::size_t length = format_line(stamp, time_us, line.level(), line.text(), line.length(), text);
+        write_out(line.level() >= LEVEL_WARN ? stderr : stdout, text, length);
+        return;
+    }
+
+    Ring* ring = local_ring.ring;
+    if (!ring) {
+        ring = local_ring.ring = acquire_ring();
+        if (!ring) {
+            dropped_total.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    unsigned long long head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= Ring::CAPACITY) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Record& record = ring->records[head & (Ring::CAPACITY - 1)];
+    record.time_us = time_us;
+    record.level = static_cast<unsigned char>(line.level());
+    record.length = static_cast<unsigned short>(line.length());
+    std::memcpy(record.text, line.text(), line.length());
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+LogLine& LogLine::append(const char* data, std::size_t length) {
+    std::size_t room = Log::MAX_LINE_LENGTH - length_;
+    if (length > room) {
+        length = room;
+    }
+    std::memcpy(text_ + length_, data, length);
+    length_ += length;
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const char* value) {
+    if (!value) {
+        return append("(null)", 6);
+    }
+    return append(value, std::strlen(value));
+}
+
+LogLine& LogLine::operator<<(double value) {
+    char text[32];
+    int length = std::snprintf(text, sizeof(text), "%g", value);
+    return append(text, length > 0 ? static_cast<std::size_t>(length) : 0);
+}
+
+LogLine& LogLine::operator<<(const void* value) {
+    char text[32];
+    int length = std::snprintf(text, sizeof(text), "%p", value);
+    return append(text, length > 0 ? static_cast<std::size_t>(length) : 0);
+}
+
+LogLine& LogLine::operator<<(Hex value) {
+    static const char digits[] = "0123456789abcdef";
+    char text[16];
+    std::size_t start = sizeof(text);
+    unsigned long long remaining = value.value;
+    do {
+        text[--start] = digits[remaining & 0xF];
+        remaining >>= 4;
+    } while (remaining != 0);
+    return append(text + start, sizeof(text) - start);
+}
+
+LogLine& LogLine::signed_number(long long value) {
+    if (value < 0) {
+        append("-", 1);
+        return unsigned_number(0ULL - static_cast<unsigned long long>(value));
+    }
+    return unsigned_number(static_cast<unsigned long long>(value));
+}
+
+LogLine& LogLine::unsigned_number(unsigned long long value) {
+    char text[20];
+    std::size_t start = sizeof(text);
+    do {
+        text[--start] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return append(text + start, sizeof(text) - start);
+}
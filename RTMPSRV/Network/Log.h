@@ -0,0 +1,121 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <string>
+#include <cstddef> // For std::size_t
+
+// Lowest level compiled into the binary (0 = debug, 1 = info, ...). Statements below it are
+// type-checked but generate no code, so per-packet tracing costs nothing in normal builds.
+// Configure with -DRTMP_DEBUG_LOG=ON to compile debug statements in.
+#ifndef RTMP_LOG_MIN_LEVEL
+#define RTMP_LOG_MIN_LEVEL 1
+#endif
+
+class LogLine;
+
+// Process-wide logger. A thread formats a line into a stack buffer and copies it into a
+// ring of fixed-size records that only it writes to; a background thread merges the rings
+// in timestamp order, formats and writes them out. Logging never allocates, locks or
+// touches a stream on the calling thread; a full ring drops the line and counts it rather
+// than blocking.
+// Until start() is called, or after stop(), lines are written synchronously instead.
+class Log {
+public:
+    enum Level {
+        LEVEL_DEBUG = 0,
+        LEVEL_INFO = 1,
+        LEVEL_WARN = 2,
+        LEVEL_ERROR = 3,
+        LEVEL_OFF = 4
+    };
+
+    static const std::size_t MAX_LINE_LENGTH = 240;  // Longer lines are truncated
+
+    // Starts the writer thread; lines logged afterwards go through the rings
+    static void start();
+    // Writes out everything queued and joins the writer thread
+    static void stop();
+
+    static void set_level(Level level) { level_.store(level, std::memory_order_relaxed); }
+    static Level level() { return static_cast<Level>(level_.load(std::memory_order_relaxed)); }
+    static bool parse_level(const char* name, Level& level);
+
+    static bool enabled(Level level) {
+        return level >= RTMP_LOG_MIN_LEVEL && level >= level_.load(std::memory_order_relaxed);
+    }
+
+    // Lines dropped because a thread's ring was full
+    static unsigned long long dropped();
+
+    static void write(const LogLine& line);
+
+private:
+    static std::atomic<int> level_;
+};
+
+// A line being formatted; streams like std::ostream into a fixed buffer
+class LogLine {
+public:
+    explicit LogLine(Log::Level level) : level_(level), length_(0) {}
+
+    Log::Level level() const { return level_; }
+    const char* text() const { return text_; }
+    std::size_t length() const { return length_; }
+
+    LogLine& operator<<(const char* value);
+    LogLine& operator<<(const std::string& value) { return append(value.data(), value.size()); }
+    LogLine& operator<<(char value) { return append(&value, 1); }
+    LogLine& operator<<(int value) { return signed_number(value); }
+    LogLine& operator<<(long value) { return signed_number(value); }
+    LogLine& operator<<(long long value) { return signed_number(value); }
+    LogLine& operator<<(unsigned int value) { return unsigned_number(value); }
+    LogLine& operator<<(unsigned long value) { return unsigned_number(value); }
+    LogLine& operator<<(unsigned long long value) { return unsigned_number(value); }
+    LogLine& operator<<(double value);
+    LogLine& operator<<(const void* value);
+
+    LogLine& append(const char* data, std::size_t length);
+
+    // Hex digits of value, e.g. line << LogLine::Hex(marker)
+    struct Hex {
+        explicit Hex(unsigned long long v) : value(v) {}
+        unsigned long long value;
+    };
+    LogLine& operator<<(Hex value);
+
+private:
+    LogLine& signed_number(long long value);
+    LogLine& unsigned_number(unsigned long long value);
+
+    Log::Level level_;
+    std::size_t length_;
+    char text_[Log::MAX_LINE_LENGTH];
+};
+
+#define RTMP_LOG(level, expr)                           \
+    do {                                                \
+        if (Log::enabled(level)) {                      \
+            LogLine rtmp_log_line_(level);              \
+            rtmp_log_line_ << expr;                     \
+            Log::write(rtmp_log_line_);                 \
+        }                                               \
+    } while (0)
+
+#if RTMP_LOG_MIN_LEVEL <= 0
+#define LOG_DEBUG(expr) RTMP_LOG(Log::LEVEL_DEBUG, expr)
+#else
+#define LOG_DEBUG(expr)                                 \
+    do {                                                \
+        if (false) {                                    \
+            LogLine rtmp_log_line_(Log::LEVEL_DEBUG);   \
+            rtmp_log_line_ << expr;                     \
+        }                                               \
+    } while (0)
+#endif
+
+#define LOG_INFO(expr) RTMP_LOG(Log::LEVEL_INFO, expr)
+#define LOG_WARN(expr) RTMP_LOG(Log::LEVEL_WARN, expr)
+#define LOG_ERROR(expr) RTMP_LOG(Log::LEVEL_ERROR, expr)
+
+#endif // LOG_H
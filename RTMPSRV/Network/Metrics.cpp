@@ -0,0 +1,246 @@
+#include "Metrics.h"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+namespace {
+
+unsigned int floor_log2(unsigned long long value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    unsigned int exponent = 0;
+    while (value >>= 1) ++exponent;
+    return exponent;
+#endif
+}
+
+// Exported bucket bounds: powers of two from 16 us to about 67 s, all exact in the histogram
+const unsigned int FIRST_EXPORTED_EXPONENT = 4;
+const unsigned int LAST_EXPORTED_EXPONENT = 26;
+
+struct MessageTypeName {
+    unsigned char id;
+    const char* name;
+};
+
+const MessageTypeName MESSAGE_TYPE_NAMES[] = {
+    { 0x01, "set_chunk_size" },
+    { 0x02, "abort" },
+    { 0x03, "acknowledgement" },
+    { 0x04, "user_control" },
+    { 0x05, "window_ack_size" },
+    { 0x06, "set_peer_bandwidth" },
+    { 0x08, "audio" },
+    { 0x09, "video" },
+    { 0x0F, "data_amf3" },
+    { 0x10, "shared_object_amf3" },
+    { 0x11, "command_amf3" },
+    { 0x12, "data_amf0" },
+    { 0x13, "shared_object_amf0" },
+    { 0x14, "command_amf0" },
+    { 0x16, "aggregate" },
+};
+const std::size_t NAMED_TYPES = sizeof(MESSAGE_TYPE_NAMES) / sizeof(MESSAGE_TYPE_NAMES[0]);
+
+void write_header(std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void write_sample(std::string& out, const char* name, const char* labels, unsigned long long value) {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%s%s %llu\n", name, labels, value);
+    out += line;
+}
+
+void write_metric(std::string& out, const char* name, const char* type, const char* help, unsigned long long value) {
+    write_header(out, name, type, help);
+    write_sample(out, name, "", value);
+}
+
+void write_seconds_metric(std::string& out, const char* name, const char* type, const char* help,
+                          unsigned long long nanoseconds) {
+    write_header(out, name, type, help);
+    char line[256];
+    std::snprintf(line, sizeof(line), "%s %.6f\n", name, nanoseconds / 1e9);
+    out += line;
+}
+
+void write_histogram(std::string& out, const char* name, const char* help, const HistogramSnapshot& histogram) {
+    write_header(out, name, "histogram", help);
+    char line[256];
+    for (unsigned int exponent = FIRST_EXPORTED_EXPONENT; exponent <= LAST_EXPORTED_EXPONENT; ++exponent) {
+        unsigned long long limit = 1ull << exponent;
+        std::snprintf(line, sizeof(line), "%s_bucket{le=\"%.9g\"} %llu\n",
+                      name, limit / 1e6, histogram.count_below(limit));
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6f\n%s_count %llu\n",
+                  name, histogram.count, name, histogram.sum / 1e6, name, histogram.count);
+    out += line;
+}
+
+} // namespace
+
+LatencyHistogram::LatencyHistogram() : sum_(0) {
+    for (std::size_t i = 0; i < BUCKETS; ++i) {
+        counts_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::size_t LatencyHistogram::bucket_index(unsigned long long micros) {
+    if (micros < SUB_BUCKETS) {
+        return static_cast<std::size_t>(micros);
+    }
+    unsigned int exponent = floor_log2(micros);
+    if (exponent >= MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    std::size_t group = exponent - SUB_BUCKET_BITS + 1;
+    return group * SUB_BUCKETS + static_cast<std::size_t>((micros >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+unsigned long long LatencyHistogram::bucket_limit(std::size_t index) {
+    std::size_t group = index / SUB_BUCKETS;
+    if (group == 0) {
+        return index + 1;
+    }
+    unsigned int exponent = static_cast<unsigned int>(group) + SUB_BUCKET_BITS - 1;
+    unsigned long long width = 1ull << (exponent - SUB_BUCKET_BITS);
+    return (1ull << exponent) + (index % SUB_BUCKETS + 1) * width;
+}
+
+HistogramSnapshot::HistogramSnapshot() : sum(0), count(0) {
+    for (std::size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        counts[i] = 0;
+    }
+}
+
+void HistogramSnapshot::add(const LatencyHistogram& histogram) {
+    for (std::size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        unsigned long long n = histogram.count(i);
+        counts[i] += n;
+        count += n;
+    }
+    sum += histogram.sum();
+}
+
+unsigned long long HistogramSnapshot::count_below(unsigned long long limit) const {
+    unsigned long long total = 0;
+    for (std::size_t i = 0; i < LatencyHistogram::BUCKETS && LatencyHistogram::bucket_limit(i) <= limit; ++i) {
+        total += counts[i];
+    }
+    return total;
+}
+
+unsigned long long Metrics::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned long long Metrics::thread_cpu_ns() {
+#if defined(CLOCK_THREAD_CPUTIME_ID) && !defined(_WIN32)
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) == 0) {
+        return static_cast<unsigned long long>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+    }
+#endif
+    return 0;
+}
+
+std::string Metrics::prometheus_text(const ServerStats& stats) {
+    std::string out;
+    out.reserve(8 * 1024);
+
+    write_metric(out, "rtmp_connections_accepted_total", "counter", "Connections accepted by all workers.",
+                 stats.connections_accepted);
+    write_metric(out, "rtmp_connections_open", "gauge", "Connections currently open.", stats.connections_open);
+    write_metric(out, "rtmp_handshake_failures_total", "counter", "Connections closed before completing the handshake.",
+                 stats.handshake_failures);
+    write_metric(out, "rtmp_handshake_timeouts_total", "counter",
+                 "Connections closed for not completing the handshake in time.", stats.handshake_timeouts);
+    write_metric(out, "rtmp_received_bytes_total", "counter", "Bytes read from client sockets.", stats.bytes_received);
+    write_metric(out, "rtmp_sent_bytes_total", "counter", "Bytes written to client sockets.", stats.bytes_sent);
+    write_metric(out, "rtmp_send_queue_bytes", "gauge", "Output queued for clients and not yet written.",
+                 stats.send_queue_bytes);
+
+    // Every named type is always present, so rates work from the first scrape
+    write_header(out, "rtmp_messages_received_total", "counter", "Complete messages dispatched, by message type.");
+    unsigned long long other = stats.messages_received;
+    for (std::size_t i = 0; i < NAMED_TYPES; ++i) {
+        unsigned long long count = stats.messages_by_type[MESSAGE_TYPE_NAMES[i].id];
+        other -= count;
+        std::string labels = std::string("{type=\"") + MESSAGE_TYPE_NAMES[i].name + "\"}";
+        write_sample(out, "rtmp_messages_received_total", labels.c_str(), count);
+    }
+    write_sample(out, "rtmp_messages_received_total", "{type=\"other\"}", other);
+
+    write_metric(out, "rtmp_chunk_cache_hits_total", "counter", "Media sent from an already chunked form.",
+                 stats.chunk_cache_hits);
+    write_metric(out, "rtmp_chunk_cache_misses_total", "counter", "Media a worker had to chunk itself.",
+                 stats.chunk_cache_misses);
+    write_metric(out, "rtmp_chunk_header_saved_bytes_total", "counter",
+                 "Chunk headers not sent because messages went out in chunks larger than 128 bytes.",
+                 stats.chunk_header_bytes_saved);
+    write_metric(out, "rtmp_acks_sent_total", "counter", "Acknowledgements sent for client input.", stats.acks_sent);
+    write_metric(out, "rtmp_send_window_stalls_total", "counter",
+                 "Times output to a client waited for it to acknowledge what it already had.",
+                 stats.send_window_stalls);
+    write_metric(out, "rtmp_gop_cache_bytes", "gauge", "Media held for players that join mid-GOP.",
+                 stats.gop_cache_bytes);
+    write_metric(out, "rtmp_media_dropped_total", "counter", "Media packets skipped for players that fell behind.",
+                 stats.media_dropped);
+    write_metric(out, "rtmp_slow_disconnects_total", "counter", "Players disconnected for exceeding the send queue limit.",
+                 stats.slow_disconnects);
+    write_metric(out, "rtmp_vod_players", "gauge", "Connections playing a file.", stats.vod_players);
+    write_metric(out, "rtmp_vod_media_bytes_total", "counter", "Media queued for VOD players from mapped files.",
+                 stats.vod_bytes);
+    write_metric(out, "rtmp_http_requests_total", "counter", "Requests answered on the HTTP port.", stats.http_requests);
+    write_metric(out, "rtmp_http_flv_players", "gauge", "Connections playing a live stream as HTTP-FLV.",
+                 stats.http_flv_players);
+    write_metric(out, "rtmp_pool_hits_total", "counter", "Buffers served from the slab pool's free lists.",
+                 stats.pool_hits);
+    write_metric(out, "rtmp_pool_misses_total", "counter", "Buffers the slab pool got from the system.",
+                 stats.pool_misses);
+    write_metric(out, "rtmp_pool_in_use_bytes", "gauge", "Pooled blocks handed out.", stats.pool_in_use_bytes);
+    write_metric(out, "rtmp_record_written_bytes_total", "counter", "FLV bytes the recorder wrote to disk.",
+                 stats.record_bytes_written);
+    write_metric(out, "rtmp_record_files_total", "counter", "Recording files started, rotations included.",
+                 stats.record_files_opened);
+    write_metric(out, "rtmp_recordings_active", "gauge", "Streams being recorded.", stats.recordings_active);
+    write_metric(out, "rtmp_record_dropped_total", "counter",
+                 "Media packets left out of recordings because the disk fell behind.", stats.record_packets_dropped);
+    write_metric(out, "rtmp_record_write_errors_total", "counter", "Recording files that could not be created or written.",
+                 stats.record_write_errors);
+    write_metric(out, "rtmp_record_queue_bytes", "gauge", "Media waiting for the recorder's I/O thread.",
+                 stats.record_queue_bytes);
+
+    write_metric(out, "rtmp_hls_streams", "gauge", "Streams being packaged as HLS.", stats.hls_streams);
+    write_metric(out, "rtmp_hls_segments_total", "counter", "HLS segments completed.", stats.hls_segments);
+    write_metric(out, "rtmp_hls_segment_bytes_total", "counter", "MPEG-TS bytes the packager produced.",
+                 stats.hls_segment_bytes);
+    write_metric(out, "rtmp_hls_dropped_total", "counter",
+                 "Media packets left out of HLS segments because the packager fell behind.", stats.hls_packets_dropped);
+    write_metric(out, "rtmp_hls_queue_bytes", "gauge", "Media waiting for the packager thread.", stats.hls_queue_bytes);
+    write_metric(out, "rtmp_hls_store_bytes", "gauge", "Segment data held in memory.", stats.hls_store_bytes);
+    write_seconds_metric(out, "rtmp_hls_cpu_seconds_total", "counter",
+                         "CPU time of the packager thread; divide by rtmp_hls_streams for the cost per stream.",
+                         stats.hls_cpu_ns);
+
+    write_histogram(out, "rtmp_handshake_seconds", "Time from accept to the client's C2.", stats.handshake_time);
+    write_histogram(out, "rtmp_delivery_latency_seconds",
+                    "Time from a publisher's message being parsed to a player's socket accepting it.",
+                    stats.delivery_latency);
+    write_histogram(out, "rtmp_hls_segment_ready_seconds",
+                    "Time from the keyframe that ends an HLS segment being parsed to the segment being servable.",
+                    stats.hls_segment_ready);
+    return out;
+}
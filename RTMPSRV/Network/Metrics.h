@@ -0,0 +1,120 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <string>
+#include <cstddef> // For std::size_t
+
+// Latencies in microseconds, bucketed the way HdrHistogram does it: values below
+// SUB_BUCKETS get a bucket each, and every power of two above that is split into SUB_BUCKETS
+// linear buckets. A recorded value is therefore known to within 1/SUB_BUCKETS (12.5%) from
+// one microsecond up to 2^MAX_EXPONENT (about 19 hours); larger values land in the last
+// bucket. Only the owning worker records, so no update needs a locked instruction; any
+// thread may read a snapshot.
+class LatencyHistogram {
+public:
+    static const unsigned int SUB_BUCKET_BITS = 3;
+    static const unsigned int SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static const unsigned int MAX_EXPONENT = 36;
+    static const std::size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    void record(unsigned long long micros) {
+        std::atomic<unsigned long long>& bucket = counts_[bucket_index(micros)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum_.store(sum_.load(std::memory_order_relaxed) + micros, std::memory_order_relaxed);
+    }
+
+    static std::size_t bucket_index(unsigned long long micros);
+    // Smallest value that no longer falls into the bucket
+    static unsigned long long bucket_limit(std::size_t index);
+
+    unsigned long long count(std::size_t index) const { return counts_[index].load(std::memory_order_relaxed); }
+    unsigned long long sum() const { return sum_.load(std::memory_order_relaxed); }
+
+private:
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    std::atomic<unsigned long long> counts_[BUCKETS];
+    std::atomic<unsigned long long> sum_;
+};
+
+// Plain copy of one or more LatencyHistograms, merged at scrape time
+struct HistogramSnapshot {
+    unsigned long long counts[LatencyHistogram::BUCKETS];
+    unsigned long long sum;    // Microseconds
+    unsigned long long count;
+
+    HistogramSnapshot();
+    void add(const LatencyHistogram& histogram);
+    // Recorded values below limit; exact when limit is a bucket boundary (any power of two is)
+    unsigned long long count_below(unsigned long long limit) const;
+};
+
+// Message type IDs counted one by one; anything else shares the last slot
+static const unsigned int MESSAGE_TYPE_SLOTS = 0x17;
+
+// Totals summed over all workers at the time of the call
+struct ServerStats {
+    unsigned long long connections_accepted;
+    unsigned long long connections_open;
+    unsigned long long handshake_failures;          // Connections closed before the handshake completed
+    unsigned long long handshake_timeouts;          // Of those, closed by the server for taking too long
+    unsigned long long messages_received;
+    unsigned long long messages_by_type[MESSAGE_TYPE_SLOTS + 1];
+    unsigned long long bytes_received;
+    unsigned long long bytes_sent;
+    unsigned long long send_queue_bytes;            // Output accepted but not yet written, all connections
+    unsigned long long chunk_cache_hits;
+    unsigned long long chunk_cache_misses;
+    unsigned long long chunk_header_bytes_saved;    // Continuation headers not sent thanks to larger chunks
+    unsigned long long acks_sent;
+    unsigned long long send_window_stalls;          // Output held back until the client acknowledged
+    unsigned long long gop_cache_bytes;  // Media currently held for players that join mid-GOP
+    unsigned long long media_dropped;
+    unsigned long long slow_disconnects;
+    unsigned long long vod_players;
+    unsigned long long vod_bytes;                   // Media sent to them from mapped files
+    unsigned long long http_requests;
+    unsigned long long http_flv_players;
+    unsigned long long pool_hits;                   // Buffers the slab pool served from its free lists
+    unsigned long long pool_misses;                 // Buffers it had to get from the system
+    unsigned long long pool_in_use_bytes;           // Pooled blocks handed out right now
+    unsigned long long pool_cached_high_water_bytes;  // Most free bytes the thread caches held
+    unsigned long long record_bytes_written;        // FLV recorder, when enabled
+    unsigned long long record_files_opened;
+    unsigned long long recordings_active;
+    unsigned long long record_packets_dropped;
+    unsigned long long record_write_errors;
+    unsigned long long record_queue_bytes;          // Media waiting for the recorder's I/O thread
+    unsigned long long hls_streams;                 // HLS packager, when enabled
+    unsigned long long hls_segments;
+    unsigned long long hls_segment_bytes;
+    unsigned long long hls_packets_dropped;
+    unsigned long long hls_queue_bytes;
+    unsigned long long hls_store_bytes;
+    unsigned long long hls_cpu_ns;                  // Packager thread CPU time
+    HistogramSnapshot handshake_time;               // Accept to C2
+    HistogramSnapshot delivery_latency;             // Publisher's message parsed to a player's socket taking it
+    HistogramSnapshot hls_segment_ready;            // Keyframe parsed to the segment it ends being in the store
+};
+
+// Helpers shared by the counters and the metrics endpoint
+class Metrics {
+public:
+    // Monotonic clock in nanoseconds, the time base of every latency we record
+    static unsigned long long now_ns();
+    // CPU time the calling thread has used, in nanoseconds; 0 where that cannot be measured
+    static unsigned long long thread_cpu_ns();
+
+    static unsigned int message_type_slot(unsigned char message_type_id) {
+        return message_type_id < MESSAGE_TYPE_SLOTS ? message_type_id : MESSAGE_TYPE_SLOTS;
+    }
+
+    // Prometheus text exposition format (version 0.0.4)
+    static std::string prometheus_text(const ServerStats& stats);
+};
+
+#endif // METRICS_H
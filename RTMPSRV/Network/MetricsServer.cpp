@@ -0,0 +1,132 @@
+#include "MetricsServer.h"
+#include "Log.h"
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+namespace {
+
+const long POLL_INTERVAL_MS = 200;   // How long stop() may wait for the accept loop
+const long REQUEST_TIMEOUT_MS = 2000;
+const std::size_t MAX_REQUEST = 8 * 1024;
+
+// Waits until fd is readable (or writable); false on timeout or error. poll, since next to
+// thousands of RTMP sockets the fd is often past what select's fd_set can hold.
+bool wait_for(socket_t fd, bool write, long timeout_ms) {
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = write ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+#ifdef _WIN32
+    int ready = WSAPoll(&pfd, 1, static_cast<INT>(timeout_ms));
+#else
+    int ready = poll(&pfd, 1, static_cast<int>(timeout_ms));
+#endif
+    return ready > 0;
+}
+
+long remaining_ms(std::chrono::steady_clock::time_point deadline) {
+    long left = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count());
+    return left > 0 ? left : 0;
+}
+
+} // namespace
+
+MetricsServer::MetricsServer() : listener_(RTMP_INVALID_SOCKET) {}
+
+MetricsServer::~MetricsServer() {
+    join();
+    if (listener_ != RTMP_INVALID_SOCKET) {
+        Socket::close(listener_);
+    }
+}
+
+bool MetricsServer::init(int port, const Renderer& render) {
+    listener_ = Socket::create_listener(port);
+    if (listener_ == RTMP_INVALID_SOCKET) {
+        LOG_ERROR("[MetricsServer] Failed to listen on port " << port);
+        return false;
+    }
+    render_ = render;
+    LOG_INFO("[MetricsServer] Serving Prometheus metrics on port " << port << " at /metrics");
+    return true;
+}
+
+void MetricsServer::spawn(const std::atomic<bool>& running) {
+    thread_ = std::thread([this, &running]() {
+        run(running);
+    });
+}
+
+void MetricsServer::join() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void MetricsServer::run(const std::atomic<bool>& running) {
+    while (running) {
+        if (!wait_for(listener_, false, POLL_INTERVAL_MS)) {
+            continue;
+        }
+        std::string client_ip;
+        socket_t client = Socket::accept(listener_, client_ip);
+        if (client != RTMP_INVALID_SOCKET) {
+            serve(client);
+            Socket::close(client);
+        }
+    }
+}
+
+void MetricsServer::serve(socket_t client) {
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(REQUEST_TIMEOUT_MS);
+
+    // Only the request line matters, but read the headers so the client sees a clean close
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST) {
+        long received = Socket::recv(client, buffer, sizeof(buffer));
+        if (received > 0) {
+            request.append(buffer, received);
+            continue;
+        }
+        if (received == 0 || !Socket::would_block(Socket::last_error()) ||
+            !wait_for(client, false, remaining_ms(deadline))) {
+            return;
+        }
+    }
+
+    std::string body;
+    const char* status;
+    const char* content_type = "text/plain; charset=utf-8";
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0) {
+        status = "200 OK";
+        content_type = "text/plain; version=0.0.4; charset=utf-8";
+        body = render_();
+    } else {
+        status = "404 Not Found";
+        body = "Metrics are served at /metrics\n";
+    }
+
+    std::string response = std::string("HTTP/1.1 ") + status + "\r\nContent-Type: " + content_type +
+                           "\r\nContent-Length: " + std::to_string(body.size()) +
+                           "\r\nConnection: close\r\n\r\n" + body;
+    std::size_t sent = 0;
+    while (sent < response.size()) {
+        long written = Socket::send(client, response.data() + sent, response.size() - sent);
+        if (written > 0) {
+            sent += written;
+            continue;
+        }
+        if (written == 0 || !Socket::would_block(Socket::last_error()) ||
+            !wait_for(client, true, remaining_ms(deadline))) {
+            LOG_WARN("[MetricsServer] Gave up sending metrics to a slow client.");
+            return;
+        }
+    }
+}
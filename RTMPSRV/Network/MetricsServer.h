@@ -0,0 +1,37 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include "Socket.h"
+
+// Minimal HTTP/1.1 endpoint for scrapers: GET /metrics answers with whatever the renderer
+// returns, anything else with 404, and every connection is closed after one response.
+// It runs on its own thread, one request at a time, so a slow scraper can delay the next
+// scrape but never an RTMP worker.
+class MetricsServer {
+public:
+    typedef std::function<std::string()> Renderer;
+
+    MetricsServer();
+    ~MetricsServer();
+
+    bool init(int port, const Renderer& render);
+    void spawn(const std::atomic<bool>& running);  // Serves until running is cleared
+    void join();
+
+private:
+    MetricsServer(const MetricsServer&);
+    MetricsServer& operator=(const MetricsServer&);
+
+    void run(const std::atomic<bool>& running);
+    void serve(socket_t client);
+
+    socket_t listener_;
+    Renderer render_;
+    std::thread thread_;
+};
+
+#endif // METRICSSERVER_H
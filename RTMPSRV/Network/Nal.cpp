@@ -0,0 +1,301 @@
+#include "Nal.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define NAL_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NAL_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+const char Nal::START_CODE[4] = { 0, 0, 0, 1 };
+
+namespace {
+
+typedef const unsigned char* (*ScanFunction)(const unsigned char* p, const unsigned char* end, unsigned char last);
+
+// Position of the first 00 00 <last> at or after p, or end. last is 1 or 3, never 0.
+const unsigned char* scan_scalar(const unsigned char* p, const unsigned char* end, unsigned char last) {
+    // Look at the third byte of the window: unless it is 0 or last, no match can cover it
+    while (end - p >= 3) {
+        if (p[2] == last) {
+            if (p[0] == 0 && p[1] == 0) {
+                return p;
+            }
+            p += 3;
+        } else if (p[2] == 0) {
+            ++p;
+        } else {
+            p += 3;
+        }
+    }
+    return end;
+}
+
+#if defined(NAL_HAVE_SSE2) || defined(NAL_HAVE_AVX2)
+inline unsigned int lowest_bit(unsigned int mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+#ifdef NAL_HAVE_SSE2
+// 16 windows per step: bytes i, i+1 and i+2 compared at once from three unaligned loads
+const unsigned char* scan_sse2(const unsigned char* p, const unsigned char* end, unsigned char last) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wanted = _mm_set1_epi8(static_cast<char>(last));
+    while (end - p >= 18) {
+        __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        __m128i third = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2));
+        __m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(first, zero), _mm_cmpeq_epi8(second, zero)),
+                                      _mm_cmpeq_epi8(third, wanted));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(match));
+        if (mask != 0) {
+            return p + lowest_bit(mask);
+        }
+        p += 16;
+    }
+    return scan_scalar(p, end, last);
+}
+#endif
+
+#ifdef NAL_HAVE_AVX2
+// The same 32 windows at a time, compiled for AVX2 whatever the rest of the build targets
+__attribute__((target("avx2")))
+const unsigned char* scan_avx2(const unsigned char* p, const unsigned char* end, unsigned char last) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i wanted = _mm256_set1_epi8(static_cast<char>(last));
+    while (end - p >= 34) {
+        __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        __m256i third = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 2));
+        __m256i match = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(first, zero),
+                                                          _mm256_cmpeq_epi8(second, zero)),
+                                         _mm256_cmpeq_epi8(third, wanted));
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(match));
+        if (mask != 0) {
+            return p + lowest_bit(mask);
+        }
+        p += 32;
+    }
+    return scan_scalar(p, end, last);
+}
+
+bool cpu_has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+struct Dispatch {
+    Nal::Kernel kernel;
+    ScanFunction scan;
+};
+
+Dispatch best_kernel() {
+#ifdef NAL_HAVE_AVX2
+    if (cpu_has_avx2()) {
+        Dispatch avx2 = { Nal::KERNEL_AVX2, scan_avx2 };
+        return avx2;
+    }
+#endif
+#ifdef NAL_HAVE_SSE2
+    Dispatch sse2 = { Nal::KERNEL_SSE2, scan_sse2 };
+    return sse2;
+#else
+    Dispatch scalar = { Nal::KERNEL_SCALAR, scan_scalar };
+    return scalar;
+#endif
+}
+
+Dispatch& dispatch() {
+    static Dispatch selected = best_kernel();
+    return selected;
+}
+
+const char* scan(const char* begin, const char* end, unsigned char last) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(begin);
+    return reinterpret_cast<const char*>(dispatch().scan(p, reinterpret_cast<const unsigned char*>(end), last));
+}
+
+} // namespace
+
+bool Nal::parse_avc_config(const char* data, std::size_t length, AvcConfig& config) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    // version, profile, compatibility, level, length size, SPS count
+    if (length < 6 || p[0] != 1) {
+        return false;
+    }
+    config.length_size = (p[4] & 0x03) + 1;
+    config.parameter_sets.clear();
+
+    std::size_t offset = 5;
+    for (int table = 0; table < 2; ++table) {
+        if (offset >= length) {
+            return false;
+        }
+        unsigned int count = table == 0 ? (p[offset] & 0x1F) : p[offset];  // SPS, then PPS
+        ++offset;
+        for (unsigned int i = 0; i < count; ++i) {
+            if (offset + 2 > length) {
+                return false;
+            }
+            std::size_t size = (static_cast<std::size_t>(p[offset]) << 8) | p[offset + 1];
+            offset += 2;
+            if (size > length - offset) {
+                return false;
+            }
+            config.parameter_sets.append(START_CODE, sizeof(START_CODE));
+            config.parameter_sets.append(data + offset, size);
+            offset += size;
+        }
+    }
+    return true;
+}
+
+bool Nal::is_avcc(const char* data, std::size_t length, unsigned int length_size) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    std::size_t offset = 0;
+    while (offset + length_size <= length) {
+        std::size_t size = 0;
+        for (unsigned int i = 0; i < length_size; ++i) {
+            size = (size << 8) | p[offset + i];
+        }
+        offset += length_size;
+        if (size > length - offset) {
+            return false;
+        }
+        offset += size;
+    }
+    return offset == length;
+}
+
+bool Nal::is_annexb(const char* data, std::size_t length) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    return (length >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 1) ||
+           (length >= 4 && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1);
+}
+
+bool Nal::avcc_to_annexb(const char* data, std::size_t length, unsigned int length_size, std::string& out) {
+    // Driven by the lengths, so nothing to scan: with 4-byte lengths the output is exactly
+    // as long as the input, and one reservation covers it
+    out.reserve(out.size() + length + (length_size < 4 ? length / 16 + 64 : 0));
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    std::size_t offset = 0;
+    while (offset + length_size <= length) {
+        std::size_t size = 0;
+        for (unsigned int i = 0; i < length_size; ++i) {
+            size = (size << 8) | p[offset + i];
+        }
+        offset += length_size;
+        if (size > length - offset) {
+            return false;
+        }
+        if (size > 0) {
+            out.append(START_CODE, sizeof(START_CODE));
+            out.append(data + offset, size);
+        }
+        offset += size;
+    }
+    return offset == length;
+}
+
+bool Nal::annexb_to_avcc(const char* data, std::size_t length, unsigned int length_size, std::string& out) {
+    out.reserve(out.size() + length);
+    const char* end = data + length;
+    const char* unit = find_start_code(data, end);
+    while (unit != end) {
+        unit += 3;
+        const char* next = find_start_code(unit, end);
+        // Zero bytes before the next start code are padding (trailing_zero_8bits, cabac_zero_words)
+        // or the first byte of a 4-byte start code
+        const char* unit_end = next;
+        while (unit_end > unit && unit_end[-1] == 0) {
+            --unit_end;
+        }
+        std::size_t size = unit_end - unit;
+        if (size > 0) {
+            if (length_size < 4 && size >> (8 * length_size) != 0) {
+                return false;
+            }
+            for (unsigned int i = length_size; i > 0; --i) {
+                out.push_back(static_cast<char>((size >> (8 * (i - 1))) & 0xFF));
+            }
+            out.append(unit, size);
+        }
+        unit = next;
+    }
+    return true;
+}
+
+const char* Nal::find_start_code(const char* begin, const char* end) {
+    return scan(begin, end, 1);
+}
+
+const char* Nal::find_emulation_prevention(const char* begin, const char* end) {
+    return scan(begin, end, 3);
+}
+
+void Nal::remove_emulation_prevention(const char* data, std::size_t length, std::string& out) {
+    out.reserve(out.size() + length);
+    const char* end = data + length;
+    const char* run = data;
+    while (run != end) {
+        const char* escape = find_emulation_prevention(run, end);
+        if (escape == end) {
+            out.append(run, end - run);
+            break;
+        }
+        out.append(run, escape + 2 - run);  // Up to the two zeros, then past the 03
+        run = escape + 3;
+    }
+}
+
+Nal::Kernel Nal::kernel() {
+    return dispatch().kernel;
+}
+
+bool Nal::set_kernel(Kernel kernel) {
+    Dispatch chosen = { kernel, scan_scalar };
+    switch (kernel) {
+        case KERNEL_SCALAR:
+            break;
+        case KERNEL_SSE2:
+#ifdef NAL_HAVE_SSE2
+            chosen.scan = scan_sse2;
+            break;
+#else
+            return false;
+#endif
+        case KERNEL_AVX2:
+#ifdef NAL_HAVE_AVX2
+            if (!cpu_has_avx2()) {
+                return false;
+            }
+            chosen.scan = scan_avx2;
+            break;
+#else
+            return false;
+#endif
+    }
+    dispatch() = chosen;
+    return true;
+}
+
+const char* Nal::kernel_name(Kernel kernel) {
+    switch (kernel) {
+        case KERNEL_SSE2: return "sse2";
+        case KERNEL_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
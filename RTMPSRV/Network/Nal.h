@@ -0,0 +1,75 @@
+#ifndef NAL_H
+#define NAL_H
+
+#include <string>
+#include <cstddef> // For std::size_t
+
+// H.264 NAL unit framing. RTMP and FLV carry NAL units the way MP4 does (AVCC): each one
+// after a big-endian length of 1-4 bytes, with SPS and PPS in a separate decoder
+// configuration record. MPEG-TS and most decoders want Annex-B instead: every unit after
+// a 00 00 00 01 start code, parameter sets in-band. H.265 frames the same way, so
+// everything here but the configuration record applies to both.
+//
+// Annex-B units are found by scanning for start codes, and escaped payload by scanning
+// for 00 00 03. Both go through one kernel chosen at startup: AVX2 or SSE2 where the
+// CPU has it, a scalar loop otherwise.
+class Nal {
+public:
+    enum Type {
+        TYPE_IDR = 5,
+        TYPE_SPS = 7,
+        TYPE_PPS = 8,
+        TYPE_AUD = 9
+    };
+
+    enum Kernel {
+        KERNEL_SCALAR,
+        KERNEL_SSE2,
+        KERNEL_AVX2
+    };
+
+    // AVCDecoderConfigurationRecord (an FLV video sequence header past its 5-byte prefix)
+    struct AvcConfig {
+        unsigned int length_size;    // Bytes in front of each NAL unit of the frames that follow
+        std::string parameter_sets;  // Every SPS and PPS, already in Annex-B
+    };
+
+    static const char START_CODE[4];
+
+    static Type type(unsigned char header) { return static_cast<Type>(header & 0x1F); }
+
+    static bool parse_avc_config(const char* data, std::size_t length, AvcConfig& config);
+
+    // Whether the data is a whole number of AVCC units with length_size-byte lengths
+    static bool is_avcc(const char* data, std::size_t length, unsigned int length_size);
+
+    // Whether the data starts with a 3- or 4-byte start code
+    static bool is_annexb(const char* data, std::size_t length);
+
+    // Appends the NAL units of one AVCC access unit to out in Annex-B. Returns false, with
+    // out holding the units before it, when a length runs past the end of the data.
+    static bool avcc_to_annexb(const char* data, std::size_t length, unsigned int length_size, std::string& out);
+
+    // Appends the NAL units of Annex-B data to out in AVCC, dropping the zero bytes that
+    // trail each one. Returns false, with out holding the units before it, when a unit is
+    // too long for length_size bytes.
+    static bool annexb_to_avcc(const char* data, std::size_t length, unsigned int length_size, std::string& out);
+
+    // The first 00 00 01 at or after begin, or end. In a 4-byte start code that is its last
+    // three bytes.
+    static const char* find_start_code(const char* begin, const char* end);
+
+    // The first 00 00 03 at or after begin, or end; its 03 is an emulation prevention byte
+    static const char* find_emulation_prevention(const char* begin, const char* end);
+
+    // Appends a NAL unit to out without its emulation prevention bytes (its RBSP)
+    static void remove_emulation_prevention(const char* data, std::size_t length, std::string& out);
+
+    // The scanning kernel in use. set_kernel() returns false when the build or the CPU
+    // lacks the one asked for; it is meant for benchmarks, before any other thread scans.
+    static Kernel kernel();
+    static bool set_kernel(Kernel kernel);
+    static const char* kernel_name(Kernel kernel);
+};
+
+#endif // NAL_H
@@ -1,183 +1,287 @@
 #include "Parse.h"
+#include "Connection.h"
+#include "ChunkStream.h"
 #include "ParseControl.h"
 #include "ParseAMF.h"
 #include "ParseUtils.h"
-#include <iostream>
-#include <cstdlib>
+#include "Log.h"
+#include "FastRandom.h"
 #include <cstring> // for memcpy
-#include <ctime>   // for time
-
-// Function to perform the RTMP handshake with the client
-bool Parse::perform_handshake(SOCKET client_socket) {
-    char c0c1[1537]; // Buffer for C0 and C1
-    char s0s1s2[3073]; // Buffer for S0, S1, S2
-    char c2[1536]; // Buffer for C2
-
-    // Receive C0 and C1
-    int bytes_received = recv(client_socket, c0c1, 1537, 0);
-    if (bytes_received != 1537) {
-        std::cerr << "Failed to receive C0 and C1" << std::endl;
-        return false;
-    }
 
-    // Prepare S0 (version byte)
-    s0s1s2[0] = 0x03; // RTMP version 3
+static const std::size_t HANDSHAKE_SIZE = 1536;  // C1, C2, S1 and S2
+static const unsigned char RTMP_VERSION = 0x03;
 
-    // Prepare S1 and S2
-    srand(static_cast<unsigned int>(time(NULL))); // Seed random number generator
-    for (int i = 1; i <= 1536; ++i) {
-        s0s1s2[i] = rand() % 256; // Fill with random data
-    }
-    memcpy(s0s1s2 + 1537, c0c1 + 1, 1536); // Copy C1 to S1 and S2
+// Function to advance the RTMP handshake with the client, one step per call.
+// Each step waits until its whole segment is buffered, however many reads that takes.
+// S0 and S1 do not depend on anything but C0, so they go out as soon as C0 is here;
+// when C0 and C1 arrive together the process_input loop runs both steps at once and
+// S0, S1 and S2 leave in a single write.
+size_t Parse::perform_handshake(Connection& conn, const char* data, std::size_t length) {
+    switch (conn.state()) {
+        case Connection::HANDSHAKE_C0: {
+            if (length < 1) {
+                return 0;
+            }
+            if ((unsigned char)data[0] != RTMP_VERSION) {
+                LOG_WARN("Unsupported RTMP version " << (int)(unsigned char)data[0] << " from IP: " << conn.client_ip());
+                conn.close();
+                return 0;
+            }
 
-    // Send S0, S1, S2
-    int bytes_sent = send(client_socket, s0s1s2, 3073, 0);
-    if (bytes_sent != 3073) {
-        std::cerr << "Failed to send S0, S1, S2" << std::endl;
-        return false;
-    }
+            // S0, then S1: our time (0), four zero bytes, random filler
+            char s0s1[1 + HANDSHAKE_SIZE];
+            s0s1[0] = RTMP_VERSION;
+            memset(s0s1 + 1, 0, 8);
+            FastRandom::fill(s0s1 + 9, HANDSHAKE_SIZE - 8);
+            if (!conn.send(s0s1, sizeof(s0s1))) {
+                LOG_WARN("Failed to send S0, S1");
+                return 0;
+            }
+            conn.set_state(Connection::HANDSHAKE_C1);
+            return 1;
+        }
 
-    // Receive C2
-    bytes_received = recv(client_socket, c2, 1536, 0);
-    if (bytes_received != 1536) {
-        std::cerr << "Failed to receive C2" << std::endl;
-        return false;
+        case Connection::HANDSHAKE_C1:
+            if (length < HANDSHAKE_SIZE) {
+                return 0;
+            }
+            // S2 echoes C1
+            if (!conn.send(data, HANDSHAKE_SIZE)) {
+                LOG_WARN("Failed to send S2");
+                return 0;
+            }
+            conn.set_state(Connection::HANDSHAKE_C2);
+            return HANDSHAKE_SIZE;
+
+        case Connection::HANDSHAKE_C2:
+            if (length < HANDSHAKE_SIZE) {
+                return 0;
+            }
+            conn.set_state(Connection::ESTABLISHED);
+            LOG_DEBUG("RTMP handshake completed successfully for IP: " << conn.client_ip());
+            return HANDSHAKE_SIZE;
+
+        default:
+            return 0;
     }
+}
 
-    std::cout << "RTMP handshake completed successfully." << std::endl;
-    return true;
+static unsigned int read_uint24(const char* data) {
+    return ((unsigned char)data[0]) << 16 |
+           ((unsigned char)data[1]) << 8 |
+           ((unsigned char)data[2]);
 }
 
-size_t Parse::parse_rtmp_packet(const char* data, std::size_t length, SOCKET client_socket) {
-    if (length < 1) {
-        std::cerr << "Packet too small to be an RTMP command." << std::endl;
-        return 0;
-    }
+static unsigned int read_uint32(const char* data) {
+    return ((unsigned int)(unsigned char)data[0]) << 24 | read_uint24(data + 1);
+}
 
-    size_t initial_length = length;
+// Demultiplexes whole chunks from the buffered input. Header fields omitted by fmt 1/2/3
+// come from the connection's ChunkStreamTable; messages spanning several chunks (possibly
+// interleaved with other chunk streams) are reassembled there and dispatched once complete.
+// Returns the number of bytes consumed; a partial chunk is left for the next call.
+size_t Parse::parse_rtmp_packet(const char* data, std::size_t length, Connection& conn) {
+    ChunkStreamTable& streams = conn.chunk_streams();
     size_t total_consumed = 0;
 
-    // Loop to handle multiple chunks in the data
-    while (total_consumed < length) {
+    while (total_consumed < length && !conn.is_closed()) {
         const char* current_data = data + total_consumed;
         size_t remaining_length = length - total_consumed;
 
-        // Check if we have enough data for at least the basic header
-        if (remaining_length < 1) {
-            break; // Not enough data
-        }
-
         // Extract fmt and csid from the basic header
         unsigned char fmt = (current_data[0] & 0xC0) >> 6;
         unsigned int csid = (current_data[0] & 0x3F);
-        size_t header_index = 1;
+        size_t header_size = 1;
 
         if (csid == 0) {
             if (remaining_length < 2) {
                 break; // Not enough data
             }
             csid = 64 + (unsigned char)current_data[1];
-            header_index++;
+            header_size = 2;
         } else if (csid == 1) {
             if (remaining_length < 3) {
                 break; // Not enough data
             }
             csid = 64 + (unsigned char)current_data[1] + ((unsigned char)current_data[2]) * 256;
-            header_index += 2;
+            header_size = 3;
         }
 
-        // Determine the header size and fields based on fmt
-        unsigned int timestamp = 0;
-        unsigned int message_length = 0;
-        unsigned char message_type_id = 0;
-        unsigned int message_stream_id = 0;
-        size_t header_size = header_index;
+        static const size_t message_header_sizes[4] = {11, 7, 3, 0};
+        if (remaining_length < header_size + message_header_sizes[fmt]) {
+            break; // Not enough data
+        }
+
+        ChunkStream* found = streams.get(csid);
+        if (found == nullptr) {
+            LOG_WARN("[parse_rtmp_packet] Too many chunk streams (at chunk stream " << csid << "), closing connection.");
+            conn.close();
+            break;
+        }
+        ChunkStream& stream = *found;
+        if (fmt != 0 && !stream.has_header) {
+            LOG_WARN("[parse_rtmp_packet] fmt " << (int)fmt << " chunk on chunk stream " << csid
+                      << " without a preceding fmt 0 header, closing connection.");
+            conn.close();
+            break;
+        }
+
+        // Read the message header into locals; the stream is only updated once the whole chunk is here
+        const char* header = current_data + header_size;
+        unsigned int timestamp_field = 0;
+        unsigned int message_length = stream.message_length;
+        unsigned char message_type_id = stream.message_type_id;
+        unsigned int message_stream_id = stream.message_stream_id;
+        bool extended_timestamp = stream.extended_timestamp;
 
         if (fmt <= 2) {
-            size_t required_header_size = header_index + (fmt == 0 ? 11 : (fmt == 1 ? 7 : 3));
-            if (remaining_length < required_header_size) {
+            timestamp_field = read_uint24(header);
+            extended_timestamp = timestamp_field == 0xFFFFFF;
+        }
+        if (fmt <= 1) {
+            message_length = read_uint24(header + 3);
+            message_type_id = (unsigned char)header[6];
+        }
+        if (fmt == 0) {
+            // Message stream ID is the one little-endian field in the protocol
+            message_stream_id = ((unsigned char)header[7]) |
+                                ((unsigned char)header[8]) << 8 |
+                                ((unsigned char)header[9]) << 16 |
+                                ((unsigned int)(unsigned char)header[10]) << 24;
+        }
+        header_size += message_header_sizes[fmt];
+
+        // fmt 3 chunks repeat the extended timestamp whenever the header they continue had one
+        if (extended_timestamp) {
+            if (remaining_length < header_size + 4) {
                 break; // Not enough data
             }
+            timestamp_field = read_uint32(current_data + header_size);
+            header_size += 4;
+        }
+
+        bool starts_message = !stream.in_message();
+        if (!starts_message && fmt != 3) {
+            LOG_WARN("[parse_rtmp_packet] New header on chunk stream " << csid << " after "
+                      << stream.received << "/" << stream.message_length
+                      << " bytes of the previous message, dropping it.");
+            streams.release(stream);
+            starts_message = true;
+        }
 
-            // Parse timestamp, message length, message type ID
-            timestamp = ((unsigned char)current_data[header_index]) << 16 |
-                        ((unsigned char)current_data[header_index + 1]) << 8 |
-                        ((unsigned char)current_data[header_index + 2]);
-            header_index += 3;
-
-            if (fmt <= 1) {
-                message_length = ((unsigned char)current_data[header_index]) << 16 |
-                                 ((unsigned char)current_data[header_index + 1]) << 8 |
-                                 ((unsigned char)current_data[header_index + 2]);
-                message_type_id = (unsigned char)current_data[header_index + 3];
-                header_index += 4;
-
-                if (fmt == 0) {
-                    message_stream_id = ((unsigned char)current_data[header_index]) |
-                                        ((unsigned char)current_data[header_index + 1]) << 8 |
-                                        ((unsigned char)current_data[header_index + 2]) << 16 |
-                                        ((unsigned char)current_data[header_index + 3]) << 24;
-                    header_index += 4;
+        size_t chunk_size = conn.in_chunk_size();
+        size_t already_received = starts_message ? 0 : stream.received;
+        size_t payload_size = message_length - already_received;
+        if (payload_size > chunk_size) {
+            payload_size = chunk_size;
+        }
+        if (remaining_length < header_size + payload_size) {
+            break; // Wait until the whole chunk is buffered
+        }
+
+        // Commit the header to the chunk stream
+        stream.has_header = true;
+        stream.extended_timestamp = extended_timestamp;
+        stream.message_length = message_length;
+        stream.message_type_id = message_type_id;
+        stream.message_stream_id = message_stream_id;
+        if (starts_message) {
+            if (fmt == 0) {
+                stream.timestamp = timestamp_field;
+                stream.timestamp_delta = 0;
+            } else {
+                if (fmt != 3) {
+                    stream.timestamp_delta = timestamp_field;
                 }
+                stream.timestamp += stream.timestamp_delta;
             }
+        }
 
-            header_size = header_index;
-        } else if (fmt == 3) {
-            // No header, use cached values (not implemented in this example)
-            header_size = header_index;
-            std::cerr << "RTMP fmt: 3 (no header, continuation packet), skipping." << std::endl;
-            // For a full implementation, you need to maintain previous chunk headers per chunk stream
-            return 0;
+        const char* payload = current_data + header_size;
+        total_consumed += header_size + payload_size;
+
+        RTMPMessage message;
+        message.csid = csid;
+        message.timestamp = stream.timestamp;
+        message.message_type_id = stream.message_type_id;
+        message.message_stream_id = stream.message_stream_id;
+
+        if (starts_message && payload_size == message_length) {
+            // Single-chunk message: dispatch straight from the receive buffer
+            message.data = payload;
+            message.length = payload_size;
+            message.buffer = nullptr;
+            dispatch_message(message, conn);
+            continue;
         }
 
-        // Handle extended timestamp
-        if (timestamp == 0xFFFFFF) {
-            if (remaining_length < header_size + 4) {
-                break; // Not enough data
-            }
-            timestamp = ((unsigned char)current_data[header_size]) << 24 |
-                        ((unsigned char)current_data[header_size + 1]) << 16 |
-                        ((unsigned char)current_data[header_size + 2]) << 8 |
-                        ((unsigned char)current_data[header_size + 3]);
-            header_size += 4;
+        if (!streams.append(stream, payload, payload_size)) {
+            LOG_WARN("[parse_rtmp_packet] Partial messages over the reassembly limit (at chunk stream " << csid
+                      << ", " << stream.message_length << "-byte message), closing connection.");
+            conn.close();
+            break;
+        }
+        if (stream.received < stream.message_length) {
+            continue;
         }
 
-        // At this point, header_size bytes have been consumed for the header
-        size_t total_message_size = header_size + message_length;
-
-        if (remaining_length < total_message_size) {
-            break; // Not enough data to parse the full message
-        }
-
-        const char* message_body = current_data + header_size;
-
-        // Correctly call methods from ParseControl and ParseAMF
-        switch (message_type_id) {
-            case 0x01:
-                ParseControl::handle_set_chunk_size(message_body, message_length);
-                break;
-            case 0x03:
-                ParseControl::handle_acknowledgement(message_body, message_length);
-                break;
-            case 0x04:
-                ParseControl::handle_user_control_message(message_body, message_length);
-                break;
-            case 0x05:
-                ParseControl::handle_window_ack_size(message_body, message_length);
-                break;
-            case 0x06:
-                ParseControl::handle_set_peer_bandwidth(message_body, message_length);
-                break;
-            case 0x14:
-                ParseAMF::handle_amf_command(message_body, message_length, client_socket);
-                break;
-            default:
-                std::cerr << "Unknown RTMP message type: " << (int)message_type_id << ", skipping." << std::endl;
-                break;
-        }
-
-        total_consumed += total_message_size;
+        message.data = stream.payload.data();
+        message.length = stream.payload.size();
+        message.buffer = &stream.payload;
+        dispatch_message(message, conn);
+        streams.release(stream);
     }
 
     return total_consumed;
 }
+
+void Parse::dispatch_message(const RTMPMessage& message, Connection& conn) {
+    const char* message_body = message.data;
+    size_t message_length = message.length;
+    conn.record_message(message.message_type_id);
+
+    // Correctly call methods from ParseControl and ParseAMF
+    switch (message.message_type_id) {
+        case 0x01:
+            ParseControl::handle_set_chunk_size(conn, message_body, message_length);
+            break;
+        case 0x02:
+            if (message_length >= 4) {
+                conn.chunk_streams().abort(read_uint32(message_body));
+            }
+            break;
+        case 0x03:
+            ParseControl::handle_acknowledgement(conn, message_body, message_length);
+            break;
+        case 0x04:
+            ParseControl::handle_user_control_message(message_body, message_length);
+            break;
+        case 0x05:
+            ParseControl::handle_window_ack_size(conn, message_body, message_length);
+            break;
+        case 0x06:
+            ParseControl::handle_set_peer_bandwidth(conn, message_body, message_length);
+            break;
+        case 0x08: // Audio
+        case 0x09: // Video
+        case 0x12: // AMF0 data (@setDataFrame / onMetaData)
+            conn.publish_media(message.timestamp, message.message_type_id, message_body, message_length, message.buffer);
+            break;
+        case 0x0F: // AMF3 data: a format byte, then AMF0 values that may switch to AMF3
+            if (message_length > 1) {
+                conn.publish_media(message.timestamp, 0x12, message_body + 1, message_length - 1, nullptr);
+            }
+            break;
+        case 0x11: // AMF3 command: same layout after the format byte
+            if (message_length > 1) {
+                ParseAMF::handle_amf_command(message_body + 1, message_length - 1, conn, message.message_stream_id);
+            }
+            break;
+        case 0x14:
+            ParseAMF::handle_amf_command(message_body, message_length, conn, message.message_stream_id);
+            break;
+        default:
+            LOG_WARN("Unknown RTMP message type: " << (int)message.message_type_id << ", skipping.");
+            break;
+    }
+}
@@ -1,13 +1,17 @@
 #ifndef PARSE_H
 #define PARSE_H
 
-#include <winsock2.h> // For SOCKET type
 #include <cstddef>    // For std::size_t
 
+class Connection;
+struct RTMPMessage;
+
 class Parse {
 public:
-    static bool perform_handshake(SOCKET client_socket);
-    static size_t parse_rtmp_packet(const char* data, std::size_t length, SOCKET client_socket);
+    // Advance the connection's handshake with buffered input; returns bytes consumed (0 = need more data)
+    static size_t perform_handshake(Connection& conn, const char* data, std::size_t length);
+    static size_t parse_rtmp_packet(const char* data, std::size_t length, Connection& conn);
+    static void dispatch_message(const RTMPMessage& message, Connection& conn);
 };
 
 #endif // PARSE_H
@@ -1,113 +1,137 @@
 #include "ParseAMF.h"
-#include <iostream>
+#include "AMF0.h"
+#include "AMF3.h"
+#include "ResponseTemplate.h"
+#include "Connection.h"
+#include "Log.h"
+#include <cstring>
 #include "ParseControl.h"
-#include <vector>
 #include "ParseUtils.h"
 #include "Parse.h"
 
-void ParseAMF::handle_amf_command(const char* data, std::size_t length, SOCKET client_socket) {
-    std::cout << "[handle_amf_command] Received AMF command with length: " << length << " bytes." << std::endl;
+void ParseAMF::handle_amf_command(const char* data, std::size_t length, Connection& conn, unsigned int message_stream_id) {
+    LOG_DEBUG("[handle_amf_command] Received AMF command with length: " << length << " bytes.");
 
     if (!data || length == 0) {
-        std::cerr << "[handle_amf_command] Error: Invalid input data" << std::endl;
+        LOG_WARN("[handle_amf_command] Error: Invalid input data");
         return;
     }
 
-    // Print full bytes of packet for debugging
-    std::cout << "[handle_amf_command] Full packet content (hex): ";
-    for (size_t i = 0; i < length; ++i) {
-        printf("%02X ", (unsigned char)data[i]);
-    }
-    std::cout << std::endl;
-
-    size_t index = 0;  // Start from the beginning of the message body
+    // Full bytes of the packet, in debug builds only
+    Parses::dump_hex(data, length);
 
-    bool found_command = false;
-    std::string command_name;
-    double transaction_id = 0.0;
-
-    // Read the command name
-    if (index + 1 > length) {
-        std::cerr << "[handle_amf_command] Error: Not enough data to read marker." << std::endl;
-        return;
+    // One arena per thread, reused for every command: strings stay in the payload, so once
+    // warm nothing here allocates
+    static thread_local AMFDocument document;
+    if (!AMF0::decode(data, length, document)) {
+        // Keep going with whatever came before the bad value; name and ID are enough for most commands
+        LOG_DEBUG("[handle_amf_command] Malformed AMF0 after " << document.root_count() << " values.");
     }
 
-    uint8_t marker = (unsigned char)data[index];
-    std::cout << "[handle_amf_command] Marker: " << std::hex << (unsigned int)marker << std::dec << " at index: " << index << std::endl;
-
-    if (marker == 0x02) { // AMF0 string marker
-        index++;
-
-        if (index + 2 > length) {
-            std::cerr << "[handle_amf_command] Error: Not enough data to read string length." << std::endl;
-            return;
-        }
-
-        // Read string length (2 bytes big-endian)
-        uint16_t str_len = (static_cast<unsigned char>(data[index]) << 8) | static_cast<unsigned char>(data[index + 1]);
-        std::cout << "[handle_amf_command] Read string length: " << str_len << " at index: " << index << std::endl;
-        index += 2;
-
-        if (index + str_len > length) {
-            std::cerr << "[handle_amf_command] Error: String length exceeds available data. Str_len: " << str_len
-                      << " Remaining length: " << (length - index) << std::endl;
-            return;
-        }
-
-        // Extract the string (command name)
-        command_name = std::string(data + index, str_len);
-        std::cout << "[handle_amf_command] Extracted command name: '" << command_name << "'" << std::endl;
-        index += str_len;
-
-        found_command = true;
-    } else {
-        std::cerr << "[handle_amf_command] Error: Expected AMF0 string marker (0x02), got: " << std::hex << (unsigned int)marker << std::dec << std::endl;
+    // Command name, transaction ID, command object, then command-specific arguments
+    const AMFValue* name = document.root(0);
+    if (!name || !name->is_string()) {
+        LOG_WARN("[handle_amf_command] Error: Expected a command name string.");
         return;
     }
-
-    // Read the transaction ID
-    if (index + 1 > length) {
-        std::cerr << "[handle_amf_command] Error: Not enough data to read transaction ID marker." << std::endl;
+    const AMFValue* transaction = document.root(1);
+    if (!transaction || !transaction->is_number()) {
+        LOG_WARN("[handle_amf_command] Error: Expected a transaction ID number after '" << name->string << "'.");
         return;
     }
+    AMFString command_name = name->string;
+    double transaction_id = transaction->number;
+    LOG_DEBUG("[handle_amf_command] Command '" << command_name << "', transaction ID: " << transaction_id);
 
-    marker = (unsigned char)data[index];
-    if (marker == 0x00) { // AMF0 number marker
-        index++;
-        if (index + 8 > length) {
-            std::cerr << "[handle_amf_command] Error: Not enough data to read transaction ID." << std::endl;
-            return;
+    // Handle the extracted command
+    if (command_name.equals("connect")) {
+        const AMFValue* command_object = document.root(2);
+        AMFString app = AMFDocument::string_or_empty(document.property(command_object, "app"));
+        if (!app.empty()) {
+            LOG_INFO("[handle_amf_command] Client connects to app: '" << app << "', tcUrl: '"
+                     << AMFDocument::string_or_empty(document.property(command_object, "tcUrl")) << "', flashVer: '"
+                     << AMFDocument::string_or_empty(document.property(command_object, "flashVer")) << "'");
+            conn.set_app(app.str());
         }
-
-        transaction_id = Parses::read_amf_number(data + index - 1);
-        std::cout << "[handle_amf_command] Extracted transaction ID: " << transaction_id << std::endl;
-        index += 8;
-    } else {
-        std::cerr << "[handle_amf_command] Error: Expected AMF0 number marker (0x00) for transaction ID, got: " << std::hex << (unsigned int)marker << std::dec << std::endl;
-        return;
+        conn.set_object_encoding(AMFDocument::number_or(document.property(command_object, "objectEncoding"), 0.0) == 3.0 ? 3 : 0);
+        // Larger chunks before anything else goes out, so replies and media carry fewer headers
+        if (conn.preferred_out_chunk_size() != conn.out_chunk_size()) {
+            ParseControl::send_set_chunk_size(conn, static_cast<unsigned int>(conn.preferred_out_chunk_size()));
+        }
+        ParseControl::send_window_ack_size(conn, conn.preferred_ack_window());
+        ParseControl::send_set_peer_bandwidth(conn, conn.preferred_ack_window(), ParseControl::LIMIT_DYNAMIC);
+        send_connect_response(conn, transaction_id);
     }
-
-    // Handle the extracted command
-    if (command_name == "connect") {
-        ParseControl::send_window_ack_size(client_socket, 5000000);
-        ParseControl::send_set_peer_bandwidth(client_socket, 5000000, 2);
-        send_connect_response(client_socket, transaction_id);
+    else if (command_name.equals("createStream")) {
+        send_create_stream_response(conn, transaction_id);
     }
-    else if (command_name == "createStream") {
-        send_create_stream_response(client_socket, transaction_id);
+    else if (command_name.equals("publish")) {
+        AMFString stream_name = stream_name_argument(document);
+        if (stream_name.empty()) {
+            LOG_WARN("[handle_amf_command] Error: publish without a stream name.");
+            return;
+        }
+        if (conn.start_publishing(stream_name.str())) {
+            send_on_status_publish(conn, message_stream_id);
+        } else {
+            send_on_status_publish_bad_name(conn, message_stream_id);
+        }
     }
-    else if (command_name == "publish") {
-        send_on_status_publish(client_socket, transaction_id);
+    else if (command_name.equals("play")) {
+        AMFString stream_name = stream_name_argument(document);
+        if (stream_name.empty()) {
+            LOG_WARN("[handle_amf_command] Error: play without a stream name.");
+            return;
+        }
+        // Start and duration are in milliseconds, as librtmp, ffmpeg and Flash send them. A
+        // negative start asks for live: -2000 (or -2) if there is one, anything else live
+        // only. A negative duration plays to the end.
+        double start = AMFDocument::number_or(document.root(4), -2000.0);
+        double duration = AMFDocument::number_or(document.root(5), -1.0);
+        LOG_DEBUG("[handle_amf_command] play '" << stream_name << "' start: " << start << " duration: " << duration);
+        if (conn.role() != Connection::ROLE_NONE) {
+            LOG_WARN("[handle_amf_command] Client " << conn.client_ip() << " already publishes or plays a stream.");
+            send_on_status_play_failed(conn, message_stream_id);
+            return;
+        }
+        // Status first, so the player is ready before cached headers and media follow.
+        // A file's first tags go out later in this loop iteration.
+        ParseControl::send_stream_begin(conn, message_stream_id);
+        if (conn.start_vod(stream_name.str(), start, duration, message_stream_id)) {
+            send_on_status(conn, message_stream_id, "status", "NetStream.Play.Reset", "Playing and resetting.");
+            send_on_status_play(conn, message_stream_id);
+        } else {
+            send_on_status_play(conn, message_stream_id);
+            conn.start_playing(stream_name.str(), message_stream_id);
+        }
     }
-    else if (command_name == "play") {
-        send_on_status_play(client_socket, transaction_id);
+    else if (command_name.equals("pause")) {
+        // pause(transaction, null, pausing, milliseconds)
+        bool pausing = AMFDocument::boolean_or(document.root(3), true);
+        conn.pause_media(pausing);
+        if (pausing) {
+            send_on_status_pause(conn, message_stream_id);
+        } else {
+            send_on_status(conn, message_stream_id, "status", "NetStream.Unpause.Notify", "Playback resumed.");
+        }
     }
-    else if (command_name == "pause") {
-        send_on_status_pause(client_socket, transaction_id);
+    else if (command_name.equals("deleteStream") || command_name.equals("closeStream") || command_name.equals("FCUnpublish")) {
+        conn.stop_media();
     }
     else {
-        std::cerr << "[handle_amf_command] Unknown command: " << command_name << std::endl;
+        LOG_WARN("[handle_amf_command] Unknown command: " << command_name);
+    }
+}
+
+// publish/play arguments: null command object, then the stream name.
+// Anything after '?' (tokens, publisher keys) is not part of the name.
+AMFString ParseAMF::stream_name_argument(const AMFDocument& document) {
+    AMFString name = AMFDocument::string_or_empty(document.root(3));
+    const void* query = name.length > 0 ? std::memchr(name.data, '?', name.length) : nullptr;
+    if (query) {
+        name.length = static_cast<const char*>(query) - name.data;
     }
+    return name;
 }
 
 
@@ -121,245 +145,208 @@ double ParseAMF::network_to_host_double(uint64_t net_double) {
 
 
 
-bool ParseAMF::send_rtmp_message_safe(SOCKET client_socket, const std::vector<char>& message) {
-    if (client_socket == INVALID_SOCKET) {
-        std::cerr << "[send_rtmp_message_safe] Invalid socket" << std::endl;
-        return false;
-    }
-    
-    try {
-        size_t total_sent = 0;
-        while (total_sent < message.size()) {
-            int sent = send(client_socket, 
-                          message.data() + total_sent, 
-                          static_cast<int>(message.size() - total_sent), 
-                          0);
-            
-            if (sent == SOCKET_ERROR) {
-                std::cerr << "[send_rtmp_message_safe] Send failed with error: " 
-                         << WSAGetLastError() << std::endl;
-                return false;
-            }
-            
-            total_sent += sent;
-        }
-        return true;
-    }
-    catch (const std::exception& e) {
-        std::cerr << "[send_rtmp_message_safe] Exception while sending: " << e.what() << std::endl;
-        return false;
-    }
-}
+// _result(transaction ID, {fmsVer, capabilities}, {level, code, description, objectEncoding})
+std::size_t ParseAMF::build_connect_body(PooledBytes& body, bool amf3, double transaction_id) {
+    begin_command(body, amf3);
 
-// Modified connect response function with additional safety
-void ParseAMF::send_connect_response(SOCKET client_socket, double transaction_id) {
-    try {
-        std::cout << "[send_connect_response] Preparing response" << std::endl;
-        
-        std::vector<char> body;
-        
-        // Write command name
-        Parses::write_amf_string("_result", body);
-        
-        // Write transaction ID
-        Parses::write_amf_number(transaction_id, body);
-        
-        // Write properties
-        body.push_back(0x03); // Object marker
-        Parses::write_amf_string("fmsVer", body);
-        Parses::write_amf_string("FMS/3,0,1,123", body);
-        Parses::write_amf_string("capabilities", body);
-        Parses::write_amf_number(31.0, body);
-        body.push_back(0x00);
-        body.push_back(0x00);
-        body.push_back(0x09);
-        
-        // Write information object
-        body.push_back(0x03); // Object marker
-        Parses::write_amf_string("level", body);
-        Parses::write_amf_string("status", body);
-        Parses::write_amf_string("code", body);
-        Parses::write_amf_string("NetConnection.Connect.Success", body);
-        Parses::write_amf_string("description", body);
-        Parses::write_amf_string("Connection succeeded.", body);
-        body.push_back(0x00);
-        body.push_back(0x00);
-        body.push_back(0x09);
-        
-        // Build header
-        std::vector<char> message = Parses::build_rtmp_header(0x03, 0, 0, body.size(), 0x14, 0);
-        message.insert(message.end(), body.begin(), body.end());
-        
-        if (send_rtmp_message_safe(client_socket, message)) {
-            std::cout << "[send_connect_response] Response sent successfully" << std::endl;
-        }
-    }
-    catch (const std::exception& e) {
-        std::cerr << "[send_connect_response] Exception: " << e.what() << std::endl;
-    }
+    // Write command name
+    Parses::write_amf_string("_result", body);
+
+    // Write transaction ID
+    std::size_t transaction_offset = body.size() + 1;  // Past the number marker
+    Parses::write_amf_number(transaction_id, body);
+
+    // Write properties
+    begin_object(body, amf3);
+    write_property(body, "fmsVer", "FMS/3,0,1,123", amf3);
+    write_property(body, "capabilities", 31.0, amf3);
+    end_object(body, amf3);
+
+    // Write information object
+    begin_object(body, amf3);
+    write_property(body, "level", "status", amf3);
+    write_property(body, "code", "NetConnection.Connect.Success", amf3);
+    write_property(body, "description", "Connection succeeded.", amf3);
+    write_property(body, "objectEncoding", amf3 ? 3.0 : 0.0, amf3);
+    end_object(body, amf3);
+    return transaction_offset;
 }
-// Send a response for the 'createStream' command with logging
-void ParseAMF::send_create_stream_response(SOCKET client_socket, double transaction_id) {
-    std::cout << "[send_create_stream_response] Preparing '_result' response for 'createStream' command." << std::endl;
-    
-    // Prepare AMF-encoded response
-    std::vector<char> body;
+
+// _result(transaction ID, null, stream ID)
+std::size_t ParseAMF::build_create_stream_body(PooledBytes& body, bool amf3, double transaction_id) {
+    begin_command(body, amf3);
     Parses::write_amf_string("_result", body);
+    std::size_t transaction_offset = body.size() + 1;
     Parses::write_amf_number(transaction_id, body);
+    body.push_back(0x05);                 // Null command object
     Parses::write_amf_number(1.0, body);  // Stream ID (we'll use 1 for simplicity)
+    return transaction_offset;
+}
 
-    // Calculate message length and build RTMP header
-    std::vector<char> header = Parses::build_rtmp_header(0x02, 2, 0, body.size(), 0x14, 0);
-    header.insert(header.end(), body.begin(), body.end());
+// onStatus(0, null, {level, code, description})
+void ParseAMF::build_on_status_body(PooledBytes& body, bool amf3, const char* level,
+                                    const char* code, const char* description) {
+    begin_command(body, amf3);
+    Parses::write_amf_string("onStatus", body);
+    Parses::write_amf_number(0.0, body);  // Events carry transaction ID 0
+    body.push_back(0x05);                 // Null command object
+
+    // Info object
+    begin_object(body, amf3);
+    write_property(body, "level", level, amf3);
+    write_property(body, "code", code, amf3);
+    write_property(body, "description", description, amf3);
+    end_object(body, amf3);
+}
 
-    // Send the response and log the result
-    if (!Parses::send_rtmp_message(client_socket, header)) {
-        std::cerr << "[send_create_stream_response] Failed to send 'createStream' response." << std::endl;
-    } else {
-        std::cout << "[send_create_stream_response] Successfully sent 'createStream' response." << std::endl;
+void ParseAMF::send_connect_response(Connection& conn, double transaction_id) {
+    if (send_response(conn, RESPONSE_CONNECT, transaction_id, 0)) {
+        LOG_DEBUG("[send_connect_response] Response sent successfully");
     }
 }
 
-// Send 'onStatus' publish response with detailed logging
-void ParseAMF::send_on_status_publish(SOCKET client_socket, double transaction_id) {
-    std::cout << "[send_on_status_publish] Start preparing 'onStatus' publish response." << std::endl;
-    
-    // Prepare RTMP header
-    char header[12] = {
-        0x02,               // fmt=0, csid=2
-        0x00, 0x00, 0x00,   // Timestamp (0)
-        0x00, 0x00, 0x00,   // Message length (to be filled later)
-        0x14,               // Message Type ID: 0x14 (Command Message AMF0)
-        0x00, 0x00, 0x00, 0x00  // Message Stream ID (usually 0 for control messages)
-    };
-
-    // Prepare the AMF-encoded response
-    std::vector<char> body;
-    Parses::write_amf_string("onStatus", body);
-    Parses::write_amf_number(transaction_id, body);
-
-    // Command object (AMF0 Object marker)
-    body.push_back(0x03); 
-    Parses::write_amf_string("level", body);
-    Parses::write_amf_string("status", body);
-    Parses::write_amf_string("code", body);
-    Parses::write_amf_string("NetStream.Publish.Start", body);
-    body.push_back(0x00);
-    body.push_back(0x00);
-    body.push_back(0x09);  // End of object
-
-    // Calculate message length and build RTMP header
-    unsigned int message_length = body.size();
-    header[3] = (message_length >> 16) & 0xFF;
-    header[4] = (message_length >> 8) & 0xFF;
-    header[5] = message_length & 0xFF;
-
-    // Combine header and body into one message
-    std::vector<char> response(header, header + sizeof(header));
-    response.insert(response.end(), body.begin(), body.end());
-
-    // Send the response and log the result
-    if (!Parses::send_rtmp_message(client_socket, response)) {
-        std::cerr << "[send_on_status_publish] Failed to send 'onStatus' publish response." << std::endl;
-    } else {
-        std::cout << "[send_on_status_publish] Successfully sent 'onStatus' publish response." << std::endl;
-        std::cout << "[send_on_status_publish] Sent " << response.size() << " bytes." << std::endl;
+void ParseAMF::send_create_stream_response(Connection& conn, double transaction_id) {
+    if (!send_response(conn, RESPONSE_CREATE_STREAM, transaction_id, 0)) {
+        LOG_WARN("[send_create_stream_response] Failed to send 'createStream' response.");
     }
+}
+
+// Send 'onStatus' publish response
+void ParseAMF::send_on_status_publish(Connection& conn, unsigned int stream_id) {
+    send_response(conn, RESPONSE_PUBLISH_START, 0.0, stream_id);
+}
 
-    std::cout << "[send_on_status_publish] End of 'onStatus' publish response preparation and sending." << std::endl;
+void ParseAMF::send_on_status_publish_bad_name(Connection& conn, unsigned int stream_id) {
+    send_response(conn, RESPONSE_PUBLISH_BAD_NAME, 0.0, stream_id);
 }
+
 // Send 'onStatus' play response
-void ParseAMF::send_on_status_play(SOCKET client_socket, double transaction_id) {
-    std::cout << "[send_on_status_play] Start preparing 'onStatus' play response." << std::endl;
-    
-    // Prepare RTMP header
-    char header[12] = {
-        0x02,               // fmt=0, csid=2
-        0x00, 0x00, 0x00,   // Timestamp (0)
-        0x00, 0x00, 0x00,   // Message length (to be filled later)
-        0x14,               // Message Type ID: 0x14 (Command Message AMF0)
-        0x00, 0x00, 0x00, 0x00  // Message Stream ID (usually 0 for control messages)
+void ParseAMF::send_on_status_play(Connection& conn, unsigned int stream_id) {
+    send_response(conn, RESPONSE_PLAY_START, 0.0, stream_id);
+}
+
+void ParseAMF::send_on_status_play_failed(Connection& conn, unsigned int stream_id) {
+    send_response(conn, RESPONSE_PLAY_FAILED, 0.0, stream_id);
+}
+
+// Send 'onStatus' pause response
+void ParseAMF::send_on_status_pause(Connection& conn, unsigned int stream_id) {
+    send_response(conn, RESPONSE_PAUSE_NOTIFY, 0.0, stream_id);
+}
+
+// Send an 'onStatus' event that has no template, built from scratch
+void ParseAMF::send_on_status(Connection& conn, unsigned int stream_id, const char* level,
+                              const char* code, const char* description) {
+    LOG_DEBUG("[send_on_status] Sending '" << code << "' on stream " << stream_id << ".");
+    bool amf3 = conn.object_encoding() == 3;
+
+    PooledBytes body;
+    build_on_status_body(body, amf3, level, code, description);
+    if (!send_command(conn, 5, stream_id, body, amf3)) {
+        LOG_WARN("[send_on_status] Failed to send '" << code << "'.");
+    }
+}
+
+// Every fixed reply in both encodings, built on first use
+const ResponseTemplate& ParseAMF::response_template(Response response, bool amf3) {
+    struct Status {
+        const char* level;
+        const char* code;
+        const char* description;
+    };
+    static const Status statuses[RESPONSE_COUNT] = {
+        { nullptr, nullptr, nullptr },  // Connect
+        { nullptr, nullptr, nullptr },  // createStream
+        { "status", "NetStream.Publish.Start", "Publishing started." },
+        { "error", "NetStream.Publish.BadName", "Stream is already being published." },
+        { "status", "NetStream.Play.Start", "Playback started." },
+        { "error", "NetStream.Play.Failed", "Connection already publishes or plays a stream." },
+        { "status", "NetStream.Pause.Notify", "Playback paused." },
     };
 
-    // Prepare the AMF-encoded response
-    std::vector<char> body;
-    Parses::write_amf_string("onStatus", body);
-    Parses::write_amf_number(transaction_id, body);
+    struct Templates {
+        explicit Templates(bool amf3) {
+            unsigned char message_type_id = amf3 ? 0x11 : 0x14;
+            for (int i = 0; i < RESPONSE_COUNT; ++i) {
+                PooledBytes body;
+                if (i == RESPONSE_CONNECT) {
+                    std::size_t offset = build_connect_body(body, amf3, 0.0);
+                    replies[i].build(3, message_type_id, body, offset);
+                } else if (i == RESPONSE_CREATE_STREAM) {
+                    std::size_t offset = build_create_stream_body(body, amf3, 0.0);
+                    replies[i].build(3, message_type_id, body, offset);
+                } else {
+                    build_on_status_body(body, amf3, statuses[i].level, statuses[i].code, statuses[i].description);
+                    replies[i].build(5, message_type_id, body, ResponseTemplate::NO_TRANSACTION);
+                }
+            }
+        }
+        ResponseTemplate replies[RESPONSE_COUNT];
+    };
+    static const Templates amf0_templates(false);
+    static const Templates amf3_templates(true);
+    return (amf3 ? amf3_templates : amf0_templates).replies[response];
+}
 
-    // Command object (AMF0 Object marker)
-    body.push_back(0x03); 
-    Parses::write_amf_string("level", body);
-    Parses::write_amf_string("status", body);
-    Parses::write_amf_string("code", body);
-    Parses::write_amf_string("NetStream.Play.Start", body);
-    body.push_back(0x00);
-    body.push_back(0x00);
-    body.push_back(0x09);  // End of object
-
-    // Calculate message length and build RTMP header
-    unsigned int message_length = body.size();
-    header[3] = (message_length >> 16) & 0xFF;
-    header[4] = (message_length >> 8) & 0xFF;
-    header[5] = message_length & 0xFF;
-
-    // Combine header and body into one message
-    std::vector<char> response(header, header + sizeof(header));
-    response.insert(response.end(), body.begin(), body.end());
-
-    // Send the response and log the result
-    if (!Parses::send_rtmp_message(client_socket, response)) {
-        std::cerr << "[send_on_status_play] Failed to send 'onStatus' play response." << std::endl;
-    } else {
-        std::cout << "[send_on_status_play] Successfully sent 'onStatus' play response." << std::endl;
+bool ParseAMF::send_response(Connection& conn, Response response, double transaction_id, unsigned int stream_id) {
+    const ResponseTemplate& reply = response_template(response, conn.object_encoding() == 3);
+    char wire[ResponseTemplate::MAX_WIRE_SIZE];
+    std::size_t length = reply.render(conn.out_chunk_size(), transaction_id, stream_id, wire, sizeof(wire));
+    if (length == 0) {
+        LOG_WARN("[send_response] Reply does not fit chunk size " << conn.out_chunk_size());
+        return false;
     }
+    conn.record_chunking(reply.body_size());
+    return conn.send(wire, length);
+}
 
-    std::cout << "[send_on_status_play] End of 'onStatus' play response preparation and sending." << std::endl;
+// Replies to AMF3 clients are AMF3 command messages: a format byte, AMF0 command name and
+// transaction ID, and objects switched to AMF3 through the avmplus marker
+void ParseAMF::begin_command(PooledBytes& body, bool amf3) {
+    if (amf3) {
+        body.push_back(0x00);
+    }
 }
 
-// Send 'onStatus' pause response
-void ParseAMF::send_on_status_pause(SOCKET client_socket, double transaction_id) {
-    std::cout << "[send_on_status_pause] Start preparing 'onStatus' pause response." << std::endl;
-    
-    // Prepare RTMP header
-    char header[12] = {
-        0x02,               // fmt=0, csid=2
-        0x00, 0x00, 0x00,   // Timestamp (0)
-        0x00, 0x00, 0x00,   // Message length (to be filled later)
-        0x14,               // Message Type ID: 0x14 (Command Message AMF0)
-        0x00, 0x00, 0x00, 0x00  // Message Stream ID (usually 0 for control messages)
-    };
+bool ParseAMF::send_command(Connection& conn, unsigned int csid, unsigned int stream_id, const PooledBytes& body, bool amf3) {
+    return conn.send_message(csid, 0, amf3 ? 0x11 : 0x14, stream_id, body.data(), body.size());
+}
 
-    // Prepare the AMF-encoded response
-    std::vector<char> body;
-    Parses::write_amf_string("onStatus", body);
-    Parses::write_amf_number(transaction_id, body);
+void ParseAMF::begin_object(PooledBytes& body, bool amf3) {
+    if (amf3) {
+        body.push_back(0x11);  // avmplus marker
+        AMF3::begin_object(body);
+    } else {
+        body.push_back(0x03);
+    }
+}
+
+void ParseAMF::write_property(PooledBytes& body, const char* key, const char* value, bool amf3) {
+    if (amf3) {
+        AMF3::write_key(key, std::strlen(key), body);
+        AMF3::write_string(value, std::strlen(value), body);
+    } else {
+        Parses::write_amf_key(key, body);
+        Parses::write_amf_string(value, body);
+    }
+}
 
-    // Command object (AMF0 Object marker)
-    body.push_back(0x03); 
-    Parses::write_amf_string("level", body);
-    Parses::write_amf_string("status", body);
-    Parses::write_amf_string("code", body);
-    Parses::write_amf_string("NetStream.Pause.Notify", body);
-    body.push_back(0x00);
-    body.push_back(0x00);
-    body.push_back(0x09);  // End of object
-
-    // Calculate message length and build RTMP header
-    unsigned int message_length = body.size();
-    header[3] = (message_length >> 16) & 0xFF;
-    header[4] = (message_length >> 8) & 0xFF;
-    header[5] = message_length & 0xFF;
-
-    // Combine header and body into one message
-    std::vector<char> response(header, header + sizeof(header));
-    response.insert(response.end(), body.begin(), body.end());
-
-    // Send the response and log the result
-    if (!Parses::send_rtmp_message(client_socket, response)) {
-        std::cerr << "[send_on_status_pause] Failed to send 'onStatus' pause response." << std::endl;
+void ParseAMF::write_property(PooledBytes& body, const char* key, double value, bool amf3) {
+    if (amf3) {
+        AMF3::write_key(key, std::strlen(key), body);
+        AMF3::write_number(value, body);
     } else {
-        std::cout << "[send_on_status_pause] Successfully sent 'onStatus' pause response." << std::endl;
+        Parses::write_amf_key(key, body);
+        Parses::write_amf_number(value, body);
     }
+}
 
-    std::cout << "[send_on_status_pause] End of 'onStatus' pause response preparation and sending." << std::endl;
+void ParseAMF::end_object(PooledBytes& body, bool amf3) {
+    if (amf3) {
+        AMF3::end_object(body);
+    } else {
+        body.push_back(0x00);
+        body.push_back(0x00);
+        body.push_back(0x09);
+    }
 }
@@ -1,18 +1,56 @@
 #pragma once
 #include <string>
 #include <vector>
-#include <WinSock2.h>
+#include <cstdint>
+#include "AMF.h"
+#include "SlabPool.h"
+
+class Connection;
+class ResponseTemplate;
 
 class ParseAMF {
 public:
-    static void handle_amf_command(const char* data, std::size_t length, SOCKET client_socket);
-    static void send_connect_response(SOCKET client_socket, double transaction_id);
-    static void send_create_stream_response(SOCKET client_socket, double transaction_id);
-    static void send_on_status_publish(SOCKET client_socket, double transaction_id);
-    static void send_on_status_play(SOCKET client_socket, double transaction_id);
-    static void send_on_status_pause(SOCKET client_socket, double transaction_id);
+    static void handle_amf_command(const char* data, std::size_t length, Connection& conn, unsigned int message_stream_id);
+    static void send_connect_response(Connection& conn, double transaction_id);
+    static void send_create_stream_response(Connection& conn, double transaction_id);
+    static void send_on_status_publish(Connection& conn, unsigned int stream_id);
+    static void send_on_status_publish_bad_name(Connection& conn, unsigned int stream_id);
+    static void send_on_status_play(Connection& conn, unsigned int stream_id);
+    static void send_on_status_play_failed(Connection& conn, unsigned int stream_id);
+    static void send_on_status_pause(Connection& conn, unsigned int stream_id);
+    static void send_on_status(Connection& conn, unsigned int stream_id, const char* level,
+                               const char* code, const char* description);
+
+    // Reply bodies. The fixed replies are built from these once and then sent from
+    // templates with the IDs patched in; the builders return the transaction ID's offset.
+    static std::size_t build_connect_body(PooledBytes& body, bool amf3, double transaction_id);
+    static std::size_t build_create_stream_body(PooledBytes& body, bool amf3, double transaction_id);
+    static void build_on_status_body(PooledBytes& body, bool amf3, const char* level,
+                                     const char* code, const char* description);
+
     static double network_to_host_double(uint64_t net_double); // renamed the function for clarity
 
 private:
-    static bool send_rtmp_message_safe(SOCKET client_socket, const std::vector<char>& message);
+    enum Response {
+        RESPONSE_CONNECT,
+        RESPONSE_CREATE_STREAM,
+        RESPONSE_PUBLISH_START,
+        RESPONSE_PUBLISH_BAD_NAME,
+        RESPONSE_PLAY_START,
+        RESPONSE_PLAY_FAILED,
+        RESPONSE_PAUSE_NOTIFY,
+        RESPONSE_COUNT
+    };
+    static const ResponseTemplate& response_template(Response response, bool amf3);
+    static bool send_response(Connection& conn, Response response, double transaction_id, unsigned int stream_id);
+
+    static AMFString stream_name_argument(const AMFDocument& document);
+
+    // Writers for replies in the connection's object encoding
+    static void begin_command(PooledBytes& body, bool amf3);
+    static bool send_command(Connection& conn, unsigned int csid, unsigned int stream_id, const PooledBytes& body, bool amf3);
+    static void begin_object(PooledBytes& body, bool amf3);
+    static void write_property(PooledBytes& body, const char* key, const char* value, bool amf3);
+    static void write_property(PooledBytes& body, const char* key, double value, bool amf3);
+    static void end_object(PooledBytes& body, bool amf3);
 };
@@ -1,15 +1,14 @@
 #include "ParseControl.h"
-#include <iostream>
-#include "Buffer.h"
+#include "Connection.h"
+#include "Log.h"
 #include "Parse.h"
 #include "ParseUtils.h"
-// Default chunk size is 128 bytes for RTMP as per the spec
-unsigned int current_chunk_size = 128;
 
-// Function to handle the 'Set Chunk Size' control message
-void ParseControl::handle_set_chunk_size(const char* data, std::size_t length) {
+// Function to handle the 'Set Chunk Size' control message; it applies to this client's
+// chunks only, from the next chunk on
+void ParseControl::handle_set_chunk_size(Connection& conn, const char* data, std::size_t length) {
     if (length < 4) {
-        std::cerr << "Set Chunk Size message is too short." << std::endl;
+        LOG_WARN("Set Chunk Size message is too short.");
         return;
     }
 
@@ -19,15 +18,21 @@ void ParseControl::handle_set_chunk_size(const char* data, std::size_t length) {
                                   ((unsigned char)data[2] << 8) |
                                   (unsigned char)data[3];
 
-    // Update the global chunk size
-    std::cout << "Setting new chunk size: " << new_chunk_size << std::endl;
-    current_chunk_size = new_chunk_size;
+    // The most significant bit must be zero, and a zero size would never make progress
+    if (new_chunk_size == 0 || new_chunk_size > 0x7FFFFFFF) {
+        LOG_WARN("Ignoring invalid chunk size: " << new_chunk_size);
+        return;
+    }
+
+    LOG_DEBUG("Setting new chunk size: " << new_chunk_size << " for IP: " << conn.client_ip());
+    conn.set_in_chunk_size(new_chunk_size);
 }
 
-// Function to handle 'Window Acknowledgement Size' message
-void ParseControl::handle_window_ack_size(const char* data, std::size_t length) {
+// Function to handle 'Window Acknowledgement Size' message: the client wants an
+// Acknowledgement every window_size bytes it sends us
+void ParseControl::handle_window_ack_size(Connection& conn, const char* data, std::size_t length) {
     if (length < 4) {
-        std::cerr << "Window Acknowledgement Size message too short." << std::endl;
+        LOG_WARN("Window Acknowledgement Size message too short.");
         return;
     }
 
@@ -37,13 +42,18 @@ void ParseControl::handle_window_ack_size(const char* data, std::size_t length)
                                ((unsigned char)data[2] << 8) |
                                (unsigned char)data[3];
 
-    std::cout << "Window Acknowledgement Size set to: " << window_size << std::endl;
+    if (window_size == 0) {
+        LOG_WARN("Ignoring zero Window Acknowledgement Size from IP: " << conn.client_ip());
+        return;
+    }
+    LOG_DEBUG("Window Acknowledgement Size set to: " << window_size);
+    conn.set_ack_window(window_size);
 }
 
-// Function to handle 'Acknowledgement' message
-void ParseControl::handle_acknowledgement(const char* data, std::size_t length) {
+// Function to handle 'Acknowledgement' message: the client's count of bytes received from us
+void ParseControl::handle_acknowledgement(Connection& conn, const char* data, std::size_t length) {
     if (length < 4) {
-        std::cerr << "Acknowledgement message too short." << std::endl;
+        LOG_WARN("Acknowledgement message too short.");
         return;
     }
 
@@ -53,13 +63,15 @@ void ParseControl::handle_acknowledgement(const char* data, std::size_t length)
                              ((unsigned char)data[2] << 8) |
                              (unsigned char)data[3];
 
-    std::cout << "Acknowledgement received for: " << ack_value << std::endl;
+    LOG_DEBUG("Acknowledgement received for: " << ack_value);
+    conn.on_acknowledgement(ack_value);
 }
 
-// Function to handle 'Set Peer Bandwidth' message
-void ParseControl::handle_set_peer_bandwidth(const char* data, std::size_t length) {
+// Function to handle 'Set Peer Bandwidth' message: how far our output may run ahead of
+// the client's acknowledgements
+void ParseControl::handle_set_peer_bandwidth(Connection& conn, const char* data, std::size_t length) {
     if (length < 5) {
-        std::cerr << "Set Peer Bandwidth message too short." << std::endl;
+        LOG_WARN("Set Peer Bandwidth message too short.");
         return;
     }
 
@@ -70,42 +82,96 @@ void ParseControl::handle_set_peer_bandwidth(const char* data, std::size_t lengt
                              (unsigned char)data[3];
     unsigned char limit_type = (unsigned char)data[4];
 
-    std::cout << "Peer Bandwidth set to: " << bandwidth 
-              << ", Limit Type: " << (int)limit_type << std::endl;
+    LOG_DEBUG("Peer Bandwidth set to: " << bandwidth 
+              << ", Limit Type: " << (int)limit_type);
+    if (bandwidth == 0 || limit_type > LIMIT_DYNAMIC) {
+        LOG_WARN("Ignoring invalid Set Peer Bandwidth from IP: " << conn.client_ip());
+        return;
+    }
+    conn.set_peer_bandwidth(bandwidth, limit_type);
+
+    // The receiver answers with its window when it differs from the last one it sent
+    if (bandwidth != conn.announced_ack_window()) {
+        send_window_ack_size(conn, bandwidth);
+    }
 }
 
 // Function to handle 'User Control Message'
 void ParseControl::handle_user_control_message(const char* data, std::size_t length) {
     if (length < 2) {
-        std::cerr << "User Control Message too short." << std::endl;
+        LOG_WARN("User Control Message too short.");
         return;
     }
 
     // Extract event type (big-endian)
     unsigned short event_type = ((unsigned char)data[0] << 8) | (unsigned char)data[1];
-    std::cout << "User Control Message Event Type: " << event_type << std::endl;
+    LOG_DEBUG("User Control Message Event Type: " << event_type);
 
     switch (event_type) {
         case 0x00:
-            std::cout << "Stream Begin event received." << std::endl;
+            LOG_DEBUG("Stream Begin event received.");
             break;
         case 0x01:
-            std::cout << "Stream EOF event received." << std::endl;
+            LOG_DEBUG("Stream EOF event received.");
             break;
         case 0x02:
-            std::cout << "Stream Dry event received." << std::endl;
+            LOG_DEBUG("Stream Dry event received.");
             break;
         // Add other cases for different events if needed
         default:
-            std::cout << "Unknown User Control Message event." << std::endl;
+            LOG_DEBUG("Unknown User Control Message event.");
             break;
     }
 }
 
-void ParseControl::send_window_ack_size(SOCKET client_socket, unsigned int size) {
-    std::cout << "[send_window_ack_size] Preparing message with window size: " << size << std::endl;
+void ParseControl::send_set_chunk_size(Connection& conn, unsigned int size) {
+    LOG_DEBUG("[send_set_chunk_size] Announcing chunk size: " << size);
+
+    char message[16] = {};  // 12-byte header + 4-byte chunk size
+
+    // Prepare the RTMP header
+    message[0] = 0x02;  // fmt=0, csid=2
+    message[6] = 0x04;  // Message length: 4 bytes
+    message[7] = 0x01;  // Message Type ID: Set Chunk Size
+                        // Timestamp and message stream ID stay 0
+
+    // Chunk size (4 bytes, big-endian, top bit clear)
+    message[12] = (size >> 24) & 0x7F;
+    message[13] = (size >> 16) & 0xFF;
+    message[14] = (size >> 8) & 0xFF;
+    message[15] = size & 0xFF;
+
+    if (!Parses::send_rtmp_message(conn, message, sizeof(message))) {
+        LOG_WARN("[send_set_chunk_size] ERROR: Failed to send Set Chunk Size.");
+        return;
+    }
+    conn.set_out_chunk_size(size);
+}
+
+void ParseControl::send_acknowledgement(Connection& conn, unsigned int sequence_number) {
+    char message[16] = {};  // 12-byte header + 4-byte sequence number
+
+    // Prepare the RTMP header
+    message[0] = 0x02;  // fmt=0, csid=2
+    message[6] = 0x04;  // Message length: 4 bytes
+    message[7] = 0x03;  // Message Type ID: Acknowledgement
+                        // Timestamp and message stream ID stay 0
+
+    // Bytes received so far, wrapping at 2^32 (big-endian)
+    message[12] = (sequence_number >> 24) & 0xFF;
+    message[13] = (sequence_number >> 16) & 0xFF;
+    message[14] = (sequence_number >> 8) & 0xFF;
+    message[15] = sequence_number & 0xFF;
+
+    if (!Parses::send_rtmp_message(conn, message, sizeof(message))) {
+        LOG_WARN("[send_acknowledgement] ERROR: Failed to send Acknowledgement.");
+    }
+}
+
+void ParseControl::send_window_ack_size(Connection& conn, unsigned int size) {
+    LOG_DEBUG("[send_window_ack_size] Preparing message with window size: " << size);
     
-    std::vector<char> message(16);  // 12-byte header + 4-byte window size
+    char message[16] = {};  // 12-byte header + 4-byte window size
 
     // Prepare the RTMP header
     message[0] = 0x02;  // fmt=0, csid=2
@@ -128,26 +194,23 @@ void ParseControl::send_window_ack_size(SOCKET client_socket, unsigned int size)
     message[15] = size & 0xFF;
 
     // Debug log the message content
-    std::cout << "[send_window_ack_size] Message content (hex): ";
-    for (size_t i = 0; i < message.size(); ++i) {
-        printf("%02X ", (unsigned char)message[i]);
-    }
-    std::cout << std::endl;
+    Parses::dump_hex(message, sizeof(message));
 
     // Send the message using the send utility function with retries
-    if (!Parses::send_rtmp_message(client_socket, message)) {
-        std::cerr << "[send_window_ack_size] ERROR: Failed to send Window Acknowledgement Size." << std::endl;
+    if (!Parses::send_rtmp_message(conn, message, sizeof(message))) {
+        LOG_WARN("[send_window_ack_size] ERROR: Failed to send Window Acknowledgement Size.");
     } else {
-        std::cout << "[send_window_ack_size] Successfully sent Window Acknowledgement Size: " << size << " bytes" << std::endl;
+        conn.set_announced_ack_window(size);
+        LOG_DEBUG("[send_window_ack_size] Successfully sent Window Acknowledgement Size: " << size << " bytes");
     }
 }
 
 // Function to send 'Set Peer Bandwidth' message to the client
-void ParseControl::send_set_peer_bandwidth(SOCKET client_socket, unsigned int bandwidth, unsigned char limit_type) {
-    std::cout << "[send_set_peer_bandwidth] Preparing message with bandwidth: " << bandwidth 
-              << ", limit type: " << (int)limit_type << std::endl;
+void ParseControl::send_set_peer_bandwidth(Connection& conn, unsigned int bandwidth, unsigned char limit_type) {
+    LOG_DEBUG("[send_set_peer_bandwidth] Preparing message with bandwidth: " << bandwidth 
+              << ", limit type: " << (int)limit_type);
     
-    std::vector<char> message(17);  // 12-byte header + 4-byte bandwidth + 1-byte limit type
+    char message[17] = {};  // 12-byte header + 4-byte bandwidth + 1-byte limit type
 
     // Prepare the RTMP header
     message[0] = 0x02;  // fmt=0, csid=2
@@ -173,39 +236,69 @@ void ParseControl::send_set_peer_bandwidth(SOCKET client_socket, unsigned int ba
     message[16] = limit_type;
 
     // Debug log the message content
-    std::cout << "[send_set_peer_bandwidth] Message content (hex): ";
-    for (size_t i = 0; i < message.size(); ++i) {
-        printf("%02X ", (unsigned char)message[i]);
-    }
-    std::cout << std::endl;
+    Parses::dump_hex(message, sizeof(message));
 
     // Validate limit type
     if (limit_type > 2) {
-        std::cerr << "[send_set_peer_bandwidth] WARNING: Invalid limit type: " << (int)limit_type 
-                 << ". Should be 0 (Hard), 1 (Soft), or 2 (Dynamic)" << std::endl;
+        LOG_WARN("[send_set_peer_bandwidth] WARNING: Invalid limit type: " << (int)limit_type 
+                 << ". Should be 0 (Hard), 1 (Soft), or 2 (Dynamic)");
     }
 
     // Send the message using the send utility function with retries
-    if (!Parses::send_rtmp_message(client_socket, message)) {
-        std::cerr << "[send_set_peer_bandwidth] ERROR: Failed to send Set Peer Bandwidth." << std::endl;
+    if (!Parses::send_rtmp_message(conn, message, sizeof(message))) {
+        LOG_WARN("[send_set_peer_bandwidth] ERROR: Failed to send Set Peer Bandwidth.");
     } else {
-        std::cout << "[send_set_peer_bandwidth] Successfully sent Set Peer Bandwidth: " << bandwidth 
-                 << " bytes, limit type: " << (int)limit_type << std::endl;
+        LOG_DEBUG("[send_set_peer_bandwidth] Successfully sent Set Peer Bandwidth: " << bandwidth 
+                 << " bytes, limit type: " << (int)limit_type);
         
         // Log the limit type meaning
         switch(limit_type) {
             case 0:
-                std::cout << "[send_set_peer_bandwidth] Limit type: Hard" << std::endl;
+                LOG_DEBUG("[send_set_peer_bandwidth] Limit type: Hard");
                 break;
             case 1:
-                std::cout << "[send_set_peer_bandwidth] Limit type: Soft" << std::endl;
+                LOG_DEBUG("[send_set_peer_bandwidth] Limit type: Soft");
                 break;
             case 2:
-                std::cout << "[send_set_peer_bandwidth] Limit type: Dynamic" << std::endl;
+                LOG_DEBUG("[send_set_peer_bandwidth] Limit type: Dynamic");
                 break;
             default:
-                std::cout << "[send_set_peer_bandwidth] Limit type: Unknown" << std::endl;
+                LOG_DEBUG("[send_set_peer_bandwidth] Limit type: Unknown");
                 break;
         }
     }
-}
\ No newline at end of file
+}
+
+// Function to send the 'Stream Begin' user control event before playback starts
+void ParseControl::send_stream_begin(Connection& conn, unsigned int stream_id) {
+    LOG_DEBUG("[send_stream_begin] Stream Begin for stream " << stream_id);
+    send_user_control_event(conn, 0, stream_id);
+}
+
+// 'Stream EOF' once a recorded stream has been sent in full
+void ParseControl::send_stream_eof(Connection& conn, unsigned int stream_id) {
+    LOG_DEBUG("[send_stream_eof] Stream EOF for stream " << stream_id);
+    send_user_control_event(conn, 1, stream_id);
+}
+
+void ParseControl::send_user_control_event(Connection& conn, unsigned short event, unsigned int stream_id) {
+    char message[18] = {};  // 12-byte header + 2-byte event type + 4-byte stream ID
+
+    // Prepare the RTMP header
+    message[0] = 0x02;  // fmt=0, csid=2
+    message[6] = 0x06;  // Message length: 6 bytes
+    message[7] = 0x04;  // Message Type ID: User Control Message
+                        // Timestamp and message stream ID stay 0
+
+    // Event type, then the stream ID (big-endian)
+    message[12] = (event >> 8) & 0xFF;
+    message[13] = event & 0xFF;
+    message[14] = (stream_id >> 24) & 0xFF;
+    message[15] = (stream_id >> 16) & 0xFF;
+    message[16] = (stream_id >> 8) & 0xFF;
+    message[17] = stream_id & 0xFF;
+
+    if (!Parses::send_rtmp_message(conn, message, sizeof(message))) {
+        LOG_WARN("[send_user_control_event] ERROR: Failed to send user control event " << event << ".");
+    }
+}
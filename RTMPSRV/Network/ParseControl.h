@@ -2,18 +2,35 @@
 #define PARSECONTROL_H
 
 #include <cstddef>    // For std::size_t
-#include <winsock2.h> // For SOCKET type
+
+class Connection;
 
 class ParseControl {
 public:
-    static void handle_set_chunk_size(const char* data, std::size_t length);
-    static void handle_acknowledgement(const char* data, std::size_t length);
+    // Largest chunk size we announce; bigger chunks only delay audio behind large frames
+    static const unsigned int MAX_OUT_CHUNK_SIZE = 65536;
+
+    // Set Peer Bandwidth limit types
+    static const unsigned char LIMIT_HARD = 0;
+    static const unsigned char LIMIT_SOFT = 1;
+    static const unsigned char LIMIT_DYNAMIC = 2;
+
+    static void handle_set_chunk_size(Connection& conn, const char* data, std::size_t length);
+    static void handle_acknowledgement(Connection& conn, const char* data, std::size_t length);
     static void handle_user_control_message(const char* data, std::size_t length);
-    static void handle_window_ack_size(const char* data, std::size_t length);
-    static void handle_set_peer_bandwidth(const char* data, std::size_t length);
+    static void handle_window_ack_size(Connection& conn, const char* data, std::size_t length);
+    static void handle_set_peer_bandwidth(Connection& conn, const char* data, std::size_t length);
+
+    // Announces size and sends everything after it in chunks of that size
+    static void send_set_chunk_size(Connection& conn, unsigned int size);
+    static void send_acknowledgement(Connection& conn, unsigned int sequence_number);
+    static void send_window_ack_size(Connection& conn, unsigned int size);
+    static void send_set_peer_bandwidth(Connection& conn, unsigned int bandwidth, unsigned char limit_type);
+    static void send_stream_begin(Connection& conn, unsigned int stream_id);
+    static void send_stream_eof(Connection& conn, unsigned int stream_id);
 
-    static void send_window_ack_size(SOCKET client_socket, unsigned int size);
-    static void send_set_peer_bandwidth(SOCKET client_socket, unsigned int bandwidth, unsigned char limit_type);
+private:
+    static void send_user_control_event(Connection& conn, unsigned short event, unsigned int stream_id);
 };
 
 #endif // PARSECONTROL_H
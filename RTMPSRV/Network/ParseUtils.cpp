@@ -1,52 +1,40 @@
 #include "ParseUtils.h"
-#include <iostream>
+#include "Connection.h"
+#include "Log.h"
+#include <cstdint>
 #include <cstring>
 #include <stdexcept>
 
-void Parses::write_amf_string(const std::string& str, std::vector<char>& buffer) {
+void Parses::write_amf_string(const std::string& str, PooledBytes& buffer) {
     buffer.push_back(0x02); // AMF0 string type marker
     uint16_t len = htons((uint16_t)str.size());
-    buffer.insert(buffer.end(), (char*)&len, (char*)&len + 2); // Insert string length
-    buffer.insert(buffer.end(), str.begin(), str.end()); // Insert string content
+    buffer.append((char*)&len, 2); // Insert string length
+    buffer.append(str.data(), str.size()); // Insert string content
 }
 
+void Parses::write_amf_key(const std::string& key, PooledBytes& buffer) {
+    buffer.push_back(static_cast<char>((key.size() >> 8) & 0xFF));
+    buffer.push_back(static_cast<char>(key.size() & 0xFF));
+    buffer.append(key.data(), key.size());
+}
 
-void Parses::write_amf_number(double value, std::vector<char>& buffer) {
-    buffer.push_back(0x00); // AMF0 number type marker
-
-    uint64_t host_double;
-    std::memcpy(&host_double, &value, sizeof(double));
 
-    // Check system endianness
-    uint16_t endian_test = 0x1;
-    bool is_little_endian = *(reinterpret_cast<uint8_t*>(&endian_test)) == 0x1;
+void Parses::write_amf_number(double value, PooledBytes& buffer) {
+    buffer.push_back(0x00); // AMF0 number type marker
 
-    uint64_t net_double;
-    if (is_little_endian) {
-        // Swap bytes from little-endian to big-endian
-        net_double = ((host_double & 0xFF00000000000000ULL) >> 56) |
-                     ((host_double & 0x00FF000000000000ULL) >> 40) |
-                     ((host_double & 0x0000FF0000000000ULL) >> 24) |
-                     ((host_double & 0x000000FF00000000ULL) >> 8) |
-                     ((host_double & 0x00000000FF000000ULL) << 8) |
-                     ((host_double & 0x0000000000FF0000ULL) << 24) |
-                     ((host_double & 0x000000000000FF00ULL) << 40) |
-                     ((host_double & 0x00000000000000FFULL) << 56);
-    } else {
-        net_double = host_double;
-    }
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(double));
 
-    // Write the 8 bytes to the buffer
+    // Big-endian, most significant byte first
     for (int i = 0; i < 8; ++i) {
-        buffer.push_back(static_cast<char>((net_double >> ((7 - i) * 8)) & 0xFF));
+        buffer.push_back(static_cast<char>((bits >> ((7 - i) * 8)) & 0xFF));
     }
 }
 
 
-std::vector<char> Parses::build_rtmp_header(unsigned char fmt, unsigned int csid, 
-                                           unsigned int timestamp, unsigned int message_length, 
-                                           unsigned char message_type_id, unsigned int stream_id) {
-    std::vector<char> header(12);
+std::size_t Parses::build_rtmp_header(unsigned char fmt, unsigned int csid,
+                                     unsigned int timestamp, unsigned int message_length,
+                                     unsigned char message_type_id, unsigned int stream_id, char* header) {
     header[0] = (fmt << 6) | (csid & 0x3F);  // Fmt and csid
     header[1] = (timestamp >> 16) & 0xFF;
     header[2] = (timestamp >> 8) & 0xFF;
@@ -60,30 +48,34 @@ std::vector<char> Parses::build_rtmp_header(unsigned char fmt, unsigned int csid
     header[10] = (stream_id >> 16) & 0xFF;
     header[11] = (stream_id >> 24) & 0xFF;
 
-    return header;
+    return 12;
 }
 
-bool Parses::send_rtmp_message(SOCKET client_socket, const std::vector<char>& message, int retry_count) {
-    int result;
-    for (int attempt = 0; attempt < retry_count; ++attempt) {
-        result = send(client_socket, message.data(), message.size(), 0);
-        if (result != SOCKET_ERROR) {
-            return true;
-        }
-        std::cerr << "Send failed, attempt " << (attempt + 1) << " of " << retry_count 
-                  << ". Error: " << WSAGetLastError() << std::endl;
+bool Parses::send_rtmp_message(Connection& conn, const char* message, std::size_t length) {
+    // Sends never block: the message is queued and written once the socket is writable
+    if (!conn.send(message, length)) {
+        LOG_WARN("Send failed, connection from " << conn.client_ip() << " is closed.");
+        return false;
     }
-    return false;
+    return true;
 }
 
 void Parses::dump_hex(const char* data, std::size_t length) {
-    std::cout << "Hex dump (" << length << " bytes):" << std::endl;
-    for (std::size_t i = 0; i < length; ++i) {
-        printf("%02X ", (unsigned char)data[i]);
-        if ((i + 1) % 16 == 0)
-            printf("\n");
+    // Folds away entirely unless debug statements are compiled in
+    if (!Log::enabled(Log::LEVEL_DEBUG)) {
+        return;
+    }
+    static const char digits[] = "0123456789ABCDEF";
+    LOG_DEBUG("Hex dump (" << length << " bytes):");
+    for (std::size_t offset = 0; offset < length; offset += 16) {
+        LogLine line(Log::LEVEL_DEBUG);
+        for (std::size_t i = offset; i < length && i < offset + 16; ++i) {
+            unsigned char byte = static_cast<unsigned char>(data[i]);
+            char text[3] = { digits[byte >> 4], digits[byte & 0xF], ' ' };
+            line.append(text, sizeof(text));
+        }
+        Log::write(line);
     }
-    printf("\n");
 }
 
 double Parses::read_amf_number(const char* data) {
@@ -118,20 +110,3 @@ double Parses::read_amf_number(const char* data) {
     std::memcpy(&number, &host_double, sizeof(double));
     return number;
 }
-
-
-//  read AMF0 string from the data stream
-std::string Parses::read_amf_string(const char* data, std::size_t& offset) {
-    if (data[0] != 0x02) {
-        throw std::runtime_error("Expected AMF0 String");
-    }
-
-    // Extract the string length (2 bytes, big-endian)
-    unsigned short string_length = (unsigned char(data[1]) << 8) | unsigned char(data[2]);
-    std::string str(data + 3, string_length);
-
-    // Update the offset to reflect the bytes read (1 byte marker + 2 bytes length + string content)
-    offset += 3 + string_length;
-
-    return str;
-}
@@ -0,0 +1,149 @@
+#include "QueuedSink.h"
+#include "Metrics.h"
+#include <chrono>
+
+const unsigned int QueuedSink::TICK_MS;  // Bound by reference in run(), so it needs a definition
+
+void QueuedSink::Session::deliver(const MediaPacketPtr& packet, bool gap) {
+    // Video resumes at a keyframe after the queue dropped packets
+    if (gap) {
+        waiting_keyframe_ = true;
+    }
+    write(packet);
+}
+
+QueuedSink::QueuedSink(QueuedSinkStats& stats)
+    : queue_stats_(stats),
+      wake_requested_(false),
+      stopping_(false) {}
+
+QueuedSink::~QueuedSink() {}
+
+void QueuedSink::start_thread() {
+    thread_ = std::thread(&QueuedSink::run, this);
+}
+
+void QueuedSink::stop_thread() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void QueuedSink::on_publish(Stream& stream) {
+    Command command;
+    command.kind = Command::OPEN;
+    command.stream = &stream;
+    command.key = stream.key();
+    push(command, 0, false);
+}
+
+void QueuedSink::on_media(Stream& stream, const MediaPacketPtr& packet) {
+    if (!accepts(*packet)) {
+        return;
+    }
+    Command command;
+    command.kind = Command::MEDIA;
+    command.stream = &stream;
+    command.packet = packet;
+    push(command, packet->payload.size(), false);
+}
+
+void QueuedSink::on_unpublish(Stream& stream) {
+    Command command;
+    command.kind = Command::CLOSE;
+    command.stream = &stream;
+    push(command, 0, true);
+}
+
+void QueuedSink::push(Command& command, std::size_t bytes, bool wake) {
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unsigned long long queued = queue_stats_.queued_bytes.load(std::memory_order_relaxed);
+        if (bytes > 0 && queued + bytes > MAX_QUEUE_BYTES) {
+            queue_stats_.packets_dropped.fetch_add(1, std::memory_order_relaxed);
+            gaps_.insert(command.stream);
+            return;
+        }
+        // The next packet queued after a drop carries the gap; a CLOSE just forgets it
+        if (!gaps_.empty() && command.kind != Command::OPEN) {
+            command.gap = gaps_.erase(command.stream) > 0;
+        }
+        queued += bytes;
+        wake = wake || (command.packet && wakes(*command.packet, queued));
+        pending_.push_back(Command());
+        std::swap(pending_.back(), command);
+        queue_stats_.queued_bytes.store(queued, std::memory_order_relaxed);
+
+        // The thread wakes on its own every tick; only what the subclass asks for is worth a syscall
+        if (wake && !wake_requested_) {
+            wake_requested_ = true;
+            notify = true;
+        }
+    }
+    if (notify) {
+        wake_.notify_one();
+    }
+}
+
+void QueuedSink::run() {
+    std::vector<Command> batch;
+    bool stopping = false;
+    while (!stopping) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(TICK_MS), [this]() { return wake_requested_ || stopping_; });
+            batch.swap(pending_);
+            wake_requested_ = false;
+            stopping = stopping_;
+        }
+
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i].packet) {
+                bytes += batch[i].packet->payload.size();
+            }
+            execute(batch[i]);
+        }
+        batch.clear();  // Packets go back to the pool from here, not from the workers
+        // Under the lock, so a worker never adds to a stale total
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_stats_.queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+
+        unsigned long long now = Metrics::now_ns();
+        for (auto& entry : sessions_) {
+            entry.second->tick(now);
+        }
+        tick(now);
+        queue_stats_.cpu_ns.store(Metrics::thread_cpu_ns(), std::memory_order_relaxed);
+    }
+
+    sessions_.clear();  // Each session finishes its stream's output
+    queue_stats_.cpu_ns.store(Metrics::thread_cpu_ns(), std::memory_order_relaxed);
+}
+
+void QueuedSink::execute(Command& command) {
+    switch (command.kind) {
+        case Command::OPEN:
+            sessions_[command.stream].reset(open_session(command.key));
+            break;
+        case Command::MEDIA: {
+            auto found = sessions_.find(command.stream);
+            if (found != sessions_.end()) {
+                found->second->deliver(command.packet, command.gap);
+            }
+            break;
+        }
+        case Command::CLOSE:
+            sessions_.erase(command.stream);
+            break;
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef QUEUEDSINK_H
+#define QUEUEDSINK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "StreamHub.h"
+
+// Counters every QueuedSink keeps; sinks extend them with their own
+struct QueuedSinkStats {
+    std::atomic<unsigned long long> packets_dropped;  // Queue full, or behind a gap until the next keyframe
+    std::atomic<unsigned long long> queued_bytes;     // Payload waiting for the sink's thread
+    std::atomic<unsigned long long> cpu_ns;           // CPU time the sink's thread has used
+
+    QueuedSinkStats()
+        : packets_dropped(0),
+          queued_bytes(0),
+          cpu_ns(0) {}
+};
+
+// A StreamSink that does its work on a thread of its own. Workers only append packet
+// references to a queue; the thread takes the whole queue at a time and hands each packet
+// to the Session of its stream. When the thread falls behind by MAX_QUEUE_BYTES, packets
+// are dropped rather than ever making a worker wait; the stream's next queued packet carries
+// the gap, and its session resumes video at the next keyframe. Subclasses choose which packets to queue and when
+// one is worth waking the thread for, and create the sessions.
+class QueuedSink : public StreamSink {
+public:
+    static const std::size_t MAX_QUEUE_BYTES = 64 * 1024 * 1024;
+    static const unsigned int TICK_MS = 100;  // The thread wakes at least this often
+
+    void on_publish(Stream& stream) override;
+    void on_media(Stream& stream, const MediaPacketPtr& packet) override;
+    void on_unpublish(Stream& stream) override;
+
+protected:
+    // One stream's state, from its publish to its unpublish or the sink's stop. Only the
+    // sink's thread touches it.
+    class Session {
+    public:
+        Session() : waiting_keyframe_(true) {}
+        virtual ~Session() {}
+
+        // Every queued packet of the stream, in order; gap when packets before it were dropped
+        void deliver(const MediaPacketPtr& packet, bool gap);
+
+        // After every batch, and at least every TICK_MS
+        virtual void tick(unsigned long long now_ns) { (void)now_ns; }
+
+    protected:
+        virtual void write(const MediaPacketPtr& packet) = 0;
+
+        bool waiting_keyframe_;  // Video waits for a keyframe: at the start, and after a gap
+    };
+
+    explicit QueuedSink(QueuedSinkStats& stats);
+    virtual ~QueuedSink();
+
+    void start_thread();
+    // Hands every queued packet to its session, then destroys every session. Subclasses
+    // call it from their destructor at the latest, since sessions call back into them.
+    void stop_thread();
+
+    // Whether on_media queues the packet at all
+    virtual bool accepts(const MediaPacket& packet) const = 0;
+    // Whether it wakes the thread at once, with queued bytes waiting including it
+    virtual bool wakes(const MediaPacket& packet, unsigned long long queued) const = 0;
+    virtual Session* open_session(const std::string& key) = 0;
+    // Sink's thread, after the sessions' ticks
+    virtual void tick(unsigned long long now_ns) { (void)now_ns; }
+
+private:
+    QueuedSink(const QueuedSink&);
+    QueuedSink& operator=(const QueuedSink&);
+
+    struct Command {
+        enum Kind { OPEN, MEDIA, CLOSE };
+        Command() : kind(OPEN), stream(nullptr), gap(false) {}
+        Kind kind;
+        const Stream* stream;  // Identifies the session; OPEN and CLOSE keep every use in order
+        std::string key;       // OPEN only
+        MediaPacketPtr packet; // MEDIA only
+        bool gap;              // MEDIA only: the queue dropped packets of the stream just before it,
+                               // as opposed to ones accepts() never let in
+    };
+
+    void push(Command& command, std::size_t bytes, bool wake);
+    void run();
+    void execute(Command& command);
+
+    QueuedSinkStats& queue_stats_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<Command> pending_;  // Guarded by mutex_
+    bool wake_requested_;           // Guarded by mutex_
+    bool stopping_;                 // Guarded by mutex_
+    std::unordered_set<const Stream*> gaps_;  // Guarded by mutex_; dropped since their last queued packet
+    std::thread thread_;
+
+    // Sink's thread only
+    std::unordered_map<const Stream*, std::unique_ptr<Session> > sessions_;
+};
+
+#endif // QUEUEDSINK_H
@@ -0,0 +1,337 @@
+#include "Reactor.h"
+#include "Connection.h"
+#include "Worker.h"
+#include "Metrics.h"
+#include "Log.h"
+#include <algorithm>
+#include <cerrno>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+static const int MAX_EVENTS = 256;
+static const int WAIT_TIMEOUT_MS = 100;  // Bounds how long a stop() request goes unnoticed
+
+#ifdef __linux__
+static char wakeup_tag;         // epoll tag of the fan-out wakeup; the listener's tag is null
+static char http_listener_tag;  // And of the HTTP listener
+#endif
+
+Reactor::Reactor()
+    : listener_(RTMP_INVALID_SOCKET), http_listener_(RTMP_INVALID_SOCKET), worker_(nullptr), stats_(nullptr) {
+#ifdef __linux__
+    epoll_fd_ = -1;
+#endif
+}
+
+Reactor::~Reactor() {
+    connections_.clear();
+#ifdef __linux__
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+#endif
+}
+
+const char* Reactor::name() const {
+#ifdef __linux__
+    return "epoll";
+#else
+    return "poll";
+#endif
+}
+
+bool Reactor::init(socket_t listener, Worker* worker) {
+    listener_ = listener;
+    http_listener_ = worker->http_listener();
+    worker_ = worker;
+    stats_ = &worker->stats();
+    handshake_deadlines_.set_timeout_ms(worker->handshake_timeout_ms());
+
+#ifdef __linux__
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        LOG_ERROR("[Reactor::init] epoll_create1 failed. Error: " << errno);
+        return false;
+    }
+
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = nullptr;  // A null tag marks the listening socket
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listener_, &event) != 0) {
+        LOG_ERROR("[Reactor::init] Failed to register listener. Error: " << errno);
+        return false;
+    }
+
+    if (http_listener_ != RTMP_INVALID_SOCKET) {
+        event.data.ptr = &http_listener_tag;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, http_listener_, &event) != 0) {
+            LOG_ERROR("[Reactor::init] Failed to register HTTP listener. Error: " << errno);
+            return false;
+        }
+    }
+
+    // Level-triggered: the fan-out clears it when it drains
+    event.events = EPOLLIN;
+    event.data.ptr = &wakeup_tag;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, worker_->fanout().wakeup().fd(), &event) != 0) {
+        LOG_ERROR("[Reactor::init] Failed to register wakeup. Error: " << errno);
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+void Reactor::run(const std::atomic<bool>& running) {
+#ifdef __linux__
+    epoll_event events[MAX_EVENTS];
+
+    while (running) {
+        // Don't sleep while a connection still has input we left unread
+        int timeout = read_again_.empty() ? WAIT_TIMEOUT_MS : 0;
+        int count = epoll_wait(epoll_fd_, events, MAX_EVENTS, timeout);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("[Reactor::run] epoll_wait failed. Error: " << errno);
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.ptr == &wakeup_tag) {
+                continue;  // Drained below with the rest of the inbox
+            }
+            if (events[i].data.ptr == &http_listener_tag) {
+                accept_connections(http_listener_, true);
+                continue;
+            }
+            Connection* conn = static_cast<Connection*>(events[i].data.ptr);
+            if (conn == nullptr) {
+                accept_connections(listener_, false);
+                continue;
+            }
+
+            uint32_t flags = events[i].events;
+            handle_event(conn,
+                         (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0,
+                         (flags & EPOLLOUT) != 0,
+                         (flags & EPOLLERR) != 0);
+        }
+
+        resume_reads();
+        worker_->fanout().drain();
+        worker_->vod().run();
+        flush_pending();
+        expire_handshakes();
+        reap_closed();
+    }
+#else
+    std::vector<pollfd> fds;
+    std::vector<Connection*> owners;
+
+    while (running) {
+        // Level-triggered: only ask for POLLOUT while output is queued
+        fds.clear();
+        owners.clear();
+
+        pollfd listener_fd;
+        listener_fd.fd = listener_;
+        listener_fd.events = POLLIN;
+        listener_fd.revents = 0;
+        fds.push_back(listener_fd);
+        owners.push_back(nullptr);
+
+        pollfd wakeup_fd;
+        wakeup_fd.fd = worker_->fanout().wakeup().fd();
+        wakeup_fd.events = POLLIN;
+        wakeup_fd.revents = 0;
+        fds.push_back(wakeup_fd);
+        owners.push_back(nullptr);
+
+        if (http_listener_ != RTMP_INVALID_SOCKET) {
+            pollfd http_fd = listener_fd;
+            http_fd.fd = http_listener_;
+            fds.push_back(http_fd);
+            owners.push_back(nullptr);
+        }
+
+        for (auto& entry : connections_) {
+            pollfd pfd;
+            pfd.fd = entry.first;
+            pfd.events = POLLIN | (entry.second->has_pending_output() && !entry.second->send_window_full() ? POLLOUT : 0);
+            pfd.revents = 0;
+            fds.push_back(pfd);
+            owners.push_back(entry.second.get());
+        }
+
+#ifdef _WIN32
+        int count = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), WAIT_TIMEOUT_MS);
+#else
+        int count = poll(fds.data(), fds.size(), WAIT_TIMEOUT_MS);
+#endif
+        if (count < 0) {
+            if (Socket::interrupted(Socket::last_error())) continue;
+            LOG_ERROR("[Reactor::run] poll failed. Error: " << Socket::last_error());
+            break;
+        }
+
+        for (size_t i = 0; i < fds.size() && count > 0; ++i) {
+            short revents = fds[i].revents;
+            if (revents == 0) continue;
+            --count;
+
+            if (i == 0) {
+                accept_connections(listener_, false);
+                continue;
+            }
+            if (i == 2 && owners[i] == nullptr) {
+                accept_connections(http_listener_, true);
+                continue;
+            }
+            if (owners[i] == nullptr) {
+                continue;  // Wakeup, drained below
+            }
+            handle_event(owners[i],
+                         (revents & (POLLIN | POLLHUP)) != 0,
+                         (revents & POLLOUT) != 0,
+                         (revents & (POLLERR | POLLNVAL)) != 0);
+        }
+
+        worker_->fanout().drain();
+        worker_->vod().run();
+        flush_pending();
+        expire_handshakes();
+        reap_closed();
+    }
+#endif
+
+    LOG_INFO("[Reactor::run] Closing " << connections_.size() << " client connections.");
+    pending_flush_.clear();
+    closed_.clear();
+    read_again_.clear();
+    connections_.clear();
+}
+
+void Reactor::request_flush(Connection* conn) {
+    pending_flush_.push_back(conn);
+}
+
+void Reactor::accept_connections(socket_t listener, bool http) {
+    // The listeners are edge-triggered as well, so accept until the backlog is empty
+    while (true) {
+        std::string client_ip;
+        socket_t client_socket = Socket::accept(listener, client_ip);
+        if (client_socket == RTMP_INVALID_SOCKET) {
+            int error = Socket::last_error();
+            if (Socket::interrupted(error)) continue;
+            if (!Socket::would_block(error)) {
+                LOG_ERROR("[accept_connections] Failed to accept connection. Error: " << error);
+            }
+            return;
+        }
+
+        Socket::set_no_delay(client_socket);
+        stats_->connections_accepted.fetch_add(1, std::memory_order_relaxed);
+        LOG_INFO("[accept_connections] New client connected from " << client_ip);
+
+        Connection* conn = new Connection(client_socket, client_ip, this, worker_, http);
+        connections_[client_socket].reset(conn);
+        handshake_deadlines_.add(client_socket, conn->accepted_ns());
+
+#ifdef __linux__
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_socket, &event) != 0) {
+            LOG_ERROR("[accept_connections] Failed to register client socket. Error: " << errno);
+            close_connection(conn);
+        }
+#endif
+    }
+}
+
+void Reactor::handle_event(Connection* conn, bool readable, bool writable, bool failed) {
+    if (conn->is_closed()) {
+        close_connection(conn);  // Closed by a handler earlier in this batch
+        return;
+    }
+
+    // Errors surface through recv(), so let the read path report them
+    if ((readable || failed) && !conn->on_readable()) {
+        close_connection(conn);
+        return;
+    }
+#ifdef __linux__
+    // Level-triggered poll() reports leftover input by itself; edge-triggered epoll does not
+    if (readable && conn->input_pending() &&
+        std::find(read_again_.begin(), read_again_.end(), conn) == read_again_.end()) {
+        read_again_.push_back(conn);
+    }
+#endif
+    if (writable && !conn->on_writable()) {
+        close_connection(conn);
+    }
+}
+
+void Reactor::close_connection(Connection* conn) {
+    if (std::find(closed_.begin(), closed_.end(), conn) != closed_.end()) {
+        return;
+    }
+    conn->close();
+#ifdef __linux__
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn->fd(), nullptr);
+    read_again_.erase(std::remove(read_again_.begin(), read_again_.end(), conn), read_again_.end());
+#endif
+    closed_.push_back(conn);
+}
+
+void Reactor::resume_reads() {
+    // Take the list first: connections that hit their budget again re-add themselves
+    std::vector<Connection*> again;
+    again.swap(read_again_);
+    for (size_t i = 0; i < again.size(); ++i) {
+        handle_event(again[i], true, false, false);
+    }
+}
+
+void Reactor::flush_pending() {
+    // Sends queued while handling this batch go out together, one pass per connection
+    for (size_t i = 0; i < pending_flush_.size(); ++i) {
+        Connection* conn = pending_flush_[i];
+        if (conn->is_closed() || !conn->on_writable()) {
+            close_connection(conn);
+        }
+    }
+    pending_flush_.clear();
+}
+
+void Reactor::expire_handshakes() {
+    if (handshake_deadlines_.empty()) {
+        return;
+    }
+    unsigned long long now = Metrics::now_ns();
+    socket_t fd;
+    while (handshake_deadlines_.pop_expired(now, fd)) {
+        auto found = connections_.find(fd);
+        if (found == connections_.end()) {
+            continue;
+        }
+        Connection* conn = found->second.get();
+        if (!conn->is_closed() && conn->handshake_expired(now, handshake_deadlines_.timeout_ns())) {
+            LOG_WARN("[Reactor] Handshake timed out for client IP: " << conn->client_ip());
+            stats_->handshake_timeouts.fetch_add(1, std::memory_order_relaxed);
+            close_connection(conn);
+        }
+    }
+}
+
+void Reactor::reap_closed() {
+    for (size_t i = 0; i < closed_.size(); ++i) {
+        connections_.erase(closed_[i]->fd());
+    }
+    closed_.clear();
+}
@@ -0,0 +1,46 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "IOBackend.h"
+#include "HandshakeDeadlines.h"
+
+// Readiness-based backend: edge-triggered epoll on Linux, poll()/WSAPoll elsewhere.
+class Reactor : public IOBackend {
+public:
+    Reactor();
+    ~Reactor();
+
+    bool init(socket_t listener, Worker* worker) override;
+    void run(const std::atomic<bool>& running) override;
+    void request_flush(Connection* conn) override;
+    const char* name() const override;
+
+    std::size_t connection_count() const { return connections_.size(); }
+
+private:
+    void accept_connections(socket_t listener, bool http);
+    void handle_event(Connection* conn, bool readable, bool writable, bool failed);
+    void close_connection(Connection* conn);
+    void resume_reads();
+    void flush_pending();
+    void expire_handshakes();
+    void reap_closed();
+
+    socket_t listener_;
+    socket_t http_listener_;  // Worker::http_listener(), or invalid
+    Worker* worker_;
+    WorkerStats* stats_;
+#ifdef __linux__
+    int epoll_fd_;
+#endif
+    std::unordered_map<socket_t, std::unique_ptr<Connection>> connections_;
+    std::vector<Connection*> pending_flush_;  // Connections with freshly queued output
+    std::vector<Connection*> closed_;         // Closed this iteration, deleted at its end
+    std::vector<Connection*> read_again_;     // Stopped at their read budget; epoll will not report them again
+    HandshakeDeadlines handshake_deadlines_;
+};
+
+#endif // REACTOR_H
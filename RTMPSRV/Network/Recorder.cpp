@@ -0,0 +1,355 @@
+#include "Recorder.h"
+#include "Flv.h"
+#include "Log.h"
+#include "Metrics.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const std::size_t PAGE_SIZE = 4096;
+
+int open_exclusive(const std::string& path, int& error) {
+#ifdef _WIN32
+    int fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+#endif
+    error = fd < 0 ? errno : 0;
+    return fd;
+}
+
+bool write_all(int fd, const char* data, std::size_t length) {
+    while (length > 0) {
+#ifdef _WIN32
+        int written = _write(fd, data, static_cast<unsigned int>(length));
+#else
+        ssize_t written = write(fd, data, length);
+#endif
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Reserves blocks past the end of the file without changing its size
+bool preallocate(int fd, unsigned long long offset, unsigned long long length) {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    return fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(length)) == 0;
+#else
+    (void)fd;
+    (void)offset;
+    (void)length;
+    return false;
+#endif
+}
+
+// Drops whatever was preallocated past size, then closes
+void close_file(int fd, unsigned long long size, bool truncate) {
+#ifdef _WIN32
+    if (truncate) _chsize_s(fd, static_cast<__int64>(size));
+    _close(fd);
+#else
+    if (truncate && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        LOG_WARN("[Recorder] Could not release preallocated space, error: " << errno);
+    }
+    close(fd);
+#endif
+}
+
+bool make_directory(const std::string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+bool directory_writable(const std::string& path) {
+#ifdef _WIN32
+    return _access(path.c_str(), 2) == 0;
+#else
+    return access(path.c_str(), W_OK | X_OK) == 0;
+#endif
+}
+
+// Stream keys come from clients; only a safe subset of characters reaches the file name
+std::string file_name_for(const std::string& key) {
+    std::string name;
+    for (std::size_t i = 0; i < key.size(); ++i) {
+        char c = key[i];
+        bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+        name += safe && !(c == '.' && i == 0) ? c : '_';
+    }
+
+    std::time_t now = std::time(nullptr);
+    std::tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "-%Y%m%d-%H%M%S", &utc);
+    return name + stamp;
+}
+
+} // namespace
+
+// One stream's files
+class Recorder::Recording : public QueuedSink::Session {
+public:
+    Recording(Recorder& owner, const std::string& key)
+        : owner_(owner),
+          key_(key),
+          base_path_(owner.directory_ + "/" + file_name_for(key)),
+          part_(0),
+          fd_(-1),
+          file_bytes_(0),
+          flushed_bytes_(0),
+          preallocated_bytes_(0),
+          preallocate_(true),
+          storage_(new char[WRITE_BATCH + PAGE_SIZE]),
+          buffered_(0),
+          base_timestamp_(0),
+          seen_video_(false),
+          last_flush_ns_(Metrics::now_ns()) {
+        // Page-aligned, so every full batch hands the page cache whole pages
+        std::size_t misalignment = reinterpret_cast<std::size_t>(storage_.get()) % PAGE_SIZE;
+        buffer_ = storage_.get() + (misalignment ? PAGE_SIZE - misalignment : 0);
+        owner_.stats_.recordings_active.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~Recording() {
+        close();
+        owner_.stats_.recordings_active.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Writes out what is buffered once it has waited long enough
+    void tick(unsigned long long now_ns) override {
+        if (buffered_ > 0 && now_ns - last_flush_ns_ >= FLUSH_INTERVAL_MS * 1000000ull) {
+            write_buffer();
+        }
+    }
+
+protected:
+    void write(const MediaPacketPtr& packet) override {
+        if (packet->message_type_id == Flv::TAG_SCRIPT || packet->is_sequence_header()) {
+            MediaPacketPtr& slot = packet->message_type_id == Flv::TAG_SCRIPT ? metadata_
+                                 : (packet->is_video() ? video_header_ : audio_header_);
+            slot = packet;
+            if (fd_ >= 0) {
+                append_tag(*packet, relative(packet->timestamp));
+            }
+            return;
+        }
+
+        if (packet->is_video()) {
+            seen_video_ = true;
+            if (waiting_keyframe_ && !packet->is_keyframe()) {
+                owner_.stats_.packets_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            waiting_keyframe_ = false;
+        }
+
+        // Files start, and rotate, at keyframes; audio-only streams anywhere
+        bool boundary = packet->is_keyframe() || !seen_video_;
+        if (fd_ < 0 || (boundary && rotation_due(packet->timestamp))) {
+            if (!boundary || !open(packet->timestamp)) {
+                return;
+            }
+        }
+        append_tag(*packet, relative(packet->timestamp));
+    }
+
+private:
+    unsigned int relative(unsigned int timestamp) const {
+        return timestamp >= base_timestamp_ ? timestamp - base_timestamp_ : 0;
+    }
+
+    bool rotation_due(unsigned int timestamp) const {
+        return (owner_.max_file_bytes_ != 0 && file_bytes_ >= owner_.max_file_bytes_) ||
+               (owner_.max_file_seconds_ != 0 && relative(timestamp) >= owner_.max_file_seconds_ * 1000ull);
+    }
+
+    bool open(unsigned int timestamp) {
+        close();
+
+        // Another recording of the same key may have started in the same second
+        std::string path;
+        int error = 0;
+        for (int attempt = 0; attempt < 1000 && fd_ < 0; ++attempt) {
+            char suffix[16];
+            std::snprintf(suffix, sizeof(suffix), "-%03u.flv", part_++);
+            path = base_path_ + suffix;
+            fd_ = open_exclusive(path, error);
+            if (fd_ < 0 && error != EEXIST) break;
+        }
+        if (fd_ < 0) {
+            LOG_ERROR("[Recorder] Cannot create " << path << ", error: " << error);
+            owner_.stats_.write_errors.fetch_add(1, std::memory_order_relaxed);
+            waiting_keyframe_ = true;
+            return false;
+        }
+        LOG_INFO("[Recorder] Recording '" << key_ << "' to " << path);
+        owner_.stats_.files_opened.fetch_add(1, std::memory_order_relaxed);
+        file_bytes_ = 0;
+        flushed_bytes_ = 0;
+        preallocated_bytes_ = 0;
+        base_timestamp_ = timestamp;
+
+        // Every file plays on its own: header, metadata and decoder configuration first
+        char header[Flv::FILE_HEADER_SIZE];
+        Flv::write_file_header(header, true, seen_video_ || video_header_);
+        append(header, sizeof(header));
+        if (metadata_) append_tag(*metadata_, 0);
+        if (video_header_) append_tag(*video_header_, 0);
+        if (audio_header_) append_tag(*audio_header_, 0);
+        return true;
+    }
+
+    void close() {
+        if (fd_ < 0) {
+            return;
+        }
+        write_buffer();
+        if (fd_ >= 0) {
+            close_file(fd_, flushed_bytes_, preallocated_bytes_ > flushed_bytes_);
+            fd_ = -1;
+        }
+    }
+
+    void append_tag(const MediaPacket& packet, unsigned int timestamp) {
+        char header[Flv::TAG_HEADER_SIZE];
+        char trailer[Flv::TAG_TRAILER_SIZE];
+        Flv::write_tag_header(header, packet.message_type_id, packet.payload.size(), timestamp);
+        Flv::write_tag_trailer(trailer, packet.payload.size());
+        append(header, sizeof(header));
+        append(packet.payload.data(), packet.payload.size());
+        append(trailer, sizeof(trailer));
+    }
+
+    void append(const char* data, std::size_t length) {
+        if (fd_ < 0) {
+            return;
+        }
+        file_bytes_ += length;
+        if (buffered_ + length > WRITE_BATCH) {
+            write_buffer();
+            if (length >= WRITE_BATCH) {
+                write_out(data, length);  // Large frames skip the copy
+                return;
+            }
+        }
+        std::memcpy(buffer_ + buffered_, data, length);
+        buffered_ += length;
+    }
+
+    void write_buffer() {
+        std::size_t length = buffered_;
+        buffered_ = 0;
+        last_flush_ns_ = Metrics::now_ns();
+        if (length > 0) {
+            write_out(buffer_, length);
+        }
+    }
+
+    void write_out(const char* data, std::size_t length) {
+        if (fd_ < 0) {
+            return;
+        }
+        if (preallocate_ && flushed_bytes_ + length > preallocated_bytes_) {
+            unsigned long long step = PREALLOCATE_STEP > length ? PREALLOCATE_STEP : length;
+            if (preallocate(fd_, preallocated_bytes_, step)) {
+                preallocated_bytes_ += step;
+            } else {
+                preallocate_ = false;  // Not supported here; plain appends still work
+            }
+        }
+        if (!write_all(fd_, data, length)) {
+            LOG_ERROR("[Recorder] Write failed for '" << key_ << "', error: " << errno << "; closing the file.");
+            owner_.stats_.write_errors.fetch_add(1, std::memory_order_relaxed);
+            close_file(fd_, flushed_bytes_, preallocated_bytes_ > flushed_bytes_);
+            fd_ = -1;
+            buffered_ = 0;
+            waiting_keyframe_ = true;  // Try a new file from the next keyframe
+            return;
+        }
+        flushed_bytes_ += length;
+        owner_.stats_.bytes_written.fetch_add(length, std::memory_order_relaxed);
+    }
+
+    Recorder& owner_;
+    std::string key_;
+    std::string base_path_;  // Directory, sanitized key and start time; parts add "-NNN.flv"
+    unsigned int part_;
+
+    int fd_;
+    unsigned long long file_bytes_;          // Appended to this file, buffered or not
+    unsigned long long flushed_bytes_;       // Written to it
+    unsigned long long preallocated_bytes_;
+    bool preallocate_;
+
+    std::unique_ptr<char[]> storage_;
+    char* buffer_;                           // WRITE_BATCH bytes inside storage_, page-aligned
+    std::size_t buffered_;
+
+    unsigned int base_timestamp_;            // Stream time of the file's first tag
+    MediaPacketPtr metadata_;
+    MediaPacketPtr video_header_;
+    MediaPacketPtr audio_header_;
+    bool seen_video_;
+    unsigned long long last_flush_ns_;
+};
+
+Recorder::Recorder(const std::string& directory, unsigned long long max_file_bytes, unsigned int max_file_seconds)
+    : QueuedSink(stats_),
+      directory_(directory),
+      max_file_bytes_(max_file_bytes),
+      max_file_seconds_(max_file_seconds) {}
+
+Recorder::~Recorder() {
+    stop();
+}
+
+bool Recorder::start() {
+    if (!make_directory(directory_) || !directory_writable(directory_)) {
+        LOG_ERROR("[Recorder] Recording directory " << directory_ << " is not writable.");
+        return false;
+    }
+    start_thread();
+    return true;
+}
+
+void Recorder::stop() {
+    stop_thread();
+}
+
+bool Recorder::accepts(const MediaPacket& packet) const {
+    return Flv::is_tag_type(packet.message_type_id);
+}
+
+bool Recorder::wakes(const MediaPacket& packet, unsigned long long queued) const {
+    (void)packet;
+    return queued >= WRITE_BATCH;  // Only a full batch is worth waking the I/O thread early
+}
+
+QueuedSink::Session* Recorder::open_session(const std::string& key) {
+    return new Recording(*this, key);
+}
@@ -0,0 +1,58 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <atomic>
+#include <string>
+#include "QueuedSink.h"
+
+struct RecorderStats : QueuedSinkStats {
+    std::atomic<unsigned long long> bytes_written;
+    std::atomic<unsigned long long> files_opened;
+    std::atomic<unsigned long long> recordings_active;
+    std::atomic<unsigned long long> write_errors;
+
+    RecorderStats()
+        : bytes_written(0),
+          files_opened(0),
+          recordings_active(0),
+          write_errors(0) {}
+};
+
+// Writes every published stream to FLV files (DVR). Packets reach the I/O thread through
+// the QueuedSink queue, which it takes whole, waking early once WRITE_BATCH bytes are
+// waiting. It frames them into page-aligned per-recording buffers and writes those out
+// WRITE_BATCH bytes at a time, or at least every FLUSH_INTERVAL_MS. Files grow into space
+// preallocated PREALLOCATE_STEP at a time where the filesystem supports it. A new file
+// starts at the first keyframe after either limit is reached and repeats metadata and
+// sequence headers, so each one plays on its own.
+class Recorder : public QueuedSink {
+public:
+    static const std::size_t WRITE_BATCH = 1024 * 1024;
+    static const std::size_t PREALLOCATE_STEP = 64 * 1024 * 1024;
+    static const unsigned int FLUSH_INTERVAL_MS = 1000;
+
+    // Limits of 0 never rotate
+    Recorder(const std::string& directory, unsigned long long max_file_bytes, unsigned int max_file_seconds);
+    ~Recorder();
+
+    bool start();  // Fails when the directory is not writable
+    void stop();   // Writes everything queued so far and closes every file
+
+    const RecorderStats& stats() const { return stats_; }
+
+protected:
+    bool accepts(const MediaPacket& packet) const override;
+    bool wakes(const MediaPacket& packet, unsigned long long queued) const override;
+    Session* open_session(const std::string& key) override;
+
+private:
+    class Recording;
+
+    std::string directory_;
+    unsigned long long max_file_bytes_;
+    unsigned int max_file_seconds_;
+
+    RecorderStats stats_;
+};
+
+#endif // RECORDER_H
@@ -0,0 +1,161 @@
+#include "RecvBuffer.h"
+#include "Log.h"
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::atomic<std::size_t> mirrored_rings(0);
+std::atomic<bool> fallback_logged(false);
+
+} // namespace
+
+RecvBuffer::RecvBuffer()
+    : base_(nullptr),
+      capacity_(0),
+      head_(0),
+      size_(0),
+      mirrored_(false) {}
+
+RecvBuffer::~RecvBuffer() {
+    release(base_, capacity_, mirrored_);
+}
+
+void RecvBuffer::consume(std::size_t length) {
+    head_ += length;
+    size_ -= length;
+    if (size_ == 0) {
+        head_ = 0;  // Empty again: restart at the front, which is still warm in cache
+    } else if (mirrored_ && head_ >= capacity_) {
+        head_ -= capacity_;
+    }
+}
+
+char* RecvBuffer::write_ptr() {
+    std::size_t tail = head_ + size_;
+    if (mirrored_ && tail >= capacity_) {
+        tail -= capacity_;
+    }
+    return base_ + tail;
+}
+
+bool RecvBuffer::reserve(std::size_t length) {
+    if (writable() >= length) {
+        return true;
+    }
+
+    // Linear buffer: slide the unread tail to the front if that frees enough room
+    if (!mirrored_ && base_ && capacity_ - size_ >= length) {
+        std::memmove(base_, base_ + head_, size_);
+        head_ = 0;
+        return true;
+    }
+
+    std::size_t capacity = capacity_ ? capacity_ : INITIAL_CAPACITY;
+    while (capacity - size_ < length) {
+        capacity *= 2;
+    }
+    if (capacity > MAX_CAPACITY) {
+        LOG_WARN("[RecvBuffer::reserve] Refusing to grow receive buffer to " << capacity << " bytes.");
+        return false;
+    }
+
+    char* base;
+    bool mirrored;
+    if (!allocate(capacity, base, mirrored)) {
+        return false;
+    }
+    if (size_ > 0) {
+        std::memcpy(base, read_ptr(), size_);
+    }
+    release(base_, capacity_, mirrored_);
+
+    base_ = base;
+    capacity_ = capacity;
+    mirrored_ = mirrored;
+    head_ = 0;
+    return true;
+}
+
+bool RecvBuffer::append(const char* data, std::size_t length) {
+    if (!reserve(length)) {
+        return false;
+    }
+    std::memcpy(write_ptr(), data, length);
+    commit(length);
+    return true;
+}
+
+bool RecvBuffer::allocate(std::size_t capacity, char*& base, bool& mirrored) {
+#ifdef __linux__
+    // Only buffers that outgrew the initial size are worth their mappings
+    bool mirror = capacity > INITIAL_CAPACITY;
+    if (mirror && mirrored_rings.fetch_add(1, std::memory_order_relaxed) >= MAX_MIRRORED_RINGS) {
+        mirrored_rings.fetch_sub(1, std::memory_order_relaxed);
+        mirror = false;
+        if (!fallback_logged.exchange(true, std::memory_order_relaxed)) {
+            LOG_WARN("[RecvBuffer::allocate] " << MAX_MIRRORED_RINGS << " mirrored rings in use; "
+                     "further large receive buffers are linear.");
+        }
+    }
+    // Reserve twice the capacity, then map the same memfd pages over both halves
+    int fd = mirror ? memfd_create("rtmp-recv", MFD_CLOEXEC) : -1;
+    if (fd >= 0) {
+        void* region = MAP_FAILED;
+        if (ftruncate(fd, static_cast<off_t>(capacity)) == 0) {
+            region = mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        if (region != MAP_FAILED) {
+            char* start = static_cast<char*>(region);
+            bool mapped =
+                mmap(start, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+                mmap(start + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+            if (mapped) {
+                close(fd);  // The mappings keep the pages alive
+                base = start;
+                mirrored = true;
+                return true;
+            }
+            munmap(region, capacity * 2);
+        }
+        close(fd);
+    }
+    if (mirror) {
+        mirrored_rings.fetch_sub(1, std::memory_order_relaxed);
+        if (!fallback_logged.exchange(true, std::memory_order_relaxed)) {
+            LOG_WARN("[RecvBuffer::allocate] Mirrored mapping failed, using linear buffers.");
+        }
+    }
+#endif
+
+    base = new (std::nothrow) char[capacity];
+    mirrored = false;
+    if (!base) {
+        LOG_ERROR("[RecvBuffer::allocate] Out of memory allocating " << capacity << " bytes.");
+        return false;
+    }
+    return true;
+}
+
+void RecvBuffer::release(char* base, std::size_t capacity, bool mirrored) {
+    if (!base) {
+        return;
+    }
+#ifdef __linux__
+    if (mirrored) {
+        munmap(base, capacity * 2);
+        mirrored_rings.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+#else
+    (void)capacity;
+    (void)mirrored;
+#endif
+    delete[] base;
+}
@@ -0,0 +1,57 @@
+#ifndef RECVBUFFER_H
+#define RECVBUFFER_H
+
+#include <cstddef> // For std::size_t
+
+// Per-connection receive buffer the parser reads in place.
+//
+// Every buffer starts linear: it only compacts the unread tail when the free space at the
+// end runs out. One that has to grow past INITIAL_CAPACITY (a publisher sending large
+// messages) becomes, on Linux, a "magic ring": one memfd mapped twice back to back, so the
+// readable bytes are always contiguous even when they wrap around the end, and neither
+// consuming nor wrapping ever moves data. Each ring costs memory mappings, which count
+// against vm.max_map_count for the whole process, so at most MAX_MIRRORED_RINGS exist at a
+// time; past that, or if the mapping fails, buffers stay linear.
+// recv() writes directly into the free space returned by write_ptr().
+class RecvBuffer {
+public:
+    static const std::size_t INITIAL_CAPACITY = 64 * 1024;
+    static const std::size_t MAX_CAPACITY = 64 * 1024 * 1024;  // Bounds what one peer can make us hold
+    static const std::size_t MAX_MIRRORED_RINGS = 4096;        // Process-wide
+
+    RecvBuffer();
+    ~RecvBuffer();
+
+    const char* read_ptr() const { return base_ + head_; }
+    std::size_t readable() const { return size_; }
+    void consume(std::size_t length);
+
+    char* write_ptr();
+    std::size_t writable() const { return capacity_ - size_ - (mirrored_ ? 0 : head_); }
+    void commit(std::size_t length) { size_ += length; }
+
+    // Makes at least length bytes writable, growing the buffer if needed.
+    // Returns false when that would exceed MAX_CAPACITY.
+    bool reserve(std::size_t length);
+
+    // Copies data in; used by completion-based backends that already received into their own buffers
+    bool append(const char* data, std::size_t length);
+
+    bool mirrored() const { return mirrored_; }
+    std::size_t capacity() const { return capacity_; }
+
+private:
+    RecvBuffer(const RecvBuffer&);
+    RecvBuffer& operator=(const RecvBuffer&);
+
+    bool allocate(std::size_t capacity, char*& base, bool& mirrored);
+    void release(char* base, std::size_t capacity, bool mirrored);
+
+    char* base_;
+    std::size_t capacity_;
+    std::size_t head_;      // Offset of the first unread byte
+    std::size_t size_;      // Unread bytes
+    bool mirrored_;
+};
+
+#endif // RECVBUFFER_H
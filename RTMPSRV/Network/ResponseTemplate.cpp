@@ -0,0 +1,76 @@
+#include "ResponseTemplate.h"
+#include "ParseUtils.h"
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const std::size_t HEADER_SIZE = 12;  // One-byte basic header, fmt 0 message header; csid < 64
+
+std::size_t wire_size(std::size_t body_length, std::size_t chunk_size) {
+    std::size_t continuations = body_length > 0 ? (body_length - 1) / chunk_size : 0;
+    return HEADER_SIZE + body_length + continuations;
+}
+
+// Header, then the body with a fmt 3 basic header before every chunk after the first
+std::size_t write_chunked(unsigned int csid, unsigned char message_type_id, const PooledBytes& body,
+                          std::size_t chunk_size, char* out) {
+    std::size_t position = Parses::build_rtmp_header(0, csid, 0, static_cast<unsigned int>(body.size()),
+                                                     message_type_id, 0, out);
+    for (std::size_t offset = 0; offset < body.size(); offset += chunk_size) {
+        if (offset > 0) {
+            out[position++] = static_cast<char>(0xC0 | (csid & 0x3F));
+        }
+        std::size_t piece = body.size() - offset < chunk_size ? body.size() - offset : chunk_size;
+        std::memcpy(out + position, body.data() + offset, piece);
+        position += piece;
+    }
+    return position;
+}
+
+} // namespace
+
+void ResponseTemplate::build(unsigned int csid, unsigned char message_type_id, const PooledBytes& body,
+                             std::size_t transaction_offset) {
+    csid_ = csid;
+    message_type_id_ = message_type_id;
+    transaction_offset_ = transaction_offset;
+    body_.assign(body.data(), body.size());
+
+    wire_.resize(wire_size(body.size(), DEFAULT_CHUNK_SIZE));
+    write_chunked(csid, message_type_id, body_, DEFAULT_CHUNK_SIZE, wire_.data());
+    single_.resize(wire_size(body.size(), body.size()));
+    write_chunked(csid, message_type_id, body_, body.size() > 0 ? body.size() : 1, single_.data());
+}
+
+std::size_t ResponseTemplate::render(std::size_t chunk_size, double transaction_id, unsigned int message_stream_id,
+                                     char* out, std::size_t capacity) const {
+    std::size_t size = wire_size(body_.size(), chunk_size);
+    if (size > capacity) {
+        return 0;
+    }
+    if (chunk_size == DEFAULT_CHUNK_SIZE) {
+        std::memcpy(out, wire_.data(), size);
+    } else if (chunk_size >= body_.size()) {
+        std::memcpy(out, single_.data(), size);
+    } else {
+        write_chunked(csid_, message_type_id_, body_, chunk_size, out);
+    }
+
+    // Message stream ID, little-endian in the fmt 0 header
+    out[8] = static_cast<char>(message_stream_id & 0xFF);
+    out[9] = static_cast<char>((message_stream_id >> 8) & 0xFF);
+    out[10] = static_cast<char>((message_stream_id >> 16) & 0xFF);
+    out[11] = static_cast<char>((message_stream_id >> 24) & 0xFF);
+
+    // Transaction ID, a big-endian double; a chunk boundary may fall inside it
+    if (transaction_offset_ != NO_TRANSACTION) {
+        uint64_t bits;
+        std::memcpy(&bits, &transaction_id, sizeof(bits));
+        for (std::size_t i = 0; i < 8; ++i) {
+            std::size_t offset = transaction_offset_ + i;
+            out[HEADER_SIZE + offset + offset / chunk_size] = static_cast<char>((bits >> ((7 - i) * 8)) & 0xFF);
+        }
+    }
+    return size;
+}
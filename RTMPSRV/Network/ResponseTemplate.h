@@ -0,0 +1,44 @@
+#ifndef RESPONSETEMPLATE_H
+#define RESPONSETEMPLATE_H
+
+#include <cstddef> // For std::size_t
+#include "SlabPool.h"
+
+// A command reply whose bytes never change apart from the transaction ID and the message
+// stream ID. Built once from its AMF body, it keeps the complete wire form for the default
+// chunk size (fmt 0 header, payload, fmt 3 continuation headers). Sending copies it into
+// a buffer and patches the two IDs in place. A second, single-chunk form covers the large
+// chunk size the server announces after connect; any other size has the body split again.
+class ResponseTemplate {
+public:
+    static const std::size_t NO_TRANSACTION = static_cast<std::size_t>(-1);
+    static const std::size_t DEFAULT_CHUNK_SIZE = 128;
+    // Largest reply render() produces; command replies are a few hundred bytes
+    static const std::size_t MAX_WIRE_SIZE = 1024;
+
+    ResponseTemplate() : csid_(0), message_type_id_(0), transaction_offset_(NO_TRANSACTION) {}
+
+    // transaction_offset is where the transaction ID's 8 bytes start in body, or NO_TRANSACTION
+    void build(unsigned int csid, unsigned char message_type_id, const PooledBytes& body,
+               std::size_t transaction_offset);
+
+    // Writes the reply chunked for chunk_size with both IDs filled in; returns its length,
+    // or 0 if it would not fit in capacity
+    std::size_t render(std::size_t chunk_size, double transaction_id, unsigned int message_stream_id,
+                       char* out, std::size_t capacity) const;
+
+    std::size_t body_size() const { return body_.size(); }
+
+private:
+    ResponseTemplate(const ResponseTemplate&);
+    ResponseTemplate& operator=(const ResponseTemplate&);
+
+    unsigned int csid_;
+    unsigned char message_type_id_;
+    std::size_t transaction_offset_;
+    PooledBytes body_;
+    PooledBytes wire_;     // Chunked for DEFAULT_CHUNK_SIZE
+    PooledBytes single_;   // One chunk, for any chunk size that holds the whole body
+};
+
+#endif // RESPONSETEMPLATE_H
@@ -0,0 +1,167 @@
+#include "SendQueue.h"
+#include "Metrics.h"
+
+SendQueue::SendQueue()
+    : front_segment_(0),
+      front_offset_(0),
+      queued_bytes_(0),
+      pinned_items_(0),
+      delivery_(nullptr) {}
+
+void SendQueue::append(const char* data, std::size_t length) {
+    if (length == 0) {
+        return;
+    }
+    queued_bytes_ += length;
+
+    // Merge into the last block while nothing is reading it asynchronously
+    if (!items_.empty() && items_.size() > pinned_items_) {
+        Item& last = items_.back();
+        if (last.segments == nullptr && last.data == nullptr && last.length + length <= COALESCE_LIMIT) {
+            last.bytes.append(data, length);
+            last.length += length;
+            return;
+        }
+    }
+
+    items_.push_back(Item());
+    Item& item = items_.back();
+    item.segments = nullptr;
+    item.data = nullptr;
+    item.bytes.reserve(length > MIN_BLOCK ? length : MIN_BLOCK);  // Leaves room for messages coalesced later
+    item.bytes.assign(data, length);
+    item.length = length;
+    item.priority = PRIORITY_ESSENTIAL;
+    item.ingest_ns = 0;
+}
+
+void SendQueue::append(const std::shared_ptr<const void>& owner, const ChunkedMessage& message, Priority priority,
+                       unsigned long long ingest_ns) {
+    append(owner, message.segments(), message.segment_count(), message.total_length(), priority, ingest_ns);
+}
+
+void SendQueue::append(const std::shared_ptr<const void>& owner, const ChunkSegment* segments, std::size_t count,
+                       std::size_t length, Priority priority, unsigned long long ingest_ns) {
+    items_.push_back(Item());
+    Item& item = items_.back();
+    item.owner = owner;
+    item.segments = segments;
+    item.segment_count = count;
+    item.data = nullptr;
+    item.length = length;
+    item.priority = priority;
+    item.ingest_ns = delivery_ ? ingest_ns : 0;
+    queued_bytes_ += item.length;
+}
+
+void SendQueue::append(const std::shared_ptr<const void>& owner, const char* data, std::size_t length,
+                       Priority priority) {
+    if (length == 0) {
+        return;
+    }
+    items_.push_back(Item());
+    Item& item = items_.back();
+    item.owner = owner;
+    item.segments = nullptr;
+    item.data = data;
+    item.length = length;
+    item.priority = priority;
+    item.ingest_ns = 0;
+    queued_bytes_ += length;
+}
+
+std::size_t SendQueue::segment_count(const Item& item) const {
+    return item.segments ? item.segment_count : 1;
+}
+
+ChunkSegment SendQueue::segment(const Item& item, std::size_t index) const {
+    if (item.segments) {
+        return item.segments[index];
+    }
+    if (item.data) {
+        ChunkSegment referenced = { item.data, item.length };
+        return referenced;
+    }
+    ChunkSegment whole = { item.bytes.data(), item.bytes.size() };
+    return whole;
+}
+
+std::size_t SendQueue::gather(ChunkSegment* segments, std::size_t max, bool pin) {
+    std::size_t count = 0;
+    std::size_t items = 0;
+    for (std::deque<Item>::const_iterator it = items_.begin(); it != items_.end() && count < max; ++it, ++items) {
+        std::size_t index = items == 0 ? front_segment_ : 0;
+        std::size_t total = segment_count(*it);
+        for (; index < total && count < max; ++index) {
+            ChunkSegment piece = segment(*it, index);
+            if (items == 0 && index == front_segment_) {
+                piece.data += front_offset_;
+                piece.length -= front_offset_;
+            }
+            if (piece.length > 0) {
+                segments[count++] = piece;
+            }
+        }
+    }
+    if (pin) {
+        pinned_items_ = items;
+    }
+    return count;
+}
+
+void SendQueue::consume(std::size_t length) {
+    pinned_items_ = 0;
+    queued_bytes_ -= length;
+    unsigned long long now = 0;  // Read once, and only if a finished message needs it
+
+    while (length > 0 && !items_.empty()) {
+        const Item& front = items_.front();
+        ChunkSegment piece = segment(front, front_segment_);
+        std::size_t left = piece.length - front_offset_;
+        if (length < left) {
+            front_offset_ += length;
+            return;
+        }
+        length -= left;
+        front_offset_ = 0;
+        if (++front_segment_ >= segment_count(front)) {
+            if (front.ingest_ns != 0) {
+                if (now == 0) now = Metrics::now_ns();
+                delivery_->record(now > front.ingest_ns ? (now - front.ingest_ns) / 1000 : 0);
+            }
+            pop_front();
+        }
+    }
+}
+
+void SendQueue::pop_front() {
+    items_.pop_front();  // Copy blocks go back to the slab pool
+    front_segment_ = 0;
+    front_offset_ = 0;
+}
+
+std::size_t SendQueue::drop(Priority at_least) {
+    // The front item may be partly on the wire and pinned items are being read; keep both
+    std::size_t keep_front = pinned_items_;
+    if (keep_front == 0 && (front_segment_ > 0 || front_offset_ > 0)) {
+        keep_front = 1;
+    }
+
+    std::size_t freed = 0;
+    std::size_t dropped = 0;
+    std::size_t kept = keep_front;
+    for (std::size_t i = keep_front; i < items_.size(); ++i) {
+        if (items_[i].priority >= at_least) {
+            freed += items_[i].length;
+            ++dropped;
+            continue;
+        }
+        if (kept != i) {
+            std::swap(items_[kept], items_[i]);
+        }
+        ++kept;
+    }
+    items_.resize(kept);
+    queued_bytes_ -= freed;
+    return dropped;
+}
@@ -0,0 +1,89 @@
+#ifndef SENDQUEUE_H
+#define SENDQUEUE_H
+
+#include <deque>
+#include <memory>
+#include <cstddef> // For std::size_t
+#include "ChunkCache.h"
+#include "SlabPool.h"
+
+class LatencyHistogram;
+
+// Output of one connection that has not reached the socket yet, as a list of messages.
+// Small messages the connection serializes itself are copied and coalesced into shared
+// blocks; pre-chunked media is queued by reference, so a packet sent to a thousand players
+// is queued a thousand times without its payload being copied once. gather() turns the
+// front of the queue into segments for a single writev/sendmsg.
+class SendQueue {
+public:
+    // What may be thrown away when the peer falls behind; higher values go first
+    enum Priority {
+        PRIORITY_ESSENTIAL = 0,    // Protocol messages, metadata, sequence headers, keyframes
+        PRIORITY_AUDIO = 1,
+        PRIORITY_INTER_FRAME = 2   // Video that depends on earlier frames
+    };
+
+    SendQueue();
+
+    bool empty() const { return items_.empty(); }
+    std::size_t queued_bytes() const { return queued_bytes_; }
+
+    // Copies data to the end of the queue
+    void append(const char* data, std::size_t length);
+
+    // Queues a pre-chunked message; owner keeps its segments alive until they are sent.
+    // A nonzero ingest_ns (Metrics::now_ns() when the message came in) is recorded in the
+    // delivery histogram once the message's last byte has been sent.
+    void append(const std::shared_ptr<const void>& owner, const ChunkedMessage& message, Priority priority,
+                unsigned long long ingest_ns = 0);
+
+    // The same for any other serialized form, such as an FlvTag: count segments of total
+    // length bytes that owner keeps alive
+    void append(const std::shared_ptr<const void>& owner, const ChunkSegment* segments, std::size_t count,
+                std::size_t length, Priority priority, unsigned long long ingest_ns = 0);
+
+    // Queues length bytes at data by reference, such as a response body; owner keeps them
+    // alive until they are sent
+    void append(const std::shared_ptr<const void>& owner, const char* data, std::size_t length, Priority priority);
+
+    void set_delivery_histogram(LatencyHistogram* histogram) { delivery_ = histogram; }
+
+    // Fills up to max segments from the front of the queue and returns how many.
+    // With pin set, the gathered messages stay untouched until the next consume(), so an
+    // asynchronous send may keep using the segments after this returns.
+    std::size_t gather(ChunkSegment* segments, std::size_t max, bool pin);
+
+    // Drops length sent bytes from the front and releases any pin
+    void consume(std::size_t length);
+
+    // Removes whole unsent messages of at least the given priority; returns how many
+    std::size_t drop(Priority at_least);
+
+private:
+    static const std::size_t COALESCE_LIMIT = 64 * 1024;  // Largest block small messages are merged into
+    static const std::size_t MIN_BLOCK = 4 * 1024;        // Room a new copy block starts with
+
+    struct Item {
+        std::shared_ptr<const void> owner;  // Keeps segments alive
+        const ChunkSegment* segments;       // Serialized media, or null for plain bytes
+        std::size_t segment_count;
+        const char* data;                   // Referenced bytes when segments is null, or null for copies
+        PooledBytes bytes;                  // Copied output when both are null
+        std::size_t length;
+        Priority priority;
+        unsigned long long ingest_ns;       // 0 when the delivery latency is not recorded
+    };
+
+    std::size_t segment_count(const Item& item) const;
+    ChunkSegment segment(const Item& item, std::size_t index) const;
+    void pop_front();
+
+    std::deque<Item> items_;
+    std::size_t front_segment_;   // First unsent segment of the front item
+    std::size_t front_offset_;    // Bytes of that segment already sent
+    std::size_t queued_bytes_;    // Unsent bytes across all items
+    std::size_t pinned_items_;    // Front items an asynchronous send is still reading
+    LatencyHistogram* delivery_;
+};
+
+#endif // SENDQUEUE_H
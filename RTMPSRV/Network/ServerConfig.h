@@ -0,0 +1,65 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <cstddef> // For std::size_t
+#include <string>
+
+// How much unsent output a connection may build up before we shed load, from the
+// cheapest loss to the most drastic. Queued media shares its payload with every other
+// player, so these bound how far behind a player may fall more than memory itself.
+struct BackpressurePolicy {
+    std::size_t drop_inter_frames_bytes;  // Skip video until the next keyframe
+    std::size_t drop_audio_bytes;         // Skip audio as well
+    std::size_t disconnect_bytes;         // Give up on the connection
+
+    BackpressurePolicy()
+        : drop_inter_frames_bytes(4 * 1024 * 1024),
+          drop_audio_bytes(8 * 1024 * 1024),
+          disconnect_bytes(16 * 1024 * 1024) {}
+};
+
+// Startup options for RTMPServer, filled from the command line in Main.cpp
+struct ServerConfig {
+    enum Backend {
+        BACKEND_EPOLL,     // Readiness-based reactor (poll() where epoll is unavailable)
+        BACKEND_IO_URING   // Completion-based; falls back to epoll when the kernel lacks support
+    };
+
+    int port;
+    unsigned int workers;   // Accept/serve loops; 0 = one per hardware thread
+    bool pin_workers;       // Pin worker N to CPU N (Linux only)
+    Backend backend;
+    std::size_t gop_cache_bytes;  // Per-stream cap on media cached since the last keyframe; 0 disables
+    BackpressurePolicy backpressure;
+    std::size_t chunk_size;       // Outbound chunk size announced after connect; 128 keeps the protocol default
+    unsigned int ack_window;      // Window Acknowledgement Size and Set Peer Bandwidth sent after connect
+    unsigned int handshake_timeout_ms;  // Accept to C2, after which the connection is dropped; 0 disables
+    int metrics_port;             // HTTP port for Prometheus scrapes; 0 disables
+    std::string record_dir;       // Where every published stream is recorded as FLV; empty disables
+    unsigned long long record_max_bytes;  // Start a new file at the next keyframe past this size; 0 = never
+    unsigned int record_max_seconds;      // Or past this duration; 0 = never
+    std::string vod_dir;          // Where "play" finds FLV files for video on demand; empty disables
+    int http_port;                // HTTP on the workers' event loops, for HTTP-FLV and HLS; 0 disables
+    bool hls;                     // Package published streams as HLS; needs http_port
+    unsigned int hls_segment_ms;  // Segments end at the first keyframe at least this long after they start
+    unsigned int hls_window;      // Segments per playlist
+
+    ServerConfig()
+        : port(1935),
+          workers(0),
+          pin_workers(false),
+          backend(BACKEND_EPOLL),
+          gop_cache_bytes(16 * 1024 * 1024),
+          chunk_size(4096),
+          ack_window(5000000),
+          handshake_timeout_ms(10000),
+          metrics_port(0),
+          record_max_bytes(0),
+          record_max_seconds(3600),
+          http_port(0),
+          hls(false),
+          hls_segment_ms(2000),
+          hls_window(6) {}
+};
+
+#endif // SERVERCONFIG_H
@@ -0,0 +1,303 @@
+#include "SlabPool.h"
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+const std::size_t OVERSIZE = SlabPool::CLASS_COUNT;     // Counter slot for requests past the last class
+const std::size_t THREAD_CACHE_BYTES = 1 << 20;         // Free bytes a thread keeps per class
+const std::size_t SHARED_CACHE_BYTES = 8 << 20;         // Free bytes the shared list keeps per class
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+std::size_t class_index(std::size_t size) {
+    std::size_t index = 0;
+    std::size_t block = SlabPool::MIN_BLOCK_SIZE;
+    while (block < size && index < OVERSIZE) {
+        block <<= 1;
+        ++index;
+    }
+    return index;
+}
+
+std::size_t class_block_size(std::size_t index) {
+    return SlabPool::MIN_BLOCK_SIZE << index;
+}
+
+// Blocks one thread or the shared list may hold for a class; always at least one
+std::size_t cache_limit(std::size_t index, std::size_t bytes) {
+    std::size_t blocks = bytes / class_block_size(index);
+    return blocks > 0 ? blocks : 1;
+}
+
+// Counters are only written by the owning thread; atomics so stats() may read them anywhere
+struct ClassCache {
+    ClassCache() : head(nullptr), count(0), hits(0), misses(0), releases(0), cached(0), cached_high_water(0) {}
+
+    void bump(std::atomic<unsigned long long>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void set_count(std::size_t value) {
+        count = value;
+        cached.store(value, std::memory_order_relaxed);
+        if (value > cached_high_water.load(std::memory_order_relaxed)) {
+            cached_high_water.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    FreeBlock* head;
+    std::size_t count;
+    std::atomic<unsigned long long> hits;
+    std::atomic<unsigned long long> misses;
+    std::atomic<unsigned long long> releases;
+    std::atomic<unsigned long long> cached;
+    std::atomic<unsigned long long> cached_high_water;
+};
+
+// One per thread that ever touched the pool; adopted by a new thread once its owner exits
+struct ThreadCache {
+    ThreadCache() : in_use(true), next(nullptr) {}
+
+    ClassCache classes[SlabPool::CLASS_COUNT + 1];
+    std::atomic<bool> in_use;
+    ThreadCache* next;  // Never changes once published
+};
+
+struct SharedList {
+    SharedList() : head(nullptr), count(0) {}
+
+    std::mutex mutex;
+    FreeBlock* head;
+    std::size_t count;
+};
+
+// Allocated once and never destroyed, so payloads freed during static destruction
+// (a global server tearing down its streams) still find it
+struct Shared {
+    Shared() : caches(nullptr) {}
+
+    SharedList lists[SlabPool::CLASS_COUNT];
+    std::atomic<ThreadCache*> caches;
+};
+
+Shared& shared() {
+    static Shared* instance = new Shared();
+    return *instance;
+}
+
+void free_chain(FreeBlock* head) {
+    while (head) {
+        FreeBlock* next = head->next;
+        ::operator delete(head);
+        head = next;
+    }
+}
+
+// Moves up to count blocks from the front of a thread's list to the shared list,
+// or back to the system when the shared list is full
+void spill(ClassCache& cache, std::size_t index, std::size_t count) {
+    FreeBlock* first = cache.head;
+    FreeBlock* last = first;
+    std::size_t moved = 1;
+    while (moved < count && last->next) {
+        last = last->next;
+        ++moved;
+    }
+    cache.head = last->next;
+    last->next = nullptr;
+    cache.set_count(cache.count - moved);
+
+    SharedList& list = shared().lists[index];
+    {
+        std::lock_guard<std::mutex> lock(list.mutex);
+        if (list.count + moved <= cache_limit(index, SHARED_CACHE_BYTES)) {
+            last->next = list.head;
+            list.head = first;
+            list.count += moved;
+            return;
+        }
+    }
+    free_chain(first);
+}
+
+// Takes up to count blocks from the shared list; returns how many arrived
+std::size_t refill(ClassCache& cache, std::size_t index, std::size_t count) {
+    SharedList& list = shared().lists[index];
+    std::lock_guard<std::mutex> lock(list.mutex);
+    std::size_t moved = 0;
+    while (moved < count && list.head) {
+        FreeBlock* block = list.head;
+        list.head = block->next;
+        block->next = cache.head;
+        cache.head = block;
+        ++moved;
+    }
+    list.count -= moved;
+    cache.set_count(cache.count + moved);
+    return moved;
+}
+
+ThreadCache* acquire_cache() {
+    Shared& pool = shared();
+    for (ThreadCache* cache = pool.caches.load(std::memory_order_acquire); cache; cache = cache->next) {
+        bool free = false;
+        if (!cache->in_use.load(std::memory_order_relaxed) &&
+            cache->in_use.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+            return cache;
+        }
+    }
+
+    ThreadCache* cache = new ThreadCache();
+    ThreadCache* head = pool.caches.load(std::memory_order_relaxed);
+    do {
+        cache->next = head;
+    } while (!pool.caches.compare_exchange_weak(head, cache, std::memory_order_release, std::memory_order_relaxed));
+    return cache;
+}
+
+// Hands the exiting thread's free blocks to the shared list and its counters to the next thread
+struct CacheOwner {
+    CacheOwner() : cache(nullptr), exited(false) {}
+    ~CacheOwner() {
+        exited = true;
+        if (!cache) {
+            return;
+        }
+        for (std::size_t index = 0; index < SlabPool::CLASS_COUNT; ++index) {
+            ClassCache& classes = cache->classes[index];
+            while (classes.count > 0) {
+                spill(classes, index, classes.count);
+            }
+        }
+        cache->in_use.store(false, std::memory_order_release);
+        cache = nullptr;
+    }
+
+    ThreadCache* cache;
+    bool exited;
+};
+
+thread_local CacheOwner local_cache;
+
+// Null once the thread is past its thread_local destructors
+ThreadCache* this_thread_cache() {
+    if (!local_cache.cache && !local_cache.exited) {
+        local_cache.cache = acquire_cache();
+    }
+    return local_cache.cache;
+}
+
+} // namespace
+
+std::size_t SlabPool::block_size(std::size_t size) {
+    std::size_t index = class_index(size);
+    return index < OVERSIZE ? class_block_size(index) : 0;
+}
+
+void* SlabPool::allocate(std::size_t size) {
+    std::size_t index = class_index(size);
+    ThreadCache* thread = this_thread_cache();
+    if (index == OVERSIZE) {
+        if (thread) thread->classes[OVERSIZE].bump(thread->classes[OVERSIZE].misses);
+        return ::operator new(size);
+    }
+    if (!thread) {
+        return ::operator new(class_block_size(index));
+    }
+
+    ClassCache& cache = thread->classes[index];
+    if (cache.head || refill(cache, index, (cache_limit(index, THREAD_CACHE_BYTES) + 1) / 2) > 0) {
+        FreeBlock* block = cache.head;
+        cache.head = block->next;
+        cache.set_count(cache.count - 1);
+        cache.bump(cache.hits);
+        return block;
+    }
+    cache.bump(cache.misses);
+    return ::operator new(class_block_size(index));
+}
+
+void SlabPool::release(void* block, std::size_t size) {
+    if (!block) {
+        return;
+    }
+    std::size_t index = class_index(size);
+    ThreadCache* thread = this_thread_cache();
+    if (thread) {
+        thread->classes[index].bump(thread->classes[index].releases);
+    }
+    if (index == OVERSIZE || !thread) {
+        ::operator delete(block);
+        return;
+    }
+
+    ClassCache& cache = thread->classes[index];
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed->next = cache.head;
+    cache.head = freed;
+    cache.set_count(cache.count + 1);
+
+    std::size_t limit = cache_limit(index, THREAD_CACHE_BYTES);
+    if (cache.count > limit) {
+        spill(cache, index, (limit + 1) / 2);
+    }
+}
+
+void SlabPool::stats(std::vector<SlabClassStats>& classes) {
+    classes.assign(CLASS_COUNT + 1, SlabClassStats());
+    unsigned long long releases[CLASS_COUNT + 1] = {};
+    for (std::size_t index = 0; index <= CLASS_COUNT; ++index) {
+        classes[index].block_size = index < OVERSIZE ? class_block_size(index) : 0;
+    }
+    for (ThreadCache* cache = shared().caches.load(std::memory_order_acquire); cache; cache = cache->next) {
+        for (std::size_t index = 0; index <= CLASS_COUNT; ++index) {
+            const ClassCache& counters = cache->classes[index];
+            classes[index].hits += counters.hits.load(std::memory_order_relaxed);
+            classes[index].misses += counters.misses.load(std::memory_order_relaxed);
+            classes[index].cached += counters.cached.load(std::memory_order_relaxed);
+            classes[index].cached_high_water += counters.cached_high_water.load(std::memory_order_relaxed);
+            releases[index] += counters.releases.load(std::memory_order_relaxed);
+        }
+    }
+    for (std::size_t index = 0; index <= CLASS_COUNT; ++index) {
+        unsigned long long handed_out = classes[index].hits + classes[index].misses;
+        classes[index].in_use = handed_out > releases[index] ? handed_out - releases[index] : 0;
+    }
+}
+
+void PooledBytes::append(const char* bytes, std::size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (size_ + length > capacity_) {
+        grow(size_ + length);
+    }
+    std::memcpy(data_ + size_, bytes, length);
+    size_ += length;
+}
+
+void PooledBytes::erase_front(std::size_t length) {
+    if (length >= size_) {
+        size_ = 0;
+        return;
+    }
+    std::memmove(data_, data_ + length, size_ - length);
+    size_ -= length;
+}
+
+void PooledBytes::grow(std::size_t needed) {
+    std::size_t wanted = capacity_ * 2 > needed ? capacity_ * 2 : needed;
+    std::size_t block = SlabPool::block_size(wanted);
+    std::size_t capacity = block > 0 ? block : wanted;
+    char* data = static_cast<char*>(SlabPool::allocate(capacity));
+    if (size_ > 0) {
+        std::memcpy(data, data_, size_);
+    }
+    SlabPool::release(data_, capacity_);
+    data_ = data;
+    capacity_ = capacity;
+}
@@ -0,0 +1,137 @@
+#ifndef SLABPOOL_H
+#define SLABPOOL_H
+
+#include <new>
+#include <utility>
+#include <vector>
+#include <cstddef> // For std::size_t
+
+// Counters for one size class, summed over every thread
+struct SlabClassStats {
+    std::size_t block_size;                // 0 for requests larger than the biggest class
+    unsigned long long hits;               // Served from a thread cache or the shared free list
+    unsigned long long misses;             // Went to the system allocator
+    unsigned long long in_use;             // Handed out and not yet released
+    unsigned long long cached;             // Free blocks held by thread caches right now
+    unsigned long long cached_high_water;  // Most free blocks each thread cache ever held, summed
+};
+
+// Size-class allocator for payloads and other per-message buffers.
+// Classes are powers of two from 128 bytes (control messages, command replies) up to 4 MB
+// (large video frames); bigger requests go straight to the system. Each thread keeps a
+// free list per class, so the hot path takes no lock. Blocks freed on another thread than
+// the one that allocated them (media fanned out across workers) land in that thread's
+// cache; once a cache holds more than its share, half of it moves to a shared list the
+// allocating thread refills from, a batch at a time.
+class SlabPool {
+public:
+    static const std::size_t CLASS_COUNT = 16;
+    static const std::size_t MIN_BLOCK_SIZE = 128;
+    static const std::size_t MAX_BLOCK_SIZE = MIN_BLOCK_SIZE << (CLASS_COUNT - 1);
+
+    // At least size bytes, aligned for any type; throws std::bad_alloc like operator new
+    static void* allocate(std::size_t size);
+    // size must be what the block was allocated with
+    static void release(void* block, std::size_t size);
+
+    // Bytes actually reserved for a request of size, or 0 if it bypasses the pool
+    static std::size_t block_size(std::size_t size);
+
+    // One entry per class, then one for oversized requests
+    static void stats(std::vector<SlabClassStats>& classes);
+};
+
+// std::allocator replacement drawing from SlabPool
+template <typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(std::size_t count) { return static_cast<T*>(SlabPool::allocate(count * sizeof(T))); }
+    void deallocate(T* pointer, std::size_t count) { SlabPool::release(pointer, count * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+// Growable byte buffer in pooled blocks, for payloads and serialized output. Used instead of
+// std::vector with PoolAllocator because vector copies element by element through a custom
+// allocator; this copies with memcpy and uses the whole block the class rounds up to.
+class PooledBytes {
+public:
+    typedef char* iterator;
+    typedef const char* const_iterator;
+
+    PooledBytes() : data_(nullptr), size_(0), capacity_(0) {}
+    ~PooledBytes() { SlabPool::release(data_, capacity_); }
+
+    PooledBytes(PooledBytes&& other) : data_(other.data_), size_(other.size_), capacity_(other.capacity_) {
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+    PooledBytes& operator=(PooledBytes&& other) {
+        swap(other);
+        return *this;
+    }
+
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    std::size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    char& operator[](std::size_t index) { return data_[index]; }
+    const char& operator[](std::size_t index) const { return data_[index]; }
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    void reserve(std::size_t capacity) {
+        if (capacity > capacity_) grow(capacity);
+    }
+    void clear() { size_ = 0; }
+    // Bytes past the old size are left uninitialized
+    void resize(std::size_t size) {
+        if (size > capacity_) grow(size);
+        size_ = size;
+    }
+
+    void push_back(char byte) {
+        if (size_ == capacity_) grow(size_ + 1);
+        data_[size_++] = byte;
+    }
+    void append(const char* bytes, std::size_t length);
+    void assign(const char* bytes, std::size_t length) {
+        size_ = 0;
+        append(bytes, length);
+    }
+    // Drops the first length bytes
+    void erase_front(std::size_t length);
+
+    void swap(PooledBytes& other) {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+private:
+    PooledBytes(const PooledBytes&);
+    PooledBytes& operator=(const PooledBytes&);
+
+    void grow(std::size_t needed);
+
+    char* data_;
+    std::size_t size_;
+    std::size_t capacity_;  // Size of the pooled block, which is what gets released
+};
+
+#endif // SLABPOOL_H
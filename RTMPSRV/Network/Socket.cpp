@@ -0,0 +1,211 @@
+#include "Socket.h"
+#include "ChunkCache.h"  // For ChunkSegment
+#include "Log.h"
+#include <cstring>
+
+#ifdef _WIN32
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#endif
+
+bool Socket::startup() {
+#ifdef _WIN32
+    WSADATA wsaData;
+    int result = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    if (result != 0) {
+        LOG_ERROR("[startup] WSAStartup failed with error: " << result);
+        return false;
+    }
+#endif
+    return true;
+}
+
+void Socket::cleanup() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+socket_t Socket::create_listener(int port, bool reuse_port) {
+    socket_t fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd == RTMP_INVALID_SOCKET) {
+        LOG_ERROR("[create_listener] Failed to create socket. Error: " << last_error());
+        return RTMP_INVALID_SOCKET;
+    }
+
+#ifndef _WIN32
+    // Allow quick restarts while old connections sit in TIME_WAIT
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+#endif
+
+#ifdef __linux__
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0) {
+        LOG_ERROR("[create_listener] Failed to enable SO_REUSEPORT. Error: " << last_error());
+        close(fd);
+        return RTMP_INVALID_SOCKET;
+    }
+#else
+    (void)reuse_port;
+#endif
+
+    // Bind to address
+    sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        LOG_ERROR("[create_listener] Bind failed. Error: " << last_error());
+        close(fd);
+        return RTMP_INVALID_SOCKET;
+    }
+
+    // Start listening
+    if (listen(fd, SOMAXCONN) != 0) {
+        LOG_ERROR("[create_listener] Listen failed. Error: " << last_error());
+        close(fd);
+        return RTMP_INVALID_SOCKET;
+    }
+
+    if (!set_non_blocking(fd)) {
+        LOG_ERROR("[create_listener] Failed to make listener non-blocking. Error: " << last_error());
+        close(fd);
+        return RTMP_INVALID_SOCKET;
+    }
+
+    return fd;
+}
+
+bool Socket::supports_reuse_port() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+socket_t Socket::accept(socket_t listener, std::string& client_ip) {
+    sockaddr_in client_address;
+#ifdef _WIN32
+    int client_len = sizeof(client_address);
+    socket_t fd = ::accept(listener, (sockaddr*)&client_address, &client_len);
+    if (fd != RTMP_INVALID_SOCKET && !set_non_blocking(fd)) {
+        close(fd);
+        return RTMP_INVALID_SOCKET;
+    }
+#else
+    socklen_t client_len = sizeof(client_address);
+    socket_t fd = accept4(listener, (sockaddr*)&client_address, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#endif
+    if (fd == RTMP_INVALID_SOCKET) {
+        return RTMP_INVALID_SOCKET;
+    }
+
+    char ip[INET_ADDRSTRLEN] = {0};
+    inet_ntop(AF_INET, &client_address.sin_addr, ip, sizeof(ip));
+    client_ip = ip;
+    return fd;
+}
+
+bool Socket::set_non_blocking(socket_t fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return false;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+void Socket::set_no_delay(socket_t fd) {
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(enable));
+}
+
+long Socket::recv(socket_t fd, char* buffer, std::size_t length) {
+#ifdef _WIN32
+    int result = ::recv(fd, buffer, static_cast<int>(length), 0);
+    return result == SOCKET_ERROR ? -1 : result;
+#else
+    return ::recv(fd, buffer, length, 0);
+#endif
+}
+
+long Socket::send(socket_t fd, const char* data, std::size_t length) {
+#ifdef _WIN32
+    int result = ::send(fd, data, static_cast<int>(length), 0);
+    return result == SOCKET_ERROR ? -1 : result;
+#else
+    return ::send(fd, data, length, MSG_NOSIGNAL);
+#endif
+}
+
+long Socket::send_segments(socket_t fd, const ChunkSegment* segments, std::size_t count) {
+    if (count > MAX_SEND_SEGMENTS) {
+        count = MAX_SEND_SEGMENTS;
+    }
+#ifdef _WIN32
+    WSABUF buffers[MAX_SEND_SEGMENTS];
+    for (std::size_t i = 0; i < count; ++i) {
+        buffers[i].buf = const_cast<char*>(segments[i].data);
+        buffers[i].len = static_cast<ULONG>(segments[i].length);
+    }
+    DWORD sent = 0;
+    if (WSASend(fd, buffers, static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+        return -1;
+    }
+    return static_cast<long>(sent);
+#else
+    iovec buffers[MAX_SEND_SEGMENTS];
+    for (std::size_t i = 0; i < count; ++i) {
+        buffers[i].iov_base = const_cast<char*>(segments[i].data);
+        buffers[i].iov_len = segments[i].length;
+    }
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = buffers;
+    message.msg_iovlen = count;
+    return ::sendmsg(fd, &message, MSG_NOSIGNAL);  // sendmsg rather than writev, for MSG_NOSIGNAL
+#endif
+}
+
+void Socket::close(socket_t fd) {
+#ifdef _WIN32
+    closesocket(fd);
+#else
+    ::close(fd);
+#endif
+}
+
+int Socket::last_error() {
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+bool Socket::would_block(int error) {
+#ifdef _WIN32
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+}
+
+bool Socket::interrupted(int error) {
+#ifdef _WIN32
+    return error == WSAEINTR;
+#else
+    return error == EINTR;
+#endif
+}
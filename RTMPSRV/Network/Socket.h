@@ -0,0 +1,54 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <cstddef> // For std::size_t
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define RTMP_INVALID_SOCKET INVALID_SOCKET
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+typedef int socket_t;
+#define RTMP_INVALID_SOCKET (-1)
+#endif
+
+struct ChunkSegment;
+
+// Thin portability layer over the platform socket API (Winsock / BSD sockets).
+// All sockets handed out by this class are non-blocking.
+class Socket {
+public:
+    static bool startup();   // WSAStartup on Windows, no-op elsewhere
+    static void cleanup();   // WSACleanup on Windows, no-op elsewhere
+
+    // With reuse_port each caller gets its own listener on the same port and the
+    // kernel balances incoming connections across them (SO_REUSEPORT, Linux only).
+    static socket_t create_listener(int port, bool reuse_port = false);
+    static bool supports_reuse_port();
+    static socket_t accept(socket_t listener, std::string& client_ip);
+
+    static bool set_non_blocking(socket_t fd);
+    static void set_no_delay(socket_t fd);
+
+    // Return the number of bytes transferred, or -1 on error (see last_error()).
+    static long recv(socket_t fd, char* buffer, std::size_t length);
+    static long send(socket_t fd, const char* data, std::size_t length);
+
+    // Sends several buffers with one call (sendmsg / WSASend); count is capped at MAX_SEND_SEGMENTS
+    static const std::size_t MAX_SEND_SEGMENTS = 512;
+    static long send_segments(socket_t fd, const ChunkSegment* segments, std::size_t count);
+
+    static void close(socket_t fd);
+
+    static int last_error();
+    static bool would_block(int error);
+    static bool interrupted(int error);
+};
+
+#endif // SOCKET_H
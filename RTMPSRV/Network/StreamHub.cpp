@@ -0,0 +1,301 @@
+#include "StreamHub.h"
+#include "Connection.h"
+#include "Log.h"
+#include <algorithm>
+
+Stream::Stream(const std::string& key, unsigned int worker_count, std::size_t gop_cache_limit)
+    : key_(key),
+      publisher_(nullptr),
+      player_count_(0),
+      players_per_worker_(new std::atomic<unsigned int>[worker_count]),
+      sequence_(0),
+      gop_bytes_(0),
+      gop_limit_(gop_cache_limit) {
+    for (unsigned int i = 0; i < worker_count; ++i) {
+        players_per_worker_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Stream::cache(const MediaPacketPtr& packet) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    if (packet->message_type_id == 0x12) {
+        metadata_ = packet;
+        return;
+    }
+    if (packet->is_sequence_header()) {
+        (packet->is_video() ? video_header_ : audio_header_) = packet;
+        return;
+    }
+    if (gop_limit_ == 0) {
+        return;
+    }
+
+    if (packet->is_keyframe()) {
+        clear_gop();
+    } else if (gop_.empty()) {
+        return;  // Nothing a player could decode until the next keyframe
+    }
+
+    std::size_t bytes = gop_bytes_.load(std::memory_order_relaxed) + packet->payload.size();
+    if (bytes > gop_limit_) {
+        // Dropping only the oldest frames would orphan the rest from their keyframe
+        LOG_WARN("[Stream::cache] GOP of '" << key_ << "' exceeds " << gop_limit_
+                  << " bytes, not caching it.");
+        clear_gop();
+        return;
+    }
+    gop_.push_back(packet);
+    gop_bytes_.store(bytes, std::memory_order_relaxed);
+}
+
+void Stream::clear_cache() {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    metadata_.reset();
+    video_header_.reset();
+    audio_header_.reset();
+    clear_gop();
+}
+
+void Stream::clear_gop() {
+    gop_.clear();
+    gop_bytes_.store(0, std::memory_order_relaxed);
+}
+
+unsigned long long Stream::initial_packets(std::vector<MediaPacketPtr>& packets) const {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    if (metadata_) packets.push_back(metadata_);
+    if (video_header_) packets.push_back(video_header_);
+    if (audio_header_) packets.push_back(audio_header_);
+    packets.insert(packets.end(), gop_.begin(), gop_.end());
+
+    unsigned long long last = 0;
+    for (size_t i = 0; i < packets.size(); ++i) {
+        last = std::max(last, packets[i]->sequence);
+    }
+    return last;
+}
+
+StreamFanout::StreamFanout() : tail_(&stub_), signaled_(false) {
+    stub_.next.store(nullptr, std::memory_order_relaxed);
+    head_.store(&stub_, std::memory_order_relaxed);
+}
+
+StreamFanout::~StreamFanout() {
+    while (InboxNode* node = pop()) {
+        delete node;
+    }
+}
+
+bool StreamFanout::init() {
+    return wakeup_.open();
+}
+
+void StreamFanout::add_player(Stream* stream, Connection* player) {
+    players_[stream].push_back(player);
+}
+
+void StreamFanout::remove_player(Stream* stream, Connection* player) {
+    auto entry = players_.find(stream);
+    if (entry == players_.end()) {
+        return;
+    }
+    std::vector<Connection*>& players = entry->second;
+    players.erase(std::remove(players.begin(), players.end(), player), players.end());
+    if (players.empty()) {
+        players_.erase(entry);
+    }
+}
+
+void StreamFanout::deliver(Stream* stream, const MediaPacketPtr& packet) {
+    auto entry = players_.find(stream);
+    if (entry == players_.end()) {
+        return;  // The last local player left after the packet was posted
+    }
+    const std::vector<Connection*>& players = entry->second;
+    for (size_t i = 0; i < players.size(); ++i) {
+        players[i]->send_media(packet);
+    }
+}
+
+void StreamFanout::post(const std::shared_ptr<Stream>& stream, const MediaPacketPtr& packet) {
+    InboxNode* node = new InboxNode();
+    node->stream = stream;
+    node->packet = packet;
+    push(node);
+
+    // One wakeup per drain is enough; the consumer clears the flag before draining
+    if (!signaled_.exchange(true, std::memory_order_acq_rel)) {
+        wakeup_.signal();
+    }
+}
+
+void StreamFanout::drain() {
+    if (!signaled_.load(std::memory_order_acquire)) {
+        return;
+    }
+    wakeup_.clear();
+    signaled_.store(false, std::memory_order_release);
+
+    while (InboxNode* node = pop()) {
+        deliver(node->stream.get(), node->packet);
+        delete node;
+    }
+}
+
+void StreamFanout::push(InboxNode* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    InboxNode* previous = head_.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+}
+
+StreamFanout::InboxNode* StreamFanout::pop() {
+    InboxNode* tail = tail_;
+    InboxNode* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+        tail_ = next;
+        return tail;
+    }
+
+    // tail is the last linked node; a producer may be between its exchange and its link,
+    // in which case it signals again once linked and we pick the node up next drain
+    if (tail != head_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+        tail_ = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+StreamHub::StreamHub(unsigned int worker_count, std::size_t gop_cache_limit)
+    : fanouts_(worker_count, nullptr),
+      gop_cache_limit_(gop_cache_limit) {}
+
+void StreamHub::attach(unsigned int worker, StreamFanout* fanout) {
+    fanouts_[worker] = fanout;
+}
+
+void StreamHub::add_sink(StreamSink* sink) {
+    sinks_.push_back(sink);
+}
+
+bool StreamHub::is_live(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = streams_.find(key);
+    return found != streams_.end() && found->second->publisher_ != nullptr;
+}
+
+std::shared_ptr<Stream> StreamHub::publish(const std::string& key, Connection* publisher) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::shared_ptr<Stream>& stream = streams_[key];
+    if (!stream) {
+        stream = std::make_shared<Stream>(key, worker_count(), gop_cache_limit_);
+    } else if (stream->publisher_ != nullptr) {
+        LOG_WARN("[StreamHub::publish] Stream '" << key << "' already has a publisher.");
+        return std::shared_ptr<Stream>();
+    }
+    stream->publisher_ = publisher;
+    LOG_INFO("[StreamHub::publish] Publishing '" << key << "' to " << stream->player_count_ << " waiting player(s).");
+    for (size_t i = 0; i < sinks_.size(); ++i) {
+        sinks_[i]->on_publish(*stream);
+    }
+    return stream;
+}
+
+void StreamHub::unpublish(const std::shared_ptr<Stream>& stream, Connection* publisher) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stream->publisher_ != publisher) {
+        return;
+    }
+    stream->publisher_ = nullptr;
+    LOG_INFO("[StreamHub::unpublish] Stream '" << stream->key() << "' unpublished.");
+    for (size_t i = 0; i < sinks_.size(); ++i) {
+        sinks_[i]->on_unpublish(*stream);
+    }
+
+    // Players stay attached and pick up the next publisher of the same name;
+    // its sequence headers and GOP replace these ones
+    stream->clear_cache();
+    release_if_idle(stream);
+}
+
+std::shared_ptr<Stream> StreamHub::play(const std::string& key, unsigned int worker, Connection* player) {
+    std::shared_ptr<Stream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<Stream>& entry = streams_[key];
+        if (!entry) {
+            entry = std::make_shared<Stream>(key, worker_count(), gop_cache_limit_);
+        }
+        entry->player_count_++;
+        stream = entry;
+    }
+
+    // List the player locally before publishing the count, so any packet the
+    // publisher sends because of the count finds it
+    fanouts_[worker]->add_player(stream.get(), player);
+    stream->players_per_worker_[worker].fetch_add(1, std::memory_order_release);
+    return stream;
+}
+
+void StreamHub::stop_playing(const std::shared_ptr<Stream>& stream, unsigned int worker, Connection* player) {
+    stream->players_per_worker_[worker].fetch_sub(1, std::memory_order_release);
+    fanouts_[worker]->remove_player(stream.get(), player);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stream->player_count_--;
+    release_if_idle(stream);
+}
+
+void StreamHub::broadcast(const std::shared_ptr<Stream>& stream, unsigned int from_worker, const MediaPacketPtr& packet) {
+    stream->cache(packet);
+    for (size_t i = 0; i < sinks_.size(); ++i) {
+        sinks_[i]->on_media(*stream, packet);
+    }
+
+    for (unsigned int worker = 0; worker < fanouts_.size(); ++worker) {
+        if (stream->players_on(worker) == 0) {
+            continue;
+        }
+        if (worker == from_worker) {
+            fanouts_[worker]->deliver(stream.get(), packet);
+        } else {
+            fanouts_[worker]->post(stream, packet);
+        }
+    }
+}
+
+std::size_t StreamHub::stream_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return streams_.size();
+}
+
+std::size_t StreamHub::gop_cache_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t total = 0;
+    for (auto& entry : streams_) {
+        total += entry.second->gop_cache_bytes();
+    }
+    return total;
+}
+
+void StreamHub::release_if_idle(const std::shared_ptr<Stream>& stream) {
+    if (stream->publisher_ != nullptr || stream->player_count_ > 0) {
+        return;
+    }
+    auto entry = streams_.find(stream->key());
+    if (entry != streams_.end() && entry->second == stream) {
+        streams_.erase(entry);
+    }
+}
@@ -0,0 +1,197 @@
+#ifndef STREAMHUB_H
+#define STREAMHUB_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ChunkCache.h"
+#include "SlabPool.h"
+#include "Wakeup.h"
+
+class Connection;
+
+// One audio (8), video (9) or data (18) message from a publisher.
+// Built once, never modified afterwards, and shared by every player through MediaPacketPtr.
+struct MediaPacket {
+    unsigned long long sequence;  // Position in the stream; lets a player skip what the GOP cache already sent
+    unsigned int timestamp;
+    unsigned char message_type_id;
+    unsigned long long ingest_ns;  // Metrics::now_ns() when the publisher's message was parsed
+    PooledBytes payload;
+    ChunkCache chunk_cache;  // Serialized forms, filled in by the first player that needs each one
+
+    // The message chunked the way a player with this chunk size and stream id receives it
+    const ChunkedMessage& chunked(std::size_t chunk_size, unsigned int csid,
+                                  unsigned int message_stream_id, bool& hit) const {
+        return chunk_cache.get(payload.data(), payload.size(), timestamp, message_type_id,
+                               chunk_size, csid, message_stream_id, hit);
+    }
+
+    // The message as an FLV tag, for HTTP-FLV viewers; the payload is referenced, not copied
+    const FlvTag& flv_tag(bool& hit) const {
+        return chunk_cache.flv_tag(payload.data(), payload.size(), timestamp, message_type_id, hit);
+    }
+
+    bool is_video() const { return message_type_id == 0x09; }
+    bool is_audio() const { return message_type_id == 0x08; }
+
+    // FLV video tag: frame type in the high nibble of the first byte
+    bool is_keyframe() const {
+        return is_video() && !payload.empty() && ((unsigned char)payload[0] >> 4) == 1;
+    }
+
+    // AVC/HEVC decoder configuration or AAC AudioSpecificConfig; players cannot decode without it
+    bool is_sequence_header() const {
+        if (payload.size() < 2 || payload[1] != 0) return false;
+        if (is_video()) {
+            unsigned char codec = (unsigned char)payload[0] & 0x0F;
+            return codec == 7 || codec == 12;
+        }
+        return is_audio() && ((unsigned char)payload[0] >> 4) == 10;
+    }
+};
+
+typedef std::shared_ptr<const MediaPacket> MediaPacketPtr;
+
+// A named stream ("app/name"): at most one publisher and any number of players on any worker.
+class Stream {
+public:
+    Stream(const std::string& key, unsigned int worker_count, std::size_t gop_cache_limit);
+
+    const std::string& key() const { return key_; }
+
+    // Publisher's worker: numbers packets in the order they are broadcast
+    unsigned long long next_sequence() { return sequence_.fetch_add(1, std::memory_order_relaxed) + 1; }
+
+    // Players attached on the given worker; read by the publisher's worker on every packet
+    unsigned int players_on(unsigned int worker) const {
+        return players_per_worker_[worker].load(std::memory_order_acquire);
+    }
+
+    // Publisher's worker, for every packet: keeps metadata, sequence headers and the
+    // current GOP (everything since the last keyframe) for players that join mid-stream.
+    // The cache holds the same packets the live path sends, so it costs no payload copies.
+    void cache(const MediaPacketPtr& packet);
+    void clear_cache();
+
+    // What a new player gets before live packets, in order; returns the highest sequence
+    // number included, so the player can drop live copies of the same packets
+    unsigned long long initial_packets(std::vector<MediaPacketPtr>& packets) const;
+
+    // Payload bytes of the cached GOP
+    std::size_t gop_cache_bytes() const { return gop_bytes_.load(std::memory_order_relaxed); }
+
+private:
+    friend class StreamHub;
+
+    void clear_gop();  // Caller holds cache_mutex_
+
+    std::string key_;
+    Connection* publisher_;      // Guarded by the hub mutex
+    unsigned int player_count_;  // Guarded by the hub mutex
+    std::unique_ptr<std::atomic<unsigned int>[]> players_per_worker_;
+    std::atomic<unsigned long long> sequence_;
+
+    mutable std::mutex cache_mutex_;
+    MediaPacketPtr metadata_;
+    MediaPacketPtr video_header_;
+    MediaPacketPtr audio_header_;
+    std::vector<MediaPacketPtr> gop_;  // Starts with a keyframe, or is empty
+    std::atomic<std::size_t> gop_bytes_;
+    std::size_t gop_limit_;
+};
+
+// Consumes every published stream besides its players: a recorder, a segmenter. Sinks are
+// added before the workers start. on_publish and on_unpublish run under the hub's lock and
+// on_media on the publisher's worker, for every packet, so implementations queue work for
+// their own threads instead of doing it here.
+class StreamSink {
+public:
+    virtual ~StreamSink() {}
+
+    virtual void on_publish(Stream& stream) = 0;
+    virtual void on_media(Stream& stream, const MediaPacketPtr& packet) = 0;
+    virtual void on_unpublish(Stream& stream) = 0;
+};
+
+// Worker-local half of the hub. Only the owning worker thread touches the player lists;
+// other workers hand it packets through a lock-free MPSC inbox and wake its event loop.
+class StreamFanout {
+public:
+    StreamFanout();
+    ~StreamFanout();
+
+    bool init();
+    Wakeup& wakeup() { return wakeup_; }
+
+    void add_player(Stream* stream, Connection* player);
+    void remove_player(Stream* stream, Connection* player);
+
+    // Owning worker: sends the packet to every local player of the stream
+    void deliver(Stream* stream, const MediaPacketPtr& packet);
+
+    // Any worker: queues the packet for this worker's players and wakes it if needed
+    void post(const std::shared_ptr<Stream>& stream, const MediaPacketPtr& packet);
+
+    // Owning worker, once per event loop iteration: delivers everything posted so far
+    void drain();
+
+private:
+    // Intrusive MPSC queue node (Vyukov); the stub keeps head and tail non-null
+    struct InboxNode {
+        std::atomic<InboxNode*> next;
+        std::shared_ptr<Stream> stream;  // Keeps the Stream, and so the players_ key, alive
+        MediaPacketPtr packet;
+    };
+
+    void push(InboxNode* node);
+    InboxNode* pop();
+
+    std::unordered_map<Stream*, std::vector<Connection*> > players_;
+
+    std::atomic<InboxNode*> head_;   // Producers swap themselves in here
+    InboxNode* tail_;                // Consumer side
+    InboxNode stub_;
+    std::atomic<bool> signaled_;     // A wakeup is pending, so further posts need not signal
+    Wakeup wakeup_;
+};
+
+// Registry of live streams shared by all workers. Publish/play/stop take a mutex;
+// the per-packet path (broadcast) only reads atomic per-worker player counts.
+class StreamHub {
+public:
+    StreamHub(unsigned int worker_count, std::size_t gop_cache_limit);
+
+    unsigned int worker_count() const { return static_cast<unsigned int>(fanouts_.size()); }
+    void attach(unsigned int worker, StreamFanout* fanout);  // During startup, before workers run
+    void add_sink(StreamSink* sink);                         // Likewise; the sink must outlive the workers
+
+    // Returns null when the stream already has a publisher
+    std::shared_ptr<Stream> publish(const std::string& key, Connection* publisher);
+    bool is_live(const std::string& key) const;  // Whether the stream has a publisher right now
+    void unpublish(const std::shared_ptr<Stream>& stream, Connection* publisher);
+
+    // Must be called on the player's own worker
+    std::shared_ptr<Stream> play(const std::string& key, unsigned int worker, Connection* player);
+    void stop_playing(const std::shared_ptr<Stream>& stream, unsigned int worker, Connection* player);
+
+    // Called on the publisher's worker for every media message
+    void broadcast(const std::shared_ptr<Stream>& stream, unsigned int from_worker, const MediaPacketPtr& packet);
+
+    std::size_t stream_count() const;
+    std::size_t gop_cache_bytes() const;  // Summed over all streams
+
+private:
+    void release_if_idle(const std::shared_ptr<Stream>& stream);  // Caller holds mutex_
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Stream> > streams_;
+    std::vector<StreamFanout*> fanouts_;
+    std::vector<StreamSink*> sinks_;
+    std::size_t gop_cache_limit_;
+};
+
+#endif // STREAMHUB_H
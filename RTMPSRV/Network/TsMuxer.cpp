@@ -0,0 +1,260 @@
+#include "TsMuxer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const unsigned char SYNC_BYTE = 0x47;
+const unsigned int PID_PAT = 0;
+const unsigned char STREAM_TYPE_H264 = 0x1B;
+const unsigned char STREAM_TYPE_AAC = 0x0F;     // ADTS
+const unsigned char STREAM_ID_VIDEO = 0xE0;
+const unsigned char STREAM_ID_AUDIO = 0xC0;
+const unsigned long long CLOCK_MASK = (1ull << 33) - 1;  // PTS, DTS and PCR base are 33 bits
+
+// CRC-32/MPEG-2 of PSI sections: polynomial 0x04C11DB7, not reflected, no final XOR
+struct CrcTable {
+    unsigned int values[256];
+
+    CrcTable() {
+        for (unsigned int i = 0; i < 256; ++i) {
+            unsigned int crc = i << 24;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04C11DB7u : crc << 1;
+            }
+            values[i] = crc;
+        }
+    }
+};
+
+unsigned int crc32(const unsigned char* data, std::size_t length) {
+    static const CrcTable table;
+    unsigned int crc = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < length; ++i) {
+        crc = (crc << 8) ^ table.values[((crc >> 24) ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+// prefix is 2 for PTS alone, 3 for PTS followed by DTS, 1 for that DTS
+unsigned char* write_timestamp(unsigned char* p, unsigned int prefix, unsigned long long value) {
+    value &= CLOCK_MASK;
+    p[0] = static_cast<unsigned char>((prefix << 4) | ((value >> 29) & 0x0E) | 1);
+    p[1] = static_cast<unsigned char>(value >> 22);
+    p[2] = static_cast<unsigned char>(((value >> 14) & 0xFE) | 1);
+    p[3] = static_cast<unsigned char>(value >> 7);
+    p[4] = static_cast<unsigned char>(((value << 1) & 0xFE) | 1);
+    return p + 5;
+}
+
+unsigned char* write_pcr(unsigned char* p, unsigned long long base) {
+    base &= CLOCK_MASK;
+    p[0] = static_cast<unsigned char>(base >> 25);
+    p[1] = static_cast<unsigned char>(base >> 17);
+    p[2] = static_cast<unsigned char>(base >> 9);
+    p[3] = static_cast<unsigned char>(base >> 1);
+    p[4] = static_cast<unsigned char>(((base & 1) << 7) | 0x7E);  // Reserved bits, extension high bit 0
+    p[5] = 0;
+    return p + 6;
+}
+
+unsigned char* grow(std::string& out, std::size_t length) {
+    std::size_t at = out.size();
+    out.resize(at + length);
+    return reinterpret_cast<unsigned char*>(&out[at]);
+}
+
+} // namespace
+
+bool TsMuxer::parse_aac_config(const char* data, std::size_t length, AacConfig& config) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    if (length < 2) {
+        return false;
+    }
+    config.object_type = p[0] >> 3;
+    config.frequency_index = ((p[0] & 0x07) << 1) | (p[1] >> 7);
+    config.channels = (p[1] >> 3) & 0x0F;
+    // Escaped object types and explicit sample rates have no ADTS equivalent
+    return config.object_type != 0 && config.object_type != 31 && config.frequency_index < 13;
+}
+
+void TsMuxer::write_adts_header(char* header, const AacConfig& config, std::size_t frame_length) {
+    // ADTS only has room for profiles 1-4; HE-AAC streams signal their SBR in-band over LC
+    unsigned int profile = config.object_type <= 4 ? config.object_type - 1 : 1;
+    std::size_t total = frame_length + ADTS_HEADER_SIZE;
+    header[0] = static_cast<char>(0xFF);
+    header[1] = static_cast<char>(0xF1);  // MPEG-4, no CRC
+    header[2] = static_cast<char>((profile << 6) | (config.frequency_index << 2) | ((config.channels >> 2) & 1));
+    header[3] = static_cast<char>(((config.channels & 3) << 6) | ((total >> 11) & 3));
+    header[4] = static_cast<char>(total >> 3);
+    header[5] = static_cast<char>(((total & 7) << 5) | 0x1F);
+    header[6] = static_cast<char>(0xFC);
+}
+
+TsMuxer::TsMuxer()
+    : video_(true),
+      audio_(true),
+      pat_counter_(0),
+      pmt_counter_(0),
+      video_counter_(0),
+      audio_counter_(0) {}
+
+void TsMuxer::set_tracks(bool video, bool audio) {
+    video_ = video;
+    audio_ = audio;
+}
+
+void TsMuxer::write_tables(std::string& out) {
+    unsigned char section[64];
+
+    // PAT: program 1 at PID_PMT
+    unsigned char* p = section;
+    *p++ = 0x00;                 // table_id
+    *p++ = 0xB0;                 // section_syntax_indicator, length below
+    *p++ = 13;
+    *p++ = 0x00; *p++ = 0x01;    // transport_stream_id
+    *p++ = 0xC1;                 // version 0, current
+    *p++ = 0x00; *p++ = 0x00;    // section_number, last_section_number
+    *p++ = 0x00; *p++ = 0x01;    // program_number
+    *p++ = static_cast<unsigned char>(0xE0 | (PID_PMT >> 8));
+    *p++ = static_cast<unsigned char>(PID_PMT & 0xFF);
+    write_section(out, PID_PAT, pat_counter_, section, p - section);
+
+    // PMT: the elementary streams, PCR on video when there is any
+    unsigned int pcr_pid = video_ || !audio_ ? PID_VIDEO : PID_AUDIO;
+    unsigned int streams = (video_ ? 1 : 0) + (audio_ ? 1 : 0);
+    p = section;
+    *p++ = 0x02;
+    *p++ = 0xB0;
+    *p++ = static_cast<unsigned char>(13 + 5 * streams);
+    *p++ = 0x00; *p++ = 0x01;    // program_number
+    *p++ = 0xC1;
+    *p++ = 0x00; *p++ = 0x00;
+    *p++ = static_cast<unsigned char>(0xE0 | (pcr_pid >> 8));
+    *p++ = static_cast<unsigned char>(pcr_pid & 0xFF);
+    *p++ = 0xF0; *p++ = 0x00;    // No program descriptors
+    if (video_) {
+        *p++ = STREAM_TYPE_H264;
+        *p++ = static_cast<unsigned char>(0xE0 | (PID_VIDEO >> 8));
+        *p++ = static_cast<unsigned char>(PID_VIDEO & 0xFF);
+        *p++ = 0xF0; *p++ = 0x00;
+    }
+    if (audio_) {
+        *p++ = STREAM_TYPE_AAC;
+        *p++ = static_cast<unsigned char>(0xE0 | (PID_AUDIO >> 8));
+        *p++ = static_cast<unsigned char>(PID_AUDIO & 0xFF);
+        *p++ = 0xF0; *p++ = 0x00;
+    }
+    write_section(out, PID_PMT, pmt_counter_, section, p - section);
+}
+
+void TsMuxer::write_video(std::string& out, unsigned long long dts_ms, int composition_offset_ms, bool keyframe,
+                          const char* data, std::size_t length) {
+    unsigned long long dts = dts_ms * 90 + TIMESTAMP_DELAY;
+    unsigned long long pts = dts + static_cast<long long>(composition_offset_ms) * 90;
+    write_pes(out, PID_VIDEO, video_counter_, STREAM_ID_VIDEO, pts, dts, true, keyframe, data, length);
+}
+
+void TsMuxer::write_audio(std::string& out, unsigned long long pts_ms, const char* data, std::size_t length) {
+    unsigned long long pts = pts_ms * 90 + TIMESTAMP_DELAY;
+    write_pes(out, PID_AUDIO, audio_counter_, STREAM_ID_AUDIO, pts, pts, !video_, !video_, data, length);
+}
+
+void TsMuxer::write_section(std::string& out, unsigned int pid, unsigned char& counter,
+                            const unsigned char* section, std::size_t length) {
+    unsigned char* p = grow(out, PACKET_SIZE);
+    p[0] = SYNC_BYTE;
+    p[1] = static_cast<unsigned char>(0x40 | (pid >> 8));  // payload_unit_start_indicator
+    p[2] = static_cast<unsigned char>(pid & 0xFF);
+    p[3] = static_cast<unsigned char>(0x10 | counter);
+    counter = (counter + 1) & 0x0F;
+    p[4] = 0;  // pointer_field
+    std::memcpy(p + 5, section, length);
+    unsigned int crc = crc32(section, length);
+    unsigned char* end = p + 5 + length;
+    end[0] = static_cast<unsigned char>(crc >> 24);
+    end[1] = static_cast<unsigned char>(crc >> 16);
+    end[2] = static_cast<unsigned char>(crc >> 8);
+    end[3] = static_cast<unsigned char>(crc);
+    std::memset(end + 4, 0xFF, p + PACKET_SIZE - (end + 4));
+}
+
+void TsMuxer::write_pes(std::string& out, unsigned int pid, unsigned char& counter, unsigned char stream_id,
+                        unsigned long long pts, unsigned long long dts, bool with_pcr, bool random_access,
+                        const char* data, std::size_t length) {
+    unsigned char header[19];
+    bool has_dts = dts != pts;
+    std::size_t header_data = has_dts ? 10 : 5;
+    std::size_t packet_length = 3 + header_data + length;  // After the length field
+    unsigned char* p = header;
+    *p++ = 0x00; *p++ = 0x00; *p++ = 0x01;
+    *p++ = stream_id;
+    // Video PES may leave the length open; audio ones fit in 16 bits
+    if (stream_id == STREAM_ID_VIDEO || packet_length > 0xFFFF) packet_length = 0;
+    *p++ = static_cast<unsigned char>(packet_length >> 8);
+    *p++ = static_cast<unsigned char>(packet_length);
+    *p++ = 0x84;  // data_alignment_indicator
+    *p++ = has_dts ? 0xC0 : 0x80;
+    *p++ = static_cast<unsigned char>(header_data);
+    p = write_timestamp(p, has_dts ? 3 : 2, pts);
+    if (has_dts) {
+        p = write_timestamp(p, 1, dts);
+    }
+    std::size_t header_length = p - header;
+
+    // Whole packets up front, so the loop below only fills them in
+    std::size_t total = header_length + length;
+    std::size_t first_payload = with_pcr || random_access ? PACKET_SIZE - 4 - (with_pcr ? 8 : 2) : PACKET_SIZE - 4;
+    std::size_t packets = 1 + (total > first_payload ? (total - first_payload + PACKET_SIZE - 5) / (PACKET_SIZE - 4) : 0);
+    out.reserve(out.size() + packets * PACKET_SIZE);
+
+    std::size_t written = 0;
+    bool first = true;
+    while (written < total) {
+        unsigned char* packet = grow(out, PACKET_SIZE);
+        packet[0] = SYNC_BYTE;
+        packet[1] = static_cast<unsigned char>((first ? 0x40 : 0) | (pid >> 8));
+        packet[2] = static_cast<unsigned char>(pid & 0xFF);
+        packet[3] = static_cast<unsigned char>(0x10 | counter);
+        counter = (counter + 1) & 0x0F;
+
+        // Adaptation field: PCR and random access on the first packet, stuffing on the last
+        std::size_t adaptation = first && (with_pcr || random_access) ? (with_pcr ? 8 : 2) : 0;
+        std::size_t payload = std::min(total - written, PACKET_SIZE - 4 - adaptation);
+        if (payload < PACKET_SIZE - 4 - adaptation) {
+            adaptation = PACKET_SIZE - 4 - payload;
+        }
+        unsigned char* at = packet + 4;
+        if (adaptation > 0) {
+            packet[3] |= 0x20;
+            at[0] = static_cast<unsigned char>(adaptation - 1);
+            if (adaptation > 1) {
+                unsigned char flags = 0;
+                unsigned char* field = at + 2;
+                if (first && random_access) flags |= 0x40;
+                if (first && with_pcr) {
+                    flags |= 0x10;
+                    field = write_pcr(field, dts - TIMESTAMP_DELAY);
+                }
+                at[1] = flags;
+                std::memset(field, 0xFF, at + adaptation - field);
+            }
+            at += adaptation;
+        }
+
+        // Copy from the PES header, then the data
+        std::size_t left = payload;
+        if (written < header_length) {
+            std::size_t piece = std::min(left, header_length - written);
+            std::memcpy(at, header + written, piece);
+            at += piece;
+            written += piece;
+            left -= piece;
+        }
+        if (left > 0) {
+            std::memcpy(at, data + (written - header_length), left);
+            written += left;
+        }
+        first = false;
+    }
+}
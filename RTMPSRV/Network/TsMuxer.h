@@ -0,0 +1,59 @@
+#ifndef TSMUXER_H
+#define TSMUXER_H
+
+#include <string>
+#include <cstddef> // For std::size_t
+
+// MPEG-TS for HLS: one program with H.264 video and AAC audio. Each segment starts with
+// PAT and PMT; every access unit becomes one PES, with PCR on the first packet of each
+// video PES (audio, for streams without video) and the random access flag on keyframes.
+// Timestamps go in as FLV milliseconds and are written on the 90 kHz clock, shifted by
+// TIMESTAMP_DELAY so PCR stays ahead of them as decoders expect.
+class TsMuxer {
+public:
+    static const std::size_t PACKET_SIZE = 188;
+    static const unsigned int PID_PMT = 0x1000;
+    static const unsigned int PID_VIDEO = 0x100;
+    static const unsigned int PID_AUDIO = 0x101;
+    static const unsigned long long TIMESTAMP_DELAY = 63000;  // 700 ms at 90 kHz
+
+    // AudioSpecificConfig, the AAC sequence header past its 2-byte FLV prefix
+    struct AacConfig {
+        unsigned int object_type;
+        unsigned int frequency_index;
+        unsigned int channels;
+    };
+    static const std::size_t ADTS_HEADER_SIZE = 7;
+
+    static bool parse_aac_config(const char* data, std::size_t length, AacConfig& config);
+    // The header that lets a raw AAC frame of frame_length bytes play on its own
+    static void write_adts_header(char* header, const AacConfig& config, std::size_t frame_length);
+
+    TsMuxer();
+
+    // Which streams the PMT lists; video also carries the PCR when present
+    void set_tracks(bool video, bool audio);
+
+    void write_tables(std::string& out);
+    // One Annex-B access unit
+    void write_video(std::string& out, unsigned long long dts_ms, int composition_offset_ms, bool keyframe,
+                     const char* data, std::size_t length);
+    // One or more ADTS frames, the first at pts_ms
+    void write_audio(std::string& out, unsigned long long pts_ms, const char* data, std::size_t length);
+
+private:
+    void write_section(std::string& out, unsigned int pid, unsigned char& counter,
+                       const unsigned char* section, std::size_t length);
+    void write_pes(std::string& out, unsigned int pid, unsigned char& counter, unsigned char stream_id,
+                   unsigned long long pts, unsigned long long dts, bool with_pcr, bool random_access,
+                   const char* data, std::size_t length);
+
+    bool video_;
+    bool audio_;
+    unsigned char pat_counter_;   // Continuity counters, per PID
+    unsigned char pmt_counter_;
+    unsigned char video_counter_;
+    unsigned char audio_counter_;
+};
+
+#endif // TSMUXER_H
@@ -0,0 +1,671 @@
+#include "UringBackend.h"
+#include "Connection.h"
+#include "Worker.h"
+#include "Metrics.h"
+#include "Log.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+static const unsigned int SQ_ENTRIES = 1024;
+static const unsigned int CQ_ENTRIES = 4096;    // Multishot recv can post many completions per submission
+static const unsigned int RECV_BUFFER_COUNT = 512;      // Power of two, as the buffer ring requires
+static const unsigned int RECV_BUFFER_SIZE = 4 * BUFFER_SIZE;
+static const unsigned short RECV_BUFFER_GROUP = 0;
+static const int WAIT_TIMEOUT_MS = 100;  // Bounds how long a stop() request goes unnoticed
+
+// Low bits of user_data say which operation completed; the rest is the Slot pointer
+static const unsigned long long OP_RECV = 1;
+static const unsigned long long OP_SEND = 2;
+static const unsigned long long OP_ACCEPT = 3;
+static const unsigned long long OP_WAKEUP = 4;
+static const unsigned long long OP_ACCEPT_HTTP = 5;
+static const unsigned long long OP_MASK = 7;
+
+static const unsigned long long OP_PROBE = ~0ULL;  // Only seen during init
+
+static int io_uring_setup(unsigned int entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete,
+                          unsigned int flags, void* arg, std::size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+static int io_uring_register(int ring_fd, unsigned int opcode, void* arg, unsigned int nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+UringBackend::UringBackend()
+    : listener_(RTMP_INVALID_SOCKET),
+      http_listener_(RTMP_INVALID_SOCKET),
+      worker_(nullptr),
+      stats_(nullptr),
+      ring_fd_(-1),
+      sq_ring_(nullptr),
+      sq_ring_size_(0),
+      sq_head_(nullptr),
+      sq_tail_(nullptr),
+      sq_mask_(nullptr),
+      sq_array_(nullptr),
+      sqes_(nullptr),
+      sqes_size_(0),
+      sq_entries_(0),
+      sq_local_tail_(0),
+      cq_ring_(nullptr),
+      cq_head_(nullptr),
+      cq_tail_(nullptr),
+      cq_mask_(nullptr),
+      cqes_(nullptr),
+      buf_ring_(nullptr),
+      buf_ring_size_(0),
+      buffers_(nullptr),
+      buf_local_tail_(0),
+      legacy_buffers_(false),
+      accept_armed_(false),
+      http_accept_armed_(false),
+      wakeup_armed_(false),
+      wakeup_value_(0) {}
+
+UringBackend::~UringBackend() {
+    teardown();
+}
+
+const char* UringBackend::name() const {
+    return "io_uring";
+}
+
+bool UringBackend::init(socket_t listener, Worker* worker) {
+    listener_ = listener;
+    http_listener_ = worker->http_listener();
+    worker_ = worker;
+    stats_ = &worker->stats();
+    handshake_deadlines_.set_timeout_ms(worker->handshake_timeout_ms());
+
+    // Multishot recv with provided buffer rings arrived in Linux 6.0
+    utsname info;
+    int major = 0, minor = 0;
+    if (uname(&info) != 0 || std::sscanf(info.release, "%d.%d", &major, &minor) != 2 || major < 6) {
+        LOG_ERROR("[UringBackend::init] Kernel too old for multishot recv.");
+        return false;
+    }
+
+    return setup_ring() && setup_buffer_ring();
+}
+
+bool UringBackend::setup_ring() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = CQ_ENTRIES;
+
+    ring_fd_ = io_uring_setup(SQ_ENTRIES, &params);
+    if (ring_fd_ < 0) {
+        LOG_ERROR("[UringBackend::init] io_uring_setup failed. Error: " << errno);
+        return false;
+    }
+
+    const unsigned int required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+        LOG_ERROR("[UringBackend::init] Kernel lacks required io_uring features.");
+        return false;
+    }
+
+    // Make sure every opcode we rely on is implemented
+    std::vector<char> probe_storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_storage.data());
+    if (io_uring_register(ring_fd_, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        LOG_ERROR("[UringBackend::init] io_uring probe failed. Error: " << errno);
+        return false;
+    }
+    const unsigned char needed_ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_READ };
+    for (size_t i = 0; i < sizeof(needed_ops); ++i) {
+        unsigned char op = needed_ops[i];
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            LOG_ERROR("[UringBackend::init] io_uring opcode " << (int)op << " not supported.");
+            return false;
+        }
+    }
+
+    // The SQ and CQ rings share one mapping (IORING_FEAT_SINGLE_MMAP)
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    std::size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (cq_ring_size > sq_ring_size_) sq_ring_size_ = cq_ring_size;
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        LOG_ERROR("[UringBackend::init] Failed to map rings. Error: " << errno);
+        return false;
+    }
+    cq_ring_ = sq_ring_;
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        LOG_ERROR("[UringBackend::init] Failed to map SQEs. Error: " << errno);
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    sq_local_tail_ = *sq_tail_;
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool UringBackend::setup_buffer_ring() {
+    buffers_ = new char[static_cast<size_t>(RECV_BUFFER_COUNT) * RECV_BUFFER_SIZE];
+
+    buf_ring_size_ = RECV_BUFFER_COUNT * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        LOG_ERROR("[UringBackend::init] Failed to allocate buffer ring. Error: " << errno);
+        return false;
+    }
+    buf_ring_ = static_cast<io_uring_buf_ring*>(ring);
+
+    io_uring_buf_reg registration;
+    std::memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<unsigned long long>(buf_ring_);
+    registration.ring_entries = RECV_BUFFER_COUNT;
+    registration.bgid = RECV_BUFFER_GROUP;
+    if (io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &registration, 1) == 0) {
+        for (unsigned int i = 0; i < RECV_BUFFER_COUNT; ++i) {
+            recycle_buffer(static_cast<unsigned short>(i));
+        }
+        if (probe_buffer_select()) {
+            return true;
+        }
+
+        // Some virtualized kernels accept the registration but never hand out its buffers
+        io_uring_register(ring_fd_, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+    }
+    munmap(buf_ring_, buf_ring_size_);
+    buf_ring_ = nullptr;
+
+    // Fall back to handing buffers over with IORING_OP_PROVIDE_BUFFERS (Linux 5.7+);
+    // one submission covers the whole contiguous pool
+    LOG_WARN("[UringBackend::init] Buffer ring unusable, providing receive buffers by SQE instead.");
+    legacy_buffers_ = true;
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = RECV_BUFFER_COUNT;
+    sqe->addr = reinterpret_cast<unsigned long long>(buffers_);
+    sqe->len = RECV_BUFFER_SIZE;
+    sqe->off = 0;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    submit_and_wait(1, WAIT_TIMEOUT_MS);
+    drain_completions();
+
+    if (!probe_buffer_select()) {
+        LOG_ERROR("[UringBackend::init] Kernel cannot select receive buffers.");
+        return false;
+    }
+    return true;
+}
+
+bool UringBackend::probe_buffer_select() {
+    // Receive one byte over a socketpair and check that it landed in one of our buffers
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        return false;
+    }
+    char byte = 0x03;
+    bool selected = false;
+    if (write(pair[1], &byte, 1) == 1) {
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = pair[0];
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECV_BUFFER_GROUP;
+        sqe->user_data = OP_PROBE;
+        submit_and_wait(1, 1000);
+
+        unsigned int head = *cq_head_;
+        unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe cqe = cqes_[head & *cq_mask_];
+            ++head;
+            if (cqe.user_data == OP_PROBE && cqe.res == 1 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                selected = true;
+                recycle_buffer(static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    close(pair[0]);
+    close(pair[1]);
+    return selected;
+}
+
+void UringBackend::teardown() {
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+    if (sqes_ != nullptr) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (sq_ring_ != nullptr) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+        cq_ring_ = nullptr;
+    }
+    if (buf_ring_ != nullptr) {
+        munmap(buf_ring_, buf_ring_size_);
+        buf_ring_ = nullptr;
+    }
+    delete[] buffers_;
+    buffers_ = nullptr;
+
+    pending_flush_.clear();
+    closing_.clear();
+    slots_.clear();
+}
+
+io_uring_sqe* UringBackend::get_sqe() {
+    unsigned int head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sq_local_tail_ - head >= sq_entries_) {
+        // Queue full: hand what we have to the kernel without waiting
+        submit_and_wait(0, 0);
+        head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sq_local_tail_ - head >= sq_entries_) {
+            return nullptr;
+        }
+    }
+
+    unsigned int index = sq_local_tail_ & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++sq_local_tail_;
+    return sqe;
+}
+
+int UringBackend::submit_and_wait(unsigned int wait_for, int timeout_ms) {
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    unsigned int to_submit = sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (to_submit == 0 && wait_for == 0) {
+        return 0;
+    }
+
+    __kernel_timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<unsigned long long>(&timeout);
+
+    unsigned int flags = IORING_ENTER_EXT_ARG;
+    if (wait_for > 0) flags |= IORING_ENTER_GETEVENTS;
+
+    int result = io_uring_enter(ring_fd_, to_submit, wait_for, flags, &arg, sizeof(arg));
+    if (result < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+        LOG_ERROR("[UringBackend] io_uring_enter failed. Error: " << errno);
+    }
+    return result;
+}
+
+void UringBackend::recycle_buffer(unsigned short buffer_id) {
+    if (legacy_buffers_) {
+        // Never lose a buffer to a full SQ: the pool would shrink for good
+        if (!unreturned_buffers_.empty() || !provide_buffer(buffer_id)) {
+            unreturned_buffers_.push_back(buffer_id);
+        }
+        return;
+    }
+
+    io_uring_buf* buffer = &buf_ring_->bufs[buf_local_tail_ & (RECV_BUFFER_COUNT - 1)];
+    buffer->addr = reinterpret_cast<unsigned long long>(buffers_ + static_cast<size_t>(buffer_id) * RECV_BUFFER_SIZE);
+    buffer->len = RECV_BUFFER_SIZE;
+    buffer->bid = buffer_id;
+    ++buf_local_tail_;
+    __atomic_store_n(&buf_ring_->tail, buf_local_tail_, __ATOMIC_RELEASE);
+}
+
+bool UringBackend::provide_buffer(unsigned short buffer_id) {
+    io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = reinterpret_cast<unsigned long long>(buffers_ + static_cast<size_t>(buffer_id) * RECV_BUFFER_SIZE);
+    sqe->len = RECV_BUFFER_SIZE;
+    sqe->off = buffer_id;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    return true;  // user_data 0: the completion is ignored
+}
+
+void UringBackend::return_buffers() {
+    std::size_t returned = 0;
+    while (returned < unreturned_buffers_.size() && provide_buffer(unreturned_buffers_[returned])) {
+        ++returned;
+    }
+    unreturned_buffers_.erase(unreturned_buffers_.begin(), unreturned_buffers_.begin() + returned);
+}
+
+void UringBackend::arm_accept(bool http) {
+    io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr) return;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = http ? http_listener_ : listener_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = http ? OP_ACCEPT_HTTP : OP_ACCEPT;
+    (http ? http_accept_armed_ : accept_armed_) = true;
+}
+
+void UringBackend::arm_wakeup() {
+    io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr) {
+        return;  // Still unarmed, so the next loop iteration tries again
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = worker_->fanout().wakeup().fd();
+    sqe->addr = reinterpret_cast<unsigned long long>(&wakeup_value_);
+    sqe->len = sizeof(wakeup_value_);
+    sqe->off = static_cast<unsigned long long>(-1);  // Current position; eventfds are not seekable
+    sqe->user_data = OP_WAKEUP;
+    wakeup_armed_ = true;
+}
+
+void UringBackend::arm_recv(Slot* slot) {
+    io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr) {
+        begin_close(slot);
+        return;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = slot->conn->fd();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->user_data = reinterpret_cast<unsigned long long>(slot) | OP_RECV;
+    slot->recv_armed = true;
+}
+
+void UringBackend::submit_send(Slot* slot) {
+    if (slot->send_inflight || slot->closing) {
+        return;  // One send at a time keeps the byte stream ordered
+    }
+
+    ChunkSegment segments[Socket::MAX_SEND_SEGMENTS];
+    std::size_t count = slot->conn->pin_output(segments, Socket::MAX_SEND_SEGMENTS);
+    if (count == 0) {
+        return;
+    }
+
+    io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr) {
+        begin_close(slot);
+        return;
+    }
+
+    slot->sending.resize(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        slot->sending[i].iov_base = const_cast<char*>(segments[i].data);
+        slot->sending[i].iov_len = segments[i].length;
+    }
+    std::memset(&slot->message, 0, sizeof(slot->message));
+    slot->message.msg_iov = slot->sending.data();
+    slot->message.msg_iovlen = count;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = slot->conn->fd();
+    sqe->addr = reinterpret_cast<unsigned long long>(&slot->message);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<unsigned long long>(slot) | OP_SEND;
+    slot->send_inflight = true;
+}
+
+void UringBackend::run(const std::atomic<bool>& running) {
+    arm_accept(false);
+    if (http_listener_ != RTMP_INVALID_SOCKET) arm_accept(true);
+    arm_wakeup();
+
+    while (running) {
+        // Sends prepared at the end of the previous batch are submitted with this wait
+        submit_and_wait(1, WAIT_TIMEOUT_MS);
+        drain_completions();
+
+        worker_->fanout().drain();
+        worker_->vod().run();
+        flush_pending();
+        expire_handshakes();
+        if (!accept_armed_) arm_accept(false);
+        if (!http_accept_armed_ && http_listener_ != RTMP_INVALID_SOCKET) arm_accept(true);
+        if (!wakeup_armed_) arm_wakeup();
+        if (!unreturned_buffers_.empty()) return_buffers();
+        reap_closed();
+    }
+
+    // Shut every socket down and wait for the kernel to release our buffers before unmapping them
+    LOG_INFO("[UringBackend::run] Closing " << slots_.size() << " client connections.");
+    for (auto& entry : slots_) {
+        begin_close(entry.second.get());
+    }
+    for (int attempt = 0; attempt < 20 && !closing_.empty(); ++attempt) {
+        submit_and_wait(1, WAIT_TIMEOUT_MS);
+        drain_completions();
+        reap_closed();
+    }
+    teardown();
+}
+
+void UringBackend::drain_completions() {
+    unsigned int head = *cq_head_;
+    unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        io_uring_cqe cqe = cqes_[head & *cq_mask_];
+        ++head;
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        handle_completion(&cqe);
+    }
+}
+
+void UringBackend::handle_completion(const io_uring_cqe* cqe) {
+    if (cqe->user_data == 0 || cqe->user_data == OP_PROBE) {
+        return;  // Buffer hand-overs and init probes need no follow-up
+    }
+
+    unsigned long long op = cqe->user_data & OP_MASK;
+    Slot* slot = reinterpret_cast<Slot*>(cqe->user_data & ~OP_MASK);
+
+    switch (op) {
+        case OP_ACCEPT:
+        case OP_ACCEPT_HTTP:
+            handle_accept(cqe->res, (cqe->flags & IORING_CQE_F_MORE) != 0, op == OP_ACCEPT_HTTP);
+            break;
+        case OP_RECV:
+            handle_recv(slot, cqe->res, cqe->flags);
+            break;
+        case OP_SEND:
+            handle_send(slot, cqe->res);
+            break;
+        case OP_WAKEUP:
+            wakeup_armed_ = false;  // The fan-out drains right after this batch
+            break;
+        default:
+            break;
+    }
+}
+
+void UringBackend::handle_accept(int result, bool more, bool http) {
+    if (!more) {
+        (http ? http_accept_armed_ : accept_armed_) = false;  // Re-armed at the end of this batch
+    }
+    if (result < 0) {
+        if (result != -EAGAIN && result != -EINTR && result != -ECANCELED) {
+            LOG_ERROR("[UringBackend] Failed to accept connection. Error: " << -result);
+        }
+        return;
+    }
+
+    socket_t client_socket = result;
+    std::string client_ip;
+    sockaddr_in client_address;
+    socklen_t client_len = sizeof(client_address);
+    if (getpeername(client_socket, (sockaddr*)&client_address, &client_len) == 0) {
+        char ip[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &client_address.sin_addr, ip, sizeof(ip));
+        client_ip = ip;
+    }
+
+    Socket::set_no_delay(client_socket);
+    stats_->connections_accepted.fetch_add(1, std::memory_order_relaxed);
+    LOG_INFO("[UringBackend] New client connected from " << client_ip);
+
+    Slot* slot = new Slot();
+    slot->conn.reset(new Connection(client_socket, client_ip, this, worker_, http));
+    slot->recv_armed = false;
+    slot->send_inflight = false;
+    slot->closing = false;
+    slots_[client_socket].reset(slot);
+    handshake_deadlines_.add(client_socket, slot->conn->accepted_ns());
+
+    arm_recv(slot);
+}
+
+void UringBackend::handle_recv(Slot* slot, int result, unsigned int flags) {
+    bool more = (flags & IORING_CQE_F_MORE) != 0;
+    if (!more) {
+        slot->recv_armed = false;
+    }
+
+    if (result > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        unsigned short buffer_id = static_cast<unsigned short>(flags >> IORING_CQE_BUFFER_SHIFT);
+        bool keep_open = slot->closing ||
+                         slot->conn->on_data(buffers_ + static_cast<size_t>(buffer_id) * RECV_BUFFER_SIZE, result);
+        recycle_buffer(buffer_id);
+
+        if (!keep_open) {
+            begin_close(slot);
+        } else if (!more && !slot->closing) {
+            arm_recv(slot);
+        }
+        return;
+    }
+
+    if (result == -ENOBUFS && !slot->closing) {
+        // Buffers are recycled as soon as they are parsed, so just retry, after any the SQ
+        // had no room for
+        return_buffers();
+        arm_recv(slot);
+        return;
+    }
+
+    if (!slot->closing) {
+        if (result == 0) {
+            LOG_INFO("[UringBackend] Client from IP: " << slot->conn->client_ip() << " disconnected.");
+        } else if (result != -ECANCELED) {
+            LOG_WARN("[UringBackend] Error receiving data from client IP: " << slot->conn->client_ip()
+                      << ", error: " << -result);
+        }
+    }
+    begin_close(slot);
+}
+
+void UringBackend::handle_send(Slot* slot, int result) {
+    slot->send_inflight = false;
+    if (result < 0) {
+        if (!slot->closing) {
+            LOG_WARN("[UringBackend] Send failed for client IP: " << slot->conn->client_ip() << ", error: " << -result);
+        }
+        begin_close(slot);
+        return;
+    }
+
+    if (!slot->conn->complete_output(result)) {
+        begin_close(slot);
+        return;
+    }
+    submit_send(slot);  // Remainder of a short write, or output queued meanwhile
+}
+
+void UringBackend::request_flush(Connection* conn) {
+    pending_flush_.push_back(conn);
+}
+
+void UringBackend::flush_pending() {
+    for (size_t i = 0; i < pending_flush_.size(); ++i) {
+        auto found = slots_.find(pending_flush_[i]->fd());
+        if (found == slots_.end()) continue;
+
+        Slot* slot = found->second.get();
+        if (slot->conn->is_closed()) {
+            begin_close(slot);
+        } else {
+            submit_send(slot);
+        }
+    }
+    pending_flush_.clear();
+}
+
+void UringBackend::expire_handshakes() {
+    if (handshake_deadlines_.empty()) {
+        return;
+    }
+    unsigned long long now = Metrics::now_ns();
+    socket_t fd;
+    while (handshake_deadlines_.pop_expired(now, fd)) {
+        auto found = slots_.find(fd);
+        if (found == slots_.end()) {
+            continue;
+        }
+        Slot* slot = found->second.get();
+        if (!slot->closing && slot->conn->handshake_expired(now, handshake_deadlines_.timeout_ns())) {
+            LOG_WARN("[UringBackend] Handshake timed out for client IP: " << slot->conn->client_ip());
+            stats_->handshake_timeouts.fetch_add(1, std::memory_order_relaxed);
+            begin_close(slot);
+        }
+    }
+}
+
+void UringBackend::begin_close(Slot* slot) {
+    if (slot->closing) {
+        return;
+    }
+    slot->closing = true;
+    slot->conn->close();
+
+    // Wakes the multishot recv and any pending send; the slot is freed once both have completed
+    shutdown(slot->conn->fd(), SHUT_RDWR);
+    closing_.push_back(slot);
+}
+
+void UringBackend::reap_closed() {
+    size_t kept = 0;
+    for (size_t i = 0; i < closing_.size(); ++i) {
+        Slot* slot = closing_[i];
+        if (slot->recv_armed || slot->send_inflight) {
+            closing_[kept++] = slot;
+            continue;
+        }
+        slots_.erase(slot->conn->fd());
+    }
+    closing_.resize(kept);
+}
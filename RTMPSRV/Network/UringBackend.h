@@ -0,0 +1,115 @@
+#ifndef URINGBACKEND_H
+#define URINGBACKEND_H
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "IOBackend.h"
+#include "HandshakeDeadlines.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+// Completion-based backend on raw io_uring (Linux 6.0+):
+//   - one multishot accept on the listener, and one on the worker's HTTP listener if any
+//   - one multishot recv per connection, filled from a registered provided-buffer ring
+//     (or from IORING_OP_PROVIDE_BUFFERS where buffer ring registration does not take effect)
+//   - sends queued during a batch are submitted together with the next io_uring_enter(),
+//     one sendmsg per connection gathering straight from its output queue
+//   - a read on the worker's fan-out eventfd ends the wait when another worker posts packets
+// init() fails when the kernel lacks any of these, and the caller falls back to epoll.
+class UringBackend : public IOBackend {
+public:
+    UringBackend();
+    ~UringBackend();
+
+    bool init(socket_t listener, Worker* worker) override;
+    void run(const std::atomic<bool>& running) override;
+    void request_flush(Connection* conn) override;
+    const char* name() const override;
+
+private:
+    // Backend-side state of one accepted socket
+    struct Slot {
+        std::unique_ptr<Connection> conn;
+        std::vector<iovec> sending;  // Pinned output handed to the kernel, stable until the send completes
+        msghdr message;
+        bool recv_armed;
+        bool send_inflight;
+        bool closing;
+    };
+
+    bool setup_ring();
+    bool setup_buffer_ring();
+    bool probe_buffer_select();
+    void teardown();
+
+    io_uring_sqe* get_sqe();
+    int submit_and_wait(unsigned int wait_for, int timeout_ms);
+
+    void arm_accept(bool http);
+    void arm_wakeup();
+    void arm_recv(Slot* slot);
+    void submit_send(Slot* slot);
+    void recycle_buffer(unsigned short buffer_id);
+    bool provide_buffer(unsigned short buffer_id);  // Legacy mode; false when the SQ is full
+    void return_buffers();                          // Retries what provide_buffer() could not return
+
+    void drain_completions();
+    void handle_completion(const io_uring_cqe* cqe);
+    void handle_accept(int result, bool more, bool http);
+    void handle_recv(Slot* slot, int result, unsigned int flags);
+    void handle_send(Slot* slot, int result);
+
+    void begin_close(Slot* slot);
+    void flush_pending();
+    void expire_handshakes();
+    void reap_closed();
+
+    socket_t listener_;
+    socket_t http_listener_;
+    Worker* worker_;
+    WorkerStats* stats_;
+    int ring_fd_;
+
+    // Submission queue
+    void* sq_ring_;
+    std::size_t sq_ring_size_;
+    unsigned int* sq_head_;
+    unsigned int* sq_tail_;
+    unsigned int* sq_mask_;
+    unsigned int* sq_array_;
+    io_uring_sqe* sqes_;
+    std::size_t sqes_size_;
+    unsigned int sq_entries_;
+    unsigned int sq_local_tail_;
+
+    // Completion queue
+    void* cq_ring_;
+    unsigned int* cq_head_;
+    unsigned int* cq_tail_;
+    unsigned int* cq_mask_;
+    io_uring_cqe* cqes_;
+
+    // Provided receive buffers
+    io_uring_buf_ring* buf_ring_;
+    std::size_t buf_ring_size_;
+    char* buffers_;
+    unsigned short buf_local_tail_;
+    bool legacy_buffers_;
+    std::vector<unsigned short> unreturned_buffers_;  // Legacy mode: ids still to hand back to the kernel
+
+    bool accept_armed_;
+    bool http_accept_armed_;
+    bool wakeup_armed_;
+    unsigned long long wakeup_value_;  // eventfd read target while the wakeup read is in flight
+    std::unordered_map<socket_t, std::unique_ptr<Slot>> slots_;
+    std::vector<Connection*> pending_flush_;
+    std::vector<Slot*> closing_;
+    HandshakeDeadlines handshake_deadlines_;
+};
+
+#endif // URINGBACKEND_H
@@ -0,0 +1,366 @@
+#include "VodFile.h"
+#include "Flv.h"
+#include "Log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Sidecar index layout, in host byte order: it is a cache for this machine, not an
+// interchange format, and a header that does not match is simply rebuilt
+const char INDEX_MAGIC[8] = { 'F', 'L', 'V', 'I', 'D', 'X', '1', 0 };
+
+struct IndexHeader {
+    char magic[8];
+    unsigned long long file_size;
+    long long modified;
+    unsigned long long data_start;
+    unsigned long long data_end;
+    unsigned long long metadata_offset;
+    unsigned long long video_header_offset;
+    unsigned long long audio_header_offset;
+    unsigned int last_timestamp;
+    unsigned int keyframes;
+};
+
+struct IndexEntry {
+    unsigned long long offset;
+    unsigned int timestamp;
+    unsigned int reserved;
+};
+
+bool file_status(const std::string& path, unsigned long long& size, long long& modified) {
+#ifdef _WIN32
+    struct _stat64 status;
+    if (_stat64(path.c_str(), &status) != 0 || (status.st_mode & _S_IFREG) == 0) return false;
+#else
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) return false;
+#endif
+    size = static_cast<unsigned long long>(status.st_size);
+    modified = static_cast<long long>(status.st_mtime);
+    return true;
+}
+
+// AVC/HEVC decoder configuration rather than a frame
+bool is_video_config(const char* body, std::size_t size) {
+    unsigned char codec = static_cast<unsigned char>(body[0]) & 0x0F;
+    return size >= 2 && (codec == 7 || codec == 12) && body[1] == 0;
+}
+
+// Mapped files by path. Entries expire with their last player; a file that changed on
+// disk since it was mapped gets a new mapping, and players of the old one keep theirs.
+std::mutex open_files_mutex;
+std::unordered_map<std::string, std::weak_ptr<const VodFile> > open_files;
+
+} // namespace
+
+VodFile::VodFile()
+    : data_(nullptr),
+      size_(0),
+      modified_(0),
+#ifdef _WIN32
+      mapping_(nullptr),
+#endif
+      data_start_(0),
+      data_end_(0),
+      last_timestamp_(0),
+      metadata_offset_(0),
+      video_header_offset_(0),
+      audio_header_offset_(0) {}
+
+VodFile::~VodFile() {
+    if (!data_) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+#else
+    munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+std::shared_ptr<const VodFile> VodFile::open(const std::string& path) {
+    unsigned long long size;
+    long long modified;
+    if (!file_status(path, size, modified)) {
+        return std::shared_ptr<const VodFile>();
+    }
+    {
+        std::lock_guard<std::mutex> lock(open_files_mutex);
+        auto found = open_files.find(path);
+        if (found != open_files.end()) {
+            std::shared_ptr<const VodFile> file = found->second.lock();
+            if (file && file->size_ == size && file->modified_ == modified) {
+                return file;
+            }
+        }
+    }
+
+    // Mapped and indexed without the lock; two first viewers racing here both build the
+    // index and the later one's mapping replaces the other's in the table
+    std::shared_ptr<VodFile> file(new VodFile());
+    if (!file->map(path)) {
+        return std::shared_ptr<const VodFile>();
+    }
+    if (!file->load_index()) {
+        file->build_index();
+        file->save_index();
+    }
+    LOG_INFO("[VodFile] Opened " << path << ": " << file->size_ << " bytes, " << file->keyframes_.size()
+             << " keyframe(s), " << file->last_timestamp_ / 1000.0 << " s.");
+
+    std::lock_guard<std::mutex> lock(open_files_mutex);
+    for (auto it = open_files.begin(); it != open_files.end();) {
+        it = it->second.expired() ? open_files.erase(it) : ++it;
+    }
+    open_files[path] = file;
+    return file;
+}
+
+bool VodFile::resolve(const std::string& directory, const std::string& app, const std::string& name,
+                      std::string& path) {
+    std::string base = name.compare(0, 4, "flv:") == 0 ? name.substr(4) : name;
+    std::string folders[2] = { app, std::string() };
+    for (int i = 0; i < 2; ++i) {
+        const std::string& part = i == 0 ? app : base;
+        if (part.find("..") != std::string::npos || part.find('\\') != std::string::npos ||
+            part.find(':') != std::string::npos || (!part.empty() && part[0] == '/')) {
+            return false;
+        }
+    }
+    if (base.empty()) {
+        return false;
+    }
+    std::size_t slash = base.rfind('/');
+    if (base.find('.', slash == std::string::npos ? 0 : slash) == std::string::npos) {
+        base += ".flv";
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        if (i == 0 && app.empty()) {
+            continue;
+        }
+        std::string candidate = directory + "/" + (folders[i].empty() ? "" : folders[i] + "/") + base;
+        unsigned long long size;
+        long long modified;
+        if (file_status(candidate, size, modified)) {
+            path = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VodFile::map(const std::string& path) {
+    path_ = path;
+    unsigned long long size;
+    if (!file_status(path, size, modified_) || size < Flv::FILE_HEADER_SIZE) {
+        return false;
+    }
+    size_ = static_cast<std::size_t>(size);
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    mapping_ = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(handle);  // The mapping keeps the file open
+    if (!mapping_) {
+        return false;
+    }
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, size_));
+    if (!data_) {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+        return false;
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    void* mapped = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // The mapping keeps the file open
+    if (mapped == MAP_FAILED) {
+        LOG_WARN("[VodFile] Cannot map " << path << ", error: " << errno);
+        return false;
+    }
+    data_ = static_cast<const char*>(mapped);
+#endif
+
+    // Signature, then the header size, which is where PreviousTagSize0 and the tags start
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(data_);
+    unsigned long long header_size = (static_cast<unsigned long long>(header[5]) << 24) | (header[6] << 16) |
+                                     (header[7] << 8) | header[8];
+    if (std::memcmp(data_, "FLV", 3) != 0 || header_size < 9 || header_size + Flv::TAG_TRAILER_SIZE > size_) {
+        LOG_WARN("[VodFile] " << path << " is not an FLV file.");
+        return false;
+    }
+    data_start_ = header_size + Flv::TAG_TRAILER_SIZE;
+    data_end_ = size_;
+    return true;
+}
+
+bool VodFile::tag_at(unsigned long long offset, Tag& tag) const {
+    if (offset < data_start_ || offset + Flv::TAG_HEADER_SIZE > data_end_) {
+        return false;
+    }
+    Flv::read_tag_header(data_ + offset, tag.type, tag.size, tag.timestamp);
+    tag.next = offset + Flv::TAG_OVERHEAD + tag.size;
+    if (tag.next > data_end_) {
+        return false;
+    }
+    tag.body = data_ + offset + Flv::TAG_HEADER_SIZE;
+    return true;
+}
+
+unsigned long long VodFile::seek(unsigned int ms, unsigned int& timestamp) const {
+    Keyframe target = { ms, 0 };
+    std::vector<Keyframe>::const_iterator after = std::upper_bound(
+        keyframes_.begin(), keyframes_.end(), target,
+        [](const Keyframe& a, const Keyframe& b) { return a.timestamp < b.timestamp; });
+    if (after - keyframes_.begin() > 1) {
+        timestamp = (after - 1)->timestamp;
+        return (after - 1)->offset;
+    }
+
+    // From the top, headers and all
+    Tag first;
+    timestamp = tag_at(data_start_, first) ? first.timestamp : 0;
+    return data_start_;
+}
+
+void VodFile::prefetch(unsigned long long offset, std::size_t length) const {
+#ifdef _WIN32
+    (void)offset;
+    (void)length;
+#else
+    static const unsigned long long PAGE = 4096;
+    if (offset >= size_) {
+        return;
+    }
+    unsigned long long start = offset & ~(PAGE - 1);
+    unsigned long long end = std::min<unsigned long long>(offset + length, size_);
+    madvise(const_cast<char*>(data_) + start, static_cast<std::size_t>(end - start), MADV_WILLNEED);
+#endif
+}
+
+void VodFile::build_index() {
+    keyframes_.clear();
+    metadata_offset_ = video_header_offset_ = audio_header_offset_ = 0;
+    last_timestamp_ = 0;
+
+    unsigned long long offset = data_start_;
+    Tag tag;
+    while (tag_at(offset, tag)) {
+        if (tag.type == Flv::TAG_VIDEO && tag.size > 0) {
+            if (is_video_config(tag.body, tag.size)) {
+                if (video_header_offset_ == 0) video_header_offset_ = offset;
+            } else if ((static_cast<unsigned char>(tag.body[0]) >> 4) == 1) {
+                Keyframe keyframe = { tag.timestamp, offset };
+                keyframes_.push_back(keyframe);
+            }
+        } else if (tag.type == Flv::TAG_AUDIO && tag.size >= 2) {
+            if ((static_cast<unsigned char>(tag.body[0]) >> 4) == 10 && tag.body[1] == 0 && audio_header_offset_ == 0) {
+                audio_header_offset_ = offset;
+            }
+        } else if (tag.type == Flv::TAG_SCRIPT && metadata_offset_ == 0) {
+            metadata_offset_ = offset;
+        }
+        last_timestamp_ = std::max(last_timestamp_, tag.timestamp);
+        offset = tag.next;
+    }
+    data_end_ = offset;  // A recording cut short ends at its last whole tag
+}
+
+bool VodFile::load_index() {
+    std::FILE* in = std::fopen((path_ + ".idx").c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    IndexHeader header;
+    bool valid = std::fread(&header, sizeof(header), 1, in) == 1 &&
+                 std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+                 header.file_size == size_ && header.modified == modified_ &&
+                 header.data_start == data_start_ && header.data_end <= size_ &&
+                 header.keyframes <= size_ / Flv::TAG_OVERHEAD;
+    if (valid) {
+        std::vector<IndexEntry> entries(header.keyframes);
+        valid = entries.empty() || std::fread(&entries[0], sizeof(IndexEntry), entries.size(), in) == entries.size();
+        keyframes_.clear();
+        for (std::size_t i = 0; valid && i < entries.size(); ++i) {
+            valid = entries[i].offset >= data_start_ && entries[i].offset < header.data_end &&
+                    (i == 0 || entries[i].offset > entries[i - 1].offset);
+            Keyframe keyframe = { entries[i].timestamp, entries[i].offset };
+            keyframes_.push_back(keyframe);
+        }
+    }
+    std::fclose(in);
+    if (!valid) {
+        keyframes_.clear();
+        return false;
+    }
+    data_end_ = header.data_end;
+    metadata_offset_ = header.metadata_offset;
+    video_header_offset_ = header.video_header_offset;
+    audio_header_offset_ = header.audio_header_offset;
+    last_timestamp_ = header.last_timestamp;
+    return true;
+}
+
+void VodFile::save_index() const {
+    IndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.file_size = size_;
+    header.modified = modified_;
+    header.data_start = data_start_;
+    header.data_end = data_end_;
+    header.metadata_offset = metadata_offset_;
+    header.video_header_offset = video_header_offset_;
+    header.audio_header_offset = audio_header_offset_;
+    header.last_timestamp = last_timestamp_;
+    header.keyframes = static_cast<unsigned int>(keyframes_.size());
+
+    std::vector<IndexEntry> entries(keyframes_.size());
+    for (std::size_t i = 0; i < keyframes_.size(); ++i) {
+        entries[i].offset = keyframes_[i].offset;
+        entries[i].timestamp = keyframes_[i].timestamp;
+        entries[i].reserved = 0;
+    }
+
+    // Written aside and renamed into place, so a reader never sees half an index
+    std::string index_path = path_ + ".idx";
+    std::string temporary = index_path + ".tmp";
+    std::FILE* out = std::fopen(temporary.c_str(), "wb");
+    if (!out) {
+        LOG_DEBUG("[VodFile] Cannot save the index of " << path_ << "; it is rebuilt on every open.");
+        return;
+    }
+    bool written = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+                   (entries.empty() || std::fwrite(&entries[0], sizeof(IndexEntry), entries.size(), out) == entries.size());
+    written = std::fclose(out) == 0 && written;
+#ifdef _WIN32
+    std::remove(index_path.c_str());
+#endif
+    if (!written || std::rename(temporary.c_str(), index_path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef VODFILE_H
+#define VODFILE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef> // For std::size_t
+
+// An FLV file mapped read-only into memory, for video on demand. Players send tags
+// straight out of the mapping, so every viewer of a file on every worker shares the
+// page cache instead of keeping read buffers of its own. The first open scans the file
+// once for keyframes and saves what it found next to it as "<file>.idx"; later opens,
+// in this process or the next, load that instead, as long as the file has not changed.
+// Once open the object is never modified, so any thread may read it. A file may grow
+// while it is played, as a recording does, but must not be truncated or rewritten.
+class VodFile {
+public:
+    struct Tag {
+        unsigned char type;      // Flv::TAG_AUDIO, TAG_VIDEO or TAG_SCRIPT
+        unsigned int timestamp;
+        const char* body;        // Inside the mapping
+        std::size_t size;
+        unsigned long long next; // Offset of the tag after this one
+    };
+
+    ~VodFile();
+
+    // Shares the mapping with anyone else playing the same, unchanged file.
+    // Returns null when the file cannot be mapped or is not FLV.
+    static std::shared_ptr<const VodFile> open(const std::string& path);
+
+    // Finds the file "play" names under directory: "<app>/<name>" first, then "<name>",
+    // with ".flv" added when the name has no extension and an "flv:" prefix dropped.
+    // Names that could leave the directory are refused.
+    static bool resolve(const std::string& directory, const std::string& app, const std::string& name,
+                        std::string& path);
+
+    const std::string& path() const { return path_; }
+    unsigned long long data_start() const { return data_start_; }  // First tag
+    unsigned int duration_ms() const { return last_timestamp_; }
+    std::size_t keyframe_count() const { return keyframes_.size(); }
+
+    // The tag at offset; false at the end of the file or on a tag cut short
+    bool tag_at(unsigned long long offset, Tag& tag) const;
+
+    // Where playback from ms starts: the last keyframe at or before it, by binary search
+    // over the index. Before the first keyframe, that is the first tag.
+    unsigned long long seek(unsigned int ms, unsigned int& timestamp) const;
+
+    // Metadata and decoder configuration, for playback that starts past them; 0 = none
+    unsigned long long metadata_offset() const { return metadata_offset_; }
+    unsigned long long video_header_offset() const { return video_header_offset_; }
+    unsigned long long audio_header_offset() const { return audio_header_offset_; }
+
+    // Asks the kernel to start reading a range that is about to be sent
+    void prefetch(unsigned long long offset, std::size_t length) const;
+
+private:
+    struct Keyframe {
+        unsigned int timestamp;
+        unsigned long long offset;
+    };
+
+    VodFile();
+    VodFile(const VodFile&);
+    VodFile& operator=(const VodFile&);
+
+    bool map(const std::string& path);
+    void build_index();
+    bool load_index();
+    void save_index() const;
+
+    std::string path_;
+    const char* data_;
+    std::size_t size_;
+    long long modified_;            // Modification time, to tell a changed file from the one indexed
+#ifdef _WIN32
+    void* mapping_;
+#endif
+
+    unsigned long long data_start_;
+    unsigned long long data_end_;   // End of the last complete tag
+    unsigned int last_timestamp_;
+    unsigned long long metadata_offset_;
+    unsigned long long video_header_offset_;
+    unsigned long long audio_header_offset_;
+    std::vector<Keyframe> keyframes_;  // In file order, so in timestamp order too
+};
+
+#endif // VODFILE_H
@@ -0,0 +1,135 @@
+#include "VodSession.h"
+#include "Connection.h"
+#include "Flv.h"
+#include "Metrics.h"
+#include "ParseAMF.h"
+#include "ParseControl.h"
+#include "Log.h"
+
+void VodScheduler::schedule(VodSession* session, unsigned long long due_ns) {
+    cancel(session);
+    session->due_ = queue_.insert(Queue::value_type(due_ns, session));
+    session->scheduled_ = true;
+}
+
+void VodScheduler::cancel(VodSession* session) {
+    if (session->scheduled_) {
+        queue_.erase(session->due_);
+        session->scheduled_ = false;
+    }
+}
+
+void VodScheduler::run() {
+    if (queue_.empty()) {
+        return;
+    }
+    // Sessions always reschedule themselves later than now, so this ends
+    unsigned long long now = Metrics::now_ns();
+    while (!queue_.empty() && queue_.begin()->first <= now) {
+        VodSession* session = queue_.begin()->second;
+        queue_.erase(queue_.begin());
+        session->scheduled_ = false;
+        session->pump(now);
+    }
+}
+
+VodSession::VodSession(Connection& conn, VodScheduler& scheduler, const std::shared_ptr<const VodFile>& file,
+                       unsigned int start_ms, long long duration_ms)
+    : conn_(conn),
+      scheduler_(scheduler),
+      file_(file),
+      prefetched_until_(0),
+      has_end_(duration_ms >= 0),
+      end_timestamp_(0),
+      clock_start_ns_(Metrics::now_ns()),
+      paused_ns_(0),
+      started_(false),
+      finished_(false),
+      scheduled_(false) {
+    offset_ = file_->seek(start_ms, base_timestamp_);
+    if (has_end_) {
+        end_timestamp_ = static_cast<unsigned long long>(base_timestamp_) + duration_ms;
+    }
+    // First tags go out with the rest of this loop iteration's output
+    scheduler_.schedule(this, clock_start_ns_);
+}
+
+VodSession::~VodSession() {
+    scheduler_.cancel(this);
+}
+
+void VodSession::pause(bool paused) {
+    if (finished_ || paused == (paused_ns_ != 0)) {
+        return;
+    }
+    unsigned long long now = Metrics::now_ns();
+    if (paused) {
+        paused_ns_ = now;
+        scheduler_.cancel(this);
+    } else {
+        clock_start_ns_ += now - paused_ns_;  // The clock stood still meanwhile
+        paused_ns_ = 0;
+        scheduler_.schedule(this, now);
+    }
+}
+
+void VodSession::pump(unsigned long long now_ns) {
+    if (finished_ || paused_ns_ != 0 || conn_.is_closed()) {
+        return;
+    }
+    if (!started_) {
+        // Larger chunks make nearly every tag a single chunk, sent as a header and a
+        // slice of the mapping with nothing copied
+        if (conn_.out_chunk_size() < ParseControl::MAX_OUT_CHUNK_SIZE) {
+            ParseControl::send_set_chunk_size(conn_, ParseControl::MAX_OUT_CHUNK_SIZE);
+        }
+        if (offset_ != file_->data_start()) {
+            unsigned long long headers[] = { file_->metadata_offset(), file_->video_header_offset(),
+                                             file_->audio_header_offset() };
+            for (int i = 0; i < 3; ++i) {
+                if (headers[i] != 0) send_tag(headers[i], base_timestamp_);
+            }
+        }
+        started_ = true;
+    }
+
+    unsigned long long horizon = base_timestamp_ + (now_ns - clock_start_ns_) / 1000000 + LEAD_MS;
+    VodFile::Tag tag;
+    while (true) {
+        if (conn_.queued_bytes() >= QUEUE_LIMIT) {
+            scheduler_.schedule(this, now_ns + RETRY_MS * 1000000ull);
+            break;
+        }
+        if (!file_->tag_at(offset_, tag) || (has_end_ && tag.timestamp > end_timestamp_)) {
+            finish();
+            break;
+        }
+        if (tag.timestamp > horizon) {
+            unsigned long long due_ms = tag.timestamp - base_timestamp_ - LEAD_MS;
+            scheduler_.schedule(this, clock_start_ns_ + due_ms * 1000000ull);
+            break;
+        }
+        send_tag(offset_, tag.timestamp);
+        offset_ = tag.next;
+    }
+
+    // Let the kernel read ahead of the next tags while the socket drains these
+    if (!finished_ && offset_ + PREFETCH_BYTES / 2 > prefetched_until_) {
+        file_->prefetch(offset_, PREFETCH_BYTES);
+        prefetched_until_ = offset_ + PREFETCH_BYTES;
+    }
+}
+
+void VodSession::send_tag(unsigned long long offset, unsigned int timestamp) {
+    VodFile::Tag tag;
+    if (file_->tag_at(offset, tag) && Flv::is_tag_type(tag.type)) {
+        conn_.send_mapped_media(file_, timestamp, tag.type, tag.body, tag.size);
+    }
+}
+
+void VodSession::finish() {
+    finished_ = true;
+    LOG_INFO("[VodSession] Finished playing " << file_->path() << " to " << conn_.client_ip() << ".");
+    ParseControl::send_stream_eof(conn_, conn_.media_stream_id());
+    ParseAMF::send_on_status(conn_, conn_.media_stream_id(), "status", "NetStream.Play.Stop", "Stopped playing.");
+}
@@ -0,0 +1,79 @@
+#ifndef VODSESSION_H
+#define VODSESSION_H
+
+#include <map>
+#include <memory>
+#include <cstddef> // For std::size_t
+#include "VodFile.h"
+
+class Connection;
+class VodSession;
+
+// Worker-local timers for VOD players: each session is due again once its next tag comes
+// within its lead. The backends run this once per loop iteration; they wake at least every
+// 100 ms, far more often than a lead of seconds needs.
+class VodScheduler {
+public:
+    typedef std::multimap<unsigned long long, VodSession*> Queue;
+
+    bool empty() const { return queue_.empty(); }
+
+    // Replaces any earlier time the session was due
+    void schedule(VodSession* session, unsigned long long due_ns);
+    void cancel(VodSession* session);
+
+    // Pumps every session that is due
+    void run();
+
+private:
+    Queue queue_;
+};
+
+// A player of a VodFile. Tags are queued in file order from the mapping itself, each once
+// the playback clock is within LEAD_MS of its timestamp, and never while more than
+// QUEUE_LIMIT of output is waiting for the socket. Playback that starts past the first
+// keyframe gets the file's metadata and decoder configuration first.
+class VodSession {
+public:
+    static const unsigned int LEAD_MS = 2000;            // Buffer the player builds at the start and keeps
+    static const std::size_t QUEUE_LIMIT = 512 * 1024;   // Output after which we wait for the socket
+    static const unsigned int RETRY_MS = 20;             // How soon to look again after that
+    static const std::size_t PREFETCH_BYTES = 1024 * 1024;
+
+    // Plays from the last keyframe at or before start_ms; a negative duration_ms plays to the end
+    VodSession(Connection& conn, VodScheduler& scheduler, const std::shared_ptr<const VodFile>& file,
+               unsigned int start_ms, long long duration_ms);
+    ~VodSession();
+
+    void pause(bool paused);
+    bool finished() const { return finished_; }
+
+private:
+    friend class VodScheduler;
+
+    VodSession(const VodSession&);
+    VodSession& operator=(const VodSession&);
+
+    void pump(unsigned long long now_ns);
+    void send_tag(unsigned long long offset, unsigned int timestamp);
+    void finish();
+
+    Connection& conn_;
+    VodScheduler& scheduler_;
+    std::shared_ptr<const VodFile> file_;
+
+    unsigned long long offset_;           // Next tag to send
+    unsigned long long prefetched_until_;
+    unsigned int base_timestamp_;         // Media time at which playback started
+    bool has_end_;
+    unsigned long long end_timestamp_;    // With has_end_, tags past this are not sent
+    unsigned long long clock_start_ns_;   // When media time base_timestamp_ was due, shifted by pauses
+    unsigned long long paused_ns_;        // 0 unless paused
+    bool started_;                        // Chunk size announced and, when seeking, headers sent
+    bool finished_;
+
+    bool scheduled_;                      // Kept by VodScheduler
+    VodScheduler::Queue::iterator due_;
+};
+
+#endif // VODSESSION_H
@@ -0,0 +1,93 @@
+#include "Wakeup.h"
+#include "Log.h"
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+Wakeup::Wakeup() : read_fd_(RTMP_INVALID_SOCKET), write_fd_(RTMP_INVALID_SOCKET) {}
+
+Wakeup::~Wakeup() {
+#ifdef __linux__
+    if (read_fd_ >= 0) {
+        ::close(read_fd_);
+    }
+#else
+    if (read_fd_ != RTMP_INVALID_SOCKET) Socket::close(read_fd_);
+    if (write_fd_ != RTMP_INVALID_SOCKET) Socket::close(write_fd_);
+#endif
+}
+
+bool Wakeup::open() {
+#ifdef __linux__
+    read_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (read_fd_ < 0) {
+        LOG_ERROR("[Wakeup::open] eventfd failed. Error: " << errno);
+        return false;
+    }
+    write_fd_ = read_fd_;
+    return true;
+#else
+    // Connect a socket to a throwaway loopback listener and keep both ends
+    socket_t listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == RTMP_INVALID_SOCKET) {
+        LOG_ERROR("[Wakeup::open] Failed to create socket. Error: " << Socket::last_error());
+        return false;
+    }
+
+    sockaddr_in address;
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t address_length = sizeof(address);
+
+    bool ok = bind(listener, (sockaddr*)&address, sizeof(address)) == 0 &&
+              listen(listener, 1) == 0 &&
+              getsockname(listener, (sockaddr*)&address, &address_length) == 0;
+    if (ok) {
+        write_fd_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        ok = write_fd_ != RTMP_INVALID_SOCKET &&
+             connect(write_fd_, (sockaddr*)&address, sizeof(address)) == 0;
+    }
+    if (ok) {
+        read_fd_ = ::accept(listener, nullptr, nullptr);
+        ok = read_fd_ != RTMP_INVALID_SOCKET &&
+             Socket::set_non_blocking(read_fd_) &&
+             Socket::set_non_blocking(write_fd_);
+    }
+    Socket::close(listener);
+
+    if (!ok) {
+        LOG_ERROR("[Wakeup::open] Failed to connect loopback socket pair. Error: " << Socket::last_error());
+        return false;
+    }
+    Socket::set_no_delay(write_fd_);
+    return true;
+#endif
+}
+
+void Wakeup::signal() {
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t written = write(write_fd_, &one, sizeof(one));
+    (void)written;  // Only fails when the counter is already saturated, which still wakes the loop
+#else
+    char byte = 1;
+    Socket::send(write_fd_, &byte, 1);  // A full socket buffer means a wakeup is already pending
+#endif
+}
+
+void Wakeup::clear() {
+#ifdef __linux__
+    uint64_t count;
+    ssize_t result = read(read_fd_, &count, sizeof(count));
+    (void)result;
+#else
+    char drain[64];
+    while (Socket::recv(read_fd_, drain, sizeof(drain)) > 0) {
+    }
+#endif
+}
@@ -0,0 +1,29 @@
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+#include "Socket.h"
+
+// Lets any thread interrupt a worker's event loop while it waits for I/O.
+// The worker watches fd() for readability next to its sockets.
+// Linux uses an eventfd; other platforms a connected loopback socket pair,
+// since WSAPoll only accepts sockets.
+class Wakeup {
+public:
+    Wakeup();
+    ~Wakeup();
+
+    bool open();
+    socket_t fd() const { return read_fd_; }
+
+    void signal();  // Any thread
+    void clear();   // Owning worker, once fd() reported readable
+
+private:
+    Wakeup(const Wakeup&);
+    Wakeup& operator=(const Wakeup&);
+
+    socket_t read_fd_;
+    socket_t write_fd_;
+};
+
+#endif // WAKEUP_H
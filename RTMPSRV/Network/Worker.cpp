@@ -0,0 +1,117 @@
+#include "Worker.h"
+#include "Reactor.h"
+#ifdef RTMP_HAVE_IO_URING
+#include "UringBackend.h"
+#endif
+#include "Log.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+Worker::Worker(unsigned int id)
+    : id_(id),
+      listener_(RTMP_INVALID_SOCKET),
+      owns_listener_(false),
+      http_listener_(RTMP_INVALID_SOCKET),
+      owns_http_listener_(false),
+      hls_(nullptr),
+      hub_(nullptr),
+      chunk_size_(ServerConfig().chunk_size),
+      ack_window_(ServerConfig().ack_window),
+      handshake_timeout_ms_(ServerConfig().handshake_timeout_ms) {}
+
+Worker::~Worker() {
+    join();
+    backend_.reset();
+    if (owns_listener_ && listener_ != RTMP_INVALID_SOCKET) {
+        Socket::close(listener_);
+    }
+    if (owns_http_listener_ && http_listener_ != RTMP_INVALID_SOCKET) {
+        Socket::close(http_listener_);
+    }
+}
+
+void Worker::set_http(socket_t listener, bool owns_listener, const HlsStore* hls) {
+    http_listener_ = listener;
+    owns_http_listener_ = owns_listener;
+    hls_ = hls;
+}
+
+bool Worker::attach(const ServerConfig& config, StreamHub* hub) {
+    hub_ = hub;
+    backpressure_ = config.backpressure;
+    chunk_size_ = config.chunk_size;
+    ack_window_ = config.ack_window;
+    handshake_timeout_ms_ = config.handshake_timeout_ms;
+    vod_dir_ = config.vod_dir;
+
+    if (!fanout_.init()) {
+        LOG_ERROR("[Worker " << id_ << "] Failed to create fan-out wakeup.");
+        return false;
+    }
+    hub_->attach(id_, &fanout_);
+    return true;
+}
+
+bool Worker::init(socket_t listener, bool owns_listener, const ServerConfig& config, StreamHub* hub) {
+    listener_ = listener;
+    owns_listener_ = owns_listener;
+    if (!attach(config, hub)) {
+        return false;
+    }
+
+    if (config.backend == ServerConfig::BACKEND_IO_URING) {
+#ifdef RTMP_HAVE_IO_URING
+        backend_.reset(new UringBackend());
+        if (backend_->init(listener_, this)) {
+            return true;
+        }
+        LOG_WARN("[Worker " << id_ << "] io_uring is not usable on this kernel, falling back to epoll.");
+#else
+        LOG_WARN("[Worker " << id_ << "] Built without io_uring support, falling back to epoll.");
+#endif
+    }
+
+    backend_.reset(new Reactor());
+    if (!backend_->init(listener_, this)) {
+        LOG_ERROR("[Worker " << id_ << "] Failed to initialize " << backend_->name() << " backend.");
+        backend_.reset();
+        return false;
+    }
+    return true;
+}
+
+const char* Worker::backend_name() const {
+    return backend_ ? backend_->name() : "none";
+}
+
+void Worker::run(const std::atomic<bool>& running) {
+    backend_->run(running);
+}
+
+void Worker::spawn(const std::atomic<bool>& running, bool pin_to_cpu) {
+    thread_ = std::thread([this, &running]() {
+        run(running);
+    });
+
+#ifdef __linux__
+    if (pin_to_cpu) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(id_ % CPU_SETSIZE, &cpus);
+        if (pthread_setaffinity_np(thread_.native_handle(), sizeof(cpus), &cpus) != 0) {
+            LOG_ERROR("[Worker " << id_ << "] Failed to pin thread to CPU " << id_);
+        }
+    }
+#else
+    (void)pin_to_cpu;
+#endif
+}
+
+void Worker::join() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "Socket.h"
+#include "IOBackend.h"
+#include "HlsStore.h"
+#include "Metrics.h"
+#include "ServerConfig.h"
+#include "StreamHub.h"
+#include "VodSession.h"
+
+// Counters written only by the owning worker thread and read by anyone.
+// Each worker keeps its own copy, padded by a cache line on either side so nothing is shared
+// on the hot path; alignas would not do, as new ignores extended alignment before C++17.
+// The metrics endpoint sums them over all workers on every scrape.
+struct WorkerStats {
+    char leading_padding[64];
+    std::atomic<unsigned long long> connections_accepted;
+    std::atomic<unsigned long long> connections_open;
+    std::atomic<unsigned long long> handshake_failures;  // Closed before the handshake completed
+    std::atomic<unsigned long long> messages_received;
+    std::atomic<unsigned long long> messages_by_type[MESSAGE_TYPE_SLOTS + 1];  // See Metrics::message_type_slot
+    std::atomic<unsigned long long> bytes_received;
+    std::atomic<unsigned long long> bytes_sent;
+    std::atomic<unsigned long long> send_queue_bytes;    // Queued output of this worker's connections
+    std::atomic<unsigned long long> chunk_cache_hits;    // Media sent from an already serialized form
+    std::atomic<unsigned long long> chunk_cache_misses;  // Media this worker had to serialize
+    std::atomic<unsigned long long> chunk_header_bytes_saved;  // Against sending everything in 128-byte chunks
+    std::atomic<unsigned long long> acks_sent;           // Acknowledgements for client input
+    std::atomic<unsigned long long> send_window_stalls;  // Times output waited for a client's acknowledgement
+    std::atomic<unsigned long long> handshake_timeouts;  // Connections dropped for not finishing the handshake
+    std::atomic<unsigned long long> media_dropped;       // Packets a slow player skipped or had purged
+    std::atomic<unsigned long long> slow_disconnects;    // Players closed for exceeding the send queue limit
+    std::atomic<unsigned long long> vod_players;         // Connections playing a file
+    std::atomic<unsigned long long> vod_bytes;           // Media queued for them straight from mapped files
+    std::atomic<unsigned long long> http_requests;       // Answered on HTTP connections, errors included
+    std::atomic<unsigned long long> http_flv_players;    // HTTP connections playing a live stream
+    LatencyHistogram handshake_time;                     // Accept to C2
+    LatencyHistogram delivery_latency;                   // Media parsed on any worker to written by this one
+    char trailing_padding[64];
+
+    WorkerStats()
+        : connections_accepted(0),
+          connections_open(0),
+          handshake_failures(0),
+          messages_received(0),
+          bytes_received(0),
+          bytes_sent(0),
+          send_queue_bytes(0),
+          chunk_cache_hits(0),
+          chunk_cache_misses(0),
+          chunk_header_bytes_saved(0),
+          acks_sent(0),
+          send_window_stalls(0),
+          handshake_timeouts(0),
+          media_dropped(0),
+          slow_disconnects(0),
+          vod_players(0),
+          vod_bytes(0),
+          http_requests(0),
+          http_flv_players(0) {
+        for (unsigned int i = 0; i <= MESSAGE_TYPE_SLOTS; ++i) {
+            messages_by_type[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// One accept/serve loop: a listening socket, an event loop and the connections it accepted.
+// With SO_REUSEPORT every worker binds its own listener and the kernel spreads new
+// connections across them, so workers never hand connections to each other.
+class Worker {
+public:
+    explicit Worker(unsigned int id);
+    ~Worker();
+
+    // Serves HTTP on a second listener as well, with HLS from hls when it is not null.
+    // Called before init().
+    void set_http(socket_t listener, bool owns_listener, const HlsStore* hls);
+    // With owns_listener the worker closes the listener when it goes away, even if init fails
+    bool init(socket_t listener, bool owns_listener, const ServerConfig& config, StreamHub* hub);
+    // The part of init() that joins the hub; enough for connections driven without a
+    // listener or event loop, as the benchmarks do
+    bool attach(const ServerConfig& config, StreamHub* hub);
+    void run(const std::atomic<bool>& running);  // Blocks until running is cleared
+    void spawn(const std::atomic<bool>& running, bool pin_to_cpu);
+    void join();
+
+    unsigned int id() const { return id_; }
+    const WorkerStats& stats() const { return stats_; }
+    WorkerStats& stats() { return stats_; }
+    StreamHub& hub() { return *hub_; }
+    StreamFanout& fanout() { return fanout_; }
+    const BackpressurePolicy& backpressure() const { return backpressure_; }
+    std::size_t chunk_size() const { return chunk_size_; }
+    unsigned int ack_window() const { return ack_window_; }
+    unsigned int handshake_timeout_ms() const { return handshake_timeout_ms_; }
+    const std::string& vod_dir() const { return vod_dir_; }
+    VodScheduler& vod() { return vod_; }
+    socket_t http_listener() const { return http_listener_; }
+    const HlsStore* hls() const { return hls_; }
+    const char* backend_name() const;
+
+private:
+    unsigned int id_;
+    socket_t listener_;
+    bool owns_listener_;
+    socket_t http_listener_;           // RTMP_INVALID_SOCKET without HTTP
+    bool owns_http_listener_;
+    const HlsStore* hls_;
+    StreamHub* hub_;
+    BackpressurePolicy backpressure_;
+    std::size_t chunk_size_;           // Outbound chunk size announced to every client
+    unsigned int ack_window_;          // Acknowledgement window announced to every client
+    unsigned int handshake_timeout_ms_;
+    std::string vod_dir_;              // Where "play" looks for files; empty = live only
+    VodScheduler vod_;                 // This worker's VOD players, paced by the event loop
+    StreamFanout fanout_;              // This worker's players, fed by the hub
+    std::unique_ptr<IOBackend> backend_;
+    std::thread thread_;
+    WorkerStats stats_;
+};
+
+#endif // WORKER_H